@@ -124,6 +124,9 @@ public:
 
 	void SetAlpha( unsigned char alpha ) { m_Alpha = alpha; }
 
+	// Conservative bounding radius around the origin, used for view culling
+	float GetCullRadius();
+
 
 	// IClientUnknown overrides.
 public:
@@ -326,6 +329,19 @@ struct FastSpriteQuadBuildoutBufferNonSIMDView_t
 };
 
 
+//-----------------------------------------------------------------------------
+// Origins of the old style detail objects packed four to a group so the per
+// view distance, fade and cull pass runs four objects at a time. Object i is
+// lane i & 3 of group i >> 2; a leaf's objects are contiguous, so a leaf just
+// covers a run of groups with partially used groups at either end.
+//-----------------------------------------------------------------------------
+struct DetailObjectPosX4_t
+{
+	FourVectors m_Pos;
+	fltx4 m_Radius;
+};
+
+
 class CFastDetailLeafSpriteList : public CClientLeafSubSystemData
 {
 	friend class CDetailObjectSystem;
@@ -463,6 +479,16 @@ private:
 	static bool SortLessFunc( const SortInfo_t &left, const SortInfo_t &right );
 	int SortSpritesBackToFront( int nLeaf, const Vector &viewOrigin, const Vector &viewForward, SortInfo_t *pSortInfo );
 
+	// Distance/fade/view plane pass over a run of old style objects, four at a time
+	void BuildDetailPositionsX4( void );
+	void FreeDetailPositionsX4( void );
+	int CullAndFadeDetailObjects( int nFirst, int nCount, const Vector &viewOrigin, const Vector *pViewForward,
+								  float flMaxSqDist, float flFadeSqDist, float flFalloffFactor, bool bHideCulled, SortInfo_t *pOut );
+
+public:
+	void BenchmarkDetailCulling( int nIterations );
+private:
+
 	// For fast detail object insertion
 	IterationRetval_t EnumElement( int userId, int context );
 
@@ -472,6 +498,7 @@ private:
 	CUtlVector<DetailPropSpriteDict_t>		m_DetailSpriteDictFlipped;
 	CUtlVector<DetailPropLightstylesLump_t>	m_DetailLighting;
 	FastSpriteX4_t *m_pFastSpriteData;
+	DetailObjectPosX4_t *m_pDetailPosX4;
 
 	// Necessary to get sprites to batch correctly
 	CMaterialReference m_DetailSpriteMaterial;
@@ -484,6 +511,7 @@ private:
 	int m_nSortedFastLeaf;
 	SortInfo_t *m_pSortInfo;
 	SortInfo_t *m_pFastSortInfo;
+	SortInfo_t *m_pEnumSortInfo;		// EnumerateLeaf's visible list, m_pSortInfo holds the cached sort
 	FastSpriteQuadBuildoutBufferX4_t *m_pBuildoutBuffer;
 
 	float m_flDefaultFadeStart;
@@ -509,6 +537,25 @@ IDetailObjectSystem* DetailObjectSystem()
 }
 
 
+//-----------------------------------------------------------------------------
+// Conservative radius for view culling. Sprites turn to face the view, so use
+// the farthest corner; shapes and sway can reach further, so double it for them.
+//-----------------------------------------------------------------------------
+float CDetailModel::GetCullRadius()
+{
+	if ( m_Type == DETAIL_PROP_TYPE_MODEL )
+	{
+		Vector mins, maxs;
+		modelinfo->GetModelRenderBounds( m_pModel, mins, maxs );
+		return MAX( mins.Length(), maxs.Length() );
+	}
+
+	DetailPropSpriteDict_t &dict = s_DetailObjectSystem.DetailSpriteDict( m_SpriteInfo.m_nSpriteIndex );
+	float flRadius = m_SpriteInfo.m_flScale.GetFloat() * MAX( dict.m_UL.Length(), dict.m_LR.Length() );
+	return ( m_Type == DETAIL_PROP_TYPE_SPRITE ) ? flRadius : 2.0f * flRadius;
+}
+
+
 
 //-----------------------------------------------------------------------------
 // Initialization
@@ -1399,8 +1446,10 @@ void CDetailModel::DrawSwayingQuad( CMeshBuilder &meshBuilder, Vector vecOrigin,
 CDetailObjectSystem::CDetailObjectSystem() : m_DetailSpriteDict( 0, 32 ), m_DetailObjectDict( 0, 32 ), m_DetailSpriteDictFlipped( 0, 32 )
 {
 	m_pFastSpriteData = NULL;
+	m_pDetailPosX4 = NULL;
 	m_pSortInfo = NULL;
 	m_pFastSortInfo = NULL;
+	m_pEnumSortInfo = NULL;
 	m_pBuildoutBuffer = NULL;
 }
 
@@ -1416,6 +1465,11 @@ void CDetailObjectSystem::FreeSortBuffers( void )
 		MemAlloc_FreeAligned(  m_pFastSortInfo );
 		m_pFastSortInfo = NULL;
 	}
+	if ( m_pEnumSortInfo )
+	{
+		MemAlloc_FreeAligned(  m_pEnumSortInfo );
+		m_pEnumSortInfo = NULL;
+	}
 	if ( m_pBuildoutBuffer )
 	{
 		MemAlloc_FreeAligned(  m_pBuildoutBuffer );
@@ -1430,6 +1484,7 @@ CDetailObjectSystem::~CDetailObjectSystem()
 		MemAlloc_FreeAligned( m_pFastSpriteData );
 		m_pFastSpriteData = NULL;
 	}
+	FreeDetailPositionsX4();
 	FreeSortBuffers();
 
 }
@@ -1575,6 +1630,7 @@ void CDetailObjectSystem::LevelShutdownPreEntity()
 		MemAlloc_FreeAligned( m_pFastSpriteData );
 		m_pFastSpriteData = NULL;
 	}
+	FreeDetailPositionsX4();
 	FreeSortBuffers();
 
 }
@@ -1768,6 +1824,8 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 	{
 		m_pSortInfo = reinterpret_cast<SortInfo_t *> (
 			MemAlloc_AllocAligned( (3 + nMaxOldInLeaf ) * sizeof( SortInfo_t ), sizeof( fltx4 ) ) );
+		m_pEnumSortInfo = reinterpret_cast<SortInfo_t *> (
+			MemAlloc_AllocAligned( (3 + nMaxOldInLeaf ) * sizeof( SortInfo_t ), sizeof( fltx4 ) ) );
 	}
 	if ( nMaxFastInLeaf )
 	{
@@ -1909,6 +1967,50 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 		ClientLeafSystem()->SetDetailObjectsInLeaf( detailObjectLeaf, 
 													firstDetailObject, detailObjectCount );
 	}
+
+	BuildDetailPositionsX4();
+}
+
+
+//-----------------------------------------------------------------------------
+// Packs the old style detail object origins for CullAndFadeDetailObjects
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::BuildDetailPositionsX4( void )
+{
+	FreeDetailPositionsX4();
+
+	int nCount = m_DetailObjects.Count();
+	if ( !nCount )
+		return;
+
+	int nGroups = ( nCount + 3 ) >> 2;
+	m_pDetailPosX4 = reinterpret_cast<DetailObjectPosX4_t *> (
+		MemAlloc_AllocAligned( nGroups * sizeof( DetailObjectPosX4_t ), sizeof( fltx4 ) ) );
+
+	for ( int nGroup = 0; nGroup < nGroups; ++nGroup )
+	{
+		DetailObjectPosX4_t &group = m_pDetailPosX4[nGroup];
+		for ( int nLane = 0; nLane < 4; ++nLane )
+		{
+			// Unused lanes of the last group repeat the last object to keep bad numbers out
+			int j = MIN( ( nGroup << 2 ) + nLane, nCount - 1 );
+			CDetailModel &model = m_DetailObjects[j];
+			const Vector &vecOrigin = model.GetRenderOrigin();
+			group.m_Pos.X( nLane ) = vecOrigin.x;
+			group.m_Pos.Y( nLane ) = vecOrigin.y;
+			group.m_Pos.Z( nLane ) = vecOrigin.z;
+			SubFloat( group.m_Radius, nLane ) = model.GetCullRadius();
+		}
+	}
+}
+
+void CDetailObjectSystem::FreeDetailPositionsX4( void )
+{
+	if ( m_pDetailPosX4 )
+	{
+		MemAlloc_FreeAligned( m_pDetailPosX4 );
+		m_pDetailPosX4 = NULL;
+	}
 }
 
 
@@ -2100,40 +2202,21 @@ int CDetailObjectSystem::SortSpritesBackToFront( int nLeaf, const Vector &viewOr
 	}
 	float flFalloffFactor = 255.0f / (flMaxSqDist - flFadeSqDist);
 
-	Vector vecDelta;
+	// No fade band means everything in range is opaque
+	int nVisible = CullAndFadeDetailObjects( nFirstDetailObject, nDetailObjectCount, viewOrigin, &viewForward,
+		flMaxSqDist, ( flFadeSqDist > 0 ) ? flFadeSqDist : FLT_MAX, flFalloffFactor, false, pSortInfo );
+
+	// Compact down to the sprites that will actually draw
 	int nCount = 0;
-	nDetailObjectCount += nFirstDetailObject;
-	for ( int j = nFirstDetailObject; j < nDetailObjectCount; ++j )
+	for ( int j = 0; j < nVisible; ++j )
 	{
-		CDetailModel &model = m_DetailObjects[j];
-
-		Vector v;
-		VectorSubtract( model.GetRenderOrigin(), viewOrigin, vecDelta );
-		float flSqDist = vecDelta.LengthSqr();
-		if ( flSqDist >= flMaxSqDist )
-			continue;
-
-		if ((flFadeSqDist > 0) && (flSqDist > flFadeSqDist))
-		{
-			model.SetAlpha( flFalloffFactor * ( flMaxSqDist - flSqDist ) );
-		}
-		else
-		{
-			model.SetAlpha( 255 );
-		}
-
+		CDetailModel &model = m_DetailObjects[ pSortInfo[j].m_nIndex ];
 		if ( (model.GetType() == DETAIL_PROP_TYPE_MODEL) || (model.GetAlpha() == 0) )
 			continue;
 
 		// Perform screen alignment if necessary.
 		model.ComputeAngles();
-		SortInfo_t *pSortInfoCurrent = &pSortInfo[nCount];
-
-		pSortInfoCurrent->m_nIndex = j;
-
-		// Compute distance from the camera to each object
-		pSortInfoCurrent->m_flDistance = flSqDist;
-		++nCount;
+		pSortInfo[nCount++] = pSortInfo[j];
 	}
 
 	if ( nCount )
@@ -2263,6 +2346,153 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 }
 
 
+//-----------------------------------------------------------------------------
+// Distance, fade and view plane test for the old style detail objects
+// [nFirst, nFirst + nCount), four at a time. Objects closer than flMaxSqDist
+// (and not entirely behind the view plane, if pViewForward is given) get their
+// alpha set and are written to pOut in index order with their squared distance.
+// Objects past flFadeSqDist fade as flFalloffFactor * ( flMaxSqDist - distSq ).
+// With bHideCulled the rest get zero alpha, otherwise they are left alone.
+//-----------------------------------------------------------------------------
+int CDetailObjectSystem::CullAndFadeDetailObjects( int nFirst, int nCount, const Vector &viewOrigin, const Vector *pViewForward,
+												   float flMaxSqDist, float flFadeSqDist, float flFalloffFactor, bool bHideCulled, SortInfo_t *pOut )
+{
+	if ( nCount <= 0 || !m_pDetailPosX4 )
+		return 0;
+
+	FourVectors vecViewPos;
+	vecViewPos.DuplicateVector( viewOrigin );
+	FourVectors vecFwd;
+	vecFwd.DuplicateVector( pViewForward ? *pViewForward : vec3_origin );
+
+	fltx4 maxSqDist = ReplicateX4( flMaxSqDist );
+	fltx4 fadeSqDist = ReplicateX4( flFadeSqDist );
+	fltx4 falloffFactor = ReplicateX4( flFalloffFactor );
+
+	int nEnd = nFirst + nCount;
+	int nLastGroup = ( nEnd - 1 ) >> 2;
+	int nOut = 0;
+	for ( int nGroup = nFirst >> 2; nGroup <= nLastGroup; ++nGroup )
+	{
+		DetailObjectPosX4_t const &group = m_pDetailPosX4[nGroup];
+
+		FourVectors ofs = group.m_Pos;
+		ofs -= vecViewPos;
+		fltx4 distanceSquared = ofs * ofs;
+		fltx4 visible = CmpLtSIMD( distanceSquared, maxSqDist );
+		if ( pViewForward )
+		{
+			visible = AndSIMD( visible, CmpGeSIMD( AddSIMD( ofs * vecFwd, group.m_Radius ), Four_Zeros ) );
+		}
+
+		int nVisibleMask = TestSignSIMD( visible );
+		if ( !nVisibleMask && !bHideCulled )
+			continue;
+
+		fltx4 alpha = MaskedAssign( CmpGtSIMD( distanceSquared, fadeSqDist ),
+									MulSIMD( falloffFactor, SubSIMD( maxSqDist, distanceSquared ) ), Four_255s );
+
+		int nBase = nGroup << 2;
+		int nLaneStart = MAX( nFirst - nBase, 0 );
+		int nLaneEnd = MIN( nEnd - nBase, 4 );
+		for ( int nLane = nLaneStart; nLane < nLaneEnd; ++nLane )
+		{
+			CDetailModel &model = m_DetailObjects[nBase + nLane];
+			if ( nVisibleMask & ( 1 << nLane ) )
+			{
+				model.SetAlpha( SubFloat( alpha, nLane ) );
+				pOut[nOut].m_nIndex = nBase + nLane;
+				pOut[nOut].m_flDistance = SubFloat( distanceSquared, nLane );
+				++nOut;
+			}
+			else if ( bHideCulled )
+			{
+				model.SetAlpha( 0 );
+			}
+		}
+	}
+
+	return nOut;
+}
+
+
+//-----------------------------------------------------------------------------
+// Times the old scalar distance/fade loop against CullAndFadeDetailObjects over
+// every old style detail object in the map. Needs no rendering.
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::BenchmarkDetailCulling( int nIterations )
+{
+	int nCount = m_DetailObjects.Count();
+	if ( !nCount )
+	{
+		Msg( "No old style detail objects in this map (%s fast sprites)\n", m_pFastSpriteData ? "has" : "no" );
+		return;
+	}
+
+	Vector vecOrigin = CurrentViewOrigin();
+	Vector vecForward = CurrentViewForward();
+	float flMaxSqDist = m_flCurMaxSqDist;
+	float flFadeSqDist = m_flCurFadeSqDist;
+	float flFalloffFactor = m_flCurFalloffFactor;
+
+	SortInfo_t *pOut = reinterpret_cast<SortInfo_t *>( MemAlloc_AllocAligned( nCount * sizeof( SortInfo_t ), sizeof( fltx4 ) ) );
+
+	int nScalarVisible = 0;
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; ++i )
+	{
+		nScalarVisible = 0;
+		for ( int j = 0; j < nCount; ++j )
+		{
+			CDetailModel &model = m_DetailObjects[j];
+			Vector vecDelta;
+			VectorSubtract( model.GetRenderOrigin(), vecOrigin, vecDelta );
+			float flSqDist = vecDelta.LengthSqr();
+			if ( flSqDist >= flMaxSqDist )
+			{
+				model.SetAlpha( 0 );
+				continue;
+			}
+			model.SetAlpha( ( flSqDist > flFadeSqDist ) ? flFalloffFactor * ( flMaxSqDist - flSqDist ) : 255 );
+			pOut[nScalarVisible].m_nIndex = j;
+			pOut[nScalarVisible].m_flDistance = flSqDist;
+			++nScalarVisible;
+		}
+	}
+	double flScalar = Plat_FloatTime() - flStart;
+
+	int nSIMDVisible = 0;
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; ++i )
+	{
+		nSIMDVisible = CullAndFadeDetailObjects( 0, nCount, vecOrigin, NULL, flMaxSqDist, flFadeSqDist, flFalloffFactor, true, pOut );
+	}
+	double flSIMD = Plat_FloatTime() - flStart;
+
+	int nFrustumVisible = 0;
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; ++i )
+	{
+		nFrustumVisible = CullAndFadeDetailObjects( 0, nCount, vecOrigin, &vecForward, flMaxSqDist, flFadeSqDist, flFalloffFactor, true, pOut );
+	}
+	double flFrustum = Plat_FloatTime() - flStart;
+
+	MemAlloc_FreeAligned( pOut );
+
+	double flPerObject = 1.0e9 / ( (double)nCount * nIterations );
+	Msg( "%d detail objects, %d iterations\n", nCount, nIterations );
+	Msg( "  scalar:           %6d visible, %.2f ns/object\n", nScalarVisible, flScalar * flPerObject );
+	Msg( "  x4:               %6d visible, %.2f ns/object\n", nSIMDVisible, flSIMD * flPerObject );
+	Msg( "  x4 + view plane:  %6d visible, %.2f ns/object\n", nFrustumVisible, flFrustum * flPerObject );
+}
+
+CON_COMMAND_F( cl_detail_cull_benchmark, "Time the detail object distance/fade pass, scalar vs. four at a time. Optional iteration count.", FCVAR_CHEAT )
+{
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 100;
+	s_DetailObjectSystem.BenchmarkDetailCulling( nIterations );
+}
+
+
 void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList )
 {
 	// Here, we must draw all detail objects back-to-front
@@ -2741,7 +2971,6 @@ void CDetailObjectSystem::RenderTranslucentDetailObjectsInLeaf( const Vector &vi
 bool CDetailObjectSystem::EnumerateLeaf( int leaf, int context )
 {
 	VPROF_BUDGET( "CDetailObjectSystem::EnumerateLeaf", VPROF_BUDGETGROUP_DETAILPROP_RENDERING );
-	Vector v;
 	int firstDetailObject, detailObjectCount;
 
 	EnumContext_t* pCtx = (EnumContext_t*)context;
@@ -2750,33 +2979,13 @@ bool CDetailObjectSystem::EnumerateLeaf( int leaf, int context )
 
 	// Compute the translucency. Need to do it now cause we need to
 	// know that when we're rendering (opaque stuff is rendered first)
-	for ( int i = 0; i < detailObjectCount; ++i)
-	{
-		// Calculate distance (badly)
-		CDetailModel& model = m_DetailObjects[firstDetailObject+i];
-		VectorSubtract( model.GetRenderOrigin(), pCtx->m_vViewOrigin, v );
+	int nVisible = CullAndFadeDetailObjects( firstDetailObject, detailObjectCount, pCtx->m_vViewOrigin, NULL,
+		m_flCurMaxSqDist, m_flCurFadeSqDist, m_flCurFalloffFactor, true, m_pEnumSortInfo );
 
-		float sqDist = v.LengthSqr();
-
-		model.SetAlpha( 255 );
-		if ( sqDist < m_flCurMaxSqDist )
-		{
-			if ( sqDist > m_flCurFadeSqDist ) 
-			{
-				model.SetAlpha( m_flCurFalloffFactor * ( m_flCurMaxSqDist - sqDist ) );
-			}
-			else
-			{
-				model.SetAlpha( 255 );
-			}
-			
-			// Perform screen alignment if necessary.
-			model.ComputeAngles();
-		}
-		else
-		{
-			model.SetAlpha( 0 );
-		}
+	for ( int i = 0; i < nVisible; ++i )
+	{
+		// Perform screen alignment if necessary.
+		m_DetailObjects[ m_pEnumSortInfo[i].m_nIndex ].ComputeAngles();
 	}
 	return true;
 }
@@ -95,7 +95,7 @@ void C_TFMusicPlayer::ClientThink( void )
 				FMODManager()->PlayMusicEnd( pChannel, m_Songdata[2].path );
 			}
 		}
-		else
+		else if ( FMODManager()->IsMusicReady( m_Songdata[1].path, GetIntroPath() ) )
 		{
 			FMODManager()->StopAmbientSound( pChannel, false );
 			bIsPlaying = true;
@@ -108,6 +108,9 @@ void C_TFMusicPlayer::ClientThink( void )
 			{
 				FMODManager()->PlayLoopingMusic( pChannel,m_Songdata[1].path, NULL , m_flDelay );
 			}
+
+			// Have the streams ready for the next time we start
+			FMODManager()->PrefetchMusic( m_Songdata[1].path, GetIntroPath() );
 		}
 	}
 
@@ -116,6 +119,12 @@ void C_TFMusicPlayer::ClientThink( void )
 	SetNextClientThink( gpGlobals->curtime + 0.1f );
 }
 
+// Intro to play before the loop, NULL if the song doesn't have one
+const char *C_TFMusicPlayer::GetIntroPath( void ) const
+{
+	return m_Songdata[0].path[0] != 0 ? m_Songdata[0].path : NULL;
+}
+
 static const ConVar *snd_musicvolume = NULL;
 static const ConVar *snd_mute_losefocus = NULL;
 
@@ -185,6 +194,9 @@ void C_TFMusicPlayer::OnDataChanged(DataUpdateType_t updateType)
 				}
 				DevMsg("Outro wav is %s\n", m_Songdata[2].path);
 			}
+
+			// Open the streams now, so starting the music later doesn't have to wait on the disk
+			FMODManager()->PrefetchMusic( m_Songdata[1].path, GetIntroPath() );
 		}
 
 		bParsed = true;			
@@ -21,6 +21,8 @@ public:
 	virtual void Spawn(void);
 	virtual void OnDataChanged(DataUpdateType_t updateType);
 private:
+	const char *GetIntroPath( void ) const;
+
 
 	int m_iPhase;
 	
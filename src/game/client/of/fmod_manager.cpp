@@ -45,6 +45,39 @@ CFMODManager::~CFMODManager()
 	m_bFadeOut = false;
 }
 
+// FMOD file callbacks, so streams read through the engine filesystem (search paths, VPKs) a block at a time
+// on FMOD's stream thread, instead of us loading the whole file up front
+static FMOD_RESULT F_CALLBACK FMODFileOpen(const char *name, unsigned int *filesize, void **handle, void *userdata)
+{
+	FileHandle_t hFile = filesystem->Open(name, "rb", "GAME");
+	if (!hFile)
+		return FMOD_ERR_FILE_NOTFOUND;
+
+	*filesize = filesystem->Size(hFile);
+	*handle = hFile;
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FMODFileClose(void *handle, void *userdata)
+{
+	filesystem->Close((FileHandle_t)handle);
+	return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FMODFileRead(void *handle, void *buffer, unsigned int sizebytes, unsigned int *bytesread, void *userdata)
+{
+	int iRead = filesystem->Read(buffer, sizebytes, (FileHandle_t)handle);
+	*bytesread = iRead > 0 ? iRead : 0;
+
+	return (*bytesread < sizebytes) ? FMOD_ERR_FILE_EOF : FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK FMODFileSeek(void *handle, unsigned int pos, void *userdata)
+{
+	filesystem->Seek((FileHandle_t)handle, pos, FILESYSTEM_SEEK_HEAD);
+	return FMOD_OK;
+}
+
 // Starts FMOD
 void CFMODManager::InitFMOD(void)
 {
@@ -55,6 +88,11 @@ void CFMODManager::InitFMOD(void)
 	else
 		DevMsg("FMOD system successfully created.\n");
 
+	result = pSystem->setFileSystem(FMODFileOpen, FMODFileClose, FMODFileRead, FMODFileSeek, NULL, NULL, 2048);
+
+	if (result != FMOD_OK)
+		Warning("FMOD ERROR: Failed to hook up the filesystem! (ERROR NUMBER: %i)\n", result);
+
 	result = pSystem->init(100, FMOD_INIT_NORMAL, 0);   // Initialize FMOD system.
 
 	if (result != FMOD_OK)
@@ -66,6 +104,8 @@ void CFMODManager::InitFMOD(void)
 // Stops FMOD
 void CFMODManager::ExitFMOD(void)
 {
+	ReleaseStreams(NULL);
+
 	result = pSystem->release();
 
 	if (result != FMOD_OK)
@@ -74,35 +114,144 @@ void CFMODManager::ExitFMOD(void)
 		DevMsg("FMOD system terminated successfully.\n");
 }
 
-// Returns the full path of a specified sound file in the /sounds folder
-void *CFMODManager::GetFullPathToSound(const char* pathToFileFromModFolder, int *pLength )
+// Returns the path of a specified sound file in the /sounds folder, relative to the game search paths
+void CFMODManager::GetFullPathToSound(const char* pathToFileFromSoundsFolder, char *pszFullPath, int nMaxLength)
+{
+	Q_snprintf(pszFullPath, nMaxLength, "sound/%s", pathToFileFromSoundsFolder);
+	Q_FixSlashes(pszFullPath, '/');
+}
+
+// Returns the index of a stream started by PrefetchStream, or -1 if there is none
+int CFMODManager::FindPrefetchedStream(const char* pathToFileFromSoundsFolder, FMOD_MODE mode)
 {
-/*
-	char* resultpath = new char[512];
-*/
-	char fullpath[512];
-	Q_snprintf(fullpath, sizeof(fullpath), "sound/%s", pathToFileFromModFolder);
-/*	filesystem->GetLocalPath(fullpath, fullpath, sizeof(fullpath));
-
-	Q_snprintf(resultpath, 512, "%s", fullpath);
-	// convert backwards slashes to forward slashes
-	for (int i = 0; i < 512; i++)
+	FOR_EACH_VEC(m_PrefetchedStreams, i)
 	{
-		if (resultpath[i] == '\\')
-			resultpath[i] = '/';
+		if (m_PrefetchedStreams[i].mode == mode && !Q_stricmp(m_PrefetchedStreams[i].path, pathToFileFromSoundsFolder))
+			return i;
 	}
 
-*/	
-	void *buffer = NULL;
+	return -1;
+}
+
+// Starts opening a stream without blocking, to be picked up by OpenStream later
+void CFMODManager::PrefetchStream(const char* pathToFileFromSoundsFolder, FMOD_MODE mode)
+{
+	if (!pSystem || !pathToFileFromSoundsFolder || !pathToFileFromSoundsFolder[0])
+		return;
+
+	if (FindPrefetchedStream(pathToFileFromSoundsFolder, mode) != -1)
+		return;
+
+	char fullpath[MAX_PATH];
+	GetFullPathToSound(pathToFileFromSoundsFolder, fullpath, sizeof(fullpath));
 
-	int length = filesystem->ReadFileEx( fullpath, "GAME", &buffer, true, true );
+	Sound *pStream = NULL;
+	result = pSystem->createStream(fullpath, mode | FMOD_NONBLOCKING, NULL, &pStream);
 
-	if ( pLength )
+	if (result != FMOD_OK)
 	{
-		*pLength = length;
+		Warning("FMOD: Failed to prefetch sound '%s' ! (ERROR NUMBER: %i)\n", pathToFileFromSoundsFolder, result);
+		return;
 	}
 
-	return buffer;
+	int i = m_PrefetchedStreams.AddToTail();
+	Q_strncpy(m_PrefetchedStreams[i].path, pathToFileFromSoundsFolder, sizeof(m_PrefetchedStreams[i].path));
+	m_PrefetchedStreams[i].mode = mode;
+	m_PrefetchedStreams[i].pSound = pStream;
+}
+
+// Returns a stream for the sound, the prefetched one if there is one
+// Streams only read the file header when opened, the rest is read as it plays
+Sound *CFMODManager::OpenStream(const char* pathToFileFromSoundsFolder, FMOD_MODE mode)
+{
+	int i = FindPrefetchedStream(pathToFileFromSoundsFolder, mode);
+	if (i != -1)
+	{
+		Sound *pStream = m_PrefetchedStreams[i].pSound;
+		m_PrefetchedStreams.Remove(i);
+
+		FMOD_OPENSTATE openstate;
+		if (pStream->getOpenState(&openstate, NULL, NULL, NULL) == FMOD_OK && openstate != FMOD_OPENSTATE_LOADING && openstate != FMOD_OPENSTATE_ERROR)
+			return pStream;
+
+		// Still opening, or failed. Releasing waits for the open to finish, then try again below.
+		pStream->release();
+	}
+
+	char fullpath[MAX_PATH];
+	GetFullPathToSound(pathToFileFromSoundsFolder, fullpath, sizeof(fullpath));
+
+	Sound *pStream = NULL;
+	result = pSystem->createStream(fullpath, mode, NULL, &pStream);
+
+	if (result != FMOD_OK)
+		return NULL;
+
+	return pStream;
+}
+
+void CFMODManager::AddActiveStream(Sound *pStream, ChannelGroup *pGroup)
+{
+	int i = m_ActiveStreams.AddToTail();
+	m_ActiveStreams[i].pSound = pStream;
+	m_ActiveStreams[i].pGroup = pGroup;
+}
+
+// Releases the streams playing on a channel group, or every stream if the group is NULL
+void CFMODManager::ReleaseStreams(ChannelGroup *pGroup)
+{
+	FOR_EACH_VEC_BACK(m_ActiveStreams, i)
+	{
+		if (pGroup && m_ActiveStreams[i].pGroup != pGroup)
+			continue;
+
+		if (m_ActiveStreams[i].pSound == pSound)
+			pSound = NULL;
+
+		m_ActiveStreams[i].pSound->release();
+		m_ActiveStreams.Remove(i);
+	}
+
+	if (!pGroup)
+	{
+		FOR_EACH_VEC(m_PrefetchedStreams, i)
+		{
+			m_PrefetchedStreams[i].pSound->release();
+		}
+		m_PrefetchedStreams.RemoveAll();
+	}
+}
+
+// Starts opening the intro and loop streams of a PlayLoopingMusic call
+void CFMODManager::PrefetchMusic(const char* pLoopingMusic, const char* pIntroMusic)
+{
+	if (pIntroMusic)
+		PrefetchStream(pIntroMusic, FMOD_CREATESTREAM);
+
+	PrefetchStream(pLoopingMusic, FMOD_LOOP_NORMAL | FMOD_CREATESTREAM);
+}
+
+// Returns false while prefetched streams for this music are still opening
+bool CFMODManager::IsMusicReady(const char* pLoopingMusic, const char* pIntroMusic)
+{
+	const char *pszMusic[] = { pIntroMusic, pLoopingMusic };
+	FMOD_MODE mode[] = { FMOD_CREATESTREAM, FMOD_LOOP_NORMAL | FMOD_CREATESTREAM };
+
+	for (int n = 0; n < ARRAYSIZE(pszMusic); n++)
+	{
+		if (!pszMusic[n])
+			continue;
+
+		int i = FindPrefetchedStream(pszMusic[n], mode[n]);
+		if (i == -1)
+			continue;
+
+		FMOD_OPENSTATE openstate;
+		if (m_PrefetchedStreams[i].pSound->getOpenState(&openstate, NULL, NULL, NULL) == FMOD_OK && openstate == FMOD_OPENSTATE_LOADING)
+			return false;
+	}
+
+	return true;
 }
 
 // Returns the name of the current ambient sound being played
@@ -140,23 +289,18 @@ void CFMODManager::FadeThink(void)
 	}
 	else if (m_bShouldTransition)
 	{
-		int iLength = 0;
-		void *buffer = GetFullPathToSound(newSoundFileToTransitionTo, &iLength);
-		
-		FMOD_CREATESOUNDEXINFO info;
-		memset(&info, 0, sizeof(info));
-		info.length = iLength;
-		info.cbsize = sizeof(info);
-		
-		result = pSystem->createStream((const char*)buffer, FMOD_OPENMEMORY , &info, &pSound);
+		// The faded out ambient stream is done with, release it before it's replaced
+		ReleaseStreams(pChannelGroup);
+		pSound = OpenStream(newSoundFileToTransitionTo, FMOD_CREATESTREAM);
 
-		if (result != FMOD_OK)
+		if (!pSound)
 		{
 			Warning("FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", newSoundFileToTransitionTo, result);
 			newSoundFileToTransitionTo = "NULL";
 			m_bShouldTransition = false;
 			return;
 		}
+		AddActiveStream(pSound, pChannelGroup);
 
 		result = pSystem->playSound(pSound, pChannelGroup, false, &pChannel);
 
@@ -273,15 +417,20 @@ void CFMODManager::PlayLoopingMusic( ChannelGroup *pNewChannelGroup, const char*
 		Sound *pIntroSound = NULL;
 		Sound *pLoopingSound = NULL;
 		
-		int iLengthIntro = 0;
-		void *vBufferIntro = GetFullPathToSound(pIntroMusic, &iLengthIntro);
-		
-		FMOD_CREATESOUNDEXINFO infoIntro;
-		memset(&infoIntro, 0, sizeof(infoIntro));
-		infoIntro.length = iLengthIntro;
-		infoIntro.cbsize = sizeof(infoIntro);
-		
-		result = pSystem->createStream((const char *)vBufferIntro, FMOD_OPENMEMORY | FMOD_CREATESTREAM , &infoIntro, &pIntroSound);
+		pIntroSound = OpenStream(pIntroMusic, FMOD_CREATESTREAM);
+		pLoopingSound = OpenStream(pLoopingMusic, FMOD_LOOP_NORMAL | FMOD_CREATESTREAM);
+		if (!pIntroSound || !pLoopingSound)
+		{
+			Warning("FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", pIntroSound ? pLoopingMusic : pIntroMusic, result);
+			if (pIntroSound)
+				pIntroSound->release();
+			if (pLoopingSound)
+				pLoopingSound->release();
+			return;
+		}
+		AddActiveStream(pIntroSound, pNewChannelGroup);
+		AddActiveStream(pLoopingSound, pNewChannelGroup);
+
 		pSystem->playSound(pIntroSound, pNewChannelGroup, true, &pTempChannel);
 
 		result = pIntroSound->getDefaults(&freq, 0);
@@ -300,15 +449,6 @@ void CFMODManager::PlayLoopingMusic( ChannelGroup *pNewChannelGroup, const char*
 
 		result = pLoopingSound->setLoopPoints(0, FMOD_TIMEUNIT_PCM, GetSoundLengthPCM(pLoopingSound), FMOD_TIMEUNIT_PCM);
 
-		int iLengthLoop = 0;
-		void *vBufferLoop = GetFullPathToSound(pLoopingMusic, &iLengthLoop);
-		
-		FMOD_CREATESOUNDEXINFO infoLoop;
-		memset(&infoLoop, 0, sizeof(infoLoop));
-		infoLoop.length = iLengthLoop;
-		infoLoop.cbsize = sizeof(infoLoop);
-
-		result = pSystem->createStream((const char *)vBufferLoop, FMOD_OPENMEMORY | FMOD_LOOP_NORMAL | FMOD_CREATESTREAM, &infoLoop, &pLoopingSound);
 		pSystem->playSound(pLoopingSound, pNewChannelGroup, true, &pTempLoopChannel);
 
 		result = pIntroSound->getLength(&slen, FMOD_TIMEUNIT_PCM);
@@ -326,21 +466,15 @@ void CFMODManager::PlayLoopingMusic( ChannelGroup *pNewChannelGroup, const char*
 	}
 	else
 	{
-		int iLengthLoop = 0;
-		void *vBufferLoop = GetFullPathToSound(pLoopingMusic, &iLengthLoop);
-		
-		FMOD_CREATESOUNDEXINFO infoLoop;
-		memset(&infoLoop, 0, sizeof(infoLoop));
-		infoLoop.length = iLengthLoop;
-		infoLoop.cbsize = sizeof(infoLoop);
-		
-		result = pSound->setLoopPoints(0, FMOD_TIMEUNIT_PCM, GetSoundLengthPCM(pSound), FMOD_TIMEUNIT_PCM);
-		result = pSystem->createStream((const char *)vBufferLoop, FMOD_OPENMEMORY | FMOD_LOOP_NORMAL | FMOD_CREATESTREAM , &infoLoop, &pSound);
-		if (result != FMOD_OK)
+		pSound = OpenStream(pLoopingMusic, FMOD_LOOP_NORMAL | FMOD_CREATESTREAM);
+		if (!pSound)
 		{
 			Warning("FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", pLoopingMusic, result);
 			return;
 		}
+		AddActiveStream(pSound, pNewChannelGroup);
+
+		result = pSound->setLoopPoints(0, FMOD_TIMEUNIT_PCM, GetSoundLengthPCM(pSound), FMOD_TIMEUNIT_PCM);
 		result = pSystem->playSound(pSound, pNewChannelGroup, true, &pTempChannel);
 		
 		result = pTempChannel->getDSPClock(0, &clock_start);
@@ -373,21 +507,15 @@ void CFMODManager::PlayLoopingMusic( ChannelGroup *pNewChannelGroup, const char*
 // In most cases, we'll want to use TransitionAmbientSounds instead
 void CFMODManager::PlayAmbientSound(const char* pathToFileFromSoundsFolder, bool fadeIn)
 {
-	int iLengthLoop = 0;
-	void *vBufferLoop = GetFullPathToSound(pathToFileFromSoundsFolder, &iLengthLoop);
-	
-	FMOD_CREATESOUNDEXINFO infoLoop;
-	memset(&infoLoop, 0, sizeof(infoLoop));
-	infoLoop.length = iLengthLoop;
-	infoLoop.cbsize = sizeof(infoLoop);	
-	
-	result = pSystem->createStream((const char*)vBufferLoop, FMOD_OPENMEMORY , &infoLoop, &pSound);
+	ReleaseStreams(pChannelGroup);
+	pSound = OpenStream(pathToFileFromSoundsFolder, FMOD_CREATESTREAM);
 
-	if (result != FMOD_OK)
+	if (!pSound)
 	{
 		Warning("FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", pathToFileFromSoundsFolder, result);
 		return;
 	}
+	AddActiveStream(pSound, pChannelGroup);
 
 	m_flSongStart = gpGlobals->realtime;
 	result = pSystem->playSound(pSound, pChannelGroup, false, &pChannel);
@@ -425,6 +553,7 @@ void CFMODManager::StopAmbientSound( ChannelGroup *pNewChannel, bool fadeOut)
 	{
 		pNewChannel->setVolume(0.0f);
 		pNewChannel->stop();
+		ReleaseStreams(pNewChannel);
 	}
 
 	currentSound = "NULL";
@@ -441,15 +570,14 @@ void CFMODManager::PlayMusicEnd( ChannelGroup *pNewChannelGroup, const char* pLo
 	{
 		Sound *pIntroSound = NULL;
 		
-		int iLength = 0;
-		void *vBuffer = GetFullPathToSound(pLoopingMusic, &iLength);
-		
-		FMOD_CREATESOUNDEXINFO info;
-		memset(&info, 0, sizeof(info));
-		info.length = iLength;
-		info.cbsize = sizeof(info);			
-		
-		result = pSystem->createStream((const char*)vBuffer, FMOD_CREATESTREAM | FMOD_OPENMEMORY, &info, &pIntroSound);
+		pIntroSound = OpenStream(pLoopingMusic, FMOD_CREATESTREAM);
+		if (!pIntroSound)
+		{
+			Warning("FMOD: Failed to create stream of sound '%s' ! (ERROR NUMBER: %i)\n", pLoopingMusic, result);
+			return;
+		}
+		AddActiveStream(pIntroSound, pNewChannelGroup);
+
 		pSystem->playSound(pIntroSound, pNewChannelGroup, true, &pTempChannel);
 		
 		result = pTempChannel->setPaused(false);
@@ -470,6 +598,7 @@ void CFMODManager::StopAllSound( void )
 //	pChannelGroup->setVolume(0.0f);
 	pChannelGroup->stop();
 //	pChannelGroup->setPaused(true);
+	ReleaseStreams(NULL);
 }
 
 // Transitions between two ambient sounds if necessary
@@ -32,11 +32,37 @@ public:
 	float GetSoundLength(void);
 	unsigned int GetSoundLengthPCM( Sound *sound );
 
+	// Start opening the streams for a PlayLoopingMusic call in the background, so it doesn't stall when it comes
+	void PrefetchMusic( const char* pLoopingMusic, const char* pIntroMusic = NULL );
+	bool IsMusicReady( const char* pLoopingMusic, const char* pIntroMusic = NULL );
+
 	float m_fDefaultVolume;
 private:
-	void *GetFullPathToSound( const char* pathToFileFromModFolder, int *pLength );
+	void GetFullPathToSound( const char* pathToFileFromSoundsFolder, char *pszFullPath, int nMaxLength );
 	const char* GetCurrentSoundName( void );
 
+	Sound *OpenStream( const char* pathToFileFromSoundsFolder, FMOD_MODE mode );
+	void PrefetchStream( const char* pathToFileFromSoundsFolder, FMOD_MODE mode );
+	int FindPrefetchedStream( const char* pathToFileFromSoundsFolder, FMOD_MODE mode );
+	void AddActiveStream( Sound *pStream, ChannelGroup *pGroup );
+	void ReleaseStreams( ChannelGroup *pGroup );
+
+	struct prefetchedstream_t
+	{
+		char path[ MAX_PATH ];
+		FMOD_MODE mode;
+		Sound *pSound;
+	};
+	CUtlVector<prefetchedstream_t> m_PrefetchedStreams;
+
+	// Music and ambient streams handed to a channel group, released when that group is stopped or replaced
+	struct activestream_t
+	{
+		Sound *pSound;
+		ChannelGroup *pGroup;
+	};
+	CUtlVector<activestream_t> m_ActiveStreams;
+
 	const char* currentSound;
 	const char* introSound;
 	const char* loopingSound;
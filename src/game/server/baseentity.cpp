@@ -3062,6 +3062,12 @@ FORCEINLINE bool NamesMatch( const char *pszQuery, string_t nameToMatch )
 	return false;
 }
 
+void CBaseEntity::SetName( string_t newName )
+{
+	m_iName = newName;
+	gEntList.NotifyNameChanged();
+}
+
 bool CBaseEntity::NameMatchesComplex( const char *pszNameOrWildcard )
 {
 	if ( !Q_stricmp( "!player", pszNameOrWildcard) )
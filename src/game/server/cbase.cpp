@@ -686,8 +686,8 @@ CEventQueue g_EventQueue;
 
 CEventQueue::CEventQueue()
 {
-	m_Events.m_flFireTime = -FLT_MAX;
-	m_Events.m_pNext = NULL;
+	m_nNextSequence = 0;
+	m_iListCount = 0;
 
 	Init();
 }
@@ -801,21 +801,42 @@ void CEventQueue::Init( void )
 void CEventQueue::Clear( void )
 {
 	// delete all the events in the queue
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-	
-	while ( pe != NULL )
+	for ( int i = 0; i < m_Heap.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
-		delete pe;
-		pe = next;
+		delete m_Heap[i];
 	}
 
-	m_Events.m_pNext = NULL;
+	m_Heap.RemoveAll();
+	m_CallerIndex.RemoveAll();
+	m_TargetIndex.RemoveAll();
+	m_TargetCacheIndex.RemoveAll();
+	m_TargetCache.Purge();
+}
+
+static int __cdecl EventFireOrderCompare( EventQueuePrioritizedEvent_t * const *a, EventQueuePrioritizedEvent_t * const *b )
+{
+	if ( (*a)->m_flFireTime != (*b)->m_flFireTime )
+		return ( (*a)->m_flFireTime < (*b)->m_flFireTime ) ? -1 : 1;
+
+	if ( (*a)->m_nSequence != (*b)->m_nSequence )
+		return ( (*a)->m_nSequence < (*b)->m_nSequence ) ? -1 : 1;
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: returns the queued events in the order they will fire
+//-----------------------------------------------------------------------------
+void CEventQueue::GetSortedEvents( CUtlVector< EventQueuePrioritizedEvent_t * > &events )
+{
+	events.CopyArray( m_Heap.Base(), m_Heap.Count() );
+	events.Sort( EventFireOrderCompare );
 }
 
 void CEventQueue::Dump( void )
 {
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	CUtlVector< EventQueuePrioritizedEvent_t * > events;
+	GetSortedEvents( events );
 
 	Msg("Dumping event queue. Current time is: %.2f\n",
 #if defined( TF_DLL ) || defined(OF_DLL)
@@ -825,9 +846,9 @@ void CEventQueue::Dump( void )
 #endif
 		);
 
-	while ( pe != NULL )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
+		EventQueuePrioritizedEvent_t *pe = events[i];
 
 		Msg("   (%.2f) Target: '%s', Input: '%s', Parameter '%s'. Activator: '%s', Caller '%s'.  \n", 
 			pe->m_flFireTime, 
@@ -836,8 +857,6 @@ void CEventQueue::Dump( void )
 			pe->m_VariantValue.String(),
 			pe->m_pActivator ? pe->m_pActivator->GetDebugName() : "None", 
 			pe->m_pCaller ? pe->m_pCaller->GetDebugName() : "None"  );
-
-		pe = next;
 	}
 
 	Msg("Finished dump.\n");
@@ -857,6 +876,7 @@ void CEventQueue::AddEvent( const char *target, const char *targetInput, variant
 	newEvent->m_flFireTime = gpGlobals->curtime + fireDelay;	// priority key in the priority queue
 #endif
 	newEvent->m_iTarget = MAKE_STRING( target );
+	newEvent->m_iTargetCache = ResolveTargets( target );
 	newEvent->m_pEntTarget = NULL;
 	newEvent->m_iTargetInput = MAKE_STRING( targetInput );
 	newEvent->m_pActivator = pActivator;
@@ -880,6 +900,7 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *targetInput, varian
 	newEvent->m_flFireTime = gpGlobals->curtime + fireDelay;	// primary priority key in the priority queue
 #endif
 	newEvent->m_iTarget = NULL_STRING;
+	newEvent->m_iTargetCache = -1;
 	newEvent->m_pEntTarget = target;
 	newEvent->m_iTargetInput = MAKE_STRING( targetInput );
 	newEvent->m_pActivator = pActivator;
@@ -899,41 +920,268 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 
 
 //-----------------------------------------------------------------------------
-// Purpose: private function, adds an event into the list
+// Purpose: private function, adds an event into the queue
 // Input  : *newEvent - the (already built) event to add
 //-----------------------------------------------------------------------------
 void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 {
-	// loop through the actions looking for a place to insert
-	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	// events with the same fire time go off in the order they were added
+	newEvent->m_nSequence = m_nNextSequence++;
+
+	int i = m_Heap.AddToTail();
+	HeapSet( i, newEvent );
+	HeapUp( i );
+
+	LinkEvent( m_CallerIndex, &EventQueuePrioritizedEvent_t::m_CallerLink, newEvent->m_pCaller, newEvent );
+	LinkEvent( m_TargetIndex, &EventQueuePrioritizedEvent_t::m_TargetLink, newEvent->m_pEntTarget, newEvent );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: takes an event out of the queue and the entity lists, doesn't free it
+//-----------------------------------------------------------------------------
+void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
+{
+	if ( pe->m_iHeapIndex >= 0 )
+	{
+		HeapRemove( pe );
+	}
+
+	UnlinkEvent( m_CallerIndex, &EventQueuePrioritizedEvent_t::m_CallerLink, pe->m_pCaller, pe );
+	UnlinkEvent( m_TargetIndex, &EventQueuePrioritizedEvent_t::m_TargetLink, pe->m_pEntTarget, pe );
+}
+
+inline bool CEventQueue::FiresBefore( const EventQueuePrioritizedEvent_t *a, const EventQueuePrioritizedEvent_t *b )
+{
+	if ( a->m_flFireTime != b->m_flFireTime )
+		return a->m_flFireTime < b->m_flFireTime;
+
+	return a->m_nSequence < b->m_nSequence;
+}
+
+inline void CEventQueue::HeapSet( int i, EventQueuePrioritizedEvent_t *pe )
+{
+	m_Heap[i] = pe;
+	pe->m_iHeapIndex = i;
+}
+
+void CEventQueue::HeapUp( int i )
+{
+	EventQueuePrioritizedEvent_t *pe = m_Heap[i];
+	while ( i > 0 )
+	{
+		int iParent = ( i - 1 ) >> 1;
+		if ( !FiresBefore( pe, m_Heap[iParent] ) )
+			break;
+
+		HeapSet( i, m_Heap[iParent] );
+		i = iParent;
+	}
+	HeapSet( i, pe );
+}
+
+void CEventQueue::HeapDown( int i )
+{
+	EventQueuePrioritizedEvent_t *pe = m_Heap[i];
+	int nCount = m_Heap.Count();
+	for ( ;; )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
+		int iChild = ( i << 1 ) + 1;
+		if ( iChild >= nCount )
+			break;
+
+		if ( iChild + 1 < nCount && FiresBefore( m_Heap[iChild + 1], m_Heap[iChild] ) )
 		{
+			++iChild;
+		}
+
+		if ( !FiresBefore( m_Heap[iChild], pe ) )
 			break;
+
+		HeapSet( i, m_Heap[iChild] );
+		i = iChild;
+	}
+	HeapSet( i, pe );
+}
+
+void CEventQueue::HeapRemove( EventQueuePrioritizedEvent_t *pe )
+{
+	int i = pe->m_iHeapIndex;
+	Assert( i >= 0 && i < m_Heap.Count() && m_Heap[i] == pe );
+
+	int iLast = m_Heap.Count() - 1;
+	if ( i != iLast )
+	{
+		HeapSet( i, m_Heap[iLast] );
+		m_Heap.FastRemove( iLast );
+
+		if ( i > 0 && FiresBefore( m_Heap[i], m_Heap[( i - 1 ) >> 1] ) )
+		{
+			HeapUp( i );
+		}
+		else
+		{
+			HeapDown( i );
 		}
 	}
+	else
+	{
+		m_Heap.FastRemove( iLast );
+	}
+
+	pe->m_iHeapIndex = -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: adds an event to the head of the list of events for an entity
+//-----------------------------------------------------------------------------
+void CEventQueue::LinkEvent( EntityEventIndex_t &index, EventQueueLink_t EventQueuePrioritizedEvent_t::*pLink, const CBaseHandle &hEntity, EventQueuePrioritizedEvent_t *pe )
+{
+	EventQueueLink_t &link = pe->*pLink;
+	link.m_pPrev = NULL;
+	link.m_pNext = NULL;
 
-	Assert( pe );
+	if ( !hEntity.IsValid() )
+		return;
 
-	// insert
-	newEvent->m_pNext = pe->m_pNext;
-	newEvent->m_pPrev = pe;
-	pe->m_pNext = newEvent;
-	if ( newEvent->m_pNext )
+	bool bInserted;
+	UtlHashHandle_t h = index.Insert( hEntity.ToInt(), pe, &bInserted );
+	if ( !bInserted )
 	{
-		newEvent->m_pNext->m_pPrev = newEvent;
+		EventQueuePrioritizedEvent_t *pHead = index[h];
+		(pHead->*pLink).m_pPrev = pe;
+		link.m_pNext = pHead;
+		index[h] = pe;
 	}
 }
 
-void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
+void CEventQueue::UnlinkEvent( EntityEventIndex_t &index, EventQueueLink_t EventQueuePrioritizedEvent_t::*pLink, const CBaseHandle &hEntity, EventQueuePrioritizedEvent_t *pe )
 {
-	Assert( pe->m_pPrev );
-	pe->m_pPrev->m_pNext = pe->m_pNext;
-	if ( pe->m_pNext )
+	if ( !hEntity.IsValid() )
+		return;
+
+	EventQueueLink_t &link = pe->*pLink;
+	if ( link.m_pNext )
+	{
+		(link.m_pNext->*pLink).m_pPrev = link.m_pPrev;
+	}
+
+	if ( link.m_pPrev )
 	{
-		pe->m_pNext->m_pPrev = pe->m_pPrev;
+		(link.m_pPrev->*pLink).m_pNext = link.m_pNext;
 	}
+	else
+	{
+		// was the head
+		UtlHashHandle_t h = index.Find( hEntity.ToInt() );
+		Assert( h != index.InvalidHandle() && index[h] == pe );
+		if ( link.m_pNext )
+		{
+			index[h] = link.m_pNext;
+		}
+		else
+		{
+			index.Remove( hEntity.ToInt() );
+		}
+	}
+
+	link.m_pPrev = NULL;
+	link.m_pNext = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: finds or builds the resolved target list for a target name
+// Output : index into m_TargetCache, -1 for procedural names that can't be cached
+//-----------------------------------------------------------------------------
+int CEventQueue::ResolveTargets( const char *pszTarget )
+{
+	// procedural names depend on the activator and caller at fire time
+	if ( !pszTarget || !pszTarget[0] || pszTarget[0] == '!' )
+		return -1;
+
+	const void *pKey = STRING( AllocPooledString( pszTarget ) );
+
+	UtlHashHandle_t h = m_TargetCacheIndex.Find( pKey );
+	if ( h != m_TargetCacheIndex.InvalidHandle() )
+	{
+		int iCache = m_TargetCacheIndex[h];
+		UpdateResolvedTargets( m_TargetCache[iCache], pszTarget );
+		return iCache;
+	}
+
+	int iCache = m_TargetCache.AddToTail();
+	m_TargetCache[iCache].m_nNameSerial = gEntList.GetNameSerial() - 1;
+	UpdateResolvedTargets( m_TargetCache[iCache], pszTarget );
+	m_TargetCacheIndex.Insert( pKey, iCache );
+	return iCache;
+}
+
+void CEventQueue::UpdateResolvedTargets( ResolvedTargets_t &resolved, const char *pszTarget )
+{
+	if ( resolved.m_nNameSerial == gEntList.GetNameSerial() )
+		return;
+
+	resolved.m_nNameSerial = gEntList.GetNameSerial();
+	resolved.m_Targets.RemoveAll();
+
+	CBaseEntity *target = NULL;
+	while ( ( target = gEntList.FindEntityByName( target, pszTarget ) ) != NULL )
+	{
+		resolved.m_Targets.AddToTail( target );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: pumps the event into every entity matching its target name
+// Output : true if any target was found
+//-----------------------------------------------------------------------------
+bool CEventQueue::FireAtNamedTargets( EventQueuePrioritizedEvent_t *pe )
+{
+	CBaseEntity *target = NULL;
+	bool targetFound = false;
+
+	if ( pe->m_iTargetCache >= 0 )
+	{
+		ResolvedTargets_t &resolved = m_TargetCache[pe->m_iTargetCache];
+		UpdateResolvedTargets( resolved, STRING(pe->m_iTarget) );
+
+		// Inputs can queue events that rebuild this list, so work from a copy
+		CUtlVectorFixedGrowable< EHANDLE, 16 > targets;
+		targets.CopyArray( resolved.m_Targets.Base(), resolved.m_Targets.Count() );
+
+		int nNameSerial = gEntList.GetNameSerial();
+		for ( int i = 0; i < targets.Count() && nNameSerial == gEntList.GetNameSerial(); i++ )
+		{
+			// removed since the list was built
+			if ( !targets[i] )
+				continue;
+
+			target = targets[i];
+
+			// pump the action into the target
+			target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+			targetFound = true;
+		}
+
+		if ( nNameSerial == gEntList.GetNameSerial() )
+			return targetFound;
+
+		// An input renamed something, carry on with a live search from the last target like we used to
+	}
+
+	// In the context the event, the searching entity is also the caller
+	CBaseEntity *pSearchingEntity = pe->m_pCaller;
+	while ( 1 )
+	{
+		target = gEntList.FindEntityByName( target, pe->m_iTarget, pSearchingEntity, pe->m_pActivator, pe->m_pCaller );
+		if ( !target )
+			break;
+
+		// pump the action into the target
+		target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+		targetFound = true;
+	}
+
+	return targetFound;
 }
 
 
@@ -947,34 +1195,25 @@ void CEventQueue::ServiceEvents( void )
 		return;
 	}
 
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-
 #if defined( TF_DLL ) || defined(OF_DLL)
-	while ( pe != NULL && pe->m_flFireTime <= engine->GetServerTime() )
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= engine->GetServerTime() )
 #else
-	while ( pe != NULL && pe->m_flFireTime <= gpGlobals->curtime )
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= gpGlobals->curtime )
 #endif
 	{
 		MDLCACHE_CRITICAL_SECTION();
 
+		// Take it off the queue before firing, the inputs may add or cancel events. It stays
+		// in the entity lists until it's done so HasEventPending still sees it.
+		EventQueuePrioritizedEvent_t *pe = m_Heap[0];
+		HeapRemove( pe );
+
 		bool targetFound = false;
 
 		// find the targets
 		if ( pe->m_iTarget != NULL_STRING )
 		{
-			// In the context the event, the searching entity is also the caller
-			CBaseEntity *pSearchingEntity = pe->m_pCaller;
-			CBaseEntity *target = NULL;
-			while ( 1 )
-			{
-				target = gEntList.FindEntityByName( target, pe->m_iTarget, pSearchingEntity, pe->m_pActivator, pe->m_pCaller );
-				if ( !target )
-					break;
-
-				// pump the action into the target
-				target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
-				targetFound = true;
-			}
+			targetFound = FireAtNamedTargets( pe );
 		}
 
 		// direct pointer
@@ -1025,7 +1264,6 @@ void CEventQueue::ServiceEvents( void )
 			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
 		}
 
-		// remove the event from the list (remembering that the queue may have been added to)
 		RemoveEvent( pe );
 		delete pe;
 
@@ -1039,9 +1277,6 @@ void CEventQueue::ServiceEvents( void )
 				break;
 			}
 		}
-
-		// restart the list (to catch any new items have probably been added to the queue)
-		pe = m_Events.m_pNext;	
 	}
 }
 
@@ -1069,27 +1304,21 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 	if (!pCaller)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	UtlHashHandle_t h = m_CallerIndex.Find( pCaller->GetRefEHandle().ToInt() );
+	if ( h == m_CallerIndex.InvalidHandle() )
+		return;
+
+	EventQueuePrioritizedEvent_t *pCur = m_CallerIndex[h];
 
 	while (pCur != NULL)
 	{
-		bool bDelete = false;
-		if (pCur->m_pCaller == pCaller)
-		{
-			// Pointers match; make sure everything else matches.
-			if (!stricmp(STRING(pCur->m_pCaller->GetEntityName()), STRING(pCaller->GetEntityName())) &&
-				!stricmp(pCur->m_pCaller->GetClassname(), pCaller->GetClassname()))
-			{
-				// Found a matching event; delete it from the queue.
-				bDelete = true;
-			}
-		}
-
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_CallerLink.m_pNext;
 
-		if (bDelete)
+		// Events being fired right now are freed by ServiceEvents
+		if ( pCurSave->m_iHeapIndex >= 0 )
 		{
+			// Found a matching event; delete it from the queue.
 			RemoveEvent( pCurSave );
 			delete pCurSave;
 		}
@@ -1107,12 +1336,16 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 	if (!pTarget)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	UtlHashHandle_t h = m_TargetIndex.Find( pTarget->GetRefEHandle().ToInt() );
+	if ( h == m_TargetIndex.InvalidHandle() )
+		return;
+
+	EventQueuePrioritizedEvent_t *pCur = m_TargetIndex[h];
 
 	while (pCur != NULL)
 	{
 		bool bDelete = false;
-		if (pCur->m_pEntTarget == pTarget)
+		if ( pCur->m_iHeapIndex >= 0 )
 		{
 			if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
 			{
@@ -1122,7 +1355,7 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 		}
 
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_TargetLink.m_pNext;
 
 		if (bDelete)
 		{
@@ -1142,20 +1375,17 @@ bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName
 	if (!pTarget)
 		return false;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
-
-	while (pCur != NULL)
-	{
-		if (pCur->m_pEntTarget == pTarget)
-		{
-			if ( !sInputName )
-				return true;
+	UtlHashHandle_t h = m_TargetIndex.Find( pTarget->GetRefEHandle().ToInt() );
+	if ( h == m_TargetIndex.InvalidHandle() )
+		return false;
 
-			if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
-				return true;
-		}
+	if ( !sInputName )
+		return true;
 
-		pCur = pCur->m_pNext;
+	for ( EventQueuePrioritizedEvent_t *pCur = m_TargetIndex[h]; pCur != NULL; pCur = pCur->m_TargetLink.m_pNext )
+	{
+		if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
+			return true;
 	}
 
 	return false;
@@ -1173,7 +1403,7 @@ void ServiceEventQueue( void )
 // save data description for the event queue
 BEGIN_SIMPLE_DATADESC( CEventQueue )
 	// These are saved explicitly in CEventQueue::Save below
-	// DEFINE_FIELD( m_Events, EventQueuePrioritizedEvent_t ),
+	// DEFINE_FIELD( m_Heap, EventQueuePrioritizedEvent_t ),
 
 	DEFINE_FIELD( m_iListCount, FIELD_INTEGER ),	// this value is only used during save/restore
 END_DATADESC()
@@ -1190,29 +1420,30 @@ BEGIN_SIMPLE_DATADESC( EventQueuePrioritizedEvent_t )
 	DEFINE_FIELD( m_iOutputID, FIELD_INTEGER ),
 	DEFINE_CUSTOM_FIELD( m_VariantValue, variantFuncs ),
 
-//	DEFINE_FIELD( m_pNext, FIELD_??? ),
-//	DEFINE_FIELD( m_pPrev, FIELD_??? ),
+//	DEFINE_FIELD( m_nSequence, FIELD_INTEGER ),	// rebuilt by restoring events in fire order
+//	DEFINE_FIELD( m_iHeapIndex, FIELD_INTEGER ),
+//	DEFINE_FIELD( m_iTargetCache, FIELD_INTEGER ),
+//	DEFINE_FIELD( m_CallerLink, FIELD_??? ),
+//	DEFINE_FIELD( m_TargetLink, FIELD_??? ),
 END_DATADESC()
 
 
 int CEventQueue::Save( ISave &save )
 {
-	// count the number of items in the queue
-	EventQueuePrioritizedEvent_t *pe;
+	// save in fire order, so restoring keeps events with the same fire time in sequence
+	CUtlVector< EventQueuePrioritizedEvent_t * > events;
+	GetSortedEvents( events );
 
-	m_iListCount = 0;
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
-	{
-		m_iListCount++;
-	}
+	m_iListCount = events.Count();
 
 	// save that value out to disk, so we know how many to restore
 	if ( !save.WriteFields( "EventQueue", this, NULL, m_DataMap.dataDesc, m_DataMap.dataNumFields ) )
 		return 0;
 	
 	// cycle through all the events, saving them all
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
+		EventQueuePrioritizedEvent_t *pe = events[i];
 		if ( !save.WriteFields( "PEvent", pe, NULL, pe->m_DataMap.dataDesc, pe->m_DataMap.dataNumFields ) )
 			return 0;
 	}
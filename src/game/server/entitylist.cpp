@@ -130,9 +130,20 @@ void AimTarget_ForceRepopulateList()
 struct simthinkentry_t
 {
 	unsigned short	entEntry;
-	unsigned short	unused0;
+	unsigned short	bucket;			// SIMTHINK_READY_BUCKET or the wheel slot for nextThinkTick
 	int				nextThinkTick;
 };
+
+// Entries that think in the future wait in a wheel of one bucket per tick, so each frame only
+// has to look at what became due plus the ready list (simulating or overdue entries).
+#define SIMTHINK_WHEEL_BITS		8
+#define SIMTHINK_WHEEL_SIZE		( 1 << SIMTHINK_WHEEL_BITS )
+#define SIMTHINK_WHEEL_MASK		( SIMTHINK_WHEEL_SIZE - 1 )
+#define SIMTHINK_READY_BUCKET	SIMTHINK_WHEEL_SIZE
+#define SIMTHINK_INVALID		0xFFFF
+
+ConVar sv_simthink_validate( "sv_simthink_validate", "0", FCVAR_CHEAT, "Check every frame that the think scheduler visits the same entities, in the same order, as a full scan of the list." );
+
 class CSimThinkManager : public IEntityListener
 {
 public:
@@ -147,6 +158,11 @@ public:
 		{
 			m_entinfoIndex[i] = 0xFFFF;
 		}
+		for ( int i = 0; i < ARRAYSIZE(m_bucketHead); i++ )
+		{
+			m_bucketHead[i] = SIMTHINK_INVALID;
+		}
+		m_nWheelTick = -1;
 	}
 	void LevelInitPreEntity()
 	{
@@ -175,6 +191,7 @@ public:
 		if ( listHandle != 0xFFFF )
 		{
 			Assert(m_simThinkList[listHandle].entEntry == index);
+			Unschedule( index );
 			m_simThinkList.FastRemove( listHandle );
 			m_entinfoIndex[index] = 0xFFFF;
 			
@@ -192,23 +209,44 @@ public:
 
 	int ListCopy( CBaseEntity *pList[], int listMax )
 	{
+		AdvanceWheel( gpGlobals->tickcount );
+
+		// Copy out in list order, the same order a scan of the whole list would produce
 		int count = MIN(listMax, ListCount());
+		unsigned short *pDue = (unsigned short *)stackalloc( sizeof(unsigned short) * MAX( count, 1 ) );
+		int nDue = 0;
+		for ( int entEntry = m_bucketHead[SIMTHINK_READY_BUCKET]; entEntry != SIMTHINK_INVALID; entEntry = m_bucketNext[entEntry] )
+		{
+			if ( m_entinfoIndex[entEntry] < count )
+			{
+				pDue[nDue++] = m_entinfoIndex[entEntry];
+			}
+		}
+		qsort( pDue, nDue, sizeof(unsigned short), CompareListHandles );
+
 		int out = 0;
-		for ( int i = 0; i < count; i++ )
+		for ( int i = 0; i < nDue; i++ )
 		{
 			// only copy out entities that will simulate or think this frame
-			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
-			{
+			const simthinkentry_t &entry = m_simThinkList[pDue[i]];
+			Assert( entry.nextThinkTick <= gpGlobals->tickcount );
 #ifndef OF_DLL				
-				Assert(m_simThinkList[i].nextThinkTick>=0);
+			Assert(entry.nextThinkTick>=0);
 #endif
-				int entinfoIndex = m_simThinkList[i].entEntry;
-				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
-				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
-				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
-				Assert( gEntList.IsEntityPtr( pList[out] ) );
-				out++;
-			}
+			const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entry.entEntry );
+			pList[out] = (CBaseEntity *)pInfo->m_pEntity;
+			Assert(entry.nextThinkTick==0 || pList[out]->GetFirstThinkTick()==entry.nextThinkTick);
+			Assert( gEntList.IsEntityPtr( pList[out] ) );
+			out++;
+		}
+		stackfree( pDue );
+
+		VPROF_INCREMENT_COUNTER( "SimThink entities due", out );
+		VPROF_INCREMENT_COUNTER( "SimThink visits avoided", count - out );
+
+		if ( sv_simthink_validate.GetBool() )
+		{
+			ValidateListCopy( pList, out, count );
 		}
 
 		return out;
@@ -246,6 +284,8 @@ public:
 			}
 			else
 			{
+				Unschedule( index );
+
 				// updating existing entry - if no sim, reset think time
 				if ( pEntity->IsEFlagSet(EFL_NO_GAME_PHYSICS_SIMULATION) )
 				{
@@ -257,12 +297,126 @@ public:
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
 			}
+
+			Schedule( index );
 		}
 	}
 
 private:
+	static int CompareListHandles( const void *a, const void *b )
+	{
+		return (int)*(const unsigned short *)a - (int)*(const unsigned short *)b;
+	}
+
+	// Puts an entry in the ready list if it's due by the last tick the wheel advanced to, otherwise in the wheel
+	void Schedule( int entEntry )
+	{
+		simthinkentry_t &entry = m_simThinkList[m_entinfoIndex[entEntry]];
+		int bucket = ( entry.nextThinkTick <= m_nWheelTick ) ? SIMTHINK_READY_BUCKET : ( entry.nextThinkTick & SIMTHINK_WHEEL_MASK );
+		entry.bucket = (unsigned short)bucket;
+
+		m_bucketPrev[entEntry] = SIMTHINK_INVALID;
+		m_bucketNext[entEntry] = m_bucketHead[bucket];
+		if ( m_bucketHead[bucket] != SIMTHINK_INVALID )
+		{
+			m_bucketPrev[m_bucketHead[bucket]] = (unsigned short)entEntry;
+		}
+		m_bucketHead[bucket] = (unsigned short)entEntry;
+	}
+
+	void Unschedule( int entEntry )
+	{
+		int bucket = m_simThinkList[m_entinfoIndex[entEntry]].bucket;
+		unsigned short next = m_bucketNext[entEntry];
+		unsigned short prev = m_bucketPrev[entEntry];
+		if ( next != SIMTHINK_INVALID )
+		{
+			m_bucketPrev[next] = prev;
+		}
+		if ( prev != SIMTHINK_INVALID )
+		{
+			m_bucketNext[prev] = next;
+		}
+		else
+		{
+			Assert( m_bucketHead[bucket] == entEntry );
+			m_bucketHead[bucket] = next;
+		}
+	}
+
+	// Moves the entries that came due in the wheel slot into the ready list
+	void DrainBucket( int bucket )
+	{
+		int entEntry = m_bucketHead[bucket];
+		while ( entEntry != SIMTHINK_INVALID )
+		{
+			int next = m_bucketNext[entEntry];
+			// slots are shared by ticks a whole wheel apart, later laps stay put
+			if ( m_simThinkList[m_entinfoIndex[entEntry]].nextThinkTick <= m_nWheelTick )
+			{
+				Unschedule( entEntry );
+				Schedule( entEntry );
+			}
+			entEntry = next;
+		}
+	}
+
+	void AdvanceWheel( int tick )
+	{
+		if ( tick < m_nWheelTick )
+		{
+			// clock went backwards, reschedule everything against the new time
+			m_nWheelTick = tick;
+			for ( int i = 0; i < m_simThinkList.Count(); i++ )
+			{
+				Unschedule( m_simThinkList[i].entEntry );
+				Schedule( m_simThinkList[i].entEntry );
+			}
+			return;
+		}
+
+		int nTicks = MIN( tick - m_nWheelTick, SIMTHINK_WHEEL_SIZE );
+		int firstBucket = m_nWheelTick + 1;
+		m_nWheelTick = tick;
+		for ( int i = 0; i < nTicks; i++ )
+		{
+			DrainBucket( ( firstBucket + i ) & SIMTHINK_WHEEL_MASK );
+		}
+	}
+
+	// The old behavior, a scan of the whole list
+	void ValidateListCopy( CBaseEntity *pList[], int nCopied, int count )
+	{
+		int out = 0;
+		for ( int i = 0; i < count; i++ )
+		{
+			if ( m_simThinkList[i].nextThinkTick > gpGlobals->tickcount )
+				continue;
+
+			CBaseEntity *pEntity = (CBaseEntity *)gEntList.GetEntInfoPtrByIndex( m_simThinkList[i].entEntry )->m_pEntity;
+			if ( out >= nCopied || pList[out] != pEntity )
+			{
+				Warning( "SimThink: tick %d visit %d is %s, full scan has %s\n", gpGlobals->tickcount, out,
+					out < nCopied && pList[out] ? pList[out]->GetDebugName() : "<none>", pEntity ? pEntity->GetDebugName() : "<null>" );
+				return;
+			}
+			out++;
+		}
+
+		if ( out != nCopied )
+		{
+			Warning( "SimThink: tick %d visited %d entities, full scan has %d\n", gpGlobals->tickcount, nCopied, out );
+		}
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	// per entinfo links for the bucket lists
+	unsigned short m_bucketNext[NUM_ENT_ENTRIES];
+	unsigned short m_bucketPrev[NUM_ENT_ENTRIES];
+	unsigned short m_bucketHead[SIMTHINK_WHEEL_SIZE + 1];
+	int m_nWheelTick;	// last tick whose wheel slot has been drained
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -296,6 +450,7 @@ CGlobalEntityList::CGlobalEntityList()
 {
 	m_iHighestEnt = m_iNumEnts = m_iNumEdicts = 0;
 	m_bClearingEntities = false;
+	m_nNameSerial = 0;
 }
 
 
@@ -383,6 +538,7 @@ void CGlobalEntityList::Clear( void )
 	CBaseEntity::m_bInDebugSelect = false; 
 	m_iHighestEnt = 0;
 	m_iNumEnts = 0;
+	NotifyNameChanged();
 
 	m_bClearingEntities = false;
 }
@@ -502,6 +658,33 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Iterates the entities with a given pooled classname, see entitylist.h.
+//-----------------------------------------------------------------------------
+CBaseEntity *CGlobalEntityList::FindEntityByClassnameFast( CBaseEntity *pStartEntity, string_t iszClassname )
+{
+	if ( iszClassname == NULL_STRING )
+		return NULL;
+
+	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
+
+	for ( ;pInfo; pInfo = pInfo->m_pNext )
+	{
+		CBaseEntity *pEntity = (CBaseEntity *)pInfo->m_pEntity;
+		if ( !pEntity )
+		{
+			DevWarning( "NULL entity in global entity list!\n" );
+			continue;
+		}
+
+		if ( IDENT_STRINGS( pEntity->m_iClassname, iszClassname ) )
+			return pEntity;
+	}
+
+	return NULL;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Finds an entity given a procedural name.
 // Input  : szName - The procedural name to search for, should start with '!'.
@@ -1148,6 +1331,11 @@ void CGlobalEntityList::NotifySpawn( CBaseEntity *pEnt )
 	if ( !pEnt )
 		return;
 
+	if ( pEnt->GetEntityName() != NULL_STRING )
+	{
+		NotifyNameChanged();
+	}
+
 	//DevMsg(2,"Deleted %s\n", pBaseEnt->GetClassname() );
 	for ( int i = m_entityListeners.Count()-1; i >= 0; i-- )
 	{
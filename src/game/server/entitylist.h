@@ -79,6 +79,7 @@ private:
 	int m_iNumEdicts;
 
 	bool m_bClearingEntities;
+	int m_nNameSerial;
 	CUtlVector<IEntityListener *>	m_entityListeners;
 
 public:
@@ -112,6 +113,12 @@ public:
 	void NotifyCreateEntity( CBaseEntity *pEnt );
 	void NotifySpawn( CBaseEntity *pEnt );
 	void NotifyRemoveEntity( CBaseHandle hEnt );
+
+	// Changes whenever an entity may have been named or renamed, so anything caching
+	// the result of a name search knows when to redo it.
+	int GetNameSerial() const { return m_nNameSerial; }
+	void NotifyNameChanged() { ++m_nNameSerial; }
+
 	// iteration functions
 
 	// returns the next entity after pCurrentEnt;  if pCurrentEnt is NULL, return the first entity
@@ -134,6 +141,10 @@ public:
 	// search functions
 	bool		 IsEntityPtr( void *pTest );
 	CBaseEntity *FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName );
+	// Pointer compares only: iszClassname must be pooled (e.g. a CPooledStringLiteral) and
+	// spelled as the entity factory was registered, no wildcards. Entities always carry that
+	// spelling, whatever case the map used.
+	CBaseEntity *FindEntityByClassnameFast( CBaseEntity *pStartEntity, string_t iszClassname );
 	CBaseEntity *FindEntityByName( CBaseEntity *pStartEntity, const char *szName, CBaseEntity *pSearchingEntity = NULL, CBaseEntity *pActivator = NULL, CBaseEntity *pCaller = NULL, IEntityFindFilter *pFilter = NULL );
 	CBaseEntity *FindEntityByName( CBaseEntity *pStartEntity, string_t iszName, CBaseEntity *pSearchingEntity = NULL, CBaseEntity *pActivator = NULL, CBaseEntity *pCaller = NULL, IEntityFindFilter *pFilter = NULL )
 	{
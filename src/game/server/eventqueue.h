@@ -15,6 +15,16 @@
 #endif
 
 #include "mempool.h"
+#include "tier1/utlhashtable.h"
+
+struct EventQueuePrioritizedEvent_t;
+
+// Intrusive links for the per-entity event lists
+struct EventQueueLink_t
+{
+	EventQueuePrioritizedEvent_t *m_pNext;
+	EventQueuePrioritizedEvent_t *m_pPrev;
+};
 
 struct EventQueuePrioritizedEvent_t
 {
@@ -28,8 +38,12 @@ struct EventQueuePrioritizedEvent_t
 
 	variant_t m_VariantValue;	// variable-type parameter
 
-	EventQueuePrioritizedEvent_t *m_pNext;
-	EventQueuePrioritizedEvent_t *m_pPrev;
+	unsigned int m_nSequence;	// secondary priority key, keeps events with the same fire time in FIFO order
+	int m_iHeapIndex;			// -1 once popped from the queue
+	int m_iTargetCache;			// index of the resolved target list, -1 if the target can't be cached
+
+	EventQueueLink_t m_CallerLink;
+	EventQueueLink_t m_TargetLink;
 
 	DECLARE_SIMPLE_DATADESC();
 
@@ -71,8 +85,37 @@ private:
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
 
+	// binary min-heap on ( m_flFireTime, m_nSequence )
+	static bool FiresBefore( const EventQueuePrioritizedEvent_t *a, const EventQueuePrioritizedEvent_t *b );
+	void HeapSet( int i, EventQueuePrioritizedEvent_t *pe );
+	void HeapUp( int i );
+	void HeapDown( int i );
+	void HeapRemove( EventQueuePrioritizedEvent_t *pe );
+	void GetSortedEvents( CUtlVector< EventQueuePrioritizedEvent_t * > &events );
+
+	// per-entity lists so cancelling and pending checks don't walk the whole queue
+	typedef CUtlHashtable< int, EventQueuePrioritizedEvent_t * > EntityEventIndex_t;
+	static void LinkEvent( EntityEventIndex_t &index, EventQueueLink_t EventQueuePrioritizedEvent_t::*pLink, const CBaseHandle &hEntity, EventQueuePrioritizedEvent_t *pe );
+	static void UnlinkEvent( EntityEventIndex_t &index, EventQueueLink_t EventQueuePrioritizedEvent_t::*pLink, const CBaseHandle &hEntity, EventQueuePrioritizedEvent_t *pe );
+
+	// Named targets are resolved to handles when queued. A list stays valid until
+	// an entity name changes, see CGlobalEntityList::GetNameSerial.
+	struct ResolvedTargets_t
+	{
+		int m_nNameSerial;
+		CUtlVector< EHANDLE > m_Targets;
+	};
+	int ResolveTargets( const char *pszTarget );
+	void UpdateResolvedTargets( ResolvedTargets_t &resolved, const char *pszTarget );
+	bool FireAtNamedTargets( EventQueuePrioritizedEvent_t *pe );
+
 	DECLARE_SIMPLE_DATADESC();
-	EventQueuePrioritizedEvent_t m_Events;
+	CUtlVector< EventQueuePrioritizedEvent_t * > m_Heap;
+	unsigned int m_nNextSequence;
+	EntityEventIndex_t m_CallerIndex;
+	EntityEventIndex_t m_TargetIndex;
+	CUtlHashtable< const void *, int > m_TargetCacheIndex;
+	CUtlVector< ResolvedTargets_t > m_TargetCache;
 	int m_iListCount;
 };
 
@@ -248,6 +248,7 @@ CNavArea::CNavArea( void )
 	m_funcNavCostVector.RemoveAll();
 
 	m_nVisTestCounter = (uint32)-1;
+	m_visBitIndex = -1;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -770,6 +771,7 @@ void CNavArea::OnDestroyNotify( CNavArea *dead )
 	m_inheritVisibilityFrom.area = NULL;
 	m_potentiallyVisibleAreas.RemoveAll();
 	m_isInheritedFrom = false;
+	TheNavMesh->GetVisBitSets().Invalidate();
 }
 
 
@@ -3729,6 +3731,18 @@ static Vector FindPositionInArea( CNavArea *area, NavCornerType corner )
  * Analyze local area neighborhood to find "hiding spots" for this area
  */
 void CNavArea::ComputeHidingSpots( void )
+{
+	HidingSpotCandidate_t candidates[ NUM_CORNERS ];
+	int count = FindHidingSpotCandidates( candidates );
+	CreateHidingSpots( candidates, count );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find where this area's hiding spots go without creating them. Only reads the mesh and traces,
+ * so parallel analysis can run it for many areas at once and create the spots afterwards in order.
+ */
+int CNavArea::FindHidingSpotCandidates( HidingSpotCandidate_t candidates[ NUM_CORNERS ] )
 {
 	struct
 	{
@@ -3736,16 +3750,13 @@ void CNavArea::ComputeHidingSpots( void )
 	}
 	extent;
 
-	m_hidingSpots.PurgeAndDeleteElements();
-
-
 	// "jump areas" cannot have hiding spots
 	if ( GetAttributes() & NAV_MESH_JUMP )
-		return;
+		return 0;
 
 	// "don't hide areas" cannot have hiding spots
 	if ( GetAttributes() & NAV_MESH_DONT_HIDE )
-		return;
+		return 0;
 
 	int cornerCount[NUM_CORNERS];
 	for( int i=0; i<NUM_CORNERS; ++i )
@@ -3828,21 +3839,51 @@ void CNavArea::ComputeHidingSpots( void )
 		}
 	}
 
+	const float collisionRange = 30.0f;
+
+	int count = 0;
 	for ( int c=0; c<NUM_CORNERS; ++c )
 	{
 		// if a corner count is 2, then it really is a corner (walls on both sides)
 		if (cornerCount[c] == 2)
 		{
 			Vector pos = FindPositionInArea( this, (NavCornerType)c );
-			if ( !c || !IsHidingSpotCollision( pos ) )
+
+			// skip if too close to a spot we already placed
+			bool isCollision = false;
+			for ( int i=0; i<count; ++i )
+			{
+				if ( ( candidates[i].pos - pos ).IsLengthLessThan( collisionRange ) )
+				{
+					isCollision = true;
+					break;
+				}
+			}
+
+			if ( !isCollision )
 			{
-				HidingSpot *spot = TheNavMesh->CreateHidingSpot();
-				spot->SetPosition( pos );
-				spot->SetFlags( IsHidingSpotInCover( pos ) ? HidingSpot::IN_COVER : HidingSpot::EXPOSED );
-				m_hidingSpots.AddToTail( spot );
+				candidates[ count ].pos = pos;
+				candidates[ count ].flags = IsHidingSpotInCover( pos ) ? HidingSpot::IN_COVER : HidingSpot::EXPOSED;
+				++count;
 			}
 		}
 	}
+
+	return count;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavArea::CreateHidingSpots( const HidingSpotCandidate_t *candidates, int count )
+{
+	m_hidingSpots.PurgeAndDeleteElements();
+
+	for ( int i=0; i<count; ++i )
+	{
+		HidingSpot *spot = TheNavMesh->CreateHidingSpot();
+		spot->SetPosition( candidates[i].pos );
+		spot->SetFlags( candidates[i].flags );
+		m_hidingSpots.AddToTail( spot );
+	}
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -4014,8 +4055,8 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 	Vector dir = e->path.to - e->path.from;
 	float length = dir.NormalizeInPlace();
 
-	// create unique marker to flag used spots
-	HidingSpot::ChangeMasterMarker();
+	// flag used spots locally rather than with the HidingSpot marker, so areas can be analyzed in parallel
+	CVarBitVec seenSpots( TheHidingSpots.Count() );
 
 	const float stepSize = 25.0f;		// 50
 	const float seeSpotRange = 2000.0f;	// 3000
@@ -4048,7 +4089,7 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 			if (!spot->HasGoodCover())
 				continue;
 
-			if (spot->IsMarked())
+			if (seenSpots.IsBitSet( it ))
 				continue;
 
 			const Vector &spotPos = spot->GetPosition();
@@ -4084,7 +4125,7 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 			}
 
 			// mark spot as encountered
-			spot->Mark();
+			seenSpots.Set( it );
 		}
 	}
 
@@ -4099,7 +4140,7 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
  */
 void CNavArea::ComputeSpotEncounters( void )
 {
-	m_spotEncounters.RemoveAll();
+	m_spotEncounters.PurgeAndDeleteElements();
 
 	if (nav_quicksave.GetBool())
 		return;
@@ -5515,6 +5556,7 @@ const CNavArea::CAreaBindInfoArray &CNavArea::ComputeVisibilityDelta( const CNav
 void CNavArea::ResetPotentiallyVisibleAreas()
 {
 	m_potentiallyVisibleAreas.RemoveAll();
+	TheNavMesh->GetVisBitSets().Invalidate();
 }
 
 
@@ -5581,6 +5623,7 @@ void CNavArea::ComputeVisibilityToMesh( void )
 {
 	m_inheritVisibilityFrom.area = NULL;
 	m_isInheritedFrom = false;
+	TheNavMesh->GetVisBitSets().Invalidate();
 
 	// collect all possible nav areas that could be visible from this area
 	NavAreaCollector collector;
@@ -5722,6 +5765,12 @@ bool CNavArea::IsPotentiallyVisible( const CNavArea *viewedArea ) const
 		return true;
 	}
 
+	CNavVisBitSets &visBits = TheNavMesh->GetVisBitSets();
+	if ( visBits.Update() && visBits.IsIndexed( this ) )
+	{
+		return visBits.IsPotentiallyVisible( this, viewedArea );
+	}
+
 	// normal visibility check
 	for ( int i=0; i<m_potentiallyVisibleAreas.Count(); ++i )
 	{
@@ -5767,6 +5816,12 @@ bool CNavArea::IsCompletelyVisible( const CNavArea *viewedArea ) const
 		return true;
 	}
 
+	CNavVisBitSets &visBits = TheNavMesh->GetVisBitSets();
+	if ( visBits.Update() && visBits.IsIndexed( this ) )
+	{
+		return visBits.IsCompletelyVisible( this, viewedArea );
+	}
+
 	// normal visibility check
 	for ( int i=0; i<m_potentiallyVisibleAreas.Count(); ++i )
 	{
@@ -5803,6 +5858,13 @@ bool CNavArea::IsPotentiallyVisibleToTeam( int teamIndex ) const
 {
 	VPROF_BUDGET( "CNavArea::IsPotentiallyVisibleToTeam", "NextBot" );
 
+	// union of what every living member's area can see, kept up to date as they move
+	CNavVisBitSets &visBits = TheNavMesh->GetVisBitSets();
+	if ( visBits.Update() && visBits.IsIndexed( this ) )
+	{
+		return visBits.IsPotentiallyVisibleToTeam( this, teamIndex );
+	}
+
 	CTeam *team = GetGlobalTeam( teamIndex );
 
 	for( int i = 0; i < team->GetNumPlayers(); ++i )
@@ -5830,6 +5892,13 @@ bool CNavArea::IsCompletelyVisibleToTeam( int teamIndex ) const
 {
 	VPROF_BUDGET( "CNavArea::IsCompletelyVisibleToTeam", "NextBot" );
 
+	// union of what every living member's area can see, kept up to date as they move
+	CNavVisBitSets &visBits = TheNavMesh->GetVisBitSets();
+	if ( visBits.Update() && visBits.IsIndexed( this ) )
+	{
+		return visBits.IsCompletelyVisibleToTeam( this, teamIndex );
+	}
+
 	CTeam *team = GetGlobalTeam( teamIndex );
 
 	for( int i = 0; i < team->GetNumPlayers(); ++i )
@@ -31,6 +31,9 @@ inline void DebuggerBreakOnNaN_StagingOnly( float val )
 class CFuncElevator;
 class CFuncNavPrerequisite;
 class CFuncNavCost;
+class CNavCompiledImage;
+class CNavCompiledBuilder;
+struct NavCompiledArea_t;
 
 class CNavVectorNoEditAllocator
 {
@@ -283,6 +286,12 @@ public:
 	virtual void Save( CUtlBuffer &fileBuffer, unsigned int version ) const;	// (EXTEND)
 	virtual NavErrorType Load( CUtlBuffer &fileBuffer, unsigned int version, unsigned int subVersion );		// (EXTEND)
 	virtual NavErrorType PostLoad( void );								// (EXTEND) invoked after all areas have been loaded - for pointer binding, etc
+	NavErrorType BindLadderConnections( void );						// convert loaded ladder IDs into pointers, once the ladders exist
+
+	void SaveCompiled( CNavCompiledBuilder &builder, NavCompiledArea_t *record ) const;	// flatten this area into a compiled nav image
+	NavErrorType LoadCompiled( const CNavCompiledImage &image, const NavCompiledArea_t &record, unsigned int subVersion );	// load and bind this area from a compiled nav image, all areas and hiding spots must exist already
+	virtual void SaveCompiledCustomData( CUtlBuffer &fileBuffer ) const { }							// (EXTEND) store derived class area data in a compiled nav image
+	virtual NavErrorType LoadCompiledCustomData( CUtlBuffer &fileBuffer, unsigned int subVersion ) { return NAV_OK; }	// (EXTEND) load derived class area data from a compiled nav image
 
 	virtual void SaveToSelectedSet( KeyValues *areaKey ) const;		// (EXTEND) saves attributes for the area to a KeyValues
 	virtual void RestoreFromSelectedSet( KeyValues *areaKey );		// (EXTEND) restores attributes from a KeyValues
@@ -485,6 +494,13 @@ public:
 
 	//- generation and analysis -------------------------------------------------------------------------
 	virtual void ComputeHidingSpots( void );					// analyze local area neighborhood to find "hiding spots" in this area - for map learning
+	struct HidingSpotCandidate_t
+	{
+		Vector pos;
+		int flags;
+	};
+	int FindHidingSpotCandidates( HidingSpotCandidate_t candidates[ NUM_CORNERS ] );	// the trace-only half of ComputeHidingSpots, safe to run on several areas at once
+	void CreateHidingSpots( const HidingSpotCandidate_t *candidates, int count );		// replaces this area's hiding spots with the given candidates
 	virtual void ComputeSniperSpots( void );					// analyze local area neighborhood to find "sniper spots" in this area - for map learning
 	virtual void ComputeSpotEncounters( void );					// compute spot encounter data - for map learning
 	virtual void ComputeEarliestOccupyTimes( void );
@@ -651,6 +667,7 @@ public:
 private:
 	friend class CNavMesh;
 	friend class CNavLadder;
+	friend class CNavVisBitSets;
 	friend class CCSNavArea;									// allow CS load code to complete replace our default load behavior
 
 	static bool m_isReset;										// if true, don't bother cleaning up in destructor since everything is going away
@@ -763,6 +780,7 @@ private:
 
 	uint32 m_nVisTestCounter;
 	static uint32 s_nCurrVisTestCounter;
+	int m_visBitIndex;											// index into the CNavVisBitSets windows, checked against the area on use
 
 	CUtlVector< CHandle< CFuncNavCost > > m_funcNavCostVector;	// active, overlapping cost entities
 };
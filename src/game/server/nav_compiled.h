@@ -0,0 +1,203 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Layout of compiled navigation mesh images
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_compiled.h
+// A compiled nav image (.navc) holds the same data as a .nav file, but as flat
+// little endian arrays with every reference stored as an array index. Loading
+// one is a single read followed by pointer fixups, with no per-field parsing
+// and no ID lookups.
+
+#ifndef _NAV_COMPILED_H_
+#define _NAV_COMPILED_H_
+
+#include "utlvector.h"
+#include "utlbuffer.h"
+#include "utlhashtable.h"
+
+#define NAV_COMPILED_MAGIC_NUMBER	(('C'<<24)|('V'<<16)|('A'<<8)|('N'))	// "NAVC" on disk
+
+/// IMPORTANT: Bump this whenever any of the structures below change.
+const unsigned int NavCompiledVersion = 2;
+
+const int NavCompiledLumpAlignment = 16;
+const int NavCompiledLadderDirections = 2;		// CNavLadder::NUM_LADDER_DIRECTIONS
+
+enum NavCompiledLumpType
+{
+	NAV_LUMP_AREAS = 0,				// NavCompiledArea_t, in TheNavAreas order
+	NAV_LUMP_CONNECTIONS,			// NavCompiledConnect_t
+	NAV_LUMP_HIDING_SPOTS,			// NavCompiledHidingSpot_t
+	NAV_LUMP_ENCOUNTERS,			// NavCompiledEncounter_t
+	NAV_LUMP_ENCOUNTER_SPOTS,		// NavCompiledSpotOrder_t
+	NAV_LUMP_LADDER_CONNECTIONS,	// unsigned int ladder IDs, bound once the ladders exist
+	NAV_LUMP_VISIBILITY,			// NavCompiledVisibility_t
+	NAV_LUMP_PLACES,				// NUL terminated place names, back to back
+	NAV_LUMP_AREA_CUSTOM,			// derived area data, see CNavArea::SaveCompiledCustomData
+	NAV_LUMP_MESH_CUSTOM_PRE_AREA,	// CNavMesh::SaveCustomDataPreArea stream
+	NAV_LUMP_MESH_CUSTOM,			// CNavMesh::SaveCustomData stream
+	NAV_LUMP_LADDERS,				// CNavLadder::Save stream
+
+	NAV_LUMP_COUNT
+};
+
+// Area, hiding spot and place references are "index + 1", so zero means none.
+// Ranges into the other lumps are (first element, element count).
+
+struct NavCompiledLump_t
+{
+	unsigned int offset;			// bytes from the start of the image
+	unsigned int size;				// in bytes
+};
+
+struct NavCompiledHeader_t
+{
+	unsigned int magic;
+	unsigned int version;			// NavCompiledVersion
+	unsigned int navVersion;		// .nav version of the data (NavCurrentVersion when compiled)
+	unsigned int subVersion;		// CNavMesh::GetSubVersionNumber() when compiled
+	unsigned int bspSize;			// size of the source bsp, same check as the .nav
+	unsigned int navSize;			// size of the .nav this was compiled from, to catch stale images
+	unsigned int navTime;			// and its modification time, for edits that keep the size
+	unsigned char isAnalyzed;
+	unsigned char pad[3];
+	NavCompiledLump_t lumps[ NAV_LUMP_COUNT ];
+};
+
+struct NavCompiledArea_t
+{
+	unsigned int id;
+	int attributeFlags;
+	float nwCorner[3];
+	float seCorner[3];
+	float neZ;
+	float swZ;
+	unsigned int connectStart[ NUM_DIRECTIONS ];
+	unsigned int connectCount[ NUM_DIRECTIONS ];
+	unsigned int hidingSpotStart;
+	unsigned int hidingSpotCount;
+	unsigned int encounterStart;
+	unsigned int encounterCount;
+	unsigned int ladderStart[ NavCompiledLadderDirections ];
+	unsigned int ladderCount[ NavCompiledLadderDirections ];
+	unsigned int visibleStart;
+	unsigned int visibleCount;
+	unsigned int inheritVisibilityFrom;		// area
+	unsigned int customStart;				// bytes into NAV_LUMP_AREA_CUSTOM
+	unsigned int customSize;
+	float earliestOccupyTime[ MAX_NAV_TEAMS ];
+	float lightIntensity[ NUM_CORNERS ];
+	unsigned short place;
+	unsigned short pad;
+};
+
+struct NavCompiledConnect_t
+{
+	unsigned int area;
+	float length;
+};
+
+struct NavCompiledHidingSpot_t
+{
+	unsigned int id;
+	float pos[3];
+	unsigned int area;				// area containing the spot, as HidingSpot::PostLoad would find it
+	unsigned char flags;
+	unsigned char pad[3];
+};
+
+struct NavCompiledEncounter_t
+{
+	unsigned int from;				// area
+	unsigned int to;				// area
+	unsigned char fromDir;
+	unsigned char toDir;
+	unsigned char pad[2];
+	float pathFrom[3];
+	float pathTo[3];
+	unsigned int spotStart;
+	unsigned int spotCount;
+};
+
+struct NavCompiledSpotOrder_t
+{
+	unsigned int spot;				// hiding spot
+	float t;
+};
+
+struct NavCompiledVisibility_t
+{
+	unsigned int area;
+	unsigned char attributes;
+	unsigned char pad[3];
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Typed view of a loaded image. Init() validates the header and lump bounds; the
+ * per-element ranges are checked by the code that follows them.
+ */
+class CNavCompiledImage
+{
+public:
+	CNavCompiledImage( void )
+	{
+		V_memset( this, 0, sizeof( *this ) );
+	}
+
+	bool Init( const void *data, unsigned int size );
+
+	const NavCompiledHeader_t *m_header;
+
+	const NavCompiledArea_t *m_areas;				unsigned int m_areaCount;
+	const NavCompiledConnect_t *m_connects;			unsigned int m_connectCount;
+	const NavCompiledHidingSpot_t *m_hidingSpots;	unsigned int m_hidingSpotCount;
+	const NavCompiledEncounter_t *m_encounters;		unsigned int m_encounterCount;
+	const NavCompiledSpotOrder_t *m_spotOrders;		unsigned int m_spotOrderCount;
+	const unsigned int *m_ladderIDs;				unsigned int m_ladderIDCount;
+	const NavCompiledVisibility_t *m_visibility;	unsigned int m_visibilityCount;
+
+	const Place *m_places;							unsigned int m_placeCount;
+
+	const unsigned char *GetLump( NavCompiledLumpType lump ) const	{ return (const unsigned char *)m_header + m_header->lumps[ lump ].offset; }
+	unsigned int GetLumpSize( NavCompiledLumpType lump ) const		{ return m_header->lumps[ lump ].size; }
+
+	// filled in by the loader as objects are created, indexed like the lumps
+	CNavArea **m_areaPointers;
+	HidingSpot **m_hidingSpotPointers;
+
+	CNavArea *GetArea( unsigned int ref ) const			{ return ( ref && ref <= m_areaCount ) ? m_areaPointers[ ref - 1 ] : NULL; }
+	Place GetPlace( unsigned int ref ) const			{ return ( ref && ref <= m_placeCount ) ? m_places[ ref - 1 ] : UNDEFINED_PLACE; }
+	HidingSpot *GetHidingSpot( unsigned int ref ) const	{ return ( ref && ref <= m_hidingSpotCount ) ? m_hidingSpotPointers[ ref - 1 ] : NULL; }
+	static bool IsRangeValid( unsigned int start, unsigned int count, unsigned int total )	{ return start <= total && count <= total - start; }
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Lumps being gathered while compiling the current mesh
+ */
+class CNavCompiledBuilder
+{
+public:
+	CUtlHashtable< const void *, unsigned int > m_areaRefs;			// area -> index + 1
+	CUtlHashtable< const void *, unsigned int > m_hidingSpotRefs;	// hiding spot -> index + 1
+
+	CUtlVector< NavCompiledArea_t > m_areas;
+	CUtlVector< NavCompiledConnect_t > m_connects;
+	CUtlVector< NavCompiledHidingSpot_t > m_hidingSpots;
+	CUtlVector< NavCompiledEncounter_t > m_encounters;
+	CUtlVector< NavCompiledSpotOrder_t > m_spotOrders;
+	CUtlVector< unsigned int > m_ladderIDs;
+	CUtlVector< NavCompiledVisibility_t > m_visibility;
+	CUtlBuffer m_areaCustom;
+
+	unsigned int GetAreaRef( const CNavArea *area ) const			{ return area ? m_areaRefs.Get( area, 0 ) : 0; }
+	unsigned int GetHidingSpotRef( const HidingSpot *spot ) const	{ return spot ? m_hidingSpotRefs.Get( spot, 0 ) : 0; }
+};
+
+#endif // _NAV_COMPILED_H_
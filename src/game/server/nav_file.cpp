@@ -11,6 +11,7 @@
 
 #include "cbase.h"
 #include "nav_mesh.h"
+#include "nav_compiled.h"
 #include "gamerules.h"
 #include "datacache/imdlcache.h"
 
@@ -38,6 +39,8 @@
 // TODO: Was changed from 15, update when latest 360 code is integrated (MSB 5/5/09)
 const int NavCurrentVersion = 16;
 
+ConVar nav_load_compiled( "nav_load_compiled", "1", FCVAR_GAMEDLL, "Load the map's compiled navigation image (.navc) instead of parsing the .nav when it is up to date." );
+
 //--------------------------------------------------------------------------------------------------------------
 //
 // The 'place directory' is used to save and load places from
@@ -176,9 +179,11 @@ PlaceDirectory placeDirectory;
 #if defined( _X360 )
 	#define FORMAT_BSPFILE "maps\\%s.360.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.360.nav"
+	#define FORMAT_NAVCFILE "maps\\%s.360.navc"
 #else
 	#define FORMAT_BSPFILE "maps\\%s.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.nav"
+	#define FORMAT_NAVCFILE "maps\\%s.navc"
 #endif
 
 //--------------------------------------------------------------------------------------------------------------
@@ -673,10 +678,9 @@ NavErrorType CNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, unsig
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Convert loaded IDs to pointers
- * Make sure all IDs are converted, even if corrupt data is encountered.
+ * Convert loaded ladder IDs to pointers
  */
-NavErrorType CNavArea::PostLoad( void )
+NavErrorType CNavArea::BindLadderConnections( void )
 {
 	NavErrorType error = NAV_OK;
 
@@ -701,6 +705,19 @@ NavErrorType CNavArea::PostLoad( void )
 		}
 	}
 
+	return error;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Convert loaded IDs to pointers
+ * Make sure all IDs are converted, even if corrupt data is encountered.
+ */
+NavErrorType CNavArea::PostLoad( void )
+{
+	NavErrorType error = BindLadderConnections();
+
 	// connect areas together
 	for( int d=0; d<NUM_DIRECTIONS; d++ )
 	{
@@ -793,6 +810,283 @@ NavErrorType CNavArea::PostLoad( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Flatten this area into the compiled image being built. References to other areas and
+ * hiding spots become their index in the image, so loading needs no ID lookups.
+ */
+void CNavArea::SaveCompiled( CNavCompiledBuilder &builder, NavCompiledArea_t *record ) const
+{
+	V_memset( record, 0, sizeof( *record ) );
+
+	record->id = m_id;
+	record->attributeFlags = m_attributeFlags;
+	V_memcpy( record->nwCorner, m_nwCorner.Base(), sizeof( record->nwCorner ) );
+	V_memcpy( record->seCorner, m_seCorner.Base(), sizeof( record->seCorner ) );
+	record->neZ = m_neZ;
+	record->swZ = m_swZ;
+
+	for( int d=0; d<NUM_DIRECTIONS; d++ )
+	{
+		record->connectStart[d] = builder.m_connects.Count();
+
+		FOR_EACH_VEC( m_connect[d], it )
+		{
+			const CNavArea *area = m_connect[d][ it ].area;
+			unsigned int ref = builder.GetAreaRef( area );
+
+			// don't allow self-referential connections
+			if ( ref == 0 || area == this )
+				continue;
+
+			NavCompiledConnect_t &connect = builder.m_connects[ builder.m_connects.AddToTail() ];
+			connect.area = ref;
+			connect.length = ( area->GetCenter() - GetCenter() ).Length();
+		}
+
+		record->connectCount[d] = builder.m_connects.Count() - record->connectStart[d];
+	}
+
+	// the mesh numbered every hiding spot in area order, so ours are contiguous
+	record->hidingSpotStart = builder.m_hidingSpots.Count();
+	FOR_EACH_VEC( m_hidingSpots, hit )
+	{
+		const HidingSpot *spot = m_hidingSpots[ hit ];
+		Assert( builder.GetHidingSpotRef( spot ) == (unsigned int)builder.m_hidingSpots.Count() + 1 );
+
+		NavCompiledHidingSpot_t &out = builder.m_hidingSpots[ builder.m_hidingSpots.AddToTail() ];
+		V_memset( &out, 0, sizeof( out ) );
+		out.id = spot->GetID();
+		V_memcpy( out.pos, spot->GetPosition().Base(), sizeof( out.pos ) );
+		out.area = builder.GetAreaRef( spot->GetArea() );
+		out.flags = (unsigned char)spot->GetFlags();
+	}
+	record->hidingSpotCount = builder.m_hidingSpots.Count() - record->hidingSpotStart;
+
+	record->encounterStart = builder.m_encounters.Count();
+	FOR_EACH_VEC( m_spotEncounters, it )
+	{
+		const SpotEncounter *e = m_spotEncounters[ it ];
+
+		NavCompiledEncounter_t &out = builder.m_encounters[ builder.m_encounters.AddToTail() ];
+		V_memset( &out, 0, sizeof( out ) );
+		out.from = builder.GetAreaRef( e->from.area );
+		out.to = builder.GetAreaRef( e->to.area );
+		out.fromDir = (unsigned char)e->fromDir;
+		out.toDir = (unsigned char)e->toDir;
+		V_memcpy( out.pathFrom, e->path.from.Base(), sizeof( out.pathFrom ) );
+		V_memcpy( out.pathTo, e->path.to.Base(), sizeof( out.pathTo ) );
+
+		out.spotStart = builder.m_spotOrders.Count();
+		FOR_EACH_VEC( e->spots, sit )
+		{
+			NavCompiledSpotOrder_t &order = builder.m_spotOrders[ builder.m_spotOrders.AddToTail() ];
+			order.spot = builder.GetHidingSpotRef( e->spots[ sit ].spot );
+			order.t = e->spots[ sit ].t;
+		}
+		out.spotCount = builder.m_spotOrders.Count() - out.spotStart;
+	}
+	record->encounterCount = builder.m_encounters.Count() - record->encounterStart;
+
+	record->place = placeDirectory.GetIndex( GetPlace() );
+
+	COMPILE_TIME_ASSERT( NavCompiledLadderDirections == CNavLadder::NUM_LADDER_DIRECTIONS );
+	for ( int i=0; i<CNavLadder::NUM_LADDER_DIRECTIONS; ++i )
+	{
+		record->ladderStart[i] = builder.m_ladderIDs.Count();
+		FOR_EACH_VEC( m_ladder[i], it )
+		{
+			builder.m_ladderIDs.AddToTail( m_ladder[i][ it ].ladder->GetID() );
+		}
+		record->ladderCount[i] = builder.m_ladderIDs.Count() - record->ladderStart[i];
+	}
+
+	V_memcpy( record->earliestOccupyTime, m_earliestOccupyTime, sizeof( record->earliestOccupyTime ) );
+	V_memcpy( record->lightIntensity, m_lightIntensity, sizeof( record->lightIntensity ) );
+
+	record->visibleStart = builder.m_visibility.Count();
+	for ( int vit=0; vit<m_potentiallyVisibleAreas.Count(); ++vit )
+	{
+		unsigned int ref = builder.GetAreaRef( m_potentiallyVisibleAreas[ vit ].area );
+		if ( ref == 0 )
+			continue;
+
+		NavCompiledVisibility_t &info = builder.m_visibility[ builder.m_visibility.AddToTail() ];
+		V_memset( &info, 0, sizeof( info ) );
+		info.area = ref;
+		info.attributes = m_potentiallyVisibleAreas[ vit ].attributes;
+	}
+	record->visibleCount = builder.m_visibility.Count() - record->visibleStart;
+	record->inheritVisibilityFrom = builder.GetAreaRef( m_inheritVisibilityFrom.area );
+
+	record->customStart = builder.m_areaCustom.TellPut();
+	SaveCompiledCustomData( builder.m_areaCustom );
+	record->customSize = builder.m_areaCustom.TellPut() - record->customStart;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load a navigation area from a compiled image. Every area and hiding spot in the image has
+ * already been created, so references are bound directly instead of going through PostLoad().
+ */
+NavErrorType CNavArea::LoadCompiled( const CNavCompiledImage &image, const NavCompiledArea_t &record, unsigned int subVersion )
+{
+	m_id = record.id;
+
+	// update nextID to avoid collisions
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+
+	m_attributeFlags = record.attributeFlags;
+
+	m_nwCorner.Init( record.nwCorner[0], record.nwCorner[1], record.nwCorner[2] );
+	m_seCorner.Init( record.seCorner[0], record.seCorner[1], record.seCorner[2] );
+
+	m_center.x = (m_nwCorner.x + m_seCorner.x)/2.0f;
+	m_center.y = (m_nwCorner.y + m_seCorner.y)/2.0f;
+	m_center.z = (m_nwCorner.z + m_seCorner.z)/2.0f;
+
+	if ( ( m_seCorner.x - m_nwCorner.x ) > 0.0f && ( m_seCorner.y - m_nwCorner.y ) > 0.0f )
+	{
+		m_invDxCorners = 1.0f / ( m_seCorner.x - m_nwCorner.x );
+		m_invDyCorners = 1.0f / ( m_seCorner.y - m_nwCorner.y );
+	}
+	else
+	{
+		m_invDxCorners = m_invDyCorners = 0;
+
+		DevWarning( "Degenerate Navigation Area #%d at setpos %g %g %g\n", 
+			m_id, m_center.x, m_center.y, m_center.z );
+	}
+
+	m_neZ = record.neZ;
+	m_swZ = record.swZ;
+
+	CheckWaterLevel();
+
+	for( int d=0; d<NUM_DIRECTIONS; d++ )
+	{
+		if ( !CNavCompiledImage::IsRangeValid( record.connectStart[d], record.connectCount[d], image.m_connectCount ) )
+			return NAV_CORRUPT_DATA;
+
+		m_connect[d].EnsureCapacity( record.connectCount[d] );
+		for( unsigned int i=0; i<record.connectCount[d]; ++i )
+		{
+			const NavCompiledConnect_t &in = image.m_connects[ record.connectStart[d] + i ];
+
+			NavConnect connect;
+			connect.area = image.GetArea( in.area );
+			if ( connect.area == NULL )
+				return NAV_CORRUPT_DATA;
+
+			connect.length = in.length;
+			m_connect[d].AddToTail( connect );
+		}
+	}
+
+	if ( !CNavCompiledImage::IsRangeValid( record.hidingSpotStart, record.hidingSpotCount, image.m_hidingSpotCount ) )
+		return NAV_CORRUPT_DATA;
+
+	m_hidingSpots.EnsureCapacity( record.hidingSpotCount );
+	for( unsigned int h=0; h<record.hidingSpotCount; ++h )
+	{
+		m_hidingSpots.AddToTail( image.m_hidingSpotPointers[ record.hidingSpotStart + h ] );
+	}
+
+	if ( !CNavCompiledImage::IsRangeValid( record.encounterStart, record.encounterCount, image.m_encounterCount ) )
+		return NAV_CORRUPT_DATA;
+
+	m_spotEncounters.EnsureCapacity( record.encounterCount );
+	for( unsigned int e=0; e<record.encounterCount; ++e )
+	{
+		const NavCompiledEncounter_t &in = image.m_encounters[ record.encounterStart + e ];
+		if ( !CNavCompiledImage::IsRangeValid( in.spotStart, in.spotCount, image.m_spotOrderCount ) )
+			return NAV_CORRUPT_DATA;
+
+		// same as PostLoad, an encounter has to run between two real areas
+		if ( image.GetArea( in.from ) == NULL || image.GetArea( in.to ) == NULL )
+		{
+			Msg( "CNavArea::LoadCompiled: Corrupt navigation data. Missing Navigation Area for Encounter Spot.\n" );
+			return NAV_CORRUPT_DATA;
+		}
+
+		SpotEncounter *encounter = new SpotEncounter;
+		encounter->from.area = image.GetArea( in.from );
+		encounter->fromDir = static_cast<NavDirType>( in.fromDir );
+		encounter->to.area = image.GetArea( in.to );
+		encounter->toDir = static_cast<NavDirType>( in.toDir );
+		encounter->path.from.Init( in.pathFrom[0], in.pathFrom[1], in.pathFrom[2] );
+		encounter->path.to.Init( in.pathTo[0], in.pathTo[1], in.pathTo[2] );
+
+		encounter->spots.EnsureCapacity( in.spotCount );
+		for( unsigned int s=0; s<in.spotCount; ++s )
+		{
+			const NavCompiledSpotOrder_t &inOrder = image.m_spotOrders[ in.spotStart + s ];
+
+			SpotOrder order;
+			order.spot = image.GetHidingSpot( inOrder.spot );
+			order.t = inOrder.t;
+			encounter->spots.AddToTail( order );
+		}
+
+		m_spotEncounters.AddToTail( encounter );
+	}
+
+	SetPlace( image.GetPlace( record.place ) );
+
+	// ladders don't exist yet, keep the IDs for BindLadderConnections()
+	for ( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+	{
+		if ( !CNavCompiledImage::IsRangeValid( record.ladderStart[dir], record.ladderCount[dir], image.m_ladderIDCount ) )
+			return NAV_CORRUPT_DATA;
+
+		m_ladder[dir].EnsureCapacity( record.ladderCount[dir] );
+		for( unsigned int i=0; i<record.ladderCount[dir]; ++i )
+		{
+			NavLadderConnect connect;
+			connect.id = image.m_ladderIDs[ record.ladderStart[dir] + i ];
+			m_ladder[dir].AddToTail( connect );
+		}
+	}
+
+	V_memcpy( m_earliestOccupyTime, record.earliestOccupyTime, sizeof( m_earliestOccupyTime ) );
+	V_memcpy( m_lightIntensity, record.lightIntensity, sizeof( m_lightIntensity ) );
+
+	if ( !CNavCompiledImage::IsRangeValid( record.visibleStart, record.visibleCount, image.m_visibilityCount ) )
+		return NAV_CORRUPT_DATA;
+
+	m_potentiallyVisibleAreas.EnsureCapacity( record.visibleCount );
+	for( unsigned int j=0; j<record.visibleCount; ++j )
+	{
+		const NavCompiledVisibility_t &in = image.m_visibility[ record.visibleStart + j ];
+
+		AreaBindInfo info;
+		info.area = image.GetArea( in.area );
+		info.attributes = in.attributes;
+		if ( info.area == NULL )
+		{
+			Warning( "Invalid area in visible set for area #%d\n", GetID() );
+			continue;
+		}
+
+		m_potentiallyVisibleAreas.AddToTail( info );
+	}
+
+	m_inheritVisibilityFrom.area = image.GetArea( record.inheritVisibilityFrom );
+	Assert( m_inheritVisibilityFrom.area != this );
+
+	// func avoid/prefer attributes are controlled by func_nav_cost entities
+	ClearAllNavCostEntities();
+
+	if ( !CNavCompiledImage::IsRangeValid( record.customStart, record.customSize, image.GetLumpSize( NAV_LUMP_AREA_CUSTOM ) ) )
+		return NAV_CORRUPT_DATA;
+
+	CUtlBuffer customBuffer( image.GetLump( NAV_LUMP_AREA_CUSTOM ) + record.customStart, record.customSize, CUtlBuffer::READ_ONLY );
+	return LoadCompiledCustomData( customBuffer, subVersion );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Compute travel distance along shortest path from startPos to goalPos. 
@@ -993,6 +1287,22 @@ const char *CNavMesh::GetFilename( void ) const
 	return filename;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the filename for this map's compiled "nav map" image
+ */
+const char *CNavMesh::GetCompiledFilename( void ) const
+{
+	char gamePath[256];
+	engine->GetGameDir( gamePath, 256 );
+
+	// persistant return value
+	static char filename[256];
+	Q_snprintf( filename, sizeof( filename ), "%s\\" FORMAT_NAVCFILE, gamePath, STRING( gpGlobals->mapname ) );
+
+	return filename;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /*
 ============
@@ -1194,6 +1504,14 @@ bool CNavMesh::Save( void ) const
 	unsigned int navSize = filesystem->Size( filename );
 	DevMsg( "Size of nav file '%s' is %u bytes.\n", filename, navSize );
 
+	// keep an existing compiled image in step with the .nav, otherwise it would be ignored as stale
+	char compiledFilename[256];
+	Q_snprintf( compiledFilename, sizeof( compiledFilename ), FORMAT_NAVCFILE, STRING( gpGlobals->mapname ) );
+	if ( filesystem->FileExists( compiledFilename, "MOD" ) )
+	{
+		SaveCompiled();
+	}
+
 	return true;
 }
 
@@ -1406,6 +1724,24 @@ NavErrorType CNavMesh::Load( void )
 
 	CNavArea::m_nextID = 1;
 
+	if ( nav_load_compiled.GetBool() && !IsX360() )
+	{
+		NavErrorType compiledResult = LoadCompiled();
+		if ( compiledResult == NAV_OK )
+		{
+			return NAV_OK;
+		}
+
+		if ( compiledResult != NAV_CANT_ACCESS_FILE )
+		{
+			// fall back to the .nav, starting over from an empty mesh
+			Reset();
+			placeDirectory.Reset();
+			CNavVectorNoEditAllocator::Reset();
+			CNavArea::m_nextID = 1;
+		}
+	}
+
 	// nav filename is derived from map filename
 	char filename[256];
 	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
@@ -1648,6 +1984,19 @@ NavErrorType CNavMesh::PostLoad( unsigned int version )
 		}
 	}
 
+	return PostLoadMesh();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Mesh-wide setup once every area has been loaded and bound
+ */
+NavErrorType CNavMesh::PostLoadMesh( void )
+{
+	// visibility lists were just bound
+	m_visBitSets.Invalidate();
+
 	ComputeBattlefrontAreas();
 	
 	//
@@ -1716,3 +2065,377 @@ NavErrorType CNavMesh::PostLoad( unsigned int version )
 	
 	return NAV_OK;
 }
+
+
+//--------------------------------------------------------------------------------------------------------------
+template < typename T >
+static bool GetNavCompiledLump( const CNavCompiledImage &image, NavCompiledLumpType lump, const T **data, unsigned int *count )
+{
+	if ( image.GetLumpSize( lump ) % sizeof( T ) )
+		return false;
+
+	*data = (const T *)image.GetLump( lump );
+	*count = image.GetLumpSize( lump ) / sizeof( T );
+	return true;
+}
+
+/**
+ * Point into a compiled image held in memory. Returns false if it isn't one, or is damaged.
+ */
+bool CNavCompiledImage::Init( const void *data, unsigned int size )
+{
+	if ( data == NULL || size < sizeof( NavCompiledHeader_t ) )
+		return false;
+
+	m_header = (const NavCompiledHeader_t *)data;
+	if ( m_header->magic != NAV_COMPILED_MAGIC_NUMBER || m_header->version != NavCompiledVersion )
+		return false;
+
+	for ( int i=0; i<NAV_LUMP_COUNT; ++i )
+	{
+		const NavCompiledLump_t &lump = m_header->lumps[i];
+		if ( ( lump.offset % NavCompiledLumpAlignment ) != 0 || !IsRangeValid( lump.offset, lump.size, size ) )
+			return false;
+	}
+
+	return GetNavCompiledLump( *this, NAV_LUMP_AREAS, &m_areas, &m_areaCount ) &&
+		GetNavCompiledLump( *this, NAV_LUMP_CONNECTIONS, &m_connects, &m_connectCount ) &&
+		GetNavCompiledLump( *this, NAV_LUMP_HIDING_SPOTS, &m_hidingSpots, &m_hidingSpotCount ) &&
+		GetNavCompiledLump( *this, NAV_LUMP_ENCOUNTERS, &m_encounters, &m_encounterCount ) &&
+		GetNavCompiledLump( *this, NAV_LUMP_ENCOUNTER_SPOTS, &m_spotOrders, &m_spotOrderCount ) &&
+		GetNavCompiledLump( *this, NAV_LUMP_LADDER_CONNECTIONS, &m_ladderIDs, &m_ladderIDCount ) &&
+		GetNavCompiledLump( *this, NAV_LUMP_VISIBILITY, &m_visibility, &m_visibilityCount );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static void PutNavCompiledLump( CUtlBuffer &fileBuffer, NavCompiledHeader_t *header, NavCompiledLumpType lump, const void *data, int size )
+{
+	while ( fileBuffer.TellPut() % NavCompiledLumpAlignment )
+	{
+		fileBuffer.PutUnsignedChar( 0 );
+	}
+
+	header->lumps[ lump ].offset = fileBuffer.TellPut();
+	header->lumps[ lump ].size = size;
+
+	if ( size > 0 )
+	{
+		fileBuffer.Put( data, size );
+	}
+}
+
+template < typename T >
+static void PutNavCompiledLump( CUtlBuffer &fileBuffer, NavCompiledHeader_t *header, NavCompiledLumpType lump, const CUtlVector< T > &data )
+{
+	PutNavCompiledLump( fileBuffer, header, lump, data.Base(), data.Count() * sizeof( T ) );
+}
+
+static void PutNavCompiledLump( CUtlBuffer &fileBuffer, NavCompiledHeader_t *header, NavCompiledLumpType lump, const CUtlBuffer &data )
+{
+	PutNavCompiledLump( fileBuffer, header, lump, data.Base(), data.TellPut() );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store Navigation Mesh as a compiled image (see nav_compiled.h)
+ */
+bool CNavMesh::SaveCompiled( void ) const
+{
+	if ( IsX360() )
+		return false;
+
+	const char *filename = GetCompiledFilename();
+	COM_FixSlashes( const_cast<char *>(filename) );
+
+	CNavCompiledBuilder builder;
+
+	placeDirectory.Reset();
+	FOR_EACH_VEC( TheNavAreas, nit )
+	{
+		placeDirectory.AddPlace( TheNavAreas[ nit ]->GetPlace() );
+	}
+
+	// number everything up front, so areas can refer forward
+	unsigned int spotRef = 0;
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea *area = TheNavAreas[ it ];
+		builder.m_areaRefs.Insert( area, it + 1 );
+
+		FOR_EACH_VEC( *area->GetHidingSpots(), hit )
+		{
+			builder.m_hidingSpotRefs.Insert( (*area->GetHidingSpots())[ hit ], ++spotRef );
+		}
+	}
+
+	builder.m_areas.SetCount( TheNavAreas.Count() );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		TheNavAreas[ it ]->SaveCompiled( builder, &builder.m_areas[ it ] );
+	}
+
+	CUtlBuffer places;
+	const CUtlVector< Place > *placeList = placeDirectory.GetPlaces();
+	FOR_EACH_VEC( *placeList, pit )
+	{
+		const char *placeName = PlaceToName( (*placeList)[ pit ] );
+		places.Put( placeName, V_strlen( placeName ) + 1 );
+	}
+
+	CUtlBuffer customPreArea;
+	SaveCustomDataPreArea( customPreArea );
+
+	CUtlBuffer custom;
+	SaveCustomData( custom );
+
+	CUtlBuffer ladders;
+	ladders.PutUnsignedInt( m_ladders.Count() );
+	for ( int i=0; i<m_ladders.Count(); ++i )
+	{
+		m_ladders[i]->Save( ladders, NavCurrentVersion );
+	}
+
+	char navFilename[256];
+	Q_snprintf( navFilename, sizeof( navFilename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
+
+	NavCompiledHeader_t header;
+	V_memset( &header, 0, sizeof( header ) );
+	header.magic = NAV_COMPILED_MAGIC_NUMBER;
+	header.version = NavCompiledVersion;
+	header.navVersion = NavCurrentVersion;
+	header.subVersion = GetSubVersionNumber();
+	header.bspSize = filesystem->Size( GetBspFilename( navFilename ) );
+	header.navSize = filesystem->FileExists( navFilename, "GAME" ) ? filesystem->Size( navFilename, "GAME" ) : 0;
+	header.navTime = header.navSize ? (unsigned int)filesystem->GetFileTime( navFilename, "GAME" ) : 0;
+	header.isAnalyzed = m_isAnalyzed;
+
+	CUtlBuffer fileBuffer( 4096, 1024*1024 );
+	fileBuffer.Put( &header, sizeof( header ) );
+
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_AREAS, builder.m_areas );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_CONNECTIONS, builder.m_connects );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_HIDING_SPOTS, builder.m_hidingSpots );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_ENCOUNTERS, builder.m_encounters );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_ENCOUNTER_SPOTS, builder.m_spotOrders );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_LADDER_CONNECTIONS, builder.m_ladderIDs );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_VISIBILITY, builder.m_visibility );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_PLACES, places );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_AREA_CUSTOM, builder.m_areaCustom );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_MESH_CUSTOM_PRE_AREA, customPreArea );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_MESH_CUSTOM, custom );
+	PutNavCompiledLump( fileBuffer, &header, NAV_LUMP_LADDERS, ladders );
+
+	V_memcpy( fileBuffer.Base(), &header, sizeof( header ) );
+
+	if ( !filesystem->WriteFile( filename, "MOD", fileBuffer ) )
+	{
+		Warning( "Unable to save %d bytes to %s\n", fileBuffer.Size(), filename );
+		return false;
+	}
+
+	DevMsg( "Size of compiled nav file '%s' is %u bytes.\n", filename, fileBuffer.TellPut() );
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load this map's compiled image. The whole file is read at once and everything in it is
+ * addressed by index, so there is no parsing and no ID lookup. Returns NAV_CANT_ACCESS_FILE
+ * if there is no image, and any other error if the image can't be used and the .nav should
+ * be loaded instead.
+ */
+NavErrorType CNavMesh::LoadCompiled( void )
+{
+	char filename[256];
+	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVCFILE, STRING( gpGlobals->mapname ) );
+
+	bool navIsInBsp = false;
+	CUtlBuffer fileBuffer( 0, 0, CUtlBuffer::READ_ONLY );
+	if ( !filesystem->ReadFile( filename, "GAME", fileBuffer ) )
+	{
+		navIsInBsp = true;
+		if ( !filesystem->ReadFile( filename, "BSP", fileBuffer ) )
+		{
+			return NAV_CANT_ACCESS_FILE;
+		}
+	}
+
+	CNavCompiledImage image;
+	if ( !image.Init( fileBuffer.Base(), fileBuffer.TellPut() ) )
+	{
+		Msg( "Invalid compiled navigation file '%s'.\n", filename );
+		return NAV_INVALID_FILE;
+	}
+
+	const NavCompiledHeader_t *header = image.m_header;
+	if ( header->navVersion > NavCurrentVersion || header->subVersion != GetSubVersionNumber() )
+	{
+		DevMsg( "Compiled navigation file '%s' is from another version, loading the .nav instead.\n", filename );
+		return NAV_BAD_FILE_VERSION;
+	}
+
+	// a .nav sitting next to the image has to be the one it was compiled from
+	char navFilename[256];
+	Q_snprintf( navFilename, sizeof( navFilename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
+	if ( filesystem->FileExists( navFilename, "GAME" ) &&
+		 ( filesystem->Size( navFilename, "GAME" ) != header->navSize || (unsigned int)filesystem->GetFileTime( navFilename, "GAME" ) != header->navTime ) )
+	{
+		DevMsg( "Compiled navigation file '%s' is older than '%s', loading the .nav instead.\n", filename, navFilename );
+		return NAV_BAD_FILE_VERSION;
+	}
+
+	// verify the bsp hasn't changed
+	if ( filesystem->Size( GetBspFilename( navFilename ) ) != header->bspSize && !navIsInBsp )
+	{
+		if ( engine->IsDedicatedServer() )
+		{
+			// Warning doesn't print to the dedicated server console, so we'll use Msg instead
+			DevMsg( "The Navigation Mesh was built using a different version of this map.\n" );
+		}
+		else
+		{
+			DevWarning( "The Navigation Mesh was built using a different version of this map.\n" );
+		}
+		m_isOutOfDate = true;
+	}
+
+	m_isAnalyzed = header->isAnalyzed != 0;
+
+	CUtlVector< Place > places;
+	const char *placeName = (const char *)image.GetLump( NAV_LUMP_PLACES );
+	const char *placeEnd = placeName + image.GetLumpSize( NAV_LUMP_PLACES );
+	while ( placeName < placeEnd )
+	{
+		const char *terminator = (const char *)memchr( placeName, 0, placeEnd - placeName );
+		if ( terminator == NULL )
+			return NAV_CORRUPT_DATA;
+
+		Place place = NameToPlace( placeName );
+		if ( place == UNDEFINED_PLACE )
+		{
+			Warning( "Warning: NavMesh place %s is undefined?\n", placeName );
+		}
+		places.AddToTail( place );
+
+		placeName = terminator + 1;
+	}
+	image.m_places = places.Base();
+	image.m_placeCount = places.Count();
+
+	CUtlBuffer customPreArea( image.GetLump( NAV_LUMP_MESH_CUSTOM_PRE_AREA ), image.GetLumpSize( NAV_LUMP_MESH_CUSTOM_PRE_AREA ), CUtlBuffer::READ_ONLY );
+	LoadCustomDataPreArea( customPreArea, header->subVersion );
+
+	if ( image.m_areaCount == 0 )
+	{
+		return NAV_INVALID_FILE;
+	}
+
+	// create every area and hiding spot first, so references are just array lookups
+	PreLoadAreas( image.m_areaCount );
+
+	CUtlVector< CNavArea * > areas;
+	areas.SetCount( image.m_areaCount );
+	TheNavAreas.EnsureCapacity( image.m_areaCount );
+	FOR_EACH_VEC( areas, it )
+	{
+		areas[ it ] = CreateArea();
+		TheNavAreas.AddToTail( areas[ it ] );
+	}
+	image.m_areaPointers = areas.Base();
+
+	CUtlVector< HidingSpot * > spots;
+	spots.SetCount( image.m_hidingSpotCount );
+	FOR_EACH_VEC( spots, it )
+	{
+		const NavCompiledHidingSpot_t &in = image.m_hidingSpots[ it ];
+
+		HidingSpot *spot = CreateHidingSpot();
+		spot->m_id = in.id;
+		spot->m_pos.Init( in.pos[0], in.pos[1], in.pos[2] );
+		spot->m_flags = in.flags;
+		spot->m_area = image.GetArea( in.area );
+
+		// update next ID to avoid ID collisions by later spots
+		if ( spot->m_id >= HidingSpot::m_nextID )
+			HidingSpot::m_nextID = spot->m_id + 1;
+
+		spots[ it ] = spot;
+	}
+	image.m_hidingSpotPointers = spots.Base();
+
+	Extent extent;
+	extent.lo.x = 9999999999.9f;
+	extent.lo.y = 9999999999.9f;
+	extent.hi.x = -9999999999.9f;
+	extent.hi.y = -9999999999.9f;
+
+	Extent areaExtent;
+	FOR_EACH_VEC( areas, it )
+	{
+		CNavArea *area = areas[ it ];
+		NavErrorType error = area->LoadCompiled( image, image.m_areas[ it ], header->subVersion );
+		if ( error != NAV_OK )
+		{
+			Msg( "Corrupt compiled navigation file '%s'.\n", filename );
+			return error;
+		}
+
+		area->GetExtent( &areaExtent );
+
+		if (areaExtent.lo.x < extent.lo.x)
+			extent.lo.x = areaExtent.lo.x;
+		if (areaExtent.lo.y < extent.lo.y)
+			extent.lo.y = areaExtent.lo.y;
+		if (areaExtent.hi.x > extent.hi.x)
+			extent.hi.x = areaExtent.hi.x;
+		if (areaExtent.hi.y > extent.hi.y)
+			extent.hi.y = areaExtent.hi.y;
+	}
+
+	// add the areas to the grid
+	AllocateGrid( extent.lo.x, extent.hi.x, extent.lo.y, extent.hi.y );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		AddNavArea( TheNavAreas[ it ] );
+	}
+
+	//
+	// Set up all the ladders
+	//
+
+#ifdef TERROR
+	CUtlBuffer ladderBuffer( image.GetLump( NAV_LUMP_LADDERS ), image.GetLumpSize( NAV_LUMP_LADDERS ), CUtlBuffer::READ_ONLY );
+	unsigned int ladderCount = ladderBuffer.GetUnsignedInt();
+	m_ladders.EnsureCapacity( ladderCount );
+	for( unsigned int i=0; i<ladderCount && ladderBuffer.IsValid(); ++i )
+	{
+		CNavLadder *ladder = new CNavLadder;
+		ladder->Load( ladderBuffer, header->navVersion );
+		m_ladders.AddToTail( ladder );
+	}
+#elif defined( OF_DLL )
+	BuildLadders();
+#endif
+
+	// mark stairways (TODO: this can be removed once all maps are re-saved with this attribute in them)
+	MarkStairAreas();
+
+	CUtlBuffer custom( image.GetLump( NAV_LUMP_MESH_CUSTOM ), image.GetLumpSize( NAV_LUMP_MESH_CUSTOM ), CUtlBuffer::READ_ONLY );
+	LoadCustomData( custom, header->subVersion );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		TheNavAreas[ it ]->BindLadderConnections();
+	}
+
+	NavErrorType loadResult = PostLoadMesh();
+
+	WarnIfMeshNeedsAnalysis( header->navVersion );
+
+	return loadResult;
+}
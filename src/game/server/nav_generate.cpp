@@ -17,6 +17,7 @@
 #include "viewport_panel_names.h"
 //#include "terror/TerrorShared.h"
 #include "fmtstr.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TERROR
 #include "func_simpleladder.h"
@@ -42,6 +43,8 @@ ConVar nav_generate_fixup_jump_areas( "nav_generate_fixup_jump_areas", "1", FCVA
 ConVar nav_generate_incremental_range( "nav_generate_incremental_range", "2000", FCVAR_CHEAT );
 ConVar nav_generate_incremental_tolerance( "nav_generate_incremental_tolerance", "0", FCVAR_CHEAT, "Z tolerance for adding new nav areas." );
 ConVar nav_area_max_size( "nav_area_max_size", "50", FCVAR_CHEAT, "Max area size created in nav generation" );
+ConVar nav_generate_threads( "nav_generate_threads", "1", FCVAR_CHEAT, "Threads used to trace walkable space during nav generation. 1 runs the original depth-first sampling on the main thread. 0 (every core) or more than 1 samples breadth-first across threads, which is faster but can lay out a somewhat different mesh." );
+ConVar nav_analyze_threads( "nav_analyze_threads", "0", FCVAR_CHEAT, "Threads used for per-area nav analysis steps. 0 uses every core, 1 runs the time-sliced analysis on the main thread." );
 
 // Common bounding box for traces
 Vector NavTraceMins( -0.45, -0.45, 0 );
@@ -3463,6 +3466,7 @@ void CNavMesh::BeginGeneration( bool incremental )
 
 	// the system will see this NULL and select the next walkable seed
 	m_currentNode = NULL;
+	m_sampleFrontier.RemoveAll();
 
 	// if there are no seed points, we can't generate
 	if (m_walkableSeeds.Count() == 0)
@@ -3627,6 +3631,116 @@ static void HideAnalysisProgress( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+// Parallel analysis. Traces are read-only while analyzing, so the per-area steps that only write to
+// their own area are spread across the thread pool. Anything that creates shared objects (hiding
+// spots get mesh-wide IDs) is done afterwards on the main thread in area order, so the results
+// match a serial analysis exactly.
+//--------------------------------------------------------------------------------------------------------------
+static int GetNavAnalyzeMaxParallel( void )
+{
+	int threads = nav_analyze_threads.GetInt();
+	return ( threads <= 0 ) ? INT_MAX : threads;
+}
+
+struct NavHidingSpotJob_t
+{
+	CNavArea *area;
+	int count;
+	CNavArea::HidingSpotCandidate_t candidates[ NUM_CORNERS ];
+};
+
+static void FindHidingSpotCandidatesJob( NavHidingSpotJob_t &job )
+{
+	job.count = job.area->FindHidingSpotCandidates( job.candidates );
+}
+
+static void ComputeSpotEncountersJob( CNavArea *&area )
+{
+	area->ComputeSpotEncounters();
+}
+
+static void ComputeSniperSpotsJob( CNavArea *&area )
+{
+	area->ComputeSniperSpots();
+}
+
+static void FindHidingSpotCandidatesParallel( CUtlVector< NavHidingSpotJob_t > &jobs, int maxParallel )
+{
+	jobs.SetCount( TheNavAreas.Count() );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		jobs[ it ].area = TheNavAreas[ it ];
+		jobs[ it ].count = 0;
+	}
+
+	ParallelProcess( "CNavArea::FindHidingSpotCandidates", jobs.Base(), jobs.Count(), &FindHidingSpotCandidatesJob, NULL, NULL, maxParallel );
+}
+
+static void ComputeHidingSpotsParallel( int maxParallel )
+{
+	CUtlVector< NavHidingSpotJob_t > jobs;
+	FindHidingSpotCandidatesParallel( jobs, maxParallel );
+
+	FOR_EACH_VEC( jobs, it )
+	{
+		jobs[ it ].area->CreateHidingSpots( jobs[ it ].candidates, jobs[ it ].count );
+	}
+}
+
+static void ComputeSpotEncountersParallel( int maxParallel )
+{
+	ParallelProcess( "CNavArea::ComputeSpotEncounters", TheNavAreas.Base(), TheNavAreas.Count(), &ComputeSpotEncountersJob, NULL, NULL, maxParallel );
+}
+
+static void ComputeSniperSpotsParallel( int maxParallel )
+{
+	ParallelProcess( "CNavArea::ComputeSniperSpots", TheNavAreas.Base(), TheNavAreas.Count(), &ComputeSniperSpotsJob, NULL, NULL, maxParallel );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_analyze_benchmark, "Times the parallel analysis steps on the current mesh with 1, 2, 4... threads. Optional argument is the most threads to try (default: every core).", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( !TheNavAreas.Count() )
+	{
+		Msg( "nav_analyze_benchmark: no navigation mesh loaded\n" );
+		return;
+	}
+
+	int maxThreads = ( args.ArgC() > 1 ) ? atoi( args[1] ) : GetCPUInformation()->m_nLogicalProcessors;
+	maxThreads = MAX( maxThreads, 1 );
+
+	Msg( "nav_analyze_benchmark: %d areas, %d hiding spots\n", TheNavAreas.Count(), TheHidingSpots.Count() );
+	Msg( "threads  hiding   encounter  sniper   total\n" );
+
+	// The candidate search leaves the mesh untouched, and the other steps recompute what's already there
+	CUtlVector< NavHidingSpotJob_t > jobs;
+	for ( int threads = 1; ; threads = MIN( threads * 2, maxThreads ) )
+	{
+		double start = Plat_FloatTime();
+		FindHidingSpotCandidatesParallel( jobs, threads );
+		double hidingTime = Plat_FloatTime() - start;
+
+		start = Plat_FloatTime();
+		ComputeSpotEncountersParallel( threads );
+		double encounterTime = Plat_FloatTime() - start;
+
+		start = Plat_FloatTime();
+		ComputeSniperSpotsParallel( threads );
+		double sniperTime = Plat_FloatTime() - start;
+
+		Msg( "%7d  %7.2f  %9.2f  %6.2f  %6.2f\n", threads, hidingTime, encounterTime, sniperTime, hidingTime + encounterTime + sniperTime );
+
+		if ( threads >= maxThreads )
+			break;
+	}
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Process the auto-generation for 'maxTime' seconds. return false if generation is complete.
@@ -3714,6 +3828,12 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case FIND_HIDING_SPOTS:
 		{
+			if ( nav_analyze_threads.GetInt() != 1 && m_generationIndex == 0 )
+			{
+				ComputeHidingSpotsParallel( GetNavAnalyzeMaxParallel() );
+				m_generationIndex = TheNavAreas.Count();
+			}
+
 			while( m_generationIndex < TheNavAreas.Count() )
 			{
 				CNavArea *area = TheNavAreas[ m_generationIndex ];
@@ -3739,6 +3859,12 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case FIND_ENCOUNTER_SPOTS:
 		{
+			if ( nav_analyze_threads.GetInt() != 1 && m_generationIndex == 0 )
+			{
+				ComputeSpotEncountersParallel( GetNavAnalyzeMaxParallel() );
+				m_generationIndex = TheNavAreas.Count();
+			}
+
 			while( m_generationIndex < TheNavAreas.Count() )
 			{
 				CNavArea *area = TheNavAreas[ m_generationIndex ];
@@ -3764,6 +3890,12 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case FIND_SNIPER_SPOTS:
 		{
+			if ( nav_analyze_threads.GetInt() != 1 && m_generationIndex == 0 )
+			{
+				ComputeSniperSpotsParallel( GetNavAnalyzeMaxParallel() );
+				m_generationIndex = TheNavAreas.Count();
+			}
+
 			while( m_generationIndex < TheNavAreas.Count() )
 			{
 				CNavArea *area = TheNavAreas[ m_generationIndex ];
@@ -4089,7 +4221,7 @@ const char *CNavMesh::GetPlayerSpawnName( void ) const
  * Node Z positions are ground level.
  */
 CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement, 
-							float obstacleHeight, float obstacleStartDist, float obstacleEndDist )
+							float obstacleHeight, float obstacleStartDist, float obstacleEndDist, bool checkCrouch )
 {
 	// check if a node exists at this location
 	CNavNode *node = CNavNode::GetNode( destPos );
@@ -4126,7 +4258,10 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 		m_currentNode = node;
 	}
 
-	node->CheckCrouch();
+	if ( checkCrouch )
+	{
+		node->CheckCrouch();
+	}
 
 	// determine if there's a cliff nearby and set an attribute on this node
 	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
@@ -4361,40 +4496,23 @@ static bool IsNodeOverlapped( const Vector& pos, const Vector& offset )
  */
 bool CNavMesh::SampleStep( void )
 {
+	if ( nav_generate_threads.GetInt() != 1 )
+	{
+		return SampleStepParallel();
+	}
+
 	// take a step
 	while( true )
 	{
 		if (m_currentNode == NULL)
 		{
 			// sampling is complete from current seed, try next one
-			m_currentNode = GetNextWalkableSeedNode();
+			m_currentNode = GetNextSampleStartNode();
 
 			if (m_currentNode == NULL)
 			{
-				if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
-				{
-					return false;
-				}
-
-				// search is exhausted - continue search from ends of ladders
-				for ( int i=0; i<m_ladders.Count(); ++i )
-				{
-					CNavLadder *ladder = m_ladders[i];
-
-					// check ladder bottom
-					if ((m_currentNode = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
-						break;
-
-					// check ladder top
-					if ((m_currentNode = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
-						break;
-				}
-
-				if (m_currentNode == NULL)
-				{
-					// all seeds exhausted, sampling complete
-					return false;
-				}
+				// all seeds exhausted, sampling complete
+				return false;
 			}
 		}
 
@@ -4406,233 +4524,391 @@ bool CNavMesh::SampleStep( void )
 			if (!m_currentNode->HasVisited( (NavDirType)dir ))
 			{
 				// have not searched in this direction yet
+				m_generationDir = (NavDirType)dir;
 
-				// start at current node position
-				Vector pos = *m_currentNode->GetPosition();
+				// mark direction as visited
+				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// snap to grid
-				int cx = SnapToGrid( pos.x );
-				int cy = SnapToGrid( pos.y );
+				NavSampleProbe_t probe;
+				probe.from = m_currentNode;
+				probe.dir = m_generationDir;
+				ProbeSampleStep( probe );
 
-				// attempt to move to adjacent node
-				switch( dir )
+				if ( probe.isValid )
 				{
-					case NORTH:		cy -= GenerationStepSize; break;
-					case SOUTH:		cy += GenerationStepSize; break;
-					case EAST:		cx += GenerationStepSize; break;
-					case WEST:		cx -= GenerationStepSize; break;
+					// we can move here
+					// create a new navigation node, and update current node pointer
+					AddNode( probe.to, probe.toNormal, m_generationDir, m_currentNode, probe.isOnDisplacement, probe.obstacleHeight, probe.obstacleStartDist, probe.obstacleEndDist );
 				}
 
-				pos.x = cx;
-				pos.y = cy;
+				return true;
+			}
+		}
 
-				m_generationDir = (NavDirType)dir;
+		// all directions have been searched from this node - pop back to its parent and continue
+		m_currentNode = m_currentNode->GetParent();
+	}
+}
 
-				// mark direction as visited
-				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// sanity check to not generate across the world for incremental generation
-				const float incrementalRange = nav_generate_incremental_range.GetFloat();
-				if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
-				{
-					bool inRange = false;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
-						{
-							inRange = true;
-							break;
-						}
-					}
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the node the next round of sampling starts from: the next walkable seed, or the
+ * end of a ladder once the seeds are exhausted. Returns NULL when sampling is complete.
+ */
+CNavNode *CNavMesh::GetNextSampleStartNode( void )
+{
+	CNavNode *node = GetNextWalkableSeedNode();
+	if ( node )
+		return node;
 
-					if ( !inRange )
-					{
-						return true;
-					}
-				}
+	if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
+		return NULL;
 
-				if ( m_generationMode == GENERATE_SIMPLIFY )
-				{
-					if ( !m_simplifyGenerationExtent.Contains( pos ) )
-					{
-						return true;
-					}
-				}
+	// search is exhausted - continue search from ends of ladders
+	for ( int i=0; i<m_ladders.Count(); ++i )
+	{
+		CNavLadder *ladder = m_ladders[i];
 
-				// test if we can move to new position
-				trace_t result;
-				Vector from( *m_currentNode->GetPosition() );
-				CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
-				Vector to, toNormal;
-				float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
-				if ( TraceAdjacentNode( 0, from, pos, &result ) )
-				{
-					to = result.endpos;
-					toNormal = result.plane.normal;
-				}
-				else
-				{
-					// test going up ClimbUpHeight
-					bool success = false;
-					for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
-					{						
-						trace_t tr;
-						Vector start( from );
-						Vector end( pos );
-						start.z += height;
-						end.z += height;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-						if ( !tr.startsolid && tr.fraction == 1.0f )
-						{
-							if ( !StayOnFloor( &tr ) )
-							{
-								break;
-							}
+		// check ladder bottom
+		if ((node = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
+			return node;
 
-							to = tr.endpos;
-							toNormal = tr.plane.normal;
+		// check ladder top
+		if ((node = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
+			return node;
+	}
 
-							start = end = from;
-							end.z += height;
-							UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-							if ( tr.fraction < 1.0f )
-							{
-								break;
-							}
+	return NULL;
+}
 
-							// keep track of far up we had to go to find a path to the next node
-							obstacleHeight = height;
-							success = true;
-							break;
-						}
-						else
-						{
-							// Could not trace from node to node at this height, something is in the way.
-							// Trace in the other direction to see if we hit something
-							Vector vecToObstacleStart = tr.endpos - start;
-							Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
-							if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
-							{
-								UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-								if ( !tr.startsolid && tr.fraction < 1.0 )
-								{
-									// We hit something going the other direction.  There is some obstacle between the two nodes.
-									Vector vecToObstacleEnd = tr.endpos - start;
-									Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
-									if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
-									{
-										// Remember the distances to start and end of the obstacle (with respect to the "from" node).
-										// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
-										// If we do eventually clear the obstacle, these values will be the start and end distance to the
-										// very tip of the obstacle.
-										obstacleStartDist = vecToObstacleStart.Length();
-										obstacleEndDist = vecToObstacleEnd.Length();
-										if ( obstacleEndDist == 0 )
-										{
-											obstacleEndDist = GenerationStepSize;
-										}
-									}								
-								}
-							}
-						}
-					}
 
-					if ( !success )
-					{
-						return true;
-					}
-				}
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace one step of sampling from probe.from in probe.dir, filling in where a node can be placed.
+ * Only reads the world and the existing mesh, so probes can run concurrently.
+ */
+void CNavMesh::ProbeSampleStep( NavSampleProbe_t &probe )
+{
+	probe.isValid = false;
 
-				// Don't generate nodes if we spill off the end of the world onto skybox
-				if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
-				{
-					return true;
-				}
+	// start at current node position
+	Vector pos = *probe.from->GetPosition();
 
-				// If we're incrementally generating, don't overlap existing nav areas.
-				Vector testPos( to );
-				bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
-				bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
-				bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
-				bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
-				if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
-				{
-					return true;
-				}
+	// snap to grid
+	int cx = SnapToGrid( pos.x );
+	int cy = SnapToGrid( pos.y );
 
-				int nTolerance = nav_generate_incremental_tolerance.GetInt();
-				if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
-				{
-					bool bValid = false;
-					int zPos = to.z;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						int zMin = seedPos.z - nTolerance;
-						int zMax = seedPos.z + nTolerance;
+	// attempt to move to adjacent node
+	switch( probe.dir )
+	{
+		case NORTH:		cy -= GenerationStepSize; break;
+		case SOUTH:		cy += GenerationStepSize; break;
+		case EAST:		cx += GenerationStepSize; break;
+		case WEST:		cx -= GenerationStepSize; break;
+	}
 
-						if ( zPos >= zMin && zPos <= zMax )
-						{
-							bValid = true;
-							break;
-						}
-					}
+	pos.x = cx;
+	pos.y = cy;
 
-					if ( !bValid )
-						return true;
+	// sanity check to not generate across the world for incremental generation
+	const float incrementalRange = nav_generate_incremental_range.GetFloat();
+	if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+	{
+		bool inRange = false;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
+			{
+				inRange = true;
+				break;
+			}
+		}
+
+		if ( !inRange )
+		{
+			return;
+		}
+	}
+
+	if ( m_generationMode == GENERATE_SIMPLIFY )
+	{
+		if ( !m_simplifyGenerationExtent.Contains( pos ) )
+		{
+			return;
+		}
+	}
+
+	// test if we can move to new position
+	trace_t result;
+	Vector from( *probe.from->GetPosition() );
+	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
+	Vector to, toNormal;
+	float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
+	if ( TraceAdjacentNode( 0, from, pos, &result ) )
+	{
+		to = result.endpos;
+		toNormal = result.plane.normal;
+	}
+	else
+	{
+		// test going up ClimbUpHeight
+		bool success = false;
+		for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
+		{						
+			trace_t tr;
+			Vector start( from );
+			Vector end( pos );
+			start.z += height;
+			end.z += height;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+			if ( !tr.startsolid && tr.fraction == 1.0f )
+			{
+				if ( !StayOnFloor( &tr ) )
+				{
+					break;
 				}
 
+				to = tr.endpos;
+				toNormal = tr.plane.normal;
 
-				bool isOnDisplacement = result.IsDispSurface();
+				start = end = from;
+				end.z += height;
+				UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+				if ( tr.fraction < 1.0f )
+				{
+					break;
+				}
 
-				if ( nav_displacement_test.GetInt() > 0 )
+				// keep track of far up we had to go to find a path to the next node
+				obstacleHeight = height;
+				success = true;
+				break;
+			}
+			else
+			{
+				// Could not trace from node to node at this height, something is in the way.
+				// Trace in the other direction to see if we hit something
+				Vector vecToObstacleStart = tr.endpos - start;
+				Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
+				if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
 				{
-					// Test for nodes under displacement surfaces.
-					// This happens during development, and is a pain because the space underneath a displacement
-					// is not 'solid'.
-					Vector start = to + Vector( 0, 0, 0 );
-					Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
-					UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-
-					if ( result.fraction > 0 )
+					UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+					if ( !tr.startsolid && tr.fraction < 1.0 )
 					{
-						end = start;
-						start = result.endpos;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-						if ( result.fraction < 1 )
+						// We hit something going the other direction.  There is some obstacle between the two nodes.
+						Vector vecToObstacleEnd = tr.endpos - start;
+						Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
+						if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
 						{
-							// if we made it down to within StepHeight, maybe we're on a static prop
-							if ( result.endpos.z > to.z + StepHeight )
+							// Remember the distances to start and end of the obstacle (with respect to the "from" node).
+							// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
+							// If we do eventually clear the obstacle, these values will be the start and end distance to the
+							// very tip of the obstacle.
+							obstacleStartDist = vecToObstacleStart.Length();
+							obstacleEndDist = vecToObstacleEnd.Length();
+							if ( obstacleEndDist == 0 )
 							{
-								return true;
+								obstacleEndDist = GenerationStepSize;
 							}
-						}
+						}								
 					}
 				}
+			}
+		}
+
+		if ( !success )
+		{
+			return;
+		}
+	}
+
+	// Don't generate nodes if we spill off the end of the world onto skybox
+	if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+	{
+		return;
+	}
 
-				float deltaZ = to.z - m_currentNode->GetPosition()->z;
-				// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
-				// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
-				// and distances
-				if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	// If we're incrementally generating, don't overlap existing nav areas.
+	Vector testPos( to );
+	bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
+	bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
+	bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
+	bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
+	if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+	{
+		return;
+	}
+
+	int nTolerance = nav_generate_incremental_tolerance.GetInt();
+	if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
+	{
+		bool bValid = false;
+		int zPos = to.z;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			int zMin = seedPos.z - nTolerance;
+			int zMax = seedPos.z + nTolerance;
+
+			if ( zPos >= zMin && zPos <= zMax )
+			{
+				bValid = true;
+				break;
+			}
+		}
+
+		if ( !bValid )
+			return;
+	}
+
+
+	bool isOnDisplacement = result.IsDispSurface();
+
+	if ( nav_displacement_test.GetInt() > 0 )
+	{
+		// Test for nodes under displacement surfaces.
+		// This happens during development, and is a pain because the space underneath a displacement
+		// is not 'solid'.
+		Vector start = to + Vector( 0, 0, 0 );
+		Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
+		UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+
+		if ( result.fraction > 0 )
+		{
+			end = start;
+			start = result.endpos;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+			if ( result.fraction < 1 )
+			{
+				// if we made it down to within StepHeight, maybe we're on a static prop
+				if ( result.endpos.z > to.z + StepHeight )
 				{
-					obstacleHeight = 0;
-					obstacleStartDist = 0;
-					obstacleEndDist = GenerationStepSize;
+					return;
 				}
+			}
+		}
+	}
+
+	float deltaZ = to.z - probe.from->GetPosition()->z;
+	// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
+	// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
+	// and distances
+	if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	{
+		obstacleHeight = 0;
+		obstacleStartDist = 0;
+		obstacleEndDist = GenerationStepSize;
+	}
 
-				// we can move here
-				// create a new navigation node, and update current node pointer
-				AddNode( to, toNormal, m_generationDir, m_currentNode, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist );
+	probe.isValid = true;
+	probe.to = to;
+	probe.toNormal = toNormal;
+	probe.isOnDisplacement = isOnDisplacement;
+	probe.obstacleHeight = obstacleHeight;
+	probe.obstacleStartDist = obstacleStartDist;
+	probe.obstacleEndDist = obstacleEndDist;
+}
 
-				return true;
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::ProbeSampleStepJob( NavSampleProbe_t &probe )
+{
+	TheNavMesh->ProbeSampleStep( probe );
+}
+
+void CNavMesh::CheckNodeCrouchJob( CNavNode *&node )
+{
+	node->CheckCrouch();
+}
+
+static int __cdecl NavNodePtrCompare( CNavNode * const *a, CNavNode * const *b )
+{
+	if ( *a < *b )
+		return -1;
+	return ( *a > *b ) ? 1 : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Breadth-first version of SampleStep. Each call expands the whole frontier by one step: every
+ * unexplored direction is traced across the thread pool, then the results are linked up on the
+ * main thread in frontier order so the node graph doesn't depend on thread timing.
+ *
+ * Returns true if sampling needs to continue, or false if done.
+ */
+bool CNavMesh::SampleStepParallel( void )
+{
+	if ( m_sampleFrontier.Count() == 0 )
+	{
+		// sampling is complete from current seed, try next one
+		CNavNode *seed = GetNextSampleStartNode();
+		if ( seed == NULL )
+		{
+			// all seeds exhausted, sampling complete
+			return false;
+		}
+
+		m_sampleFrontier.AddToTail( seed );
+	}
+
+	CUtlVector< NavSampleProbe_t > probes;
+	probes.EnsureCapacity( m_sampleFrontier.Count() * NUM_DIRECTIONS );
+	FOR_EACH_VEC( m_sampleFrontier, it )
+	{
+		CNavNode *node = m_sampleFrontier[ it ];
+		for( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+		{
+			if ( !node->HasVisited( (NavDirType)dir ) )
+			{
+				node->MarkAsVisited( (NavDirType)dir );
+
+				NavSampleProbe_t &probe = probes[ probes.AddToTail() ];
+				probe.from = node;
+				probe.dir = (NavDirType)dir;
 			}
 		}
+	}
+	m_sampleFrontier.RemoveAll();
 
-		// all directions have been searched from this node - pop back to its parent and continue
-		m_currentNode = m_currentNode->GetParent();
+	int threads = nav_generate_threads.GetInt();
+	ParallelProcess( "CNavMesh::ProbeSampleStep", probes.Base(), probes.Count(), &CNavMesh::ProbeSampleStepJob, NULL, NULL, ( threads <= 0 ) ? INT_MAX : threads );
+
+	// link the results up in order. The node list is newest first, so everything in front of
+	// the old head after this was created this round and becomes the next frontier.
+	CNavNode *oldHead = CNavNode::GetFirst();
+	CUtlVector< CNavNode * > touched;
+	FOR_EACH_VEC( probes, it )
+	{
+		const NavSampleProbe_t &probe = probes[ it ];
+		if ( probe.isValid )
+		{
+			m_generationDir = probe.dir;
+			touched.AddToTail( AddNode( probe.to, probe.toNormal, probe.dir, probe.from, probe.isOnDisplacement, probe.obstacleHeight, probe.obstacleStartDist, probe.obstacleEndDist, false ) );
+		}
 	}
+	m_currentNode = NULL;
+
+	for ( CNavNode *node = CNavNode::GetFirst(); node != oldHead; node = node->GetNext() )
+	{
+		m_sampleFrontier.AddToHead( node );
+	}
+
+	// crouch checks were deferred by AddNode; run each linked node once, in parallel
+	touched.Sort( NavNodePtrCompare );
+	int unique = 0;
+	FOR_EACH_VEC( touched, it )
+	{
+		if ( unique == 0 || touched[ unique - 1 ] != touched[ it ] )
+		{
+			touched[ unique++ ] = touched[ it ];
+		}
+	}
+	touched.SetCountNonDestructively( unique );
+	ParallelProcess( "CNavNode::CheckCrouch", touched.Base(), touched.Count(), &CNavMesh::CheckNodeCrouchJob, NULL, NULL, ( threads <= 0 ) ? INT_MAX : threads );
+
+	return true;
 }
 
 
@@ -202,6 +202,8 @@ void CNavMesh::DestroyNavigationMesh( bool incremental )
 	// destroy navigation nodes created during map generation
 	CNavNode::CleanupGeneration();
 
+	m_visBitSets.Invalidate();
+
 	if ( !incremental )
 	{
 		// destroy the grid
@@ -511,6 +513,7 @@ void CNavMesh::AddNavArea( CNavArea *area )
 	}
 
 	++m_areaCount;
+	m_visBitSets.Invalidate();
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -565,6 +568,7 @@ void CNavMesh::RemoveNavArea( CNavArea *area )
 	m_blockedAreas.FindAndRemove( area );
 
 	--m_areaCount;
+	m_visBitSets.Invalidate();
 }
 
 
@@ -2325,6 +2329,30 @@ void CommandNavSave( void )
 static ConCommand nav_save( "nav_save", CommandNavSave, "Saves the current Navigation Mesh to disk.", FCVAR_GAMEDLL | FCVAR_CHEAT );
 
 
+//--------------------------------------------------------------------------------------------------------------
+void CommandNavCompile( void )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( !TheNavMesh->IsLoaded() )
+	{
+		Msg( "No Navigation Mesh is loaded.\n" );
+		return;
+	}
+
+	if (TheNavMesh->SaveCompiled())
+	{
+		Msg( "Compiled navigation map '%s' saved.\n", TheNavMesh->GetCompiledFilename() );
+	}
+	else
+	{
+		Msg( "ERROR: Cannot save compiled navigation map '%s'.\n", TheNavMesh->GetCompiledFilename() );
+	}
+}
+static ConCommand nav_compile( "nav_compile", CommandNavCompile, "Converts the current Navigation Mesh into a compiled .navc image that loads without parsing. It is kept up to date by nav_save.", FCVAR_GAMEDLL | FCVAR_CHEAT );
+
+
 //--------------------------------------------------------------------------------------------------------------
 void CommandNavLoad( void )
 {
@@ -3325,4 +3353,6 @@ void CNavMesh::EndVisibilityComputations( void )
 	}
 
 	Msg( "NavMesh Visibility List Lengths:  min = %d, avg = %d, max = %d\n", minVisLength, avgVisLength, maxVisLength );
+
+	m_visBitSets.Invalidate();
 }
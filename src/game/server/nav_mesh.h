@@ -26,6 +26,7 @@
 #include "nav.h"
 #include "nav_area.h"
 #include "nav_colors.h"
+#include "nav_visbits.h"
 
 
 class CNavArea;
@@ -280,6 +281,7 @@ public:
 
 	virtual NavErrorType Load( void );									// load navigation data from a file
 	virtual NavErrorType PostLoad( unsigned int version );				// (EXTEND) invoked after all areas have been loaded - for pointer binding, etc
+	NavErrorType PostLoadMesh( void );									// mesh-wide setup once every area is bound, shared by both file formats
 	bool IsLoaded( void ) const		{ return m_isLoaded; }				// return true if a Navigation Mesh has been loaded
 	bool IsAnalyzed( void ) const	{ return m_isAnalyzed; }			// return true if a Navigation Mesh has been analyzed
 
@@ -292,6 +294,8 @@ public:
 	const CUtlVector< Place > *GetPlacesFromNavFile( bool *hasUnnamedPlaces );	// Reads the used place names from the nav file (can be used to selectively precache before the nav is loaded)
 
 	virtual bool Save( void ) const;									// store Navigation Mesh to a file
+	bool SaveCompiled( void ) const;									// store Navigation Mesh as a compiled image that loads without parsing
+	const char *GetCompiledFilename( void ) const;						// return the filename for this map's compiled "nav map" image
 	bool IsOutOfDate( void ) const	{ return m_isOutOfDate; }			// return true if the Navigation Mesh is older than the current map version
 
 	virtual unsigned int GetSubVersionNumber( void ) const;										// returns sub-version number of data format used by derived classes
@@ -322,6 +326,7 @@ public:
 	const CUtlVector< INavAvoidanceObstacle * > &GetObstructions( void ) const { return m_avoidanceObstacles; }
 
 	unsigned int GetNavAreaCount( void ) const	{ return m_areaCount; }	// return total number of nav areas
+	CNavVisBitSets &GetVisBitSets( void )		{ return m_visBitSets; }		// bitset form of the area visibility lists
 
 	// See GetNavAreaFlags_t for flags
 	CNavArea *GetNavArea( const Vector &pos, float beneathLimt = 120.0f ) const;	// given a position, return the nav area that IsOverlapping and is *immediately* beneath it
@@ -1082,6 +1087,7 @@ private:
 	bool m_isLoaded;											// true if a Navigation Mesh has been loaded
 	bool m_isOutOfDate;											// true if the Navigation Mesh is older than the actual BSP
 	bool m_isAnalyzed;											// true if the Navigation Mesh needs analysis
+	NavErrorType LoadCompiled( void );							// load this map's compiled image, if there is a current one
 
 	enum { HASH_TABLE_SIZE = 256 };
 	CNavArea *m_hashTable[ HASH_TABLE_SIZE ];					// hash table to optimize lookup by ID
@@ -1163,7 +1169,8 @@ private:
 
 	CNavNode *m_currentNode;									// the current node we are sampling from
 	NavDirType m_generationDir;
-	CNavNode *AddNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist );		// add a nav node and connect it, update current node
+	CNavNode *AddNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist, bool checkCrouch = true );		// add a nav node and connect it, update current node
+	CUtlVector< CNavNode * > m_sampleFrontier;					// nodes to expand in the next parallel sampling step
 
 #ifdef OF_DLL
 public:
@@ -1175,7 +1182,25 @@ public:
 private:
 #endif
 
+	struct NavSampleProbe_t
+	{
+		CNavNode *from;
+		NavDirType dir;
+		bool isValid;											// a node can be placed at 'to'
+		bool isOnDisplacement;
+		Vector to;
+		Vector toNormal;
+		float obstacleHeight;
+		float obstacleStartDist;
+		float obstacleEndDist;
+	};
+
 	bool SampleStep( void );									// sample the walkable areas of the map
+	bool SampleStepParallel( void );							// expand the whole sampling frontier by one step across the thread pool
+	void ProbeSampleStep( NavSampleProbe_t &probe );			// trace one sampling step, safe to run concurrently
+	static void ProbeSampleStepJob( NavSampleProbe_t &probe );
+	static void CheckNodeCrouchJob( CNavNode *&node );			// deferred AddNode crouch check, for the parallel sampler
+	CNavNode *GetNextSampleStartNode( void );					// return the next seed or ladder end to sample from, NULL when done
 	void CreateNavAreasFromNodes( void );						// cover all of the sampled nodes with nav areas
 
 	bool TestArea( CNavNode *node, int width, int height );		// check if an area of size (width, height) can fit, starting from node as upper left corner
@@ -1250,6 +1275,8 @@ private:
 	void BuildTransientAreaList( void );
 	CUtlVector< CNavArea * > m_transientAreas;
 
+	CNavVisBitSets m_visBitSets;
+
 	void UpdateAvoidanceObstacleAreas( void );
 	CUtlVector< CNavArea * > m_avoidanceObstacleAreas;
 	CUtlVector< INavAvoidanceObstacle * > m_avoidanceObstacles;
@@ -0,0 +1,361 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Bitset form of the nav area potentially visible sets
+//
+// $NoKeywords: $
+//=============================================================================//
+// nav_visbits.cpp
+
+#include "cbase.h"
+#include "nav_mesh.h"
+#include "nav_visbits.h"
+#include "team.h"
+#include "tier0/vprof.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+
+#define VISBIT_SEEN		0x80		// marks an index already taken from a list while flattening an area
+
+
+//--------------------------------------------------------------------------------------------------------------
+static int CompareIndices( const int *a, const int *b )
+{
+	return *a - *b;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavVisBitSets::CNavVisBitSets( void )
+{
+	m_isValid = false;
+	m_generation = 0;
+	m_meshWordCount = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Rebuild the sets if the visibility data changed since they were built.
+ * Returns false while the sets can't be used, in which case callers walk the lists.
+ */
+bool CNavVisBitSets::Update( void )
+{
+	if ( m_isValid )
+	{
+		return true;
+	}
+
+	// the lists are rewritten while generating, and rebuilding renumbers every area
+	if ( TheNavMesh->IsGenerating() || !ThreadInMainThread() )
+	{
+		return false;
+	}
+
+	Build();
+	return m_isValid;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Flatten every area's visibility list, with its inherited list applied, into a bit window
+ */
+void CNavVisBitSets::Build( void )
+{
+	VPROF_BUDGET( "CNavVisBitSets::Build", "NextBot" );
+
+	int areaCount = TheNavAreas.Count();
+
+	m_areas.CopyArray( TheNavAreas.Base(), areaCount );
+	m_windows.SetCount( areaCount );
+	m_words.RemoveAll();
+	m_meshWordCount = ( areaCount + 31 ) / 32;
+
+	FOR_EACH_VEC( m_areas, it )
+	{
+		m_areas[ it ]->m_visBitIndex = it;
+	}
+
+	// attributes of the area being flattened, by index
+	CUtlVector< unsigned char > attributes;
+	attributes.SetCount( areaCount );
+	if ( areaCount )
+	{
+		V_memset( attributes.Base(), 0, areaCount );
+	}
+
+	CUtlVector< int > listed;
+
+	for( int i=0; i<areaCount; ++i )
+	{
+		const CNavArea *area = m_areas[i];
+
+		listed.RemoveAll();
+
+		// our own list is definitive, the inherited list only fills in areas we don't mention
+		const CNavArea::CAreaBindInfoArray *lists[2] = { &area->m_potentiallyVisibleAreas, NULL };
+		if ( area->m_inheritVisibilityFrom.area )
+		{
+			lists[1] = &area->m_inheritVisibilityFrom.area->m_potentiallyVisibleAreas;
+		}
+
+		for( int l=0; l<2 && lists[l]; ++l )
+		{
+			const CNavArea::CAreaBindInfoArray &list = *lists[l];
+			for( int v=0; v<list.Count(); ++v )
+			{
+				int index = GetIndex( list[v].area );
+				if ( index < 0 || attributes[ index ] & VISBIT_SEEN )
+					continue;
+
+				attributes[ index ] = VISBIT_SEEN | list[v].attributes;
+				listed.AddToTail( index );
+			}
+		}
+
+		// can always see ourselves
+		if ( !( attributes[i] & VISBIT_SEEN ) )
+		{
+			listed.AddToTail( i );
+		}
+		attributes[i] = VISBIT_SEEN | CNavArea::POTENTIALLY_VISIBLE | CNavArea::COMPLETELY_VISIBLE;
+
+		int lo = i, hi = i;
+		FOR_EACH_VEC( listed, it )
+		{
+			int index = listed[ it ];
+			if ( ( attributes[ index ] & ~VISBIT_SEEN ) != CNavArea::NOT_VISIBLE )
+			{
+				lo = MIN( lo, index );
+				hi = MAX( hi, index );
+			}
+		}
+
+		AreaWindow_t &window = m_windows[i];
+		window.firstWord = lo / 32;
+		window.wordCount = hi / 32 - window.firstWord + 1;
+		window.start = m_words.Count();
+
+		m_words.AddMultipleToTail( 2 * window.wordCount );
+		uint32 *potential = &m_words[ window.start ];
+		uint32 *complete = potential + window.wordCount;
+		V_memset( potential, 0, 2 * window.wordCount * sizeof( uint32 ) );
+
+		FOR_EACH_VEC( listed, it )
+		{
+			int index = listed[ it ];
+			unsigned char attr = attributes[ index ] & ~VISBIT_SEEN;
+			attributes[ index ] = 0;
+
+			if ( attr == CNavArea::NOT_VISIBLE )
+				continue;
+
+			uint32 word = index / 32 - window.firstWord;
+			uint32 bit = 1u << ( index & 31 );
+
+			potential[ word ] |= bit;
+			if ( attr & CNavArea::COMPLETELY_VISIBLE )
+			{
+				complete[ word ] |= bit;
+			}
+		}
+	}
+
+	++m_generation;
+	m_isValid = true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the dense index of the area, or -1 if it wasn't in the mesh when the sets were built
+ */
+int CNavVisBitSets::GetIndex( const CNavArea *area ) const
+{
+	if ( !area )
+		return -1;
+
+	int index = area->m_visBitIndex;
+	if ( !m_areas.IsValidIndex( index ) || m_areas[ index ] != area )
+		return -1;
+
+	return index;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavVisBitSets::TestBit( const CNavArea *from, const CNavArea *to, int set )
+{
+	if ( !Update() )
+		return false;
+
+	int fromIndex = GetIndex( from );
+	int toIndex = GetIndex( to );
+	if ( fromIndex < 0 || toIndex < 0 )
+		return false;
+
+	const AreaWindow_t &window = m_windows[ fromIndex ];
+
+	// unsigned, so indices in front of the window wrap around and fail too
+	unsigned int word = toIndex / 32 - window.firstWord;
+	if ( word >= window.wordCount )
+		return false;
+
+	return ( m_words[ window.start + set * window.wordCount + word ] & ( 1u << ( toIndex & 31 ) ) ) != 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavVisBitSets::IsPotentiallyVisible( const CNavArea *from, const CNavArea *to )
+{
+	return TestBit( from, to, 0 );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavVisBitSets::IsCompletelyVisible( const CNavArea *from, const CNavArea *to )
+{
+	return TestBit( from, to, COMPLETE_SET );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * OR an area's window into the team union
+ */
+void CNavVisBitSets::AddWindowToTeam( TeamSet_t *teamSet, int index ) const
+{
+	const AreaWindow_t &window = m_windows[ index ];
+
+	for( int set=0; set<2; ++set )
+	{
+		const uint32 *from = &m_words[ window.start + set * window.wordCount ];
+		uint32 *to = teamSet->words[ set ].Base() + window.firstWord;
+
+		for( unsigned int w=0; w<window.wordCount; ++w )
+		{
+			to[w] |= from[w];
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Bring a team union up to date with where its living members are. Members moving into
+ * new areas are ORed in; the union is only rebuilt when someone leaves an area.
+ */
+void CNavVisBitSets::UpdateTeam( TeamSet_t *teamSet, int team )
+{
+	teamSet->tick = gpGlobals->tickcount;
+
+	CUtlVectorFixedGrowable< int, 64 > occupied;
+
+	CTeam *pTeam = GetGlobalTeam( team );
+	if ( pTeam )
+	{
+		for( int i = 0; i < pTeam->GetNumPlayers(); ++i )
+		{
+			CBasePlayer *player = pTeam->GetPlayer( i );
+			if ( !player->IsAlive() )
+				continue;
+
+			int index = GetIndex( player->GetLastKnownArea() );
+			if ( index >= 0 && !occupied.HasElement( index ) )
+			{
+				occupied.AddToTail( index );
+			}
+		}
+	}
+
+	occupied.Sort( CompareIndices );
+
+	bool isAddOnly = ( teamSet->generation == m_generation );
+	if ( isAddOnly )
+	{
+		if ( occupied.Count() == teamSet->occupied.Count() &&
+			 ( !occupied.Count() || !V_memcmp( occupied.Base(), teamSet->occupied.Base(), occupied.Count() * sizeof( int ) ) ) )
+		{
+			// nobody changed areas
+			return;
+		}
+
+		FOR_EACH_VEC( teamSet->occupied, it )
+		{
+			if ( occupied.Find( teamSet->occupied[ it ] ) < 0 )
+			{
+				isAddOnly = false;
+				break;
+			}
+		}
+	}
+
+	if ( !isAddOnly )
+	{
+		for( int set=0; set<2; ++set )
+		{
+			teamSet->words[ set ].SetCount( m_meshWordCount );
+			if ( m_meshWordCount )
+			{
+				V_memset( teamSet->words[ set ].Base(), 0, m_meshWordCount * sizeof( uint32 ) );
+			}
+		}
+
+		teamSet->occupied.RemoveAll();
+		teamSet->generation = m_generation;
+	}
+
+	FOR_EACH_VEC( occupied, it )
+	{
+		if ( !teamSet->occupied.HasElement( occupied[ it ] ) )
+		{
+			AddWindowToTeam( teamSet, occupied[ it ] );
+		}
+	}
+
+	teamSet->occupied.CopyArray( occupied.Base(), occupied.Count() );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Team unions are checked at most once per tick, the granularity last known areas change at
+ */
+bool CNavVisBitSets::TestTeamBit( const CNavArea *area, int team, int set )
+{
+	if ( !Update() || team < 0 )
+		return false;
+
+	int index = GetIndex( area );
+	if ( index < 0 )
+		return false;
+
+	if ( team >= m_teams.Count() )
+	{
+		m_teams.AddMultipleToTail( team + 1 - m_teams.Count() );
+	}
+
+	TeamSet_t *teamSet = &m_teams[ team ];
+	if ( teamSet->tick != gpGlobals->tickcount || teamSet->generation != m_generation )
+	{
+		UpdateTeam( teamSet, team );
+	}
+
+	return ( teamSet->words[ set ][ index / 32 ] & ( 1u << ( index & 31 ) ) ) != 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavVisBitSets::IsPotentiallyVisibleToTeam( const CNavArea *area, int team )
+{
+	return TestTeamBit( area, team, 0 );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavVisBitSets::IsCompletelyVisibleToTeam( const CNavArea *area, int team )
+{
+	return TestTeamBit( area, team, COMPLETE_SET );
+}
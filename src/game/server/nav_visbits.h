@@ -0,0 +1,81 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Bitset form of the nav area potentially visible sets
+//
+// $NoKeywords: $
+//=============================================================================//
+// nav_visbits.h
+// The analyzed visibility lists are stored as deltas against a neighbor, which makes
+// every query a walk of two lists. This flattens them once into per-area bit windows
+// over a dense area index so membership is a single bit test, and keeps per-team
+// unions of those windows for the "visible to team" queries.
+
+#ifndef _NAV_VISBITS_H_
+#define _NAV_VISBITS_H_
+
+#include "utlvector.h"
+
+class CNavArea;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Each area owns a window of words covering the lowest through highest index it can see,
+ * potentially visible bits followed by completely visible bits. Areas only see their
+ * surroundings and TheNavAreas is built spatially, so windows stay far smaller than
+ * the whole mesh.
+ */
+class CNavVisBitSets
+{
+public:
+	CNavVisBitSets( void );
+
+	void Invalidate( void )					{ m_isValid = false; }		// visibility lists or the area set changed
+	bool Update( void );												// rebuild if needed, return true if the sets can be used
+
+	bool IsPotentiallyVisible( const CNavArea *from, const CNavArea *to );
+	bool IsCompletelyVisible( const CNavArea *from, const CNavArea *to );
+
+	bool IsPotentiallyVisibleToTeam( const CNavArea *area, int team );	// seen from the last known area of a living team member
+	bool IsCompletelyVisibleToTeam( const CNavArea *area, int team );
+
+	bool IsIndexed( const CNavArea *area ) const	{ return GetIndex( area ) >= 0; }
+
+private:
+	enum { COMPLETE_SET = 1 };
+
+	struct AreaWindow_t
+	{
+		unsigned int start;						// first word in m_words
+		unsigned int firstWord;					// word of the full mesh bitset the window begins at
+		unsigned int wordCount;
+	};
+
+	struct TeamSet_t
+	{
+		int tick;								// tick the occupancy was last checked
+		unsigned int generation;				// m_generation the union was built from
+		CUtlVector< int > occupied;				// sorted area indices of living team members
+		CUtlVector< uint32 > words[2];			// union of the members' windows, full mesh width
+
+		TeamSet_t( void ) : tick( -1 ), generation( 0 ) { }
+	};
+
+	void Build( void );
+	int GetIndex( const CNavArea *area ) const;
+	bool TestBit( const CNavArea *from, const CNavArea *to, int set );
+	bool TestTeamBit( const CNavArea *area, int team, int set );
+	void UpdateTeam( TeamSet_t *teamSet, int team );
+	void AddWindowToTeam( TeamSet_t *teamSet, int index ) const;
+
+	bool m_isValid;
+	unsigned int m_generation;					// bumped on every rebuild
+	int m_meshWordCount;
+
+	CUtlVector< CNavArea * > m_areas;			// TheNavAreas when built, by index
+	CUtlVector< AreaWindow_t > m_windows;		// by index
+	CUtlVector< uint32 > m_words;
+	CUtlVector< TeamSet_t > m_teams;			// by team number
+};
+
+#endif // _NAV_VISBITS_H_
@@ -33,6 +33,7 @@ ConVar tf_bot_force_class( "tf_bot_force_class", "", FCVAR_GAMEDLL, "If set to a
 ConVar tf_bot_keep_class_after_death( "tf_bot_keep_class_after_death", "0", FCVAR_GAMEDLL );
 ConVar tf_bot_prefix_name_with_difficulty( "tf_bot_prefix_name_with_difficulty", "0", FCVAR_GAMEDLL, "Append the skill level of the bot to the bot's name", &PrefixNameChanged );
 ConVar tf_bot_path_lookahead_range( "tf_bot_path_lookahead_range", "300", FCVAR_GAMEDLL, "", true, 0.0f, false, 0.0f );
+ConVar tf_bot_path_cost_cache( "tf_bot_path_cost_cache", "1", FCVAR_CHEAT, "Use the sentry positions kept on the nav areas when computing path costs, instead of looking them up per area" );
 ConVar tf_bot_near_point_travel_distance( "tf_bot_near_point_travel_distance", "750", FCVAR_CHEAT );
 ConVar tf_bot_pyro_shove_away_range( "tf_bot_pyro_shove_away_range", "250", FCVAR_CHEAT, "If a Pyro bot's target is closer than this, compression blast them away" );
 ConVar tf_bot_pyro_always_reflect( "tf_bot_pyro_always_reflect", "0", FCVAR_CHEAT, "Pyro bots will always reflect projectiles fired at them. For tesing/debugging purposes.", true, 0.0f, true, 1.0f );
@@ -2599,6 +2600,26 @@ CTFBotPathCost::CTFBotPathCost( CTFBot *actor, RouteType routeType )
 	m_flStepHeight = loco->GetStepHeight();
 	m_flMaxJumpHeight = loco->GetMaxJumpHeight();
 	m_flDeathDropHeight = loco->GetDeathDropHeight();
+
+	m_iTeam = m_Actor->GetTeamNumber();
+	m_iEnemyTeam = GetEnemyTeam( m_Actor );
+
+	// consistently random pathing with huge cost modifier
+	m_flRouteMultiplier = 1.0f;
+	if ( m_iRouteType == DEFAULT_ROUTE )
+	{
+		const float rand = m_Actor->TransientlyConsistentRandomValue( 10.0f, 0 );
+		m_flRouteMultiplier += ( rand + 1.0f ) * 50.0f;
+	}
+
+	m_flSentryMultiplier = 1.0f;
+	if ( m_iRouteType == SAFEST_ROUTE )
+		m_flSentryMultiplier = 5.0f;
+	else if ( m_Actor->IsPlayerClass( TF_CLASS_SPY ) ) // spies always consider sentryguns to avoid
+		m_flSentryMultiplier = 10.0f;
+
+	// we need to be sneaky, try to take routes where no players are
+	m_bAvoidPlayers = m_Actor->IsPlayerClass( TF_CLASS_SPY ) && !( TFGameRules()->IsFreeRoam() ); //OFBOT TODO: I don't know if this is a good idea
 }
 
 float CTFBotPathCost::operator()( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder, const CFuncElevator *elevator, float length ) const
@@ -2642,38 +2663,34 @@ float CTFBotPathCost::operator()( CNavArea *area, CNavArea *fromArea, const CNav
 			return -1.0f;
 	}
 
-	// consistently random pathing with huge cost modifier
-	float fMultiplier = 1.0f;
-	if ( m_iRouteType == DEFAULT_ROUTE )
-	{
-		const float rand = m_Actor->TransientlyConsistentRandomValue( 10.0f, 0 );
-		fMultiplier += ( rand + 1.0f ) * 50.0f;
-	}
-
-	const int iOtherTeam = GetEnemyTeam( m_Actor );
-
-	for ( int i=0; i < IBaseObjectAutoList::AutoList().Count(); ++i )
+	if ( m_flSentryMultiplier != 1.0f )
 	{
-		CBaseObject *obj = static_cast<CBaseObject *>( IBaseObjectAutoList::AutoList()[i] );
-
-		if ( obj->GetType() == OBJ_SENTRYGUN && obj->GetTeamNumber() == iOtherTeam )
+		if ( tf_bot_path_cost_cache.GetBool() )
+		{
+			// sentry positions are kept on the areas by the nav mesh
+			if ( static_cast<CTFNavArea *>( area )->HasSentryOfTeam( m_iEnemyTeam ) )
+				fDist *= m_flSentryMultiplier;
+		}
+		else
 		{
-			obj->UpdateLastKnownArea();
-			if ( area == obj->GetLastKnownArea() )
+			for ( int i=0; i < IBaseObjectAutoList::AutoList().Count(); ++i )
 			{
-				if ( m_iRouteType == SAFEST_ROUTE )
-					fDist *= 5.0f;
-				else if ( m_Actor->IsPlayerClass( TF_CLASS_SPY ) ) // spies always consider sentryguns to avoid
-					fDist *= 10.0f;
+				CBaseObject *obj = static_cast<CBaseObject *>( IBaseObjectAutoList::AutoList()[i] );
+
+				if ( obj->GetType() == OBJ_SENTRYGUN && obj->GetTeamNumber() == m_iEnemyTeam )
+				{
+					obj->UpdateLastKnownArea();
+					if ( area == obj->GetLastKnownArea() )
+						fDist *= m_flSentryMultiplier;
+				}
 			}
 		}
 	}
 
-	// we need to be sneaky, try to take routes where no players are
-	if ( m_Actor->IsPlayerClass( TF_CLASS_SPY ) && !( TFGameRules()->IsFreeRoam() ) ) //OFBOT TODO: I don't know if this is a good idea
-		fDist += ( fDist * 10.0f * area->GetPlayerCount( m_Actor->GetTeamNumber() ) );
+	if ( m_bAvoidPlayers )
+		fDist += ( fDist * 10.0f * area->GetPlayerCount( m_iTeam ) );
 
-	float fCost = fDist * fMultiplier;
+	float fCost = fDist * m_flRouteMultiplier;
 
 	if ( area->HasAttributes( NAV_MESH_FUNC_COST ) )
 		fCost *= area->ComputeFuncNavCost( m_Actor );
@@ -2877,3 +2894,63 @@ CON_COMMAND_F( tf_bot_kick, "Remove a TFBot by name, or all bots (\"all\").", FC
 		}
 	}
 }
+
+CON_COMMAND_F( tf_bot_path_cost_benchmark, "Build paths between random nav areas for the first TFBot, with tf_bot_path_cost_cache off and on, and report the throughput. Arguments: [path count] [route type 0-3]", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( TheNavAreas.Count() < 2 )
+	{
+		Msg( "No navigation mesh loaded\n" );
+		return;
+	}
+
+	CTFBot *pBot = NULL;
+	CUtlVector<INextBot *> bots;
+	TheNextBots().CollectAllBots( &bots );
+	for ( int i=0; i<bots.Count() && pBot == nullptr; ++i )
+	{
+		pBot = dynamic_cast<CTFBot *>( bots[i]->GetEntity() );
+	}
+
+	if ( pBot == nullptr || !pBot->IsAlive() )
+	{
+		Msg( "Need a live TFBot to compute paths for\n" );
+		return;
+	}
+
+	const int nPaths = args.ArgC() > 1 ? Max( 1, Q_atoi( args.Arg( 1 ) ) ) : 1000;
+	const RouteType routeType = args.ArgC() > 2 ? (RouteType)Clamp( Q_atoi( args.Arg( 2 ) ), (int)DEFAULT_ROUTE, (int)RETREAT_ROUTE ) : SAFEST_ROUTE;
+
+	const bool bWasCached = tf_bot_path_cost_cache.GetBool();
+	TFNavMesh()->UpdateSentryOccupancy();
+
+	for ( int pass=0; pass < 2; ++pass )
+	{
+		tf_bot_path_cost_cache.SetValue( pass );
+
+		// same area pairs for both passes
+		CUniformRandomStream random;
+		random.SetSeed( 1 );
+
+		CTFBotPathCost cost( pBot, routeType );
+		int nReached = 0;
+
+		const double flStart = Plat_FloatTime();
+		for ( int i=0; i < nPaths; ++i )
+		{
+			CNavArea *startArea = TheNavAreas[ random.RandomInt( 0, TheNavAreas.Count() - 1 ) ];
+			CNavArea *goalArea = TheNavAreas[ random.RandomInt( 0, TheNavAreas.Count() - 1 ) ];
+
+			if ( NavAreaBuildPath( startArea, goalArea, NULL, cost ) )
+				++nReached;
+		}
+		const double flElapsed = Max( Plat_FloatTime() - flStart, 0.000001 );
+
+		Msg( "%s: %d paths (%d reached the goal) in %.1f ms, %.0f paths/sec\n",
+			 pass ? "cached" : "uncached", nPaths, nReached, flElapsed * 1000.0, nPaths / flElapsed );
+	}
+
+	tf_bot_path_cost_cache.SetValue( bWasCached );
+}
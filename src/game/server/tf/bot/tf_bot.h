@@ -382,6 +382,13 @@ private:
 	float m_flStepHeight;
 	float m_flMaxJumpHeight;
 	float m_flDeathDropHeight;
+
+	// terms that don't change while a path is being built, resolved once up front
+	int m_iEnemyTeam;
+	int m_iTeam;
+	float m_flRouteMultiplier;
+	float m_flSentryMultiplier;
+	bool m_bAvoidPlayers;
 };
 
 DEFINE_ENUM_BITWISE_OPERATORS( CTFBot::AttributeType )
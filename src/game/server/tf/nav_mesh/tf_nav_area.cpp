@@ -100,6 +100,7 @@ CTFNavArea::CTFNavArea()
 {
 	Q_memset( &m_aIncursionDistances, 0, sizeof( m_aIncursionDistances ) );
 	m_flBombTargetDistance = -1.0f;
+	m_nSentryTeams = 0;
 }
 
 CTFNavArea::~CTFNavArea()
@@ -160,6 +161,23 @@ NavErrorType CTFNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, uns
 	return NAV_OK;
 }
 
+void CTFNavArea::SaveCompiledCustomData( CUtlBuffer &fileBuffer ) const
+{
+	fileBuffer.PutUnsignedInt( m_nAttributes );
+}
+
+NavErrorType CTFNavArea::LoadCompiledCustomData( CUtlBuffer &fileBuffer, unsigned int subVersion )
+{
+	m_nAttributes = fileBuffer.GetUnsignedInt();
+	if ( !fileBuffer.IsValid() )
+	{
+		Warning( "Can't read TF-specific attributes\n" );
+		return NAV_INVALID_FILE;
+	}
+
+	return NAV_OK;
+}
+
 void CTFNavArea::UpdateBlocked( bool force, int teamID )
 {
 	//CNavArea::UpdateBlocked( force, teamID );
@@ -68,6 +68,8 @@ public:
 
 	virtual void Save( CUtlBuffer &fileBuffer, unsigned int version ) const override;
 	virtual NavErrorType Load( CUtlBuffer &fileBuffer, unsigned int version, unsigned int subVersion ) override;
+	virtual void SaveCompiledCustomData( CUtlBuffer &fileBuffer ) const override;
+	virtual NavErrorType LoadCompiledCustomData( CUtlBuffer &fileBuffer, unsigned int subVersion ) override;
 
 	virtual void UpdateBlocked( bool force = false, int teamID = TEAM_ANY ) override;
 	virtual bool IsBlocked( int teamID, bool ignoreNavBlockers = false ) const override;
@@ -150,6 +152,20 @@ public:
 		m_nAttributes &= ~bits;
 	}
 
+	// teams with a sentry gun standing in this area, kept by CTFNavMesh::UpdateSentryOccupancy for path costs
+	void ClearSentryTeams( void )
+	{
+		m_nSentryTeams = 0;
+	}
+	void AddSentryTeam( int iTeamNum )
+	{
+		m_nSentryTeams |= ( 1 << iTeamNum );
+	}
+	bool HasSentryOfTeam( int iTeamNum ) const
+	{
+		return ( m_nSentryTeams & ( 1 << iTeamNum ) ) != 0;
+	}
+
 	void SetBombTargetDistance( float distance )
 	{
 		m_flBombTargetDistance = distance;
@@ -178,6 +194,8 @@ private:
 
 	float m_flBombTargetDistance;
 
+	int m_nSentryTeams;
+
 	int m_TFMarker;
 };
 
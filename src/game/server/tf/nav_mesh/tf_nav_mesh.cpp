@@ -334,6 +334,11 @@ void CTFNavMesh::Update()
 				m_recomputeTimer.Invalidate();
 				RecomputeInternalData();
 			}
+
+			if ( m_sentryOccupancyTimer.IsElapsed() )
+			{
+				UpdateSentryOccupancy();
+			}
 		}
 		m_lastNPCCount = TheNextBots().GetNextBotCount();
 	}
@@ -487,6 +492,34 @@ bool CTFNavMesh::IsSentryGunHere( CTFNavArea *area ) const
 	return false;
 }
 
+// Mark the area each sentry gun stands in, so path costs don't have to look them up per area expanded.
+// Refreshed when sentries are built/moved/destroyed, and periodically to catch anything else.
+void CTFNavMesh::UpdateSentryOccupancy()
+{
+	VPROF_BUDGET( __FUNCTION__, "NextBot" );
+
+	for ( int i=0; i < TheNavAreas.Count(); ++i )
+	{
+		static_cast<CTFNavArea *>( TheNavAreas[i] )->ClearSentryTeams();
+	}
+
+	for ( int i=0; i < IBaseObjectAutoList::AutoList().Count(); ++i )
+	{
+		CBaseObject *obj = static_cast<CBaseObject *>( IBaseObjectAutoList::AutoList()[i] );
+		if ( obj == nullptr || obj->GetType() != OBJ_SENTRYGUN )
+			continue;
+
+		obj->UpdateLastKnownArea();
+		CTFNavArea *area = static_cast<CTFNavArea *>( obj->GetLastKnownArea() );
+		if ( area )
+		{
+			area->AddSentryTeam( obj->GetTeamNumber() );
+		}
+	}
+
+	m_sentryOccupancyTimer.Start( 1.0f );
+}
+
 void CTFNavMesh::OnBlockedAreasChanged()
 {
 	VPROF_BUDGET( __FUNCTION__, "NextBot" );
@@ -866,6 +899,8 @@ void CTFNavMesh::OnObjectChanged()
 
 	if ( tf_show_sentry_danger.GetInt() )
 		DevMsg( "%s: sentries:%d areas count:%d\n", __FUNCTION__, sentries.Count(), m_sentryAreas.Count() );
+
+	UpdateSentryOccupancy();
 }
 
 // TODO: Why do they recompute so much so often?
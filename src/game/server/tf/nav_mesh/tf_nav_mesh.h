@@ -38,6 +38,7 @@ public:
 	void CollectBuiltObjects( CUtlVector<CBaseObject *> *objects, int teamNum );
 	void CollectSpawnRoomThresholdAreas( CUtlVector<CTFNavArea *> *areas, int teamNum ) const;
 	bool IsSentryGunHere( CTFNavArea *area ) const;
+	void UpdateSentryOccupancy( void );			// refresh the sentry teams kept on each area for path costs
 
 	const CUtlVector<CTFNavArea *> &GetControlPointAreas( int iPointIndex ) const
 	{
@@ -96,6 +97,7 @@ private:
 	int m_pointChangedIdx;
 
 	CUtlVector<CTFNavArea *> m_sentryAreas;
+	CountdownTimer m_sentryOccupancyTimer;
 
 	CUtlVector<CTFNavArea *> m_CPAreas[MAX_CONTROL_POINTS];
 	CTFNavArea *m_CPArea[MAX_CONTROL_POINTS];
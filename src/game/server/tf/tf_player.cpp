@@ -2478,8 +2478,9 @@ CBaseEntity *FindPlayerStart(const char *pszClassName);
 
 CBaseEntity* CTFPlayer::EntSelectSpawnPoint()
 {
+	static CPooledStringLiteral s_iszTeamSpawn( "info_player_teamspawn" );
+
 	CBaseEntity *pSpot = g_pLastSpawnPoints[ GetTeamNumber() ];
-	const char *pSpawnPointName = "";
 
 	switch( GetTeamNumber() )
 	{
@@ -2487,8 +2488,6 @@ CBaseEntity* CTFPlayer::EntSelectSpawnPoint()
 	case TF_TEAM_BLUE:
 	case TF_TEAM_MERCENARY:
 		{
-			pSpawnPointName = "info_player_teamspawn";
-
 			bool bFind = false;
 
 			// in deathmatch players need to spawn further away from people for balance
@@ -2496,11 +2495,11 @@ CBaseEntity* CTFPlayer::EntSelectSpawnPoint()
 			// zombies (in infection) also use DM spawning algorithms
 			if ( ( TFGameRules()->IsDMGamemode() && !TFGameRules()->IsTeamplay() ) || m_Shared.IsZombie() )
 			{
-				bFind = SelectDMSpawnSpots( pSpawnPointName, pSpot );
+				bFind = SelectDMSpawnSpots( s_iszTeamSpawn, pSpot );
 			}
 			else
 			{
-				bFind = SelectSpawnSpot( pSpawnPointName, pSpot );
+				bFind = SelectSpawnSpot( s_iszTeamSpawn, pSpot );
 			}
 
 			if ( bFind )
@@ -2524,10 +2523,8 @@ CBaseEntity* CTFPlayer::EntSelectSpawnPoint()
 
 	if ( !pSpot )
 	{
-		pSpawnPointName = "info_player_teamspawn";
-
 		// There's a rare chance if there is too many players then the DM spawning will fail, so fallback to normal spawning
-		if ( SelectSpawnSpot( pSpawnPointName, pSpot ) )
+		if ( SelectSpawnSpot( s_iszTeamSpawn, pSpot ) )
 		{
 			g_pLastSpawnPoints[ GetTeamNumber() ] = pSpot;
 
@@ -2550,14 +2547,14 @@ CBaseEntity* CTFPlayer::EntSelectSpawnPoint()
 //-----------------------------------------------------------------------------
 // Purpose: Spawning for normal gameplay
 //-----------------------------------------------------------------------------
-bool CTFPlayer::SelectSpawnSpot( const char *pEntClassName, CBaseEntity* &pSpot )
+bool CTFPlayer::SelectSpawnSpot( string_t iszClassName, CBaseEntity* &pSpot )
 {
 	// Get an initial spawn point.
-	pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+	pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 	if ( !pSpot )
 	{
 		// Sometimes the first spot can be NULL????
-		pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+		pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 	}
 
 	// First we try to find a spawn point that is fully clear. If that fails,
@@ -2577,7 +2574,7 @@ bool CTFPlayer::SelectSpawnSpot( const char *pEntClassName, CBaseEntity* &pSpot
 				// Check for a bad spawn entity.
 				if ( pSpot->GetAbsOrigin() == Vector( 0, 0, 0 ) )
 				{
-					pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+					pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 					continue;
 				}
 
@@ -2609,13 +2606,13 @@ bool CTFPlayer::SelectSpawnSpot( const char *pEntClassName, CBaseEntity* &pSpot
 		}
 
 		// Get the next spawning point to check.
-		pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+		pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 
 		if ( pSpot == pFirstSpot && !bIgnorePlayers )
 		{
 			// Loop through again, ignoring players
 			bIgnorePlayers = true;
-			pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+			pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 		}
 	} 
 	// Continue until a valid spawn point is found or we hit the start.
@@ -2629,20 +2626,20 @@ bool CTFPlayer::SelectSpawnSpot( const char *pEntClassName, CBaseEntity* &pSpot
 //-----------------------------------------------------------------------------
 // Purpose: Spawning for deathmatch
 //-----------------------------------------------------------------------------
-bool CTFPlayer::SelectDMSpawnSpots( const char *pEntClassName, CBaseEntity* &pSpot )
+bool CTFPlayer::SelectDMSpawnSpots( string_t iszClassName, CBaseEntity* &pSpot )
 {
 	// Get an initial spawn point.
-	pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+	pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 	if ( !pSpot )
 	{
 		// Sometimes the first spot can be NULL????
-		pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+		pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 	}
 
 	// Randomize the spawnpoint a bit (not sure if 5 is a good value here)
 	for ( int i = random->RandomInt( 0, SPAWNPOINT_ITERATIONS ); i < ( SPAWNPOINT_ITERATIONS + 1 ); i++ )
 	{
-		pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+		pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 	}
 
 	// First we try to find a spawn point that is fully clear. If that fails,
@@ -2660,7 +2657,7 @@ bool CTFPlayer::SelectDMSpawnSpots( const char *pEntClassName, CBaseEntity* &pSp
 	{
 		if ( !pSpot )
 		{
-			pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+			pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 			continue;
 		}
 
@@ -2670,7 +2667,7 @@ bool CTFPlayer::SelectDMSpawnSpots( const char *pEntClassName, CBaseEntity* &pSp
 			// Check for a bad spawn entity.
 			if ( pSpot->GetAbsOrigin() == vec3_origin )
 			{
-				pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+				pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 				continue;
 			}
 
@@ -2715,7 +2712,7 @@ bool CTFPlayer::SelectDMSpawnSpots( const char *pEntClassName, CBaseEntity* &pSp
 		}
 
 		// Get the next spawning point to check.
-		pSpot = gEntList.FindEntityByClassname( pSpot, pEntClassName );
+		pSpot = gEntList.FindEntityByClassnameFast( pSpot, iszClassName );
 	}
 	// Continue until a valid spawn point is found or we hit the start.
 	while ( pSpot != pFirstSpot );
@@ -561,9 +561,9 @@ private:
 	int					GetCarriedWeapons();
 	void				StripWeapons();
 
-	bool				SelectSpawnSpot( const char *pEntClassName, CBaseEntity* &pSpot );
+	bool				SelectSpawnSpot( string_t iszClassName, CBaseEntity* &pSpot );
 	// for deathmatch
-	bool				SelectDMSpawnSpots(const char *pEntClassName, CBaseEntity* &pSpot);
+	bool				SelectDMSpawnSpots( string_t iszClassName, CBaseEntity* &pSpot );
 
 	void				PrecachePlayerModels( void );
 	void				PrecacheMyself( void );
@@ -158,8 +158,8 @@ void CEntityFactoryDictionary::InstallFactory( IEntityFactory *pFactory, const c
 //-----------------------------------------------------------------------------
 IServerNetworkable *CEntityFactoryDictionary::Create( const char *pClassName )
 {
-	IEntityFactory *pFactory = FindFactory( pClassName );
-	if ( !pFactory )
+	unsigned short nIndex = m_Factories.Find( pClassName );
+	if ( nIndex == m_Factories.InvalidIndex() )
 	{
 #ifdef STAGING_ONLY
 		static ConVarRef tf_bot_use_items( "tf_bot_use_items" );
@@ -172,7 +172,9 @@ IServerNetworkable *CEntityFactoryDictionary::Create( const char *pClassName )
 #if defined(TRACK_ENTITY_MEMORY) && defined(USE_MEM_DEBUG)
 	MEM_ALLOC_CREDIT_( m_Factories.GetElementName( m_Factories.Find( pClassName ) ) );
 #endif
-	return pFactory->Create( pClassName );
+	// Use the registered spelling, whatever case the map used, so every entity of
+	// a class shares one pooled classname and can be found by pointer
+	return m_Factories[nIndex]->Create( m_Factories.GetElementName( nIndex ) );
 }
 
 //-----------------------------------------------------------------------------
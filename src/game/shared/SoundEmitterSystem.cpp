@@ -15,6 +15,8 @@
 #include "tier0/vprof.h"
 #include "checksum_crc.h"
 #include "tier0/icommandline.h"
+#include "tier1/utlhashtable.h"
+#include "weapon_parse.h"
 
 #if defined( TF_CLIENT_DLL ) || defined( TF_DLL )
 #include "tf_shareddefs.h"
@@ -143,13 +145,132 @@ void Hack_FixEscapeChars( char *str )
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: 
+// Hashed name -> script handle index over every entry in soundemitterbase.
+// The base keeps its entries in a sorted tree, so each by-name lookup costs a
+// string compare per level of the tree; this flattens that to one hash probe.
+// Rebuilt whenever the set of entries can change (level overrides, reloads).
+// Handles cached outside it, the weapon shoot sounds, are re-resolved along
+// with it.
 //-----------------------------------------------------------------------------
+class CSoundScriptIndex
+{
+public:
+	CSoundScriptIndex() : m_bValid( false ), m_nLookupTick( -1 ), m_nLookupsThisTick( 0 ), m_nLookupsLastTick( 0 ), m_nLookupsPeak( 0 ), m_nLookupsTotal( 0 ), m_nMisses( 0 )
+	{
+	}
+
+	void Invalidate()
+	{
+		m_bValid = false;
+		ResolveWeaponShootSoundHandles( soundemitterbase );
+	}
+
+	void Rebuild()
+	{
+		m_Index.RemoveAll();
+		m_Names.PurgeAndDeleteElements();
+
+		m_Index.Reserve( soundemitterbase->GetSoundCount() );
+		for ( int i = soundemitterbase->First(); i != soundemitterbase->InvalidIndex(); i = soundemitterbase->Next( i ) )
+		{
+			Add( soundemitterbase->GetSoundName( i ), (HSOUNDSCRIPTHANDLE)i );
+		}
+		m_bValid = true;
+
+		ResolveWeaponShootSoundHandles( soundemitterbase );
+	}
+
+	// Resolves a script name, counting it as a lookup that didn't come with a cached handle
+	HSOUNDSCRIPTHANDLE Find( const char *soundname )
+	{
+		if ( !soundname || !soundname[0] )
+			return SOUNDEMITTER_INVALID_HANDLE;
+
+		VPROF_INCREMENT_COUNTER( "Sound script name lookups", 1 );
+		CountLookup();
+
+		if ( !m_bValid )
+		{
+			Rebuild();
+		}
+
+		UtlHashHandle_t h = m_Index.Find( soundname );
+		if ( h != m_Index.InvalidHandle() )
+			return m_Index[h];
+
+		// The base is shared with the other game dll, which may have added
+		// entries since we last rebuilt. Ask it, and remember what it says.
+		++m_nMisses;
+		int soundIndex = soundemitterbase->GetSoundIndex( soundname );
+		if ( !soundemitterbase->IsValidIndex( soundIndex ) )
+			return SOUNDEMITTER_INVALID_HANDLE;
+
+		Add( soundemitterbase->GetSoundName( soundIndex ), (HSOUNDSCRIPTHANDLE)soundIndex );
+		return (HSOUNDSCRIPTHANDLE)soundIndex;
+	}
+
+	void PrintStats( bool bReset )
+	{
+		CountLookup();
+		Msg( "Sound script index: %d entries%s\n", m_Index.Count(), m_bValid ? "" : " (stale)" );
+		Msg( "  name lookups: %d total, %d last tick, %d peak per tick, %d index misses\n",
+			m_nLookupsTotal, m_nLookupsLastTick, m_nLookupsPeak, m_nMisses );
+
+		if ( bReset )
+		{
+			m_nLookupsThisTick = m_nLookupsLastTick = m_nLookupsPeak = m_nLookupsTotal = m_nMisses = 0;
+		}
+	}
+
+private:
+	void Add( const char *soundname, HSOUNDSCRIPTHANDLE handle )
+	{
+		// Own the key, entries can disappear from the base underneath us
+		if ( m_Index.HasElement( soundname ) )
+			return;
+
+		m_Names.CopyAndAddToTail( soundname );
+		m_Index.Insert( m_Names.Tail(), handle );
+	}
+
+	// Lookups are bucketed by tick so hot by-name callers show up as a per tick rate
+	void CountLookup()
+	{
+		if ( gpGlobals->tickcount != m_nLookupTick )
+		{
+			m_nLookupsLastTick = m_nLookupsThisTick;
+			m_nLookupsPeak = MAX( m_nLookupsPeak, m_nLookupsThisTick );
+			m_nLookupsThisTick = 0;
+			m_nLookupTick = gpGlobals->tickcount;
+		}
+		++m_nLookupsThisTick;
+		++m_nLookupsTotal;
+	}
+
+	CUtlHashtable< const char *, HSOUNDSCRIPTHANDLE, CaselessStringHashFunctor, CaselessStringEqualFunctor > m_Index;
+	CUtlStringList m_Names;
+	bool m_bValid;
+
+	int m_nLookupTick;
+	int m_nLookupsThisTick;
+	int m_nLookupsLastTick;
+	int m_nLookupsPeak;
+	int m_nLookupsTotal;
+	int m_nMisses;
+};
+
 class CSoundEmitterSystem : public CBaseGameSystem
 {
 public:
 	virtual char const *Name() { return "CSoundEmitterSystem"; }
 
+	CSoundScriptIndex m_ScriptIndex;
+
+	HSOUNDSCRIPTHANDLE LookupScriptHandle( const char *soundname )
+	{
+		return m_ScriptIndex.Find( soundname );
+	}
+
 #if !defined( CLIENT_DLL )
 	bool			m_bLogPrecache;
 	FileHandle_t	m_hPrecacheLogFile;
@@ -236,6 +357,7 @@ public:
 #endif
 		g_pClosecaption = cvar->FindVar("closecaption");
 		Assert(g_pClosecaption);
+		m_ScriptIndex.Invalidate();
 		return soundemitterbase->ModInit();
 	}
 
@@ -251,6 +373,7 @@ public:
 	void ReloadSoundEntriesInList( IFileList *pFilesToReload )
 	{
 		soundemitterbase->ReloadSoundEntriesInList( pFilesToReload );
+		m_ScriptIndex.Invalidate();
 	}
 
 	virtual void TraceEmitSound( char const *fmt, ... )
@@ -319,6 +442,9 @@ public:
 			}
 		}
 
+		// Overrides may have added entries; build now rather than on the first emit of the level
+		m_ScriptIndex.Rebuild();
+
 #if !defined( CLIENT_DLL )
 		for ( int i=soundemitterbase->First(); i != soundemitterbase->InvalidIndex(); i=soundemitterbase->Next( i ) )
 		{
@@ -338,6 +464,7 @@ public:
 	virtual void LevelShutdownPostEntity()
 	{
 		soundemitterbase->ClearSoundOverrides();
+		m_ScriptIndex.Invalidate();
 
 #if !defined( CLIENT_DLL )
 		FinishLog();
@@ -404,7 +531,7 @@ public:
 
 	HSOUNDSCRIPTHANDLE PrecacheScriptSound( const char *soundname )
 	{
-		int soundIndex = soundemitterbase->GetSoundIndex( soundname );
+		int soundIndex = LookupScriptHandle( soundname );
 		if ( !soundemitterbase->IsValidIndex( soundIndex ) )
 		{
 			if ( Q_stristr( soundname, ".wav" ) || Q_strstr( soundname, ".mp3" ) )
@@ -442,7 +569,7 @@ public:
 
 	void PrefetchScriptSound( const char *soundname )
 	{
-		int soundIndex = soundemitterbase->GetSoundIndex( soundname );
+		int soundIndex = LookupScriptHandle( soundname );
 		if ( !soundemitterbase->IsValidIndex( soundIndex ) )
 		{
 			if ( Q_stristr( soundname, ".wav" ) || Q_strstr( soundname, ".mp3" ) )
@@ -719,7 +846,7 @@ public:
 
 		if ( ep.m_hSoundScriptHandle == SOUNDEMITTER_INVALID_HANDLE )
 		{
-			ep.m_hSoundScriptHandle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( ep.m_pSoundName );
+			ep.m_hSoundScriptHandle = LookupScriptHandle( ep.m_pSoundName );
 		}
 
 		if ( ep.m_hSoundScriptHandle == -1 )
@@ -906,7 +1033,8 @@ public:
 		// Pull data from parameters
 		CSoundParameters params;
 
-		if ( !soundemitterbase->GetParametersForSound( soundname, params, GENDER_NONE ) )
+		HSOUNDSCRIPTHANDLE handle = LookupScriptHandle( soundname );
+		if ( !soundemitterbase->GetParametersForSoundEx( soundname, handle, params, GENDER_NONE ) )
 		{
 			return;
 		}
@@ -979,7 +1107,7 @@ public:
 	{
 		if ( handle == SOUNDEMITTER_INVALID_HANDLE )
 		{
-			handle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( soundname );
+			handle = LookupScriptHandle( soundname );
 		}
 
 		if ( handle == SOUNDEMITTER_INVALID_HANDLE )
@@ -1012,7 +1140,7 @@ public:
 
 	void StopSound( int entindex, const char *soundname )
 	{
-		HSOUNDSCRIPTHANDLE handle = (HSOUNDSCRIPTHANDLE)soundemitterbase->GetSoundIndex( soundname );
+		HSOUNDSCRIPTHANDLE handle = LookupScriptHandle( soundname );
 		if ( handle == SOUNDEMITTER_INVALID_HANDLE )
 		{
 			return;
@@ -1117,6 +1245,15 @@ IGameSystem *SoundEmitterSystem()
 	return &g_SoundEmitterSystem;
 }
 
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_soundscript_lookup_stats, "Print how many sound script lookups came in by name rather than with a cached handle. Pass 'reset' to clear them." )
+#else
+CON_COMMAND( sv_soundscript_lookup_stats, "Print how many sound script lookups came in by name rather than with a cached handle. Pass 'reset' to clear them." )
+#endif
+{
+	g_SoundEmitterSystem.m_ScriptIndex.PrintStats( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) );
+}
+
 #if defined( CLIENT_DLL )
 void ReloadSoundEntriesInList( IFileList *pFilesToReload )
 {
@@ -1515,7 +1652,8 @@ void CBaseEntity::StopSound( int iEntIndex, int iChannel, const char *pSample )
 
 soundlevel_t CBaseEntity::LookupSoundLevel( const char *soundname )
 {
-	return soundemitterbase->LookupSoundLevel( soundname );
+	HSOUNDSCRIPTHANDLE handle = g_SoundEmitterSystem.LookupScriptHandle( soundname );
+	return soundemitterbase->LookupSoundLevelByHandle( soundname, handle );
 }
 
 
@@ -1616,8 +1754,9 @@ void CBaseEntity::GenderExpandString( char const *in, char *out, int maxlen )
 bool CBaseEntity::GetParametersForSound( const char *soundname, CSoundParameters &params, const char *actormodel )
 {
 	gender_t gender = soundemitterbase->GetActorGender( actormodel );
+	HSOUNDSCRIPTHANDLE handle = g_SoundEmitterSystem.LookupScriptHandle( soundname );
 	
-	return soundemitterbase->GetParametersForSound( soundname, params, gender );
+	return soundemitterbase->GetParametersForSoundEx( soundname, handle, params, gender );
 }
 
 bool CBaseEntity::GetParametersForSound( const char *soundname, HSOUNDSCRIPTHANDLE& handle, CSoundParameters &params, const char *actormodel )
@@ -1632,7 +1771,7 @@ HSOUNDSCRIPTHANDLE CBaseEntity::PrecacheScriptSound( const char *soundname )
 #if !defined( CLIENT_DLL )
 	return g_SoundEmitterSystem.PrecacheScriptSound( soundname );
 #else
-	return soundemitterbase->GetSoundIndex( soundname );
+	return g_SoundEmitterSystem.LookupScriptHandle( soundname );
 #endif
 }
 
@@ -315,13 +315,18 @@ void CBaseCombatWeapon::Precache( void )
 			m_iWorldModelIndex = CBaseEntity::PrecacheModel( GetWorldModel() );
 		}
 
-		// Precache sounds, too
+		// Precache sounds, too, keeping the handles of the ones from the script file for WeaponSound
+		FileWeaponInfo_t *pWeaponInfo = GetFileWeaponInfoFromHandle( m_hWeaponFileInfo );
 		for ( int i = 0; i < NUM_SHOOT_SOUND_TYPES; ++i )
 		{
 			const char *shootsound = GetShootSound( i );
 			if ( shootsound && shootsound[0] )
 			{
-				CBaseEntity::PrecacheScriptSound( shootsound );
+				HSOUNDSCRIPTHANDLE hSound = CBaseEntity::PrecacheScriptSound( shootsound );
+				if ( shootsound == pWeaponInfo->aShootSounds[i] )
+				{
+					pWeaponInfo->aShootSoundHandles[i] = hSound;
+				}
 			}
 		}
 	}
@@ -383,13 +388,18 @@ void CBaseCombatWeapon::ParseWeaponScript( bool bReParse )
 			m_iWorldModelIndex = CBaseEntity::PrecacheModel( GetWorldModel() );
 		}
 
-		// Precache sounds, too
+		// Precache sounds, too, keeping the handles of the ones from the script file for WeaponSound
+		FileWeaponInfo_t *pWeaponInfo = GetFileWeaponInfoFromHandle( m_hWeaponFileInfo );
 		for ( int i = 0; i < NUM_SHOOT_SOUND_TYPES; ++i )
 		{
 			const char *shootsound = GetShootSound( i );
 			if ( shootsound && shootsound[0] )
 			{
-				CBaseEntity::PrecacheScriptSound( shootsound );
+				HSOUNDSCRIPTHANDLE hSound = CBaseEntity::PrecacheScriptSound( shootsound );
+				if ( shootsound == pWeaponInfo->aShootSounds[i] )
+				{
+					pWeaponInfo->aShootSoundHandles[i] = hSound;
+				}
 			}
 		}
 	}
@@ -2057,9 +2067,17 @@ void CBaseCombatWeapon::WeaponSound( WeaponSound_t sound_type, float soundtime /
 	if ( !shootsound || !shootsound[0] )
 		return;
 
+	// Sounds straight from the script file were resolved at precache, and again by the sound emitter
+	// system whenever the sound scripts change, anything else resolves once here.
+	HSOUNDSCRIPTHANDLE hSound = SOUNDEMITTER_INVALID_HANDLE;
+	if ( shootsound == GetWpnData().aShootSounds[sound_type] )
+	{
+		hSound = GetWpnData().aShootSoundHandles[sound_type];
+	}
+
 	CSoundParameters params;
 	
-	if ( !GetParametersForSound( shootsound, params, NULL ) )
+	if ( !GetParametersForSound( shootsound, hSound, params, NULL ) )
 		return;
 
 	if ( params.play_to_owner_only )
@@ -2072,7 +2090,7 @@ void CBaseCombatWeapon::WeaponSound( WeaponSound_t sound_type, float soundtime /
 			{
 				filter.UsePredictionRules();
 			}
-			EmitSound( filter, GetOwner()->entindex(), shootsound, NULL, soundtime );
+			EmitSound( filter, GetOwner()->entindex(), shootsound, hSound, NULL, soundtime );
 		}
 	}
 	else
@@ -2085,7 +2103,7 @@ void CBaseCombatWeapon::WeaponSound( WeaponSound_t sound_type, float soundtime /
 			{
 				filter.UsePredictionRules();
 			}
-			EmitSound( filter, GetOwner()->entindex(), shootsound, NULL, soundtime ); 
+			EmitSound( filter, GetOwner()->entindex(), shootsound, hSound, NULL, soundtime ); 
 
 #if !defined( CLIENT_DLL )
 			if( sound_type == EMPTY )
@@ -2102,7 +2120,7 @@ void CBaseCombatWeapon::WeaponSound( WeaponSound_t sound_type, float soundtime /
 			{
 				filter.UsePredictionRules();
 			}
-			EmitSound( filter, entindex(), shootsound, NULL, soundtime ); 
+			EmitSound( filter, entindex(), shootsound, hSound, NULL, soundtime ); 
 		}
 	}
 }
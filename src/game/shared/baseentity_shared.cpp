@@ -327,6 +327,13 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 		*s = '\0';
 	}
 
+#ifdef GAME_DLL
+	// The factory already gave us the registered spelling of our classname. Keep it when the map
+	// spells it with different case, so each class has one pooled classname FindEntityByClassnameFast can match.
+	if ( !Q_stricmp( szKeyName, "classname" ) && m_iClassname != NULL_STRING && !Q_stricmp( STRING( m_iClassname ), szValue ) )
+		return true;
+#endif
+
 	if ( FStrEq( szKeyName, "rendercolor" ) || FStrEq( szKeyName, "rendercolor32" ))
 	{
 		color32 tmp;
@@ -441,6 +448,7 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 	if ( FStrEq( szKeyName, "targetname" ) )
 	{
 		m_iName = AllocPooledString( szValue );
+		gEntList.NotifyNameChanged();
 		return true;
 	}
 
@@ -16,6 +16,10 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+// Pooled strings are packed back to back into blocks of this size, which are
+// freed together at level shutdown instead of one heap allocation per string.
+#define GAMESTRING_BLOCK_SIZE		( 32 * 1024 )
+
 //-----------------------------------------------------------------------------
 // Purpose: The actual storage for pooled per-level strings
 //-----------------------------------------------------------------------------
@@ -36,14 +40,55 @@ class CGameStringPool : public CBaseGameSystem
 #endif
 		m_Strings.Purge();
 		m_KeyLookupCache.Purge();
+
+		for ( int i = 0; i < m_Blocks.Count(); ++i )
+		{
+			delete [] m_Blocks[i];
+		}
+		m_Blocks.Purge();
+		m_pBlockCur = NULL;
+		m_nBlockRemaining = 0;
+
+		// Invalidates every CPooledStringLiteral
+		++m_nSerial;
 	}
 
-	CUtlHashtable<CUtlConstString> m_Strings;
+	// Copies a string into the current block, starting a new one when it's full
+	const char *CopyString( const char *string, int nLen )
+	{
+		if ( nLen > m_nBlockRemaining )
+		{
+			// Long strings get a block of their own so the current one isn't abandoned
+			if ( nLen > GAMESTRING_BLOCK_SIZE / 4 )
+			{
+				char *pBlock = new char[ nLen ];
+				m_Blocks.AddToTail( pBlock );
+				V_memcpy( pBlock, string, nLen );
+				return pBlock;
+			}
+
+			m_pBlockCur = new char[ GAMESTRING_BLOCK_SIZE ];
+			m_nBlockRemaining = GAMESTRING_BLOCK_SIZE;
+			m_Blocks.AddToTail( m_pBlockCur );
+		}
+
+		char *pString = m_pBlockCur;
+		V_memcpy( pString, string, nLen );
+		m_pBlockCur += nLen;
+		m_nBlockRemaining -= nLen;
+		return pString;
+	}
+
+	CUtlHashtable<const char*> m_Strings;
 	CUtlHashtable<const void*, const char*> m_KeyLookupCache;
+	CUtlVector<char*> m_Blocks;
+	char *m_pBlockCur;
+	int m_nBlockRemaining;
+	int m_nSerial;
 
 public:
 
-	CGameStringPool() : m_Strings(256) { }
+	CGameStringPool() : m_Strings(256), m_pBlockCur( NULL ), m_nBlockRemaining( 0 ), m_nSerial( 0 ) { }
 
 	~CGameStringPool() { FreeAll(); }
 
@@ -52,7 +97,7 @@ public:
 		CUtlVector<const char*> strings( 0, m_Strings.Count() );
 		for (UtlHashHandle_t i = m_Strings.FirstHandle(); i != m_Strings.InvalidHandle(); i = m_Strings.NextHandle(i))
 		{
-			strings.AddToTail( strings[i] );
+			strings.AddToTail( m_Strings.Key( i ) );
 		}
 		struct _Local {
 			static int __cdecl F(const char * const *a, const char * const *b) { return strcmp(*a, *b); }
@@ -64,18 +109,39 @@ public:
 			DevMsg( "  %d (0x%p) : %s\n", i, strings[i], strings[i] );
 		}
 		DevMsg( "\n" );
-		DevMsg( "Size:  %d items\n", strings.Count() );
+		DevMsg( "Size:  %d items, %d blocks\n", strings.Count(), m_Blocks.Count() );
+	}
+
+	int Serial() const
+	{
+		return m_nSerial;
+	}
+
+	unsigned int Hash( const char *string ) const
+	{
+		return m_Strings.GetHashRef()( string );
 	}
 
 	const char *Find(const char *string)
 	{
 		UtlHashHandle_t i = m_Strings.Find( string );
-		return i == m_Strings.InvalidHandle() ? NULL : m_Strings[ i ].Get();
+		return i == m_Strings.InvalidHandle() ? NULL : m_Strings.Key( i );
+	}
+
+	const char *Allocate(const char *string, unsigned int nHash)
+	{
+		UtlHashHandle_t i = m_Strings.Find( string, nHash );
+		if ( i != m_Strings.InvalidHandle() )
+			return m_Strings.Key( i );
+
+		const char *pString = CopyString( string, V_strlen( string ) + 1 );
+		m_Strings.Insert( pString, empty_t(), nHash );
+		return pString;
 	}
 
 	const char *Allocate(const char *string)
 	{
-		return m_Strings[ m_Strings.Insert( string ) ].Get();
+		return Allocate( string, Hash( string ) );
 	}
 
 	const char *AllocateWithKey(const char *string, const void* key)
@@ -112,6 +178,14 @@ string_t AllocPooledString( const char * pszValue )
 	return NULL_STRING;
 }
 
+string_t AllocPooledString( const char *pszValue, unsigned int nHash )
+{
+	Assert( nHash == g_GameStringPool.Hash( pszValue ) );
+	if (pszValue && *pszValue)
+		return MAKE_STRING( g_GameStringPool.Allocate( pszValue, nHash ) );
+	return NULL_STRING;
+}
+
 string_t AllocPooledString_StaticConstantStringPointer( const char * pszGlobalConstValue )
 {
 	Assert(pszGlobalConstValue && *pszGlobalConstValue);
@@ -123,6 +197,11 @@ string_t FindPooledString( const char *pszValue )
 	return MAKE_STRING( g_GameStringPool.Find( pszValue ) );
 }
 
+int GameStringPoolSerial()
+{
+	return g_GameStringPool.Serial();
+}
+
 #if !defined(CLIENT_DLL) && !defined( GC )
 //------------------------------------------------------------------------------
 // Purpose: 
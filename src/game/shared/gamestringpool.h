@@ -18,9 +18,76 @@
 // String allocation
 //-----------------------------------------------------------------------------
 string_t AllocPooledString( const char *pszValue );
+string_t AllocPooledString( const char *pszValue, unsigned int nHash );	// nHash from HashPooledStringLiteral
 string_t AllocPooledString_StaticConstantStringPointer( const char *pszGlobalConstValue );
 string_t FindPooledString( const char *pszValue );
 
+// Changes every time the pool is flushed (level shutdown), invalidating any string_t cached from it
+int GameStringPoolSerial();
+
+//-----------------------------------------------------------------------------
+// The pool's hash of a string literal. Unrolled over the literal's length so
+// the compiler folds it to a constant.
+//-----------------------------------------------------------------------------
+template < int N >
+struct CPooledStringLiteralHash
+{
+	static FORCEINLINE unsigned int Fnv( const char *s, unsigned int h ) { return CPooledStringLiteralHash< N - 1 >::Fnv( s + 1, ( h ^ (unsigned char)*s ) * 16777619u ); }
+};
+
+template <>
+struct CPooledStringLiteralHash< 0 >
+{
+	static FORCEINLINE unsigned int Fnv( const char *s, unsigned int h ) { return h; }
+};
+
+// Must match StringHashFunctor
+template < int N >
+FORCEINLINE unsigned int HashPooledStringLiteral( const char (&pszLiteral)[N] )
+{
+	unsigned int h = CPooledStringLiteralHash< N - 1 >::Fnv( pszLiteral, 2166136261u );
+	return ( h ^ ( h << 17 ) ) + ( h >> 21 );
+}
+
+//-----------------------------------------------------------------------------
+// A string literal's pooled string_t, cached until the pool is flushed. Declare
+// one as a static next to a hot lookup, e.g.
+//
+//	static CPooledStringLiteral s_iszTeamSpawn( "info_player_teamspawn" );
+//	pSpot = gEntList.FindEntityByClassnameFast( pSpot, s_iszTeamSpawn );
+//
+// After the first use in a level, Get() is a serial compare and a load: no
+// hashing, and the result compares to other pooled strings by pointer.
+//-----------------------------------------------------------------------------
+class CPooledStringLiteral
+{
+public:
+	template < int N >
+	CPooledStringLiteral( const char (&pszLiteral)[N] ) : m_pszLiteral( pszLiteral ), m_nHash( HashPooledStringLiteral( pszLiteral ) ), m_nSerial( -1 )
+	{
+	}
+
+	string_t Get()
+	{
+		int nSerial = GameStringPoolSerial();
+		if ( m_nSerial != nSerial )
+		{
+			m_iszPooled = AllocPooledString( m_pszLiteral, m_nHash );
+			m_nSerial = nSerial;
+		}
+		return m_iszPooled;
+	}
+
+	operator string_t() { return Get(); }
+	const char *String() { return STRING( Get() ); }
+
+private:
+	const char *m_pszLiteral;
+	unsigned int m_nHash;
+	int m_nSerial;
+	string_t m_iszPooled;
+};
+
 #define AssertIsValidString( s )	AssertMsg( s == NULL_STRING || s == FindPooledString( STRING(s) ), "Invalid string " #s );
 		 
 #ifndef GC
@@ -18,6 +18,7 @@
 
 #include "ienginevgui.h"
 #include "engine/IEngineSound.h"
+#include "tier1/utlhashtable.h"
 
 #include "tier0/memdbgon.h"
 
@@ -27,6 +28,25 @@
 	#define SHARED_ARGS UTIL_VarArgs
 #endif
 
+// Name -> script lookups over the manifests, so GetSoundscript doesn't have to
+// walk every script in the game with FindKey. Rebuilt whenever a manifest is parsed.
+typedef CUtlHashtable< const char *, KeyValues *, CaselessStringHashFunctor, CaselessStringEqualFunctor > SoundScriptIndex_t;
+static SoundScriptIndex_t s_GlobalSoundIndex;
+static SoundScriptIndex_t s_LevelSoundIndex;
+
+static void IndexSoundManifest( KeyValues *pManifest, SoundScriptIndex_t &index )
+{
+	index.RemoveAll();
+	if ( !pManifest )
+		return;
+
+	for ( KeyValues *pSound = pManifest->GetFirstSubKey(); pSound != NULL; pSound = pSound->GetNextKey() )
+	{
+		// Keeps the first script of a name, which is the one FindKey would have found
+		index.Insert( pSound->GetName(), pSound );
+	}
+}
+
 KeyValues* gSoundManifest;
 KeyValues* GlobalSoundManifest()
 {
@@ -40,6 +60,7 @@ void InitGlobalSoundManifest()
 		gSoundManifest->deleteThis();
 	}
 	gSoundManifest = new KeyValues( "GlobalSoundManifest" );
+	s_GlobalSoundIndex.RemoveAll();
 }
 
 KeyValues* gLevelSoundManifest;
@@ -55,6 +76,7 @@ void InitLevelSoundManifest()
 		gLevelSoundManifest->deleteThis();
 	}
 	gLevelSoundManifest = new KeyValues( "LevelSoundManifest" );
+	s_LevelSoundIndex.RemoveAll();
 }
 
 void ParseSoundManifest( void )
@@ -89,6 +111,8 @@ void ParseSoundManifest( void )
 			}
 		}	
 	}
+
+	IndexSoundManifest( GlobalSoundManifest(), s_GlobalSoundIndex );
 }
 
 void CheckGlobalSounManifest( void )
@@ -142,40 +166,23 @@ void ParseLevelSoundManifest( void )
 			}
 		}
 	}
+
+	IndexSoundManifest( LevelSoundManifest(), s_LevelSoundIndex );
 }
 
 KeyValues* GetSoundscript( const char *szSoundScript )
 {
-	KeyValues *pSound = new KeyValues( "SoundScript" );
-			
-	char mapsounds[MAX_PATH];
-	char mapname[ 256 ];
-	Q_StripExtension( 
-#if CLIENT_DLL
-	engine->GetLevelName()
-#else
-	STRING(gpGlobals->mapname)
-#endif
-	, mapname, sizeof( mapname ) );
-	Q_snprintf( mapsounds, sizeof( mapsounds ), "%s_level_sounds.txt", mapname );
-			
-	if( filesystem->FileExists( mapsounds , "GAME" ) )
-	{
-		pSound = LevelSoundManifest()->FindKey( szSoundScript );
-		if( !pSound )
-		{
-			DevMsg("Key not found in level sounds\n");
-			return GlobalSoundManifest()->FindKey( szSoundScript );
-		}
-		else
-			return pSound;
-	}
-	else if ( GlobalSoundManifest() )	
+	if ( !szSoundScript )
+		return NULL;
+
+	// Level sounds take priority over the global ones
+	KeyValues **ppSound = s_LevelSoundIndex.GetPtr( szSoundScript );
+	if ( !ppSound )
 	{
-		return GlobalSoundManifest()->FindKey( szSoundScript );
+		ppSound = s_GlobalSoundIndex.GetPtr( szSoundScript );
 	}
-	
-	return NULL;
+
+	return ppSound ? *ppSound : NULL;
 }
 #ifdef CLIENT_DLL
 void PrecacheUISoundScript( char *szSoundScript )
@@ -218,7 +225,6 @@ char *GetSoundScriptWave( char *szSoundScript )
 	if( !szSoundScript )
 		return NULL;
 
-	char *szReturn = new char[128];
 	KeyValues *pSoundScript = GetSoundscript( szSoundScript );
 	if( !pSoundScript )
 		return NULL;
@@ -226,25 +232,23 @@ char *GetSoundScriptWave( char *szSoundScript )
 	KeyValues *pWave = pSoundScript->FindKey("rndwave");
 	if( pWave )
 	{
-		KeyValues *pRand = new KeyValues("Rand");
 		int iMaxSounds = 0;
 		for( KeyValues *pSub = pWave->GetFirstSubKey(); pSub != NULL ; pSub = pSub->GetNextKey() )
 		{
-			pRand->SetString(SHARED_ARGS("%d",iMaxSounds),pSub->GetString());
 			iMaxSounds++;
 		}
 
-		if( iMaxSounds )
+		if( !iMaxSounds )
 		{
-			Q_strncpy(szReturn, pRand->GetString(SHARED_ARGS("%d", random->RandomInt( 0, iMaxSounds - 1 ) ) ), 128 );
-			return szReturn;
-		}
-		else
 			Warning("Failed to Play UI sound %s\n", szSoundScript);
-		
-		// We dont need rand anymore, so clear it to not cause memory leaks
-		pRand->deleteThis();
-		return NULL;
+			return NULL;
+		}
+
+		int iPick = random->RandomInt( 0, iMaxSounds - 1 );
+		for( pWave = pWave->GetFirstSubKey(); iPick > 0; pWave = pWave->GetNextKey() )
+		{
+			iPick--;
+		}
 	}
 	else
 	{
@@ -254,9 +258,11 @@ char *GetSoundScriptWave( char *szSoundScript )
 			Warning("Failed to play UI sound %s\n", szSoundScript);
 			return NULL;
 		}
-		Q_strncpy(szReturn, pWave->GetString(), 128 );
-		return szReturn;
 	}
+
+	char *szReturn = new char[128];
+	Q_strncpy(szReturn, pWave->GetString(), 128 );
+	return szReturn;
 }
 
 KeyValues* gItemsGame;
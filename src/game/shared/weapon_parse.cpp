@@ -14,6 +14,7 @@
 #include "player.h"
 #endif
 #include "ammodef.h"
+#include "SoundEmitterSystem/isoundemittersystembase.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -148,6 +149,30 @@ WEAPON_FILE_INFO_HANDLE GetInvalidWeaponInfoHandle( void )
 	return (WEAPON_FILE_INFO_HANDLE)m_WeaponInfoDatabase.InvalidIndex();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Looks up every weapon's script shoot sounds again, so the handles
+//			WeaponSound uses stay right across sound script reloads and level changes
+//-----------------------------------------------------------------------------
+void ResolveWeaponShootSoundHandles( ISoundEmitterSystemBase *pSoundEmitter )
+{
+	for ( unsigned short i = m_WeaponInfoDatabase.First(); i != m_WeaponInfoDatabase.InvalidIndex(); i = m_WeaponInfoDatabase.Next( i ) )
+	{
+		FileWeaponInfo_t *pInfo = m_WeaponInfoDatabase[ i ];
+		for ( int j = 0; j < NUM_SHOOT_SOUND_TYPES; j++ )
+		{
+			pInfo->aShootSoundHandles[j] = SOUNDEMITTER_INVALID_HANDLE;
+			if ( !pInfo->aShootSounds[j][0] )
+				continue;
+
+			int soundIndex = pSoundEmitter->GetSoundIndex( pInfo->aShootSounds[j] );
+			if ( pSoundEmitter->IsValidIndex( soundIndex ) )
+			{
+				pInfo->aShootSoundHandles[j] = (HSOUNDSCRIPTHANDLE)soundIndex;
+			}
+		}
+	}
+}
+
 void ResetFileWeaponInfoDatabase( void )
 {
 	for( int i = 0; i < TF_WEAPON_COUNT; i++ )
@@ -359,6 +384,10 @@ FileWeaponInfo_t::FileWeaponInfo_t()
 	szAmmo1[0] = 0;
 	szAmmo2[0] = 0;
 	memset( aShootSounds, 0, sizeof( aShootSounds ) );
+	for ( int i = 0; i < NUM_SHOOT_SOUND_TYPES; i++ )
+	{
+		aShootSoundHandles[i] = SOUNDEMITTER_INVALID_HANDLE;
+	}
 	iAmmoType = 0;
 	iAmmo2Type = 0;
 	m_bMeleeWeapon = false;
@@ -504,6 +533,10 @@ void FileWeaponInfo_t::Parse( KeyValues *pKeyValuesData, const char *szWeaponNam
 
 	// Now read the weapon sounds
 	memset( aShootSounds, 0, sizeof( aShootSounds ) );
+	for ( int i = EMPTY; i < NUM_SHOOT_SOUND_TYPES; i++ )
+	{
+		aShootSoundHandles[i] = SOUNDEMITTER_INVALID_HANDLE;
+	}
 	KeyValues *pSoundData = pKeyValuesData->FindKey( "SoundData" );
 	if ( pSoundData )
 	{
@@ -116,6 +116,7 @@ public:
 
 	// Sound blocks
 	char					aShootSounds[NUM_SHOOT_SOUND_TYPES][MAX_WEAPON_STRING];	
+	HSOUNDSCRIPTHANDLE		aShootSoundHandles[NUM_SHOOT_SOUND_TYPES];	// resolved when the weapon precaches, and again whenever the sound scripts change
 
 	int						iAmmoType;
 	int						iAmmo2Type;
@@ -163,6 +164,11 @@ FileWeaponInfo_t *GetFileWeaponInfoFromHandle( WEAPON_FILE_INFO_HANDLE handle );
 WEAPON_FILE_INFO_HANDLE GetInvalidWeaponInfoHandle( void );
 void PrecacheFileWeaponInfoDatabase( IFileSystem *filesystem, const unsigned char *pICEKey );
 
+// Sound script handles get renumbered when the scripts or the level's overrides change,
+// the sound emitter system calls this to resolve the cached shoot sound handles again.
+class ISoundEmitterSystemBase;
+void ResolveWeaponShootSoundHandles( ISoundEmitterSystemBase *pSoundEmitter );
+
 
 // 
 // Read a possibly-encrypted KeyValues file in. 
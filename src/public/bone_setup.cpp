@@ -212,30 +212,27 @@ short *CBoneCache::CachedToStudio()
 	return (short *)( (char *)(this+1) + m_cachedToStudioOffset );
 }
 
-// Construct a singleton
-static CDataManager<CBoneCache, bonecacheparams_t, CBoneCache *, CThreadFastMutex> g_StudioBoneCache( 128 * 1024L );
+// Construct a singleton. Sharded so threaded bone setup doesn't serialize on one LRU.
+static CShardedDataManager<CBoneCache, bonecacheparams_t, CBoneCache *> g_StudioBoneCache( 128 * 1024L );
 
 CBoneCache *Studio_GetBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	return g_StudioBoneCache.GetResource_NoLock( cacheHandle );
 }
 
 memhandle_t Studio_CreateBoneCache( bonecacheparams_t &params )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	return g_StudioBoneCache.CreateResource( params );
 }
 
 void Studio_DestroyBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	g_StudioBoneCache.DestroyResource( cacheHandle );
 }
 
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
+	AUTO_LOCK( g_StudioBoneCache.AccessMutex( cacheHandle ) );
 	CBoneCache *pCache = g_StudioBoneCache.GetResource_NoLock( cacheHandle );
 	if ( pCache )
 	{
@@ -243,6 +240,33 @@ void Studio_InvalidateBoneCache( memhandle_t cacheHandle )
 	}
 }
 
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_bonecache_stats, "Print bone cache hit/miss/eviction statistics. Pass 'reset' to clear them." )
+#else
+CON_COMMAND( sv_bonecache_stats, "Print bone cache hit/miss/eviction statistics. Pass 'reset' to clear them." )
+#endif
+{
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_StudioBoneCache.ResetStats();
+		return;
+	}
+
+	datamanagerstats_t stats;
+	for ( int i = 0; i < g_StudioBoneCache.ShardCount(); i++ )
+	{
+		g_StudioBoneCache.GetShardStats( i, stats );
+		Msg( "  shard %d: %4u caches %7u bytes, %u hits, %u misses, %u evictions, %u deferred touches (%u dropped) in %u passes\n",
+			i, stats.nResources, stats.nMemUsed, stats.nHits, stats.nMisses, stats.nEvictions, stats.nDeferredTouches, stats.nDroppedTouches, stats.nDeferredTouchPasses );
+	}
+
+	g_StudioBoneCache.GetStats( stats );
+	unsigned int nLookups = stats.nHits + stats.nMisses;
+	Msg( "Bone cache: %u caches, %u / %u bytes, %u hits, %u misses (%.1f%% hit), %u evictions\n",
+		stats.nResources, stats.nMemUsed, g_StudioBoneCache.TargetSize(), stats.nHits, stats.nMisses,
+		nLookups ? 100.0f * stats.nHits / nLookups : 0.0f, stats.nEvictions );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -221,6 +221,10 @@ public:
 #define RTE_FLAGS_DONT_STORE_TRIANGLE_COLORS 2				// saves memory if not needed
 #define RTE_FLAGS_DONT_STORE_TRIANGLE_MATERIALS 4
 
+#define BOXVIS_PARTIAL 0									// results of ClassifyBoxToBoxVisibility
+#define BOXVIS_OPEN 1
+#define BOXVIS_BLOCKED 2
+
 enum RayTraceLightingMode_t {
 	DIRECT_LIGHTING,										// just dot product lighting
 	DIRECT_LIGHTING_WITH_SHADOWS,						// with shadows
@@ -310,6 +314,12 @@ public:
 					RayTracingResult *rslt_out,
 					int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL);
 
+	// conservatively classify every segment from one box to the other: BOXVIS_OPEN if nothing
+	// can block any of them, BOXVIS_BLOCKED if a single triangle blocks them all, otherwise
+	// BOXVIS_PARTIAL. Triangles are treated as opaque, as when tracing without a callback.
+	int ClassifyBoxToBoxVisibility( Vector const &minsA, Vector const &maxsA,
+									Vector const &minsB, Vector const &maxsB );
+
 	// compute virtual light sources to model inter-reflection
 	void ComputeVirtualLightSources(void);
 
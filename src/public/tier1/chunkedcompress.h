@@ -0,0 +1,75 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+//  Chunked compression container. The input is split into fixed size chunks
+//  that are compressed independently, so they can be decoded in parallel and
+//  with a choice of codec: LZMA for size, Snappy for decode latency.
+//
+//========================================================================//
+
+#ifndef CHUNKEDCOMPRESS_H
+#define CHUNKEDCOMPRESS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class CUtlBuffer;
+
+#if !defined( _X360 )
+#define CHUNKED_ID				(('K'<<24)|('N'<<16)|('H'<<8)|('C'))
+#else
+#define CHUNKED_ID				(('C'<<24)|('H'<<16)|('N'<<8)|('K'))
+#endif
+
+#define CHUNKED_DEFAULT_CHUNK_SIZE	( 256 * 1024 )
+
+enum ECompressedChunkCodec
+{
+	CHUNK_CODEC_LZMA = 0,		// each chunk is a complete lzma_header_t stream
+	CHUNK_CODEC_SNAPPY,			// each chunk is a raw snappy block
+
+	CHUNK_CODEC_COUNT
+};
+
+// The header is followed by numChunks + 1 offsets (from the start of the header)
+// to the compressed chunks; the last one marks the end of the data.
+#pragma pack(1)
+struct chunked_header_t
+{
+	unsigned int	id;
+	unsigned int	actualSize;		// always little endian
+	unsigned int	chunkSize;		// always little endian, uncompressed bytes per chunk (last may be short)
+	unsigned int	numChunks;		// always little endian
+	unsigned char	codec;			// ECompressedChunkCodec
+	unsigned char	pad[3];
+};
+#pragma pack()
+
+// Compresses a single chunk into output. Used to plug in codecs that live outside tier1 (LZMA encoding).
+typedef bool (*ChunkCompressFunc_t)( const unsigned char *pInput, unsigned int nInputSize, CUtlBuffer &output );
+
+class CChunkedCompression
+{
+public:
+	static bool			IsCompressed( unsigned char *pInput );
+	static unsigned int	GetActualSize( unsigned char *pInput );
+	static unsigned int	GetCompressedSize( unsigned char *pInput );
+	static int			GetChunkCount( unsigned char *pInput );
+	static ECompressedChunkCodec GetCodec( unsigned char *pInput );
+
+	// Decodes one chunk into its place in pOutput. Safe to call concurrently for different chunks.
+	// nInputSize is how many bytes of pInput are readable; chunks reaching past it fail.
+	static bool			UncompressChunk( unsigned char *pInput, unsigned int nInputSize, int iChunk, unsigned char *pOutput );
+
+	// Decodes every chunk, spreading them across up to nThreads threads (0 means one per
+	// logical processor). Caller must provide an output buffer of GetActualSize() bytes.
+	// Returns the uncompressed size, or 0 on failure, including when the header or any
+	// chunk offset doesn't fit in the nInputSize bytes of pInput.
+	static unsigned int	Uncompress( unsigned char *pInput, unsigned int nInputSize, unsigned char *pOutput, int nThreads = 0 );
+
+	// Appends a chunked container to output. Snappy is built in; other codecs need pfnCompress.
+	static bool			Compress( ECompressedChunkCodec codec, const unsigned char *pInput, unsigned int nInputSize,
+								  CUtlBuffer &output, unsigned int nChunkSize = CHUNKED_DEFAULT_CHUNK_SIZE,
+								  ChunkCompressFunc_t pfnCompress = NULL );
+};
+
+#endif // CHUNKEDCOMPRESS_H
@@ -99,6 +99,10 @@ protected:
 	void					TouchByIndex( unsigned short memoryIndex );
 	void *					GetForFreeByIndex( unsigned short memoryIndex );
 
+	// Serial numbers start at nFirst and advance by nStride each time a handle is freed.
+	// Sharded managers use this to keep the shard index in the low bits of the serial.
+	void					SetSerialSequence( unsigned short nFirst, unsigned short nStride ) { m_serialFirst = nFirst; m_serialStride = nStride; }
+
 	// One of these is stored per active allocation
 	struct resource_lru_element_t
 	{
@@ -122,6 +126,8 @@ protected:
 	unsigned short m_lruList;
 	unsigned short m_lockList;
 	unsigned short m_freeList;
+	unsigned short m_serialFirst;
+	unsigned short m_serialStride;
 	unsigned short m_listsAreFreed : 1;
 	unsigned short m_unused : 15;
 
@@ -247,6 +253,344 @@ private:
 	MUTEX_TYPE m_mutex;
 };
 
+//-----------------------------------------------------------------------------
+// Statistics reported by CShardedDataManager
+//-----------------------------------------------------------------------------
+struct datamanagerstats_t
+{
+	unsigned int nResources;
+	unsigned int nMemUsed;
+	unsigned int nHits;
+	unsigned int nMisses;
+	unsigned int nEvictions;
+	unsigned int nDeferredTouches;
+	unsigned int nDroppedTouches;
+	unsigned int nDeferredTouchPasses;	// times a shard lock found queued touches to apply
+};
+
+//-----------------------------------------------------------------------------
+// A data manager split into independently locked shards. Each shard keeps its
+// own LRU and lock lists, so threads working on different resources rarely
+// contend. The shard index lives in the low bits of the handle serial.
+//
+// The memory budget is global but approximate: a shard only evicts from its own
+// LRU, and only when the total is over budget and the shard holds more than its
+// share. Touches that would block on a busy shard are queued and applied the
+// next time that shard is locked.
+//-----------------------------------------------------------------------------
+template< class STORAGE_TYPE, class CREATE_PARAMS, class LOCK_TYPE = STORAGE_TYPE *, int SHARD_COUNT = 8 >
+class CShardedDataManager
+{
+public:
+	CShardedDataManager( unsigned int size = (unsigned)-1 ) : m_targetMemorySize( size )
+	{
+		COMPILE_TIME_ASSERT( SHARD_COUNT > 0 && ( SHARD_COUNT & ( SHARD_COUNT - 1 ) ) == 0 );
+		for ( int i = 0; i < SHARD_COUNT; i++ )
+		{
+			m_shards[i].SetSerialSequence( SHARD_COUNT + i, SHARD_COUNT );
+		}
+	}
+
+	memhandle_t CreateResource( const CREATE_PARAMS &createParams, bool bCreateLocked = false )
+	{
+		// Spread new resources round robin so concurrent users land on different shards
+		CShard &shard = m_shards[ (unsigned)( ++m_nextShard ) & ( SHARD_COUNT - 1 ) ];
+		AUTO_LOCK( shard.m_mutex );
+		shard.ProcessDeferredTouches();
+
+		unsigned int nEstimated = STORAGE_TYPE::EstimatedSize( createParams );
+		unsigned int nUsed = UsedSize();
+		if ( nUsed + nEstimated > m_targetMemorySize )
+		{
+			unsigned int nShare = m_targetMemorySize / SHARD_COUNT;
+			unsigned int nOver = nUsed + nEstimated - m_targetMemorySize;
+			unsigned int nShardUsed = shard.UsedSize();
+			if ( nShardUsed > nShare )
+			{
+				shard.EvictToSize( nShardUsed - MIN( nShardUsed - nShare, nOver ) );
+			}
+		}
+
+		return shard.CreateResource( createParams, bCreateLocked );
+	}
+
+	void DestroyResource( memhandle_t hMem )
+	{
+		CShard &shard = ShardForHandle( hMem );
+		AUTO_LOCK( shard.m_mutex );
+		shard.DestroyResource( hMem );
+	}
+
+	LOCK_TYPE LockResource( memhandle_t hMem )
+	{
+		CShard &shard = ShardForHandle( hMem );
+		AUTO_LOCK( shard.m_mutex );
+		shard.ProcessDeferredTouches();
+		return shard.Lookup( shard.LockResource( hMem ) );
+	}
+
+	int UnlockResource( memhandle_t hMem )
+	{
+		CShard &shard = ShardForHandle( hMem );
+		AUTO_LOCK( shard.m_mutex );
+		return shard.UnlockResource( hMem );
+	}
+
+	LOCK_TYPE GetResource_NoLock( memhandle_t hMem )
+	{
+		CShard &shard = ShardForHandle( hMem );
+		AUTO_LOCK( shard.m_mutex );
+		shard.ProcessDeferredTouches();
+		return shard.Lookup( shard.GetResource_NoLock( hMem ) );
+	}
+
+	// Doesn't touch the memory LRU
+	LOCK_TYPE GetResource_NoLockNoLRUTouch( memhandle_t hMem )
+	{
+		CShard &shard = ShardForHandle( hMem );
+		AUTO_LOCK( shard.m_mutex );
+		return shard.Lookup( shard.GetResource_NoLockNoLRUTouch( hMem ) );
+	}
+
+	// Never blocks; if the shard is busy the touch is applied later
+	void TouchResource( memhandle_t hMem )
+	{
+		CShard &shard = ShardForHandle( hMem );
+		if ( shard.m_mutex.TryLock() )
+		{
+			shard.ProcessDeferredTouches();
+			shard.TouchResource( hMem );
+			shard.m_mutex.Unlock();
+		}
+		else
+		{
+			shard.DeferTouch( hMem );
+		}
+	}
+
+	void MarkAsStale( memhandle_t hMem )
+	{
+		CShard &shard = ShardForHandle( hMem );
+		AUTO_LOCK( shard.m_mutex );
+		shard.ProcessDeferredTouches();
+		shard.MarkAsStale( hMem );
+	}
+
+	unsigned int TargetSize()		{ return m_targetMemorySize; }
+	unsigned int AvailableSize()	{ unsigned int nUsed = UsedSize(); return ( nUsed < m_targetMemorySize ) ? m_targetMemorySize - nUsed : 0; }
+	void SetTargetSize( unsigned int targetSize ) { m_targetMemorySize = targetSize; }
+
+	// Unlocked sum of the shards, so only approximate while other threads are allocating
+	unsigned int UsedSize()
+	{
+		unsigned int nUsed = 0;
+		for ( int i = 0; i < SHARD_COUNT; i++ )
+		{
+			nUsed += m_shards[i].UsedSize();
+		}
+		return nUsed;
+	}
+
+	unsigned int FlushAllUnlocked()
+	{
+		unsigned int nFlushed = 0;
+		for ( int i = 0; i < SHARD_COUNT; i++ )
+		{
+			nFlushed += m_shards[i].FlushAllUnlocked();
+		}
+		return nFlushed;
+	}
+
+	unsigned int FlushAll()
+	{
+		unsigned int nFlushed = 0;
+		for ( int i = 0; i < SHARD_COUNT; i++ )
+		{
+			nFlushed += m_shards[i].FlushAll();
+		}
+		return nFlushed;
+	}
+
+	int ShardCount() const { return SHARD_COUNT; }
+
+	// The lock of the shard owning hMem, for callers that modify a resource in place. Recursive, so
+	// the accessors above can still be called while holding it.
+	CThreadFastMutex &AccessMutex( memhandle_t hMem ) { return ShardForHandle( hMem ).m_mutex; }
+
+	void GetShardStats( int iShard, datamanagerstats_t &stats )
+	{
+		CShard &shard = m_shards[iShard];
+		AUTO_LOCK( shard.m_mutex );
+		stats = shard.m_stats;
+		stats.nResources = shard.ResourceCount();
+		stats.nMemUsed = shard.UsedSize();
+		stats.nDeferredTouches = shard.m_nDeferredTouches;
+		stats.nDroppedTouches = shard.m_nDroppedTouches;
+	}
+
+	void GetStats( datamanagerstats_t &stats )
+	{
+		memset( &stats, 0, sizeof( stats ) );
+		for ( int i = 0; i < SHARD_COUNT; i++ )
+		{
+			datamanagerstats_t shardStats;
+			GetShardStats( i, shardStats );
+			stats.nResources += shardStats.nResources;
+			stats.nMemUsed += shardStats.nMemUsed;
+			stats.nHits += shardStats.nHits;
+			stats.nMisses += shardStats.nMisses;
+			stats.nEvictions += shardStats.nEvictions;
+			stats.nDeferredTouches += shardStats.nDeferredTouches;
+			stats.nDroppedTouches += shardStats.nDroppedTouches;
+			stats.nDeferredTouchPasses += shardStats.nDeferredTouchPasses;
+		}
+	}
+
+	void ResetStats()
+	{
+		for ( int i = 0; i < SHARD_COUNT; i++ )
+		{
+			CShard &shard = m_shards[i];
+			AUTO_LOCK( shard.m_mutex );
+			memset( &shard.m_stats, 0, sizeof( shard.m_stats ) );
+			shard.m_nDeferredTouches = 0;
+			shard.m_nDroppedTouches = 0;
+		}
+	}
+
+private:
+	enum
+	{
+		MAX_DEFERRED_TOUCHES = 64,
+	};
+
+	class CShard : public CDataManagerBase
+	{
+	public:
+		CShard() : CDataManagerBase( (unsigned)-1 )
+		{
+			memset( &m_stats, 0, sizeof( m_stats ) );
+			for ( int i = 0; i < MAX_DEFERRED_TOUCHES; i++ )
+			{
+				m_deferredTouches[i] = INVALID_MEMHANDLE;
+			}
+		}
+
+		~CShard()
+		{
+			FreeAllLists();
+		}
+
+		using CDataManagerBase::SetSerialSequence;
+		using CDataManagerBase::LockResource;
+		using CDataManagerBase::GetResource_NoLock;
+		using CDataManagerBase::GetResource_NoLockNoLRUTouch;
+
+		memhandle_t CreateResource( const CREATE_PARAMS &createParams, bool bCreateLocked )
+		{
+			unsigned short memoryIndex = CreateHandle( bCreateLocked );
+			STORAGE_TYPE *pStore = STORAGE_TYPE::CreateResource( createParams );
+			return StoreResourceInHandle( memoryIndex, pStore, pStore->Size() );
+		}
+
+		LOCK_TYPE Lookup( void *pStore )
+		{
+			if ( pStore )
+			{
+				m_stats.nHits++;
+				return static_cast<STORAGE_TYPE *>( pStore )->GetData();
+			}
+			m_stats.nMisses++;
+			return NULL;
+		}
+
+		// Frees from the head of this shard's LRU until it uses no more than nSize bytes
+		void EvictToSize( unsigned int nSize )
+		{
+			while ( MemUsed_Inline() > nSize )
+			{
+				unsigned short lruIndex = m_memoryLists.Head( m_lruList );
+				if ( lruIndex == m_memoryLists.InvalidIndex() )
+					break;
+				m_memoryLists.Unlink( m_lruList, lruIndex );
+				DestroyResourceStorage( GetForFreeByIndex( lruIndex ) );
+				m_stats.nEvictions++;
+			}
+		}
+
+		unsigned int ResourceCount()
+		{
+			return m_memoryLists.Count( m_lruList ) + m_memoryLists.Count( m_lockList );
+		}
+
+		void DeferTouch( memhandle_t hMem )
+		{
+			int iSlot = ++m_nPendingTouches - 1;
+			if ( iSlot < MAX_DEFERRED_TOUCHES )
+			{
+				m_deferredTouches[iSlot] = hMem;
+				++m_nDeferredTouches;
+			}
+			else
+			{
+				// The LRU is approximate anyway; losing a touch only makes eviction slightly less fair
+				++m_nDroppedTouches;
+			}
+		}
+
+		// Must hold m_mutex. Stale handles are harmless since FromHandle checks the serial.
+		void ProcessDeferredTouches()
+		{
+			if ( m_nPendingTouches == 0 )
+				return;
+
+			m_stats.nDeferredTouchPasses++;
+			int nPending = MIN( (int)m_nPendingTouches, (int)MAX_DEFERRED_TOUCHES );
+			for ( int i = 0; i < nPending; i++ )
+			{
+				memhandle_t hMem = m_deferredTouches[i];
+				m_deferredTouches[i] = INVALID_MEMHANDLE;
+				if ( hMem != INVALID_MEMHANDLE )
+				{
+					TouchByIndex( FromHandle( hMem ) );
+				}
+			}
+			m_nPendingTouches = 0;
+		}
+
+		virtual void Lock() { m_mutex.Lock(); }
+		virtual bool TryLock() { return m_mutex.TryLock(); }
+		virtual void Unlock() { m_mutex.Unlock(); }
+
+		virtual void DestroyResourceStorage( void *pStore )
+		{
+			static_cast<STORAGE_TYPE *>( pStore )->DestroyResource();
+		}
+
+		virtual unsigned int GetRealSize( void *pStore )
+		{
+			return static_cast<STORAGE_TYPE *>( pStore )->Size();
+		}
+
+		CThreadFastMutex m_mutex;
+		datamanagerstats_t m_stats;
+		CInterlockedInt m_nPendingTouches;
+		CInterlockedInt m_nDeferredTouches;
+		CInterlockedInt m_nDroppedTouches;
+		memhandle_t m_deferredTouches[MAX_DEFERRED_TOUCHES];
+	};
+
+	CShard &ShardForHandle( memhandle_t hMem )
+	{
+		unsigned int serial = ( (unsigned int)(uintp)hMem ) >> 16;
+		return m_shards[ serial & ( SHARD_COUNT - 1 ) ];
+	}
+
+	CShard m_shards[SHARD_COUNT];
+	CInterlockedInt m_nextShard;
+	unsigned int m_targetMemorySize;
+};
+
 //-----------------------------------------------------------------------------
 
 inline unsigned short CDataManagerBase::FromHandle( memhandle_t handle )
@@ -592,6 +592,259 @@ void RayTracingEnvironment::Trace4Rays(const FourRays &rays, fltx4 TMin, fltx4 T
 }
 
 
+// Box to box visibility. The shaft is the convex hull of the two boxes, bounded here by
+// the planes of their union box plus the axis parallel planes bridging their corners.
+#define BOXVIS_PLANE_EPSILON 0.01f
+#define BOXVIS_EDGE_EPSILON 0.001f							// barycentric
+#define BOXVIS_MAX_CANDIDATES 256							// triangles looked at for a blocker
+
+struct ShaftPlane_t
+{
+	Vector m_Normal;										// points out of the shaft
+	float m_flDist;
+};
+
+struct ShaftNodeToVisit
+{
+	int m_nNode;
+	Vector m_Mins;
+	Vector m_Maxs;
+};
+
+static void GetBoxCorners( Vector const &mins, Vector const &maxs, Vector *pCorners )
+{
+	for( int i = 0; i < 8; i++ )
+	{
+		pCorners[i].Init( ( i & 1 ) ? maxs.x : mins.x,
+						  ( i & 2 ) ? maxs.y : mins.y,
+						  ( i & 4 ) ? maxs.z : mins.z );
+	}
+}
+
+static int BuildShaftPlanes( Vector const &minsA, Vector const &maxsA,
+							 Vector const &minsB, Vector const &maxsB, ShaftPlane_t *pPlanes )
+{
+	int nPlanes = 0;
+	for( int c = 0; c < 3; c++ )
+	{
+		pPlanes[nPlanes].m_Normal.Init();
+		pPlanes[nPlanes].m_Normal[c] = 1;
+		pPlanes[nPlanes++].m_flDist = max( maxsA[c], maxsB[c] );
+		pPlanes[nPlanes].m_Normal.Init();
+		pPlanes[nPlanes].m_Normal[c] = -1;
+		pPlanes[nPlanes++].m_flDist = -min( minsA[c], minsB[c] );
+	}
+
+	// each pair of axes gets the edges of the 2d hull of the two projected rectangles
+	for( int i = 0; i < 3; i++ )
+	{
+		int j = ( i + 1 ) % 3;
+		float rects[2][4][2] = {
+			{ { minsA[i], minsA[j] }, { maxsA[i], minsA[j] }, { minsA[i], maxsA[j] }, { maxsA[i], maxsA[j] } },
+			{ { minsB[i], minsB[j] }, { maxsB[i], minsB[j] }, { minsB[i], maxsB[j] }, { maxsB[i], maxsB[j] } } };
+
+		for( int corner = 0; corner < 4; corner++ )
+		{
+			float *pA = rects[0][corner];
+			float *pB = rects[1][corner];
+			float nx = pB[1] - pA[1];
+			float ny = pA[0] - pB[0];
+			float len = sqrt( nx * nx + ny * ny );
+			if ( len < BOXVIS_PLANE_EPSILON )
+				continue;
+			nx /= len;
+			ny /= len;
+
+			// only lines with both rectangles on one side bound the hull
+			int nSides = 0;
+			for( int r = 0; r < 2; r++ )
+			{
+				for( int v = 0; v < 4; v++ )
+				{
+					float dist = nx * ( rects[r][v][0] - pA[0] ) + ny * ( rects[r][v][1] - pA[1] );
+					if ( dist > BOXVIS_PLANE_EPSILON )
+						nSides |= 1;
+					else if ( dist < -BOXVIS_PLANE_EPSILON )
+						nSides |= 2;
+				}
+			}
+			if ( nSides == 3 || nSides == 0 )
+				continue;
+			if ( nSides == 1 )
+			{
+				nx = -nx;
+				ny = -ny;
+			}
+
+			ShaftPlane_t &plane = pPlanes[nPlanes++];
+			plane.m_Normal.Init();
+			plane.m_Normal[i] = nx;
+			plane.m_Normal[j] = ny;
+			plane.m_flDist = nx * pA[0] + ny * pA[1];
+		}
+	}
+	return nPlanes;
+}
+
+static bool IsBoxOutsideShaft( Vector const &mins, Vector const &maxs, ShaftPlane_t const *pPlanes, int nPlanes )
+{
+	for( int p = 0; p < nPlanes; p++ )
+	{
+		Vector const &n = pPlanes[p].m_Normal;
+		float flNearest = n.x * ( n.x > 0 ? mins.x : maxs.x ) +
+			n.y * ( n.y > 0 ? mins.y : maxs.y ) +
+			n.z * ( n.z > 0 ? mins.z : maxs.z );
+		if ( flNearest > pPlanes[p].m_flDist + BOXVIS_PLANE_EPSILON )
+			return true;
+	}
+	return false;
+}
+
+static inline void GetBarycentrics( TriIntersectData_t const &tri, Vector const &pt, float &b0, float &b1 )
+{
+	float u = pt[tri.m_nCoordSelect0];
+	float v = pt[tri.m_nCoordSelect1];
+	b0 = tri.m_ProjectedEdgeEquations[0] * u + tri.m_ProjectedEdgeEquations[1] * v + tri.m_ProjectedEdgeEquations[2];
+	b1 = tri.m_ProjectedEdgeEquations[3] * u + tri.m_ProjectedEdgeEquations[4] * v + tri.m_ProjectedEdgeEquations[5];
+}
+
+// corners 0-7 are box A, 8-15 box B. Returns false if the triangle can't touch the shaft.
+static bool TriangleMayCrossShaft( TriIntersectData_t const &tri, Vector const *pCorners, float *pPlaneDists )
+{
+	Vector N( tri.m_flNx, tri.m_flNy, tri.m_flNz );
+	int nSides = 0;
+	int nOutside[3] = { 0, 0, 0 };
+	for( int c = 0; c < 16; c++ )
+	{
+		pPlaneDists[c] = DotProduct( N, pCorners[c] ) - tri.m_flD;
+		if ( pPlaneDists[c] > BOXVIS_PLANE_EPSILON )
+			nSides |= 1;
+		else if ( pPlaneDists[c] < -BOXVIS_PLANE_EPSILON )
+			nSides |= 2;
+		else
+			nSides |= 3;
+
+		// the shaft projects inside the hull of the projected corners
+		float b0, b1;
+		GetBarycentrics( tri, pCorners[c], b0, b1 );
+		nOutside[0] += ( b0 < -BOXVIS_EDGE_EPSILON );
+		nOutside[1] += ( b1 < -BOXVIS_EDGE_EPSILON );
+		nOutside[2] += ( b0 + b1 > 1 + BOXVIS_EDGE_EPSILON );
+	}
+
+	if ( nSides != 3 )
+		return false;
+	return nOutside[0] != 16 && nOutside[1] != 16 && nOutside[2] != 16;
+}
+
+// True if the triangle's plane separates the boxes and every segment from one box to the
+// other crosses the plane inside the triangle. The crossings of any segment are convex
+// combinations of the crossings of the corner to corner segments, so those are enough.
+static bool TriangleBlocksShaft( TriIntersectData_t const &tri, Vector const *pCorners, float const *pPlaneDists )
+{
+	float flSignA = pPlaneDists[0] > 0 ? 1 : -1;
+	for( int c = 0; c < 16; c++ )
+	{
+		float flSign = ( c < 8 ) ? flSignA : -flSignA;
+		if ( pPlaneDists[c] * flSign < BOXVIS_PLANE_EPSILON )
+			return false;
+	}
+
+	for( int a = 0; a < 8; a++ )
+	{
+		for( int b = 8; b < 16; b++ )
+		{
+			float t = pPlaneDists[a] / ( pPlaneDists[a] - pPlaneDists[b] );
+			Vector vecCross;
+			VectorLerp( pCorners[a], pCorners[b], t, vecCross );
+
+			float b0, b1;
+			GetBarycentrics( tri, vecCross, b0, b1 );
+			if ( b0 < BOXVIS_EDGE_EPSILON || b1 < BOXVIS_EDGE_EPSILON || b0 + b1 > 1 - BOXVIS_EDGE_EPSILON )
+				return false;
+		}
+	}
+	return true;
+}
+
+int RayTracingEnvironment::ClassifyBoxToBoxVisibility( Vector const &minsA, Vector const &maxsA,
+													   Vector const &minsB, Vector const &maxsB )
+{
+	if ( !OptimizedKDTree.Count() )
+		return BOXVIS_OPEN;
+
+	Vector corners[16];
+	GetBoxCorners( minsA, maxsA, corners );
+	GetBoxCorners( minsB, maxsB, corners + 8 );
+
+	ShaftPlane_t planes[6 + 12];
+	int nPlanes = BuildShaftPlanes( minsA, maxsA, minsB, maxsB, planes );
+
+	int32 mailboxids[MAILBOX_HASH_SIZE];
+	memset( mailboxids, 0xff, sizeof( mailboxids ) );
+
+	int nCandidates = 0;
+	float flPlaneDists[16];
+
+	ShaftNodeToVisit NodeQueue[MAX_NODE_STACK_LEN];
+	int nStack = 0;
+	NodeQueue[nStack].m_nNode = 0;
+	NodeQueue[nStack].m_Mins = m_MinBound;
+	NodeQueue[nStack++].m_Maxs = m_MaxBound;
+
+	while( nStack )
+	{
+		ShaftNodeToVisit cur = NodeQueue[--nStack];
+		if ( IsBoxOutsideShaft( cur.m_Mins, cur.m_Maxs, planes, nPlanes ) )
+			continue;
+
+		CacheOptimizedKDNode const &node = OptimizedKDTree[cur.m_nNode];
+		if ( node.NodeType() != KDNODE_STATE_LEAF )
+		{
+			int split_plane_number = node.NodeType();
+			Assert( nStack + 2 <= MAX_NODE_STACK_LEN );
+
+			ShaftNodeToVisit &left = NodeQueue[nStack++];
+			left.m_nNode = node.LeftChild();
+			left.m_Mins = cur.m_Mins;
+			left.m_Maxs = cur.m_Maxs;
+			left.m_Maxs[split_plane_number] = node.SplittingPlaneValue;
+
+			ShaftNodeToVisit &right = NodeQueue[nStack++];
+			right.m_nNode = node.RightChild();
+			right.m_Mins = cur.m_Mins;
+			right.m_Maxs = cur.m_Maxs;
+			right.m_Mins[split_plane_number] = node.SplittingPlaneValue;
+			continue;
+		}
+
+		int ntris = node.NumberOfTrianglesInLeaf();
+		int32 const *tlist = ntris ? &( TriangleIndexList[node.TriangleIndexStart()] ) : NULL;
+		for( int t = 0; t < ntris; t++ )
+		{
+			int tnum = tlist[t];
+			int mbox_slot = tnum & ( MAILBOX_HASH_SIZE - 1 );
+			if ( mailboxids[mbox_slot] == tnum )
+				continue;
+			mailboxids[mbox_slot] = tnum;
+
+			TriIntersectData_t const &tri = OptimizedTriangleList[tnum].m_Data.m_IntersectData;
+			if ( !TriangleMayCrossShaft( tri, corners, flPlaneDists ) )
+				continue;
+
+			if ( TriangleBlocksShaft( tri, corners, flPlaneDists ) )
+				return BOXVIS_BLOCKED;
+
+			// something is in the way of some segments, keep looking a while for a blocker
+			if ( ++nCandidates >= BOXVIS_MAX_CANDIDATES )
+				return BOXVIS_PARTIAL;
+		}
+	}
+
+	return nCandidates ? BOXVIS_PARTIAL : BOXVIS_OPEN;
+}
+
+
 int RayTracingEnvironment::MakeLeafNode(int first_tri, int last_tri)
 {
 	CacheOptimizedKDNode ret;
@@ -0,0 +1,339 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+//  Chunked compression container, see chunkedcompress.h
+//
+//========================================================================//
+
+#include "tier0/platform.h"
+#include "tier0/basetypes.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlvector.h"
+#include "tier1/lzmaDecoder.h"
+#include "tier1/snappy.h"
+#include "tier1/chunkedcompress.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Below this many chunks it isn't worth spinning up threads
+#define CHUNKED_MIN_PARALLEL_CHUNKS	4
+#define CHUNKED_MAX_THREADS			32
+
+static inline chunked_header_t *GetChunkedHeader( unsigned char *pInput )
+{
+	chunked_header_t *pHeader = (chunked_header_t *)pInput;
+	if ( pHeader && pHeader->id == CHUNKED_ID )
+		return pHeader;
+	return NULL;
+}
+
+static inline unsigned int GetChunkOffset( unsigned char *pInput, int iOffset )
+{
+	unsigned int *pOffsets = (unsigned int *)( pInput + sizeof( chunked_header_t ) );
+	return LittleLong( pOffsets[iOffset] );
+}
+
+//-----------------------------------------------------------------------------
+// Checks that the header agrees with itself and that the offset table and every
+// chunk lie inside the nInputSize bytes the caller has, so a corrupt container
+// can't make a decode read or write out of bounds.
+//-----------------------------------------------------------------------------
+static bool IsValidContainer( unsigned char *pInput, unsigned int nInputSize )
+{
+	if ( nInputSize < sizeof( chunked_header_t ) )
+		return false;
+
+	chunked_header_t *pHeader = GetChunkedHeader( pInput );
+	if ( !pHeader )
+		return false;
+
+	uint64 nActualSize = LittleLong( pHeader->actualSize );
+	uint64 nChunkSize = LittleLong( pHeader->chunkSize );
+	uint64 nChunks = LittleLong( pHeader->numChunks );
+	if ( !nChunkSize || nChunks != ( nActualSize + nChunkSize - 1 ) / nChunkSize || pHeader->codec >= CHUNK_CODEC_COUNT )
+		return false;
+
+	uint64 nTableEnd = sizeof( chunked_header_t ) + ( nChunks + 1 ) * sizeof( unsigned int );
+	if ( nTableEnd > nInputSize )
+		return false;
+
+	unsigned int nPrev = (unsigned int)nTableEnd;
+	for ( uint64 i = 0; i <= nChunks; i++ )
+	{
+		unsigned int nOffset = GetChunkOffset( pInput, (int)i );
+		if ( nOffset < nPrev || nOffset > nInputSize )
+			return false;
+		nPrev = nOffset;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Returns true if buffer is a chunked container.
+//-----------------------------------------------------------------------------
+/* static */
+bool CChunkedCompression::IsCompressed( unsigned char *pInput )
+{
+	return GetChunkedHeader( pInput ) != NULL;
+}
+
+/* static */
+unsigned int CChunkedCompression::GetActualSize( unsigned char *pInput )
+{
+	chunked_header_t *pHeader = GetChunkedHeader( pInput );
+	return pHeader ? LittleLong( pHeader->actualSize ) : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Returns the size of the whole container, header and offsets included.
+//-----------------------------------------------------------------------------
+/* static */
+unsigned int CChunkedCompression::GetCompressedSize( unsigned char *pInput )
+{
+	chunked_header_t *pHeader = GetChunkedHeader( pInput );
+	return pHeader ? GetChunkOffset( pInput, LittleLong( pHeader->numChunks ) ) : 0;
+}
+
+/* static */
+int CChunkedCompression::GetChunkCount( unsigned char *pInput )
+{
+	chunked_header_t *pHeader = GetChunkedHeader( pInput );
+	return pHeader ? (int)LittleLong( pHeader->numChunks ) : 0;
+}
+
+/* static */
+ECompressedChunkCodec CChunkedCompression::GetCodec( unsigned char *pInput )
+{
+	chunked_header_t *pHeader = GetChunkedHeader( pInput );
+	return pHeader ? (ECompressedChunkCodec)pHeader->codec : CHUNK_CODEC_COUNT;
+}
+
+//-----------------------------------------------------------------------------
+// Decodes one chunk into its place in the output buffer.
+//-----------------------------------------------------------------------------
+/* static */
+bool CChunkedCompression::UncompressChunk( unsigned char *pInput, unsigned int nInputSize, int iChunk, unsigned char *pOutput )
+{
+	chunked_header_t *pHeader = GetChunkedHeader( pInput );
+	if ( !pHeader || nInputSize < sizeof( chunked_header_t ) || iChunk < 0 || iChunk >= (int)LittleLong( pHeader->numChunks ) )
+		return false;
+
+	unsigned int nActualSize = LittleLong( pHeader->actualSize );
+	unsigned int nChunkSize = LittleLong( pHeader->chunkSize );
+	uint64 nOutputOffset = (uint64)iChunk * nChunkSize;
+	if ( !nChunkSize || nOutputOffset >= nActualSize )
+		return false;
+	unsigned int nOutputSize = (unsigned int)MIN( (uint64)nChunkSize, nActualSize - nOutputOffset );
+
+	// the offset table entries for this chunk must be inside the input too
+	uint64 nTableEnd = sizeof( chunked_header_t ) + ( (uint64)iChunk + 2 ) * sizeof( unsigned int );
+	if ( nTableEnd > nInputSize )
+		return false;
+
+	unsigned int nStart = GetChunkOffset( pInput, iChunk );
+	unsigned int nEnd = GetChunkOffset( pInput, iChunk + 1 );
+	if ( nStart < nTableEnd || nEnd < nStart || nEnd > nInputSize )
+		return false;
+
+	unsigned char *pChunk = pInput + nStart;
+	unsigned int nChunkCompressedSize = nEnd - nStart;
+
+	switch ( pHeader->codec )
+	{
+	case CHUNK_CODEC_LZMA:
+		{
+			if ( nChunkCompressedSize < sizeof( lzma_header_t ) || CLZMA::GetActualSize( pChunk ) != nOutputSize )
+				return false;
+			lzma_header_t *pLZMAHeader = (lzma_header_t *)pChunk;
+			if ( LittleLong( pLZMAHeader->lzmaSize ) > nChunkCompressedSize - sizeof( lzma_header_t ) )
+				return false;
+			return CLZMA::Uncompress( pChunk, pOutput + nOutputOffset ) == nOutputSize;
+		}
+
+	case CHUNK_CODEC_SNAPPY:
+		{
+			size_t nSnappySize = 0;
+			if ( !snappy::GetUncompressedLength( (const char *)pChunk, nChunkCompressedSize, &nSnappySize ) || nSnappySize != nOutputSize )
+				return false;
+			return snappy::RawUncompress( (const char *)pChunk, nChunkCompressedSize, (char *)( pOutput + nOutputOffset ) );
+		}
+
+	default:
+		Warning( "Unknown chunk codec %d\n", pHeader->codec );
+		return false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Shared state for a parallel decode. Workers pull chunk indices until none are left.
+//-----------------------------------------------------------------------------
+struct ChunkedDecodeJob_t
+{
+	unsigned char *pInput;
+	unsigned int nInputSize;
+	unsigned char *pOutput;
+	int nChunks;
+	CInterlockedInt nNextChunk;
+	CInterlockedInt nFailed;
+};
+
+static unsigned ChunkedDecodeThread( void *pParam )
+{
+	ChunkedDecodeJob_t *pJob = (ChunkedDecodeJob_t *)pParam;
+	for ( ;; )
+	{
+		int iChunk = ++pJob->nNextChunk - 1;
+		if ( iChunk >= pJob->nChunks || pJob->nFailed )
+			break;
+
+		if ( !CChunkedCompression::UncompressChunk( pJob->pInput, pJob->nInputSize, iChunk, pJob->pOutput ) )
+		{
+			++pJob->nFailed;
+		}
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Uncompress a buffer, Returns the uncompressed size. Caller must provide an
+// adequate sized output buffer or memory corruption will occur.
+//-----------------------------------------------------------------------------
+/* static */
+unsigned int CChunkedCompression::Uncompress( unsigned char *pInput, unsigned int nInputSize, unsigned char *pOutput, int nThreads )
+{
+	chunked_header_t *pHeader = GetChunkedHeader( pInput );
+	if ( !pHeader )
+	{
+		// not ours
+		return 0;
+	}
+
+	if ( !IsValidContainer( pInput, nInputSize ) )
+	{
+		Warning( "Chunked decompression failed, corrupt container\n" );
+		return 0;
+	}
+
+	ChunkedDecodeJob_t job;
+	job.pInput = pInput;
+	job.nInputSize = nInputSize;
+	job.pOutput = pOutput;
+	job.nChunks = LittleLong( pHeader->numChunks );
+
+	if ( nThreads <= 0 )
+	{
+		nThreads = GetCPUInformation()->m_nLogicalProcessors;
+	}
+	nThreads = clamp( MIN( nThreads, job.nChunks ), 1, CHUNKED_MAX_THREADS );
+
+	if ( job.nChunks < CHUNKED_MIN_PARALLEL_CHUNKS )
+	{
+		nThreads = 1;
+	}
+
+	// The calling thread decodes too, so spawn one fewer
+	ThreadHandle_t hThreads[CHUNKED_MAX_THREADS];
+	int nSpawned = 0;
+	for ( int i = 1; i < nThreads; i++ )
+	{
+		ThreadHandle_t hThread = CreateSimpleThread( ChunkedDecodeThread, &job );
+		if ( !hThread )
+			break;
+		hThreads[nSpawned++] = hThread;
+	}
+
+	ChunkedDecodeThread( &job );
+
+	for ( int i = 0; i < nSpawned; i++ )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+	}
+
+	if ( job.nFailed )
+	{
+		Warning( "Chunked decompression failed\n" );
+		return 0;
+	}
+
+	return LittleLong( pHeader->actualSize );
+}
+
+static bool CompressChunkSnappy( const unsigned char *pInput, unsigned int nInputSize, CUtlBuffer &output )
+{
+	int nStart = output.TellPut();
+	output.EnsureCapacity( nStart + snappy::MaxCompressedLength( nInputSize ) );
+
+	size_t nCompressedSize = 0;
+	snappy::RawCompress( (const char *)pInput, nInputSize, (char *)output.Base() + nStart, &nCompressedSize );
+	output.SeekPut( CUtlBuffer::SEEK_HEAD, nStart + nCompressedSize );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Compress a buffer into a chunked container appended to output.
+//-----------------------------------------------------------------------------
+/* static */
+bool CChunkedCompression::Compress( ECompressedChunkCodec codec, const unsigned char *pInput, unsigned int nInputSize,
+									CUtlBuffer &output, unsigned int nChunkSize, ChunkCompressFunc_t pfnCompress )
+{
+	if ( !pfnCompress )
+	{
+		if ( codec != CHUNK_CODEC_SNAPPY )
+		{
+			AssertMsg( false, "Chunked compression needs a compress function for this codec" );
+			return false;
+		}
+		pfnCompress = CompressChunkSnappy;
+	}
+
+	if ( !nChunkSize )
+	{
+		nChunkSize = CHUNKED_DEFAULT_CHUNK_SIZE;
+	}
+
+	unsigned int nChunks = ( nInputSize + nChunkSize - 1 ) / nChunkSize;
+	int nHeaderPos = output.TellPut();
+
+	chunked_header_t header;
+	memset( &header, 0, sizeof( header ) );
+	header.id = CHUNKED_ID;
+	header.actualSize = LittleLong( nInputSize );
+	header.chunkSize = LittleLong( nChunkSize );
+	header.numChunks = LittleLong( nChunks );
+	header.codec = (unsigned char)codec;
+	output.Put( &header, sizeof( header ) );
+
+	// Reserve the offset table, filled in as chunks are written
+	int nOffsetPos = output.TellPut();
+	for ( unsigned int i = 0; i <= nChunks; i++ )
+	{
+		output.PutUnsignedInt( 0 );
+	}
+
+	CUtlVector< unsigned int > offsets;
+	offsets.SetCount( nChunks + 1 );
+	for ( unsigned int i = 0; i < nChunks; i++ )
+	{
+		offsets[i] = output.TellPut() - nHeaderPos;
+
+		unsigned int nOffset = i * nChunkSize;
+		if ( !pfnCompress( pInput + nOffset, MIN( nChunkSize, nInputSize - nOffset ), output ) )
+		{
+			output.SeekPut( CUtlBuffer::SEEK_HEAD, nHeaderPos );
+			return false;
+		}
+	}
+	offsets[nChunks] = output.TellPut() - nHeaderPos;
+
+	unsigned int *pOffsets = (unsigned int *)( (unsigned char *)output.Base() + nOffsetPos );
+	for ( unsigned int i = 0; i <= nChunks; i++ )
+	{
+		pOffsets[i] = LittleLong( offsets[i] );
+	}
+
+	return true;
+}
@@ -20,6 +20,8 @@ CDataManagerBase::CDataManagerBase( unsigned int maxSize )
 	m_lruList = m_memoryLists.CreateList();
 	m_lockList = m_memoryLists.CreateList();
 	m_freeList = m_memoryLists.CreateList();
+	m_serialFirst = 1;
+	m_serialStride = 1;
 	m_listsAreFreed = 0;
 }
 
@@ -287,6 +289,7 @@ unsigned short CDataManagerBase::CreateHandle( bool bCreateLocked )
 	else
 	{
 		memoryIndex = m_memoryLists.AddToTail( list );
+		m_memoryLists[memoryIndex].serial = m_serialFirst;
 	}
 
 	if ( bCreateLocked )
@@ -381,7 +384,7 @@ void *CDataManagerBase::GetForFreeByIndex( unsigned short memoryIndex )
 		m_memUsed -= size;
 		p = mem.pStore;
 		mem.pStore = NULL;
-		mem.serial++;
+		mem.serial += m_serialStride;
 		m_memoryLists.LinkToTail( m_freeList, memoryIndex );
 	}
 	return p;
@@ -13,6 +13,7 @@
 #include "tier0/platform.h"
 #include "tier0/basetypes.h"
 #include "tier0/dbg.h"
+#include "tier0/threadtools.h"
 
 #include "../utils/lzma/C/7zTypes.h"
 #include "../utils/lzma/C/LzmaEnc.h"
@@ -25,9 +26,74 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
-// Allocator to pass to LZMA functions
-static void *SzAlloc(void *p, size_t size) { return malloc(size); }
-static void SzFree(void *p, void *address) { free(address); }
+//-----------------------------------------------------------------------------
+// Allocator to pass to LZMA functions. Every decode allocates a probability
+// table, almost always the same size as the previous decode's, so hold on to a
+// few freed ones and hand them back out instead of going to the heap each time.
+// Stream dictionaries are too big to keep around for the life of the process,
+// so the cache never holds more than SLOTS * MAX_BLOCK bytes (2MB).
+//-----------------------------------------------------------------------------
+#define LZMA_ALLOC_CACHE_SLOTS		8
+#define LZMA_ALLOC_CACHE_MAX_BLOCK	( 256 * 1024 )
+
+struct lzmaCachedBlock_t
+{
+	void	*pMem;
+	size_t	nSize;
+};
+
+static CThreadFastMutex g_AllocCacheMutex;
+static lzmaCachedBlock_t g_AllocCache[LZMA_ALLOC_CACHE_SLOTS];
+
+// Blocks carry their size in front so SzFree knows which slot they fit
+#define LZMA_ALLOC_HEADER_SIZE		16
+
+static void *SzAlloc( void *p, size_t size )
+{
+	{
+		AUTO_LOCK( g_AllocCacheMutex );
+		for ( int i = 0; i < LZMA_ALLOC_CACHE_SLOTS; i++ )
+		{
+			if ( g_AllocCache[i].pMem && g_AllocCache[i].nSize == size )
+			{
+				void *pMem = g_AllocCache[i].pMem;
+				g_AllocCache[i].pMem = NULL;
+				return pMem;
+			}
+		}
+	}
+
+	byte *pBlock = (byte *)malloc( size + LZMA_ALLOC_HEADER_SIZE );
+	if ( !pBlock )
+		return NULL;
+	*(size_t *)pBlock = size;
+	return pBlock + LZMA_ALLOC_HEADER_SIZE;
+}
+
+static void SzFree( void *p, void *address )
+{
+	if ( !address )
+		return;
+
+	byte *pBlock = (byte *)address - LZMA_ALLOC_HEADER_SIZE;
+	size_t size = *(size_t *)pBlock;
+	if ( size <= LZMA_ALLOC_CACHE_MAX_BLOCK )
+	{
+		AUTO_LOCK( g_AllocCacheMutex );
+		for ( int i = 0; i < LZMA_ALLOC_CACHE_SLOTS; i++ )
+		{
+			if ( !g_AllocCache[i].pMem )
+			{
+				g_AllocCache[i].pMem = address;
+				g_AllocCache[i].nSize = size;
+				return;
+			}
+		}
+	}
+
+	free( pBlock );
+}
+
 static ISzAlloc g_Alloc = { SzAlloc, SzFree };
 
 //-----------------------------------------------------------------------------
@@ -77,16 +143,6 @@ unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 		return false;
 	}
 
-	CLzmaDec state;
-
-	LzmaDec_Construct(&state);
-
-	if ( LzmaDec_Allocate(&state, pHeader->properties, LZMA_PROPS_SIZE, &g_Alloc) != SZ_OK )
-	{
-		Assert( false );
-		return 0;
-	}
-
 	// These are in/out variables
 	SizeT outProcessed = pHeader->actualSize;
 	SizeT inProcessed = pHeader->lzmaSize;
@@ -94,9 +150,6 @@ unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 	SRes result = LzmaDecode( (Byte *)pOutput, &outProcessed, (Byte *)(pInput + sizeof( lzma_header_t ) ),
 	                          &inProcessed, (Byte *)pHeader->properties, LZMA_PROPS_SIZE, LZMA_FINISH_END, &status, &g_Alloc );
 
-
-	LzmaDec_Free(&state, &g_Alloc);
-
 	if ( result != SZ_OK || pHeader->actualSize != outProcessed )
 	{
 		Warning( "LZMA Decompression failed (%i)\n", result );
@@ -126,6 +179,7 @@ void CLZMAStream::FreeDecoderState()
 	if ( m_pDecoderState )
 	{
 		LzmaDec_Free( m_pDecoderState, &g_Alloc );
+		delete m_pDecoderState;
 		m_pDecoderState = NULL;
 	}
 }
@@ -144,6 +198,7 @@ bool CLZMAStream::CreateDecoderState( const unsigned char *pProperties )
 	if ( LzmaDec_Allocate( m_pDecoderState, pProperties, LZMA_PROPS_SIZE, &g_Alloc) != SZ_OK )
 	{
 		AssertMsg( false, "Failed to allocate lzma decoder state" );
+		delete m_pDecoderState;
 		m_pDecoderState = NULL;
 		return false;
 	}
@@ -28,6 +28,7 @@
 #include "vtf/vtf.h"
 #include "lzma/lzma.h"
 #include "tier1/lzmaDecoder.h"
+#include "tier1/chunkedcompress.h"
 
 //=============================================================================
 
@@ -1211,41 +1212,26 @@ void CGameLump::SwapGameLump( GameLumpId_t id, int version, byte *dest, byte *sr
 //-----------------------------------------------------------------------------
 // Game lump file I/O
 //-----------------------------------------------------------------------------
-void CGameLump::ParseGameLump( dheader_t* pHeader )
+void CGameLump::ParseGameLump( CMappedBSPFile &bsp )
 {
 	g_GameLumps.DestroyAllGameLumps();
 
 	g_Lumps.bLumpParsed[LUMP_GAME_LUMP] = true;
 
-	int length = pHeader->lumps[LUMP_GAME_LUMP].filelen;
-	int ofs = pHeader->lumps[LUMP_GAME_LUMP].fileofs;
-	
-	if (length > 0)
+	// Copied out, the game lumps get rebuilt and outlive the file
+	int count;
+	dgamelump_t* pGameLump = bsp.GetGameLumpDirectory( &count );
+	for (int i = 0; i < count; ++i )
 	{
-		// Read dictionary...
-		dgamelumpheader_t* pGameLumpHeader = (dgamelumpheader_t*)((byte *)pHeader + ofs);
-		if ( g_bSwapOnLoad )
+		int length = pGameLump[i].filelen;
+		GameLumpHandle_t lump = g_GameLumps.CreateGameLump( pGameLump[i].id, length, pGameLump[i].flags, pGameLump[i].version );
+		if ( bsp.IsSwapped() )
 		{
-			g_Swap.SwapFieldsToTargetEndian( pGameLumpHeader );
+			SwapGameLump( pGameLump[i].id, pGameLump[i].version, (byte*)g_GameLumps.GetGameLump(lump), bsp.GetGameLumpData( pGameLump[i] ), length );
 		}
-		dgamelump_t* pGameLump = (dgamelump_t*)(pGameLumpHeader + 1);
-		for (int i = 0; i < pGameLumpHeader->lumpCount; ++i )
+		else
 		{
-			if ( g_bSwapOnLoad )
-			{
-				g_Swap.SwapFieldsToTargetEndian( &pGameLump[i] );
-			}
-
-			int length = pGameLump[i].filelen;
-			GameLumpHandle_t lump = g_GameLumps.CreateGameLump( pGameLump[i].id, length, pGameLump[i].flags, pGameLump[i].version );
-			if ( g_bSwapOnLoad )
-			{
-				SwapGameLump( pGameLump[i].id, pGameLump[i].version, (byte*)g_GameLumps.GetGameLump(lump), (byte *)pHeader + pGameLump[i].fileofs, length );
-			}
-			else
-			{
-				memcpy( g_GameLumps.GetGameLump(lump), (byte *)pHeader + pGameLump[i].fileofs, length );
-			}
+			memcpy( g_GameLumps.GetGameLump(lump), bsp.GetGameLumpData( pGameLump[i] ), length );
 		}
 	}
 }
@@ -2173,6 +2159,155 @@ void ValidateHeader( const char *filename, const dheader_t *pHeader )
 	}
 }
 
+//-----------------------------------------------------------------------------
+//	CMappedBSPFile
+//-----------------------------------------------------------------------------
+CMappedBSPFile::CMappedBSPFile()
+{
+	m_pHeader = NULL;
+	m_nFileSize = 0;
+	m_bMapped = false;
+	m_bSwap = false;
+}
+
+CMappedBSPFile::~CMappedBSPFile()
+{
+	Close();
+}
+
+void CMappedBSPFile::Open( const char *pFilename )
+{
+	Close();
+
+	m_pHeader = (dheader_t *)MapFile( pFilename, &m_nFileSize );
+	m_bMapped = ( m_pHeader != NULL );
+	if ( !m_bMapped )
+	{
+		// not on disk where it can be mapped, read it through the filesystem
+		m_nFileSize = LoadFile( pFilename, (void **)&m_pHeader );
+	}
+
+	if ( m_nFileSize < (int)sizeof( dheader_t ) )
+	{
+		Error( "%s is not a IBSP file", pFilename );
+	}
+
+	m_bSwap = ( m_pHeader->ident == BigLong( IDBSPHEADER ) );
+	m_Swap.ActivateByteSwapping( m_bSwap );
+	if ( m_bSwap )
+	{
+		m_Swap.SwapFieldsToTargetEndian( m_pHeader );
+	}
+	memset( m_bLumpSwapped, 0, sizeof( m_bLumpSwapped ) );
+
+	ValidateHeader( pFilename, m_pHeader );
+}
+
+void CMappedBSPFile::Close()
+{
+	if ( !m_pHeader )
+		return;
+
+	if ( m_bMapped )
+	{
+		UnmapFile( m_pHeader, m_nFileSize );
+	}
+	else
+	{
+		free( m_pHeader );
+	}
+	m_pHeader = NULL;
+	m_nFileSize = 0;
+}
+
+byte *CMappedBSPFile::GetRawLump( int lump, int *pSize ) const
+{
+	const lump_t &l = m_pHeader->lumps[lump];
+	if ( l.filelen < 0 || l.fileofs < 0 || l.fileofs > m_nFileSize - l.filelen )
+	{
+		Error( "Lump %d runs past the end of the file", lump );
+	}
+
+	if ( pSize )
+	{
+		*pSize = l.filelen;
+	}
+	return (byte *)m_pHeader + l.fileofs;
+}
+
+byte *CMappedBSPFile::BeginLump( int lump, int elementSize, int forceVersion, int *pCount, bool &bSwapNow )
+{
+	int length;
+	byte *pData = GetRawLump( lump, &length );
+
+	if ( length % elementSize )
+	{
+		Error( "ValidateLump: odd size for lump %d", lump );
+	}
+	if ( forceVersion >= 0 && forceVersion != m_pHeader->lumps[lump].version )
+	{
+		Error( "ValidateLump: old version for lump %d in map!", lump );
+	}
+	*pCount = length / elementSize;
+
+	bSwapNow = m_bSwap && !m_bLumpSwapped[lump];
+	if ( bSwapNow )
+	{
+		// these aren't arrays, see SwapVisibilityLump and friends
+		if ( lump == LUMP_VISIBILITY || lump == LUMP_PHYSCOLLIDE || lump == LUMP_PHYSDISP || lump == LUMP_GAME_LUMP )
+		{
+			Error( "Lump %d can't be swapped in place\n", lump );
+		}
+		m_bLumpSwapped[lump] = true;
+	}
+
+	return pData;
+}
+
+dgamelump_t *CMappedBSPFile::GetGameLumpDirectory( int *pCount )
+{
+	int length;
+	byte *pData = GetRawLump( LUMP_GAME_LUMP, &length );
+
+	*pCount = 0;
+	if ( length < (int)sizeof( dgamelumpheader_t ) )
+		return NULL;
+
+	dgamelumpheader_t *pGameLumpHeader = (dgamelumpheader_t *)pData;
+	dgamelump_t *pGameLump = (dgamelump_t *)( pGameLumpHeader + 1 );
+	bool bSwapNow = m_bSwap && !m_bLumpSwapped[LUMP_GAME_LUMP];
+	if ( bSwapNow )
+	{
+		m_Swap.SwapFieldsToTargetEndian( pGameLumpHeader );
+	}
+
+	if ( pGameLumpHeader->lumpCount < 0 || pGameLumpHeader->lumpCount > (int)( ( length - sizeof( dgamelumpheader_t ) ) / sizeof( dgamelump_t ) ) )
+	{
+		Error( "Game lump directory runs past the end of the lump" );
+	}
+
+	if ( bSwapNow )
+	{
+		m_Swap.SwapFieldsToTargetEndian( pGameLump, pGameLumpHeader->lumpCount );
+		m_bLumpSwapped[LUMP_GAME_LUMP] = true;
+	}
+
+	*pCount = pGameLumpHeader->lumpCount;
+	return pGameLump;
+}
+
+byte *CMappedBSPFile::GetGameLumpData( const dgamelump_t &gameLump ) const
+{
+	if ( gameLump.filelen < 0 || gameLump.fileofs < 0 || gameLump.fileofs > m_nFileSize - gameLump.filelen )
+	{
+		Error( "Game lump runs past the end of the file" );
+	}
+	return (byte *)m_pHeader + gameLump.fileofs;
+}
+
+// The file OpenBSPFile has open, g_pBSPHeader points into it
+static CMappedBSPFile s_BSPFile;
+
 //-----------------------------------------------------------------------------
 //	Low level BSP opener for external parsing. Parses headers, but nothing else.
 //	You must close the BSP, via CloseBSPFile().
@@ -2181,17 +2316,19 @@ void OpenBSPFile( const char *filename )
 {
 	Lumps_Init();
 
-	// load the file header
-	LoadFile( filename, (void **)&g_pBSPHeader );
+	// map the file, the lumps get copied and swapped out of it
+	s_BSPFile.Open( filename );
+	if ( s_BSPFile.IsSwapped() != g_bSwapOnLoad )
+	{
+		Error ("%s is not a IBSP file", filename);
+	}
+	g_pBSPHeader = s_BSPFile.GetHeader();
 
 	if ( g_bSwapOnLoad )
 	{
 		g_Swap.ActivateByteSwapping( true );
-		g_Swap.SwapFieldsToTargetEndian( g_pBSPHeader );
 	}
 
-	ValidateHeader( filename, g_pBSPHeader );
-
 	g_MapRevision = g_pBSPHeader->mapRevision;
 }
 
@@ -2200,7 +2337,7 @@ void OpenBSPFile( const char *filename )
 //-----------------------------------------------------------------------------
 void CloseBSPFile( void )
 {
-	free( g_pBSPHeader );
+	s_BSPFile.Close();
 	g_pBSPHeader = NULL;
 }
 
@@ -2297,9 +2434,10 @@ void LoadBSPFile( const char *filename )
 	}
 	*/
 		
-	// Load PAK file lump into appropriate data structure
-	byte *pakbuffer = NULL;
-	int paksize = CopyVariableLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, ( void ** )&pakbuffer );
+	// Load PAK file lump into appropriate data structure, straight from the file
+	g_Lumps.bLumpParsed[LUMP_PAKFILE] = true;
+	int paksize;
+	byte *pakbuffer = s_BSPFile.GetRawLump( LUMP_PAKFILE, &paksize );
 	if ( paksize > 0 )
 	{
 		GetPakFile()->ActivateByteSwapping( IsX360() );
@@ -2310,9 +2448,7 @@ void LoadBSPFile( const char *filename )
 		GetPakFile()->Reset();
 	}
 
-	free( pakbuffer );
-
-	g_GameLumps.ParseGameLump( g_pBSPHeader );
+	g_GameLumps.ParseGameLump( s_BSPFile );
 
 	// NOTE: Do NOT call CopyLump after Lumps_Parse() it parses all un-Copied lumps
 	// parse any additional lumps
@@ -2439,16 +2575,13 @@ void LoadBSPFile_FileSystemOnly( const char *filename )
 {
 	Lumps_Init();
 
-	//
-	// load the file header
-	//
-	LoadFile( filename, (void **)&g_pBSPHeader );
-
-	ValidateHeader( filename, g_pBSPHeader );
+	// only the pak lump's pages get read
+	CMappedBSPFile bsp;
+	bsp.Open( filename );
 
 	// Load PAK file lump into appropriate data structure
-	byte *pakbuffer = NULL;
-	int paksize = CopyVariableLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, ( void ** )&pakbuffer, 1 );
+	int paksize;
+	byte *pakbuffer = bsp.GetLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, &paksize, 1 );
 	if ( paksize > 0 )
 	{
 		GetPakFile()->ParseFromBuffer( pakbuffer, paksize );
@@ -2458,26 +2591,18 @@ void LoadBSPFile_FileSystemOnly( const char *filename )
 		GetPakFile()->Reset();
 	}
 
-	free( pakbuffer );
-
-	// everything has been copied out
-	free( g_pBSPHeader );
-	g_pBSPHeader = NULL;
+	// the pak file copied out what it needs, the mapping closes here
 }
 
 void ExtractZipFileFromBSP( char *pBSPFileName, char *pZipFileName )
 {
 	Lumps_Init();
 
-	//
-	// load the file header
-	//
-	LoadFile( pBSPFileName, (void **)&g_pBSPHeader);
-
-	ValidateHeader( pBSPFileName, g_pBSPHeader );
+	CMappedBSPFile bsp;
+	bsp.Open( pBSPFileName );
 
-	byte *pakbuffer = NULL;
-	int paksize = CopyVariableLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, ( void ** )&pakbuffer );
+	int paksize;
+	byte *pakbuffer = bsp.GetLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, &paksize );
 	if ( paksize > 0 )
 	{
 		FILE *fp;
@@ -4293,8 +4418,9 @@ void SwapPakfileLumpToDisk( const char *pInFilename )
 {
 	DevMsg( "Swapping %s\n", GetLumpName( LUMP_PAKFILE ) );
 
-	byte *pakbuffer = NULL;
-	int paksize = CopyVariableLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, ( void ** )&pakbuffer );
+	g_Lumps.bLumpParsed[LUMP_PAKFILE] = true;
+	int paksize;
+	byte *pakbuffer = s_BSPFile.GetRawLump( LUMP_PAKFILE, &paksize );
 	if ( paksize > 0 )
 	{
 		GetPakFile()->ActivateByteSwapping( IsX360() );
@@ -4302,7 +4428,6 @@ void SwapPakfileLumpToDisk( const char *pInFilename )
 
 		ConvertPakFileContents( pInFilename );
 	}
-	free( pakbuffer );
 
 	SetAlignedLumpPosition( LUMP_PAKFILE, XBOX_DVD_SECTORSIZE );
 	WritePakFileLump();
@@ -4314,7 +4439,7 @@ void SwapGameLumpsToDisk( void )
 {
 	DevMsg( "Swapping %s\n", GetLumpName( LUMP_GAME_LUMP ) );
 
-	g_GameLumps.ParseGameLump( g_pBSPHeader );
+	g_GameLumps.ParseGameLump( s_BSPFile );
 	SetAlignedLumpPosition( LUMP_GAME_LUMP );
 	AddGameLumps();
 }
@@ -4328,7 +4453,7 @@ void BuildStaticPropNameTable()
 	g_StaticPropNames.Purge();
 	g_StaticPropInstances.Purge();
 
-	g_GameLumps.ParseGameLump( g_pBSPHeader );
+	g_GameLumps.ParseGameLump( s_BSPFile );
 
 	GameLumpHandle_t hGameLump = g_GameLumps.GetGameLumpHandle( GAMELUMP_STATIC_PROPS );
 	if ( hGameLump != g_GameLumps.InvalidGameLump() )
@@ -4440,6 +4565,38 @@ int SortLumpsByOffset( const SortedLump_t *pSortedLumpA, const SortedLump_t *pSo
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+// Compressed lumps are a single LZMA stream, checked against the space the
+// lump has in the file before decoding.
+//-----------------------------------------------------------------------------
+unsigned int GetUncompressedLumpSize( byte *pCompressedLump )
+{
+	if ( CLZMA::IsCompressed( pCompressedLump ) )
+		return CLZMA::GetActualSize( pCompressedLump );
+	return 0;
+}
+
+unsigned int UncompressLumpData( byte *pCompressedLump, unsigned int nCompressedSize, CUtlBuffer &outputBuffer )
+{
+	unsigned int nActualSize = GetUncompressedLumpSize( pCompressedLump );
+	if ( !nActualSize )
+		return 0;
+
+	outputBuffer.EnsureCapacity( outputBuffer.TellPut() + nActualSize );
+	unsigned char *pOutput = (unsigned char *)outputBuffer.Base() + outputBuffer.TellPut();
+
+	lzma_header_t *pHeader = (lzma_header_t *)pCompressedLump;
+	if ( nCompressedSize < sizeof( lzma_header_t ) || LittleLong( pHeader->lzmaSize ) > nCompressedSize - sizeof( lzma_header_t ) )
+	{
+		Warning( "Compressed lump is larger than its file space, BSP may be corrupt\n" );
+		return 0;
+	}
+	unsigned int outSize = CLZMA::Uncompress( pCompressedLump, pOutput );
+
+	outputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
+	return outSize;
+}
+
 bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc )
 {
 	CByteswap	byteSwap;
@@ -4484,12 +4641,12 @@ bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBu
 			if ( pInGameLump[i].flags & GAMELUMPFLAG_COMPRESSED )
 			{
 				byte *pCompressedLump = ((byte *)pInBSPHeader) + pInGameLump[i].fileofs;
-				if ( CLZMA::IsCompressed( pCompressedLump ) )
+				if ( GetUncompressedLumpSize( pCompressedLump ) )
 				{
-					inputBuffer.EnsureCapacity( CLZMA::GetActualSize( pCompressedLump ) );
-					unsigned int outSize = CLZMA::Uncompress( pCompressedLump, (unsigned char *)inputBuffer.Base() );
-					inputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
-					if ( outSize != CLZMA::GetActualSize( pCompressedLump ) )
+					// filelen is the uncompressed size, the next entry's offset ends the compressed data
+					unsigned int nCompressedSize = ( i + 1 < pInGameLumpHeader->lumpCount ) ? pInGameLump[i+1].fileofs - pInGameLump[i].fileofs : 0;
+					unsigned int outSize = UncompressLumpData( pCompressedLump, nCompressedSize, inputBuffer );
+					if ( outSize != GetUncompressedLumpSize( pCompressedLump ) )
 					{
 						Warning( "Decompressed size differs from header, BSP may be corrupt\n" );
 					}
@@ -4578,6 +4735,141 @@ bool RepackBSPCallback_LZMA( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer )
 }
 
 
+//-----------------------------------------------------------------------------
+// Chunk compressor for CChunkedCompression, each chunk is a full LZMA stream
+//-----------------------------------------------------------------------------
+bool CompressChunk_LZMA( const unsigned char *pInput, unsigned int nInputSize, CUtlBuffer &output )
+{
+	unsigned int compressedSize = 0;
+	unsigned char *pCompressedOutput = LZMA_Compress( const_cast< unsigned char * >( pInput ), nInputSize, &compressedSize );
+	if ( !pCompressedOutput )
+		return false;
+
+	output.Put( pCompressedOutput, compressedSize );
+	free( pCompressedOutput );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Decode throughput benchmark over the lumps of a real BSP. Each lump is
+// compressed as one LZMA stream, as chunked LZMA and as chunked Snappy, then
+// decoded repeatedly, serially and across nThreads threads.
+//-----------------------------------------------------------------------------
+struct LumpDecodeBenchTotals_t
+{
+	double flTime[5];
+	unsigned int nCompressed[3];
+};
+
+static double TimeLumpDecode( CUtlBuffer &compressed, unsigned char *pOutput, unsigned int nExpected, bool bChunked, int nThreads, int nIterations )
+{
+	unsigned char *pCompressed = (unsigned char *)compressed.Base();
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		unsigned int nSize = bChunked ? CChunkedCompression::Uncompress( pCompressed, compressed.TellPut(), pOutput, nThreads ) : CLZMA::Uncompress( pCompressed, pOutput );
+		if ( nSize != nExpected )
+		{
+			Warning( "Lump decode benchmark: decode failed\n" );
+			return 0.0;
+		}
+	}
+	return ( Plat_FloatTime() - flStart ) / nIterations;
+}
+
+void BenchmarkLumpDecompression( const char *pBSPFilename, int nThreads, int nIterations )
+{
+	static const char *s_pszColumns[5] = { "lzma", "chunked lzma x1", "chunked lzma xN", "snappy x1", "snappy xN" };
+
+	OpenBSPFile( pBSPFilename );
+
+	if ( nThreads <= 0 )
+	{
+		nThreads = GetCPUInformation()->m_nLogicalProcessors;
+	}
+	nIterations = MAX( nIterations, 1 );
+
+	Msg( "Lump decode benchmark: %s, %d threads, %d iterations, %u byte chunks\n", pBSPFilename, nThreads, nIterations, CHUNKED_DEFAULT_CHUNK_SIZE );
+	Msg( "%-6s %10s %10s %10s %10s", "lump", "bytes", "lzma", "chunk lzma", "snappy" );
+	for ( int i = 0; i < ARRAYSIZE( s_pszColumns ); i++ )
+	{
+		Msg( " %16s", s_pszColumns[i] );
+	}
+	Msg( "   (MB/s)\n" );
+
+	LumpDecodeBenchTotals_t totals;
+	memset( &totals, 0, sizeof( totals ) );
+	unsigned int nTotalBytes = 0;
+
+	for ( int lump = 0; lump < HEADER_LUMPS; lump++ )
+	{
+		lump_t *pLump = &g_pBSPHeader->lumps[lump];
+
+		// Work from the uncompressed data, whatever the file has
+		CUtlBuffer raw;
+		byte *pLumpData = (byte *)g_pBSPHeader + pLump->fileofs;
+		if ( pLump->uncompressedSize )
+		{
+			if ( UncompressLumpData( pLumpData, pLump->filelen, raw ) != (unsigned int)pLump->uncompressedSize )
+				continue;
+		}
+		else
+		{
+			raw.Put( pLumpData, pLump->filelen );
+		}
+
+		// Tiny lumps only measure call overhead
+		unsigned int nSize = raw.TellPut();
+		if ( nSize < 16 * 1024 )
+			continue;
+
+		CUtlBuffer lzma, chunkedLZMA, chunkedSnappy;
+		if ( !CompressChunk_LZMA( (unsigned char *)raw.Base(), nSize, lzma ) ||
+			 !CChunkedCompression::Compress( CHUNK_CODEC_LZMA, (unsigned char *)raw.Base(), nSize, chunkedLZMA, CHUNKED_DEFAULT_CHUNK_SIZE, CompressChunk_LZMA ) ||
+			 !CChunkedCompression::Compress( CHUNK_CODEC_SNAPPY, (unsigned char *)raw.Base(), nSize, chunkedSnappy ) )
+		{
+			Warning( "Lump decode benchmark: failed to compress lump %d\n", lump );
+			continue;
+		}
+
+		unsigned char *pOutput = (unsigned char *)malloc( nSize );
+		double flTimes[5];
+		flTimes[0] = TimeLumpDecode( lzma, pOutput, nSize, false, 1, nIterations );
+		flTimes[1] = TimeLumpDecode( chunkedLZMA, pOutput, nSize, true, 1, nIterations );
+		flTimes[2] = TimeLumpDecode( chunkedLZMA, pOutput, nSize, true, nThreads, nIterations );
+		flTimes[3] = TimeLumpDecode( chunkedSnappy, pOutput, nSize, true, 1, nIterations );
+		flTimes[4] = TimeLumpDecode( chunkedSnappy, pOutput, nSize, true, nThreads, nIterations );
+
+		if ( memcmp( pOutput, raw.Base(), nSize ) )
+		{
+			Warning( "Lump decode benchmark: lump %d round trip mismatch\n", lump );
+		}
+		free( pOutput );
+
+		Msg( "%-6d %10u %10u %10u %10u", lump, nSize, lzma.TellPut(), chunkedLZMA.TellPut(), chunkedSnappy.TellPut() );
+		for ( int i = 0; i < ARRAYSIZE( flTimes ); i++ )
+		{
+			Msg( " %16.1f", flTimes[i] > 0.0 ? nSize / ( flTimes[i] * 1024.0 * 1024.0 ) : 0.0 );
+			totals.flTime[i] += flTimes[i];
+		}
+		Msg( "\n" );
+
+		totals.nCompressed[0] += lzma.TellPut();
+		totals.nCompressed[1] += chunkedLZMA.TellPut();
+		totals.nCompressed[2] += chunkedSnappy.TellPut();
+		nTotalBytes += nSize;
+	}
+
+	Msg( "%-6s %10u %10u %10u %10u", "total", nTotalBytes, totals.nCompressed[0], totals.nCompressed[1], totals.nCompressed[2] );
+	for ( int i = 0; i < ARRAYSIZE( totals.flTime ); i++ )
+	{
+		Msg( " %16.1f", totals.flTime[i] > 0.0 ? nTotalBytes / ( totals.flTime[i] * 1024.0 * 1024.0 ) : 0.0 );
+	}
+	Msg( "\n" );
+
+	CloseBSPFile();
+}
+
 bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc, IZip::eCompressionType packfileCompression )
 {
 	dheader_t *pInBSPHeader = (dheader_t *)inputBuffer.Base();
@@ -4638,20 +4930,17 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 			if ( pSortedLump->pLump->uncompressedSize )
 			{
 				byte *pCompressedLump = ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs;
-				if ( CLZMA::IsCompressed( pCompressedLump ) && pSortedLump->pLump->uncompressedSize == CLZMA::GetActualSize( pCompressedLump ) )
+				if ( (unsigned int)pSortedLump->pLump->uncompressedSize == GetUncompressedLumpSize( pCompressedLump ) )
 				{
-					inputBuffer.EnsureCapacity( CLZMA::GetActualSize( pCompressedLump ) );
-					unsigned int outSize = CLZMA::Uncompress( pCompressedLump, (unsigned char *)inputBuffer.Base() );
-					inputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
-					if ( outSize != pSortedLump->pLump->uncompressedSize )
+					unsigned int outSize = UncompressLumpData( pCompressedLump, pSortedLump->pLump->filelen, inputBuffer );
+					if ( outSize != (unsigned int)pSortedLump->pLump->uncompressedSize )
 					{
 						Warning( "Decompressed size differs from header, BSP may be corrupt\n" );
 					}
 				}
 				else
 				{
-					Assert( CLZMA::IsCompressed( pCompressedLump ) &&
-					        pSortedLump->pLump->uncompressedSize == CLZMA::GetActualSize( pCompressedLump ) );
+					Assert( (unsigned int)pSortedLump->pLump->uncompressedSize == GetUncompressedLumpSize( pCompressedLump ) );
 					Warning( "Unsupported BSP: Unrecognized compressed lump\n" );
 				}
 			}
@@ -4983,24 +5272,22 @@ bool GetPakFileLump( const char *pBSPFilename, void **pPakData, int *pPakSize )
 		return false;
 	}
 
-	// determine endian nature
-	dheader_t *pHeader;
-	LoadFile( pBSPFilename, (void **)&pHeader );
-	bool bSwap = ( pHeader->ident == BigLong( IDBSPHEADER ) );
-	free( pHeader );
+	// only the header and the pak lump get read
+	CMappedBSPFile bsp;
+	bsp.Open( pBSPFilename );
 
-	g_bSwapOnLoad = bSwap;
-	g_bSwapOnWrite = !bSwap;
+	g_bSwapOnLoad = bsp.IsSwapped();
+	g_bSwapOnWrite = !g_bSwapOnLoad;
 
-	OpenBSPFile( pBSPFilename );
-	
-	if ( g_pBSPHeader->lumps[LUMP_PAKFILE].filelen )
+	int paksize;
+	byte *pakbuffer = bsp.GetLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, &paksize );
+	if ( paksize > 0 )
 	{
-		*pPakSize = CopyVariableLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, pPakData );
+		*pPakData = malloc( paksize );
+		memcpy( *pPakData, pakbuffer, paksize );
+		*pPakSize = paksize;
 	}
 
-	CloseBSPFile();
-
 	return true;
 }
 
@@ -5071,10 +5358,10 @@ bool SetPakFileLump( const char *pBSPFilename, const char *pNewFilename, void *p
 	}
 
 	// determine endian nature
-	dheader_t *pHeader;
-	LoadFile( pBSPFilename, (void **)&pHeader );
-	bool bSwap = ( pHeader->ident == BigLong( IDBSPHEADER ) );
-	free( pHeader );
+	CMappedBSPFile bsp;
+	bsp.Open( pBSPFilename );
+	bool bSwap = bsp.IsSwapped();
+	bsp.Close();
 
 	g_bSwapOnLoad = bSwap;
 	g_bSwapOnWrite = bSwap;
@@ -5086,9 +5373,24 @@ bool SetPakFileLump( const char *pBSPFilename, const char *pNewFilename, void *p
 	dheader_t oldHeader;
 	oldHeader = *g_pBSPHeader;
 
+	// copy the lumps out and let go of the mapping, the new file may be the same one
+	dheader_t header = *g_pBSPHeader;
+	CUtlVector< byte > lumpData[HEADER_LUMPS];
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		if ( i == LUMP_PAKFILE || !header.lumps[i].filelen )
+			continue;
+
+		lumpData[i].SetCount( header.lumps[i].filelen );
+		V_memcpy( lumpData[i].Base(), (byte *)g_pBSPHeader + header.lumps[i].fileofs, header.lumps[i].filelen );
+	}
+	CloseBSPFile();
+	g_pBSPHeader = &header;
+
 	g_hBSPFile = SafeOpenWrite( pNewFilename );
 	if ( !g_hBSPFile )
 	{
+		g_pBSPHeader = NULL;
 		return false;
 	}
 
@@ -5118,9 +5420,8 @@ bool SetPakFileLump( const char *pBSPFilename, const char *pNewFilename, void *p
 		if ( length )
 		{
 			// save the lump data
-			int offset = g_pBSPHeader->lumps[lump].fileofs;
 			SetAlignedLumpPosition( lump );
-			SafeWrite( g_hBSPFile, (byte *)g_pBSPHeader + offset, length );
+			SafeWrite( g_hBSPFile, lumpData[lump].Base(), length );
 		}
 		else
 		{
@@ -5142,7 +5443,7 @@ bool SetPakFileLump( const char *pBSPFilename, const char *pNewFilename, void *p
 	WriteData( g_pBSPHeader );
 	g_pFileSystem->Close( g_hBSPFile );
 
-	CloseBSPFile();
+	g_pBSPHeader = NULL;
 	
 	return true;
 }
@@ -209,6 +209,92 @@ typedef bool (*CompressFunc_t)( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffe
 typedef bool (*VTFConvertFunc_t)( const char *pDebugName, CUtlBuffer &sourceBuf, CUtlBuffer &targetBuf, CompressFunc_t pCompressFunc );
 typedef bool (*VHVFixupFunc_t)( const char *pVhvFilename, const char *pModelName, CUtlBuffer &sourceBuf, CUtlBuffer &targetBuf );
 
+//-----------------------------------------------------------------------------
+// Memory mapped BSP reader. Lumps are viewed where they sit in the file,
+// nothing gets read until it's touched. A file with the other byte order is
+// swapped in place a lump at a time, on first access, which only costs the
+// pages of that lump since the mapping is copy on write. The file can't be
+// written while it's open.
+//-----------------------------------------------------------------------------
+class CMappedBSPFile
+{
+public:
+	CMappedBSPFile();
+	~CMappedBSPFile();
+
+	// The byte order comes from the header, errors out if it isn't a BSP
+	void		Open( const char *pFilename );
+	void		Close();
+	bool		IsOpen() const						{ return m_pHeader != NULL; }
+	bool		IsSwapped() const					{ return m_bSwap; }
+
+	// Already swapped
+	dheader_t	*GetHeader() const					{ return m_pHeader; }
+	bool		HasLump( int lump ) const			{ return m_pHeader->lumps[lump].filelen > 0; }
+	int			LumpVersion( int lump ) const		{ return m_pHeader->lumps[lump].version; }
+	int			LumpSize( int lump ) const			{ return m_pHeader->lumps[lump].filelen; }
+
+	// The lump as stored, never swapped
+	byte		*GetRawLump( int lump, int *pSize = NULL ) const;
+
+	// Lumps of types with datadescs, pCount gets the element count
+	template< class T > T *GetLump( int lump, int *pCount = NULL, int forceVersion = -1 );
+
+	// Lumps of integral types without datadescs, vectors are passed in as floats
+	template< class T > T *GetLump( int fieldType, int lump, int *pCount = NULL, int forceVersion = -1 );
+
+	// The game lump directory, and each game lump's data as stored
+	dgamelump_t	*GetGameLumpDirectory( int *pCount );
+	byte		*GetGameLumpData( const dgamelump_t &gameLump ) const;
+
+private:
+	byte		*BeginLump( int lump, int elementSize, int forceVersion, int *pCount, bool &bSwapNow );
+
+	dheader_t	*m_pHeader;
+	int			m_nFileSize;
+	bool		m_bMapped;			// otherwise m_pHeader is a LoadFile buffer
+	bool		m_bSwap;
+	bool		m_bLumpSwapped[HEADER_LUMPS];
+	CByteswap	m_Swap;
+};
+
+template< class T >
+T *CMappedBSPFile::GetLump( int lump, int *pCount, int forceVersion )
+{
+	int count;
+	bool bSwapNow;
+	T *pData = (T *)BeginLump( lump, sizeof( T ), forceVersion, &count, bSwapNow );
+	if ( bSwapNow )
+	{
+		m_Swap.SwapFieldsToTargetEndian( pData, count );
+	}
+
+	if ( pCount )
+	{
+		*pCount = count;
+	}
+	return pData;
+}
+
+template< class T >
+T *CMappedBSPFile::GetLump( int fieldType, int lump, int *pCount, int forceVersion )
+{
+	int count;
+	bool bSwapNow;
+	int fieldSize = ( fieldType == FIELD_VECTOR ) ? sizeof( Vector ) : sizeof( T );
+	T *pData = (T *)BeginLump( lump, fieldSize, forceVersion, &count, bSwapNow );
+	if ( bSwapNow )
+	{
+		m_Swap.SwapBufferToTargetEndian( pData, (T *)NULL, LumpSize( lump ) / sizeof( T ) );
+	}
+
+	if ( pCount )
+	{
+		*pCount = count;
+	}
+	return pData;
+}
+
 //-----------------------------------------------------------------------------
 // Game lump memory storage
 //-----------------------------------------------------------------------------
@@ -239,7 +325,7 @@ public:
 	int					GetGameLumpFlags( GameLumpHandle_t handle );
 	int					GetGameLumpVersion( GameLumpHandle_t handle );
 	void				ComputeGameLumpSizeAndCount( int& size, int& clumpCount );
-	void				ParseGameLump( dheader_t* pHeader );
+	void				ParseGameLump( CMappedBSPFile &bsp );
 	void				SwapGameLump( GameLumpId_t id, int version, byte *dest, byte *src, int size );
 
 
@@ -298,6 +384,10 @@ void	PrintBSPPackDirectory(void);
 void	ReleasePakFileLumps(void);
 
 bool	RepackBSPCallback_LZMA( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer );
+bool	CompressChunk_LZMA( const unsigned char *pInput, unsigned int nInputSize, CUtlBuffer &output );
+unsigned int GetUncompressedLumpSize( byte *pCompressedLump );
+unsigned int UncompressLumpData( byte *pCompressedLump, unsigned int nCompressedSize, CUtlBuffer &outputBuffer );
+void	BenchmarkLumpDecompression( const char *pBSPFilename, int nThreads, int nIterations );
 bool	RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc, IZip::eCompressionType packfileCompression );
 bool	SwapBSPFile( const char *filename, const char *swapFilename, bool bSwapOnLoad, VTFConvertFunc_t pVTFConvertFunc, VHVFixupFunc_t pVHVFixupFunc, CompressFunc_t pCompressFunc );
 
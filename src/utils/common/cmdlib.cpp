@@ -19,6 +19,11 @@
 #ifdef _WIN32
 #include <conio.h>
 #endif
+#ifdef POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "utlvector.h"
 #include "filesystem_helpers.h"
 #include "utllinkedlist.h"
@@ -868,6 +873,84 @@ int    LoadFile ( const char *filename, void **bufferptr )
 
 
 
+/*
+==============
+MapFile
+==============
+*/
+static void *MapFileAtPath( const char *pPath, int *pLength )
+{
+	void *pView = NULL;
+
+#ifdef IS_WINDOWS_PC
+	HANDLE hFile = ::CreateFile( pPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	LARGE_INTEGER size;
+	if ( ::GetFileSizeEx( hFile, &size ) && size.QuadPart > 0 && size.QuadPart < INT_MAX )
+	{
+		// the view keeps the mapping alive
+		HANDLE hMapping = ::CreateFileMapping( hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+		if ( hMapping )
+		{
+			pView = ::MapViewOfFile( hMapping, FILE_MAP_COPY, 0, 0, 0 );
+			::CloseHandle( hMapping );
+			*pLength = (int)size.QuadPart;
+		}
+	}
+	::CloseHandle( hFile );
+#elif defined( POSIX )
+	int fd = open( pPath, O_RDONLY );
+	if ( fd < 0 )
+		return NULL;
+
+	struct stat st;
+	if ( fstat( fd, &st ) == 0 && st.st_size > 0 && st.st_size < INT_MAX )
+	{
+		pView = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+		if ( pView == MAP_FAILED )
+			pView = NULL;
+		*pLength = (int)st.st_size;
+	}
+	close( fd );
+#endif
+
+	return pView;
+}
+
+void *MapFile( const char *filename, int *pLength )
+{
+	// look where SafeOpenRead would
+	int pathLength;
+	if ( CmdLib_HasBasePath( filename, pathLength ) )
+	{
+		filename = filename + pathLength;
+		for ( int i = 0; i < g_NumBasePaths; i++ )
+		{
+			char tmp[MAX_PATH];
+			V_strncpy( tmp, g_pBasePaths[i], sizeof( tmp ) );
+			V_strncat( tmp, filename, sizeof( tmp ) );
+			void *pView = MapFileAtPath( tmp, pLength );
+			if ( pView )
+				return pView;
+		}
+		return NULL;
+	}
+
+	return MapFileAtPath( filename, pLength );
+}
+
+void UnmapFile( void *pView, int length )
+{
+#ifdef IS_WINDOWS_PC
+	::UnmapViewOfFile( pView );
+#elif defined( POSIX )
+	munmap( pView, length );
+#endif
+}
+
+
 /*
 ==============
 SaveFile
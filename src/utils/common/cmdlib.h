@@ -102,6 +102,10 @@ void			SafeRead( FileHandle_t f, void *buffer, int count);
 void			SafeWrite( FileHandle_t f, void *buffer, int count);
 
 int		LoadFile ( const char *filename, void **bufferptr );
+// Maps the whole file copy on write, so writes through the view never reach the file.
+// Returns NULL if it isn't on disk where it can be mapped, LoadFile it instead.
+void	*MapFile ( const char *filename, int *pLength );
+void	UnmapFile ( void *pView, int length );
 void	SaveFile ( const char *filename, void *buffer, int count );
 qboolean	FileExists ( const char *filename );
 
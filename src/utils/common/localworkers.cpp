@@ -0,0 +1,388 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Local multi-process work distribution, see localworkers.h
+//
+//=============================================================================//
+
+#include "cmdlib.h"
+#include "pacifier.h"
+#include "localworkers.h"
+#include "tier1/utlvector.h"
+
+#ifdef POSIX
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+
+#define LOCALWORKERS_MAX_PROCS		64
+#define LOCALWORKERS_UNITS_AHEAD	2		// units queued per worker so it never waits on the master
+#define LOCALWORKERS_MAX_CRASHES	3		// a unit that takes down this many workers won't get better
+#define LOCALWORKERS_UPDATE_MS		200		// how often g_pDistributeWorkCallbacks->Update() gets called
+
+static int s_nProcs = 0;
+
+
+void LocalWorkers_Init( int nProcs )
+{
+#ifdef POSIX
+	if ( nProcs > LOCALWORKERS_MAX_PROCS )
+	{
+		Warning( "-procs %d is more than the %d worker processes supported, using %d.\n", nProcs, LOCALWORKERS_MAX_PROCS, LOCALWORKERS_MAX_PROCS );
+	}
+	s_nProcs = clamp( nProcs, 0, LOCALWORKERS_MAX_PROCS );
+#else
+	if ( nProcs > 0 )
+	{
+		Warning( "-procs needs fork(), which this platform doesn't have. Using threads instead.\n" );
+	}
+	s_nProcs = 0;
+#endif
+}
+
+
+bool LocalWorkers_IsActive()
+{
+	return s_nProcs > 0;
+}
+
+
+int LocalWorkers_GetCount()
+{
+	return s_nProcs;
+}
+
+
+#ifdef POSIX
+
+struct localresultheader_t
+{
+	uint64	m_iWorkUnit;
+	int		m_nBytes;		// of MessageBuffer data following the header
+};
+
+struct localworker_t
+{
+	pid_t				m_Pid;				// 0 when not running
+	int					m_fdWork;			// unit numbers go out here
+	int					m_fdResults;		// and come back here with their results
+	CUtlVector<uint64>	m_Outstanding;		// in the order they were sent, the first one is being worked on
+	CUtlVector<char>	m_Pending;			// results read so far that don't make a whole message yet
+};
+
+static localworker_t	s_Workers[LOCALWORKERS_MAX_PROCS];
+static char				s_ReadBuffer[64 * 1024];
+
+
+static bool ReadFull( int fd, void *pDest, int nBytes )
+{
+	char *pOut = (char *)pDest;
+	while ( nBytes > 0 )
+	{
+		int nRead = read( fd, pOut, nBytes );
+		if ( nRead < 0 && errno == EINTR )
+			continue;
+		if ( nRead <= 0 )
+			return false;
+
+		pOut += nRead;
+		nBytes -= nRead;
+	}
+	return true;
+}
+
+
+static bool WriteFull( int fd, const void *pSrc, int nBytes )
+{
+	const char *pIn = (const char *)pSrc;
+	while ( nBytes > 0 )
+	{
+		int nWritten = write( fd, pIn, nBytes );
+		if ( nWritten < 0 && errno == EINTR )
+			continue;
+		if ( nWritten <= 0 )
+			return false;
+
+		pIn += nWritten;
+		nBytes -= nWritten;
+	}
+	return true;
+}
+
+
+static void WorkerMain( int fdWork, int fdResults, ProcessWorkUnitFn processFn )
+{
+	uint64 iWorkUnit;
+	while ( ReadFull( fdWork, &iWorkUnit, sizeof( iWorkUnit ) ) )
+	{
+		MessageBuffer mb;
+		processFn( 0, iWorkUnit, &mb );
+
+		localresultheader_t header;
+		header.m_iWorkUnit = iWorkUnit;
+		header.m_nBytes = mb.getLen();
+		if ( !WriteFull( fdResults, &header, sizeof( header ) ) || !WriteFull( fdResults, mb.data, header.m_nBytes ) )
+			break;
+	}
+
+	// the master closed the work pipe. Skip the exit handlers, they belong to the master.
+	_exit( 0 );
+}
+
+
+static void StartWorker( int iWorker, ProcessWorkUnitFn processFn )
+{
+	int fdWork[2], fdResults[2];
+	if ( pipe( fdWork ) != 0 || pipe( fdResults ) != 0 )
+		Error( "Couldn't create the pipes for local worker %d: %s\n", iWorker, strerror( errno ) );
+
+	// anything still buffered would get printed again by the worker
+	fflush( stdout );
+	fflush( stderr );
+
+	pid_t pid = fork();
+	if ( pid < 0 )
+		Error( "Couldn't fork local worker %d: %s\n", iWorker, strerror( errno ) );
+
+	if ( pid == 0 )
+	{
+		// the other workers' pipes came along, close them so the master still sees their EOFs
+		for ( int i = 0; i < LOCALWORKERS_MAX_PROCS; i++ )
+		{
+			if ( s_Workers[i].m_Pid > 0 )
+			{
+				close( s_Workers[i].m_fdWork );
+				close( s_Workers[i].m_fdResults );
+			}
+		}
+		close( fdWork[1] );
+		close( fdResults[0] );
+		WorkerMain( fdWork[0], fdResults[1], processFn );
+	}
+
+	close( fdWork[0] );
+	close( fdResults[1] );
+
+	localworker_t &worker = s_Workers[iWorker];
+	worker.m_Pid = pid;
+	worker.m_fdWork = fdWork[1];
+	worker.m_fdResults = fdResults[0];
+	worker.m_Outstanding.RemoveAll();
+	worker.m_Pending.RemoveAll();
+}
+
+
+// Returns the worker's wait status
+static int StopWorker( int iWorker, bool bKill )
+{
+	localworker_t &worker = s_Workers[iWorker];
+	if ( worker.m_Pid <= 0 )
+		return 0;
+
+	// closing the work pipe is what tells a worker to exit
+	close( worker.m_fdWork );
+	close( worker.m_fdResults );
+	if ( bKill )
+	{
+		kill( worker.m_Pid, SIGKILL );
+	}
+
+	int status = 0;
+	while ( waitpid( worker.m_Pid, &status, 0 ) < 0 && errno == EINTR )
+		;
+
+	worker.m_Pid = 0;
+	return status;
+}
+
+
+// Hands the worker's complete results to receiveFn. Returns how many were new.
+static int ReceiveResults( int iWorker, ReceiveWorkUnitFn receiveFn, CUtlVector<byte> &received )
+{
+	localworker_t &worker = s_Workers[iWorker];
+
+	int nReceived = 0;
+	int nOffset = 0;
+	while ( worker.m_Pending.Count() - nOffset >= (int)sizeof( localresultheader_t ) )
+	{
+		localresultheader_t header;
+		memcpy( &header, &worker.m_Pending[nOffset], sizeof( header ) );
+		if ( worker.m_Pending.Count() - nOffset - (int)sizeof( header ) < header.m_nBytes )
+			break;
+
+		// workers do their units in the order they got them
+		if ( !worker.m_Outstanding.Count() || worker.m_Outstanding[0] != header.m_iWorkUnit )
+			Error( "Local worker %d sent back work unit %llu out of order\n", iWorker, header.m_iWorkUnit );
+		worker.m_Outstanding.Remove( 0 );
+
+		if ( !received[header.m_iWorkUnit] )
+		{
+			MessageBuffer mb;
+			mb.write( &worker.m_Pending[nOffset + sizeof( header )], header.m_nBytes );
+			mb.setOffset( 0 );
+			receiveFn( header.m_iWorkUnit, &mb, iWorker );
+
+			received[header.m_iWorkUnit] = true;
+			++nReceived;
+		}
+
+		nOffset += sizeof( header ) + header.m_nBytes;
+	}
+
+	worker.m_Pending.RemoveMultipleFromHead( nOffset );
+	return nReceived;
+}
+
+
+double DistributeWorkLocal( uint64 nWorkUnits, ProcessWorkUnitFn processFn, ReceiveWorkUnitFn receiveFn )
+{
+	double flStart = Plat_FloatTime();
+	StartPacifier( "" );
+
+	// a worker that died doesn't take the master with it when we write its next unit
+	signal( SIGPIPE, SIG_IGN );
+
+	CUtlVector<byte> received;
+	CUtlVector<byte> crashes;
+	received.SetCount( nWorkUnits );
+	crashes.SetCount( nWorkUnits );
+	memset( received.Base(), 0, nWorkUnits );
+	memset( crashes.Base(), 0, nWorkUnits );
+
+	CUtlVector<uint64> retry;		// units that were lost with a worker
+	uint64 iNextWorkUnit = 0;
+	uint64 nReceived = 0;
+	uint64 nContiguous = 0;
+
+	int nWorkers = (int)MIN( (uint64)s_nProcs, nWorkUnits );
+	for ( int i = 0; i < nWorkers; i++ )
+	{
+		StartWorker( i, processFn );
+	}
+
+	double flNextUpdate = flStart + LOCALWORKERS_UPDATE_MS / 1000.0;
+	bool bStopped = false;
+	while ( nReceived < nWorkUnits )
+	{
+		// keep every worker a few units ahead
+		for ( int i = 0; i < nWorkers; i++ )
+		{
+			localworker_t &worker = s_Workers[i];
+			while ( worker.m_Outstanding.Count() < LOCALWORKERS_UNITS_AHEAD )
+			{
+				uint64 iWorkUnit;
+				if ( retry.Count() )
+				{
+					iWorkUnit = retry.Tail();
+					retry.RemoveMultipleFromTail( 1 );
+				}
+				else if ( iNextWorkUnit < nWorkUnits )
+				{
+					iWorkUnit = iNextWorkUnit++;
+				}
+				else
+				{
+					break;
+				}
+
+				// if this fails the worker is gone, the poll below finds out and requeues it
+				worker.m_Outstanding.AddToTail( iWorkUnit );
+				WriteFull( worker.m_fdWork, &iWorkUnit, sizeof( iWorkUnit ) );
+			}
+		}
+
+		pollfd fds[LOCALWORKERS_MAX_PROCS];
+		for ( int i = 0; i < nWorkers; i++ )
+		{
+			fds[i].fd = s_Workers[i].m_fdResults;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+
+		int nTimeout = clamp( (int)( ( flNextUpdate - Plat_FloatTime() ) * 1000 ), 0, LOCALWORKERS_UPDATE_MS );
+		if ( poll( fds, nWorkers, nTimeout ) < 0 && errno != EINTR )
+			Error( "Couldn't poll the local workers: %s\n", strerror( errno ) );
+
+		for ( int i = 0; i < nWorkers; i++ )
+		{
+			if ( !fds[i].revents )
+				continue;
+
+			localworker_t &worker = s_Workers[i];
+			int nRead = read( worker.m_fdResults, s_ReadBuffer, sizeof( s_ReadBuffer ) );
+			if ( nRead < 0 && errno == EINTR )
+				continue;
+
+			if ( nRead > 0 )
+			{
+				worker.m_Pending.AddMultipleToTail( nRead, s_ReadBuffer );
+				nReceived += ReceiveResults( i, receiveFn, received );
+				continue;
+			}
+
+			// the worker is gone, give its units to a new one
+			int status = StopWorker( i, false );
+			if ( worker.m_Outstanding.Count() )
+			{
+				uint64 iLost = worker.m_Outstanding[0];
+				if ( ++crashes[iLost] >= LOCALWORKERS_MAX_CRASHES )
+					Error( "Work unit %llu took down %d local workers, giving up\n", iLost, LOCALWORKERS_MAX_CRASHES );
+
+				Warning( "\nLocal worker %d died (status 0x%x) on work unit %llu, requeueing %d work units\n",
+					i, status, iLost, worker.m_Outstanding.Count() );
+
+				for ( int j = 0; j < worker.m_Outstanding.Count(); j++ )
+				{
+					if ( !received[worker.m_Outstanding[j]] )
+						retry.AddToTail( worker.m_Outstanding[j] );
+				}
+			}
+			StartWorker( i, processFn );
+		}
+
+		uint64 nOldContiguous = nContiguous;
+		while ( nContiguous < nWorkUnits && received[nContiguous] )
+		{
+			++nContiguous;
+		}
+		if ( nContiguous != nOldContiguous && g_pDistributeWorkCallbacks )
+		{
+			g_pDistributeWorkCallbacks->OnWorkUnitsCompleted( nContiguous );
+		}
+
+		UpdatePacifier( (float)nReceived / nWorkUnits );
+
+		if ( Plat_FloatTime() >= flNextUpdate )
+		{
+			flNextUpdate = Plat_FloatTime() + LOCALWORKERS_UPDATE_MS / 1000.0;
+			if ( g_pDistributeWorkCallbacks && g_pDistributeWorkCallbacks->Update() )
+			{
+				bStopped = true;
+				break;
+			}
+		}
+	}
+
+	for ( int i = 0; i < nWorkers; i++ )
+	{
+		StopWorker( i, bStopped );
+	}
+
+	double flElapsed = Plat_FloatTime() - flStart;
+	EndPacifier( false );
+	printf( " (%d)\n", (int)flElapsed );
+	return flElapsed;
+}
+
+#else
+
+double DistributeWorkLocal( uint64 nWorkUnits, ProcessWorkUnitFn processFn, ReceiveWorkUnitFn receiveFn )
+{
+	Error( "DistributeWorkLocal: local workers need fork()\n" );
+	return 0;
+}
+
+#endif // POSIX
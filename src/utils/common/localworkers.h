@@ -0,0 +1,34 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Local multi-process work distribution for -procs.
+//
+// DistributeWorkLocal runs the same process/receive pairs as the VMPI
+// DistributeWork, but the workers are forked copies of this process on the same
+// machine instead of remote workers. Each worker gets work unit numbers through a
+// pipe, runs the process function into a MessageBuffer and writes the results
+// back. The master hands out units a few at a time per worker, so a slow worker
+// just ends up with fewer of them, and the units a crashed worker was holding are
+// handed to a replacement.
+//
+//=============================================================================//
+
+#ifndef LOCALWORKERS_H
+#define LOCALWORKERS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "vmpi_distribute_work.h"
+
+
+// Called while parsing the command line. Warns and stays inactive where fork() isn't available.
+void LocalWorkers_Init( int nProcs );
+bool LocalWorkers_IsActive();
+int LocalWorkers_GetCount();
+
+// Like DistributeWork but with forked workers, iThread is always 0 in them.
+// Shows a pacifier and returns how long it took, like RunThreadsOn.
+double DistributeWorkLocal( uint64 nWorkUnits, ProcessWorkUnitFn processFn, ReceiveWorkUnitFn receiveFn );
+
+
+#endif // LOCALWORKERS_H
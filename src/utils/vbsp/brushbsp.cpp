@@ -310,17 +310,15 @@ AllocNode
 */
 node_t *AllocNode (void)
 {
-	static int s_NodeCount = 0;
+	static CInterlockedInt s_NodeCount;
 
 	node_t	*node;
 
 	node = (node_t*)malloc(sizeof(*node));
 	memset (node, 0, sizeof(*node));
-	node->id = s_NodeCount;
+	node->id = s_NodeCount++;
 	node->diskId = -1;
 
-	s_NodeCount++;
-
 	return node;
 }
 
@@ -332,7 +330,7 @@ AllocBrush
 */
 bspbrush_t *AllocBrush (int numsides)
 {
-	static int s_BrushId = 0;
+	static CInterlockedInt s_BrushId;
 
 	bspbrush_t	*bb;
 	int			c;
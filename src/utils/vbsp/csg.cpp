@@ -271,9 +271,15 @@ static void ComputeBoundingPlanes( const Vector& clipmins, const Vector& clipmax
 		VectorClear (normal);
 		normal[i] = 1;
 		dist = clipmaxs[i];
-		maxplanenums[i] = g_MainMap->FindFloatPlane (normal, dist);
+		int maxplane = g_MainMap->FindFloatPlane (normal, dist);
 		dist = clipmins[i];
-		minplanenums[i] = g_MainMap->FindFloatPlane (normal, dist);
+		int minplane = g_MainMap->FindFloatPlane (normal, dist);
+
+		// submodels are clipped on several threads, all to the same box
+		if (maxplanenums[i] != maxplane)
+			maxplanenums[i] = maxplane;
+		if (minplanenums[i] != minplane)
+			minplanenums[i] = minplane;
 	}
 }
 
@@ -651,21 +657,160 @@ qboolean BrushGE (bspbrush_t *b1, bspbrush_t *b2)
 	return false;
 }
 
+/*
+=================
+Chop grid
+
+ChopBrushes only needs the brushes whose bounds overlap each brush, so the
+working brushes are hashed into a uniform grid by their bounds. Brushes too
+big for the grid are checked against everything, like before.
+=================
+*/
+#define CHOP_GRID_BUCKETS	4096		// power of two, cells hash into these
+#define CHOP_GRID_MAXCELLS	64			// brushes covering more cells than this aren't gridded
+
+struct chopgrid_t
+{
+	float					cellsize;
+	CUtlVector<bspbrush_t *>	brushes;	// by slot, NULL once freed
+	CUtlVector<int>			pos;		// by slot, place in the working list, -1 once kept
+	CUtlVector<int>			stamp;		// by slot, last query that saw it
+	CUtlVector<int>			big;		// slots too big for the grid
+	CUtlVector<int>			buckets[CHOP_GRID_BUCKETS];
+	int						curstamp;
+};
+
+static inline int ChopGridBucket (int x, int y, int z)
+{
+	return ( x * 73856093 ^ y * 19349663 ^ z * 83492791 ) & (CHOP_GRID_BUCKETS - 1);
+}
+
+static int ChopGridCells (chopgrid_t &grid, bspbrush_t *b, int *cellmins, int *cellmaxs)
+{
+	int		i, count;
+
+	count = 1;
+	for (i=0 ; i<3 ; i++)
+	{
+		cellmins[i] = (int)floor (b->mins[i] / grid.cellsize);
+		cellmaxs[i] = (int)floor (b->maxs[i] / grid.cellsize);
+		count *= cellmaxs[i] - cellmins[i] + 1;
+		if (count > CHOP_GRID_MAXCELLS)
+			return count;
+	}
+	return count;
+}
+
+static int AddChopBrush (chopgrid_t &grid, bspbrush_t *b)
+{
+	int		cellmins[3], cellmaxs[3];
+	int		x, y, z;
+
+	int slot = grid.brushes.AddToTail (b);
+	grid.pos.AddToTail (-1);
+	grid.stamp.AddToTail (0);
+
+	if (ChopGridCells (grid, b, cellmins, cellmaxs) > CHOP_GRID_MAXCELLS)
+	{
+		grid.big.AddToTail (slot);
+		return slot;
+	}
+
+	for (x=cellmins[0] ; x<=cellmaxs[0] ; x++)
+		for (y=cellmins[1] ; y<=cellmaxs[1] ; y++)
+			for (z=cellmins[2] ; z<=cellmaxs[2] ; z++)
+				grid.buckets[ChopGridBucket (x, y, z)].AddToTail (slot);
+
+	return slot;
+}
+
+static inline void AddChopCandidate (chopgrid_t &grid, bspbrush_t *b1, int pos1, int slot, CUtlVector<int> &candidates)
+{
+	int		i;
+
+	bspbrush_t *b2 = grid.brushes[slot];
+	if (!b2 || grid.pos[slot] <= pos1 || grid.stamp[slot] == grid.curstamp)
+		return;
+	grid.stamp[slot] = grid.curstamp;
+
+	// same test BrushesDisjoint starts with
+	for (i=0 ; i<3 ; i++)
+		if (b1->mins[i] >= b2->maxs[i] || b1->maxs[i] <= b2->mins[i])
+			return;
+
+	candidates.AddToTail (grid.pos[slot]);
+}
+
+static int ChopPosComp (const void *a, const void *b)
+{
+	return *(int *)a - *(int *)b;
+}
+
+/*
+=================
+GetChopCandidates
+
+Positions of the brushes after pos1 in the working list whose bounds overlap
+the brush at pos1, in list order
+=================
+*/
+static void GetChopCandidates (chopgrid_t &grid, CUtlVector<int> &worklist, int pos1, CUtlVector<int> &candidates)
+{
+	int		cellmins[3], cellmaxs[3];
+	int		i, x, y, z;
+
+	candidates.RemoveAll ();
+
+	int slot1 = worklist[pos1];
+	bspbrush_t *b1 = grid.brushes[slot1];
+	grid.curstamp++;
+
+	if (ChopGridCells (grid, b1, cellmins, cellmaxs) > CHOP_GRID_MAXCELLS)
+	{
+		for (i=pos1+1 ; i<worklist.Count() ; i++)
+			AddChopCandidate (grid, b1, pos1, worklist[i], candidates);
+		return;
+	}
+
+	for (x=cellmins[0] ; x<=cellmaxs[0] ; x++)
+	{
+		for (y=cellmins[1] ; y<=cellmaxs[1] ; y++)
+		{
+			for (z=cellmins[2] ; z<=cellmaxs[2] ; z++)
+			{
+				CUtlVector<int> &bucket = grid.buckets[ChopGridBucket (x, y, z)];
+				for (i=0 ; i<bucket.Count() ; i++)
+					AddChopCandidate (grid, b1, pos1, bucket[i], candidates);
+			}
+		}
+	}
+	for (i=0 ; i<grid.big.Count() ; i++)
+		AddChopCandidate (grid, b1, pos1, grid.big[i], candidates);
+
+	qsort (candidates.Base(), candidates.Count(), sizeof(int), ChopPosComp);
+}
+
 /*
 =================
 ChopBrushes
 
 Carves any intersecting solid brushes into the minimum number
 of non-intersecting brushes. 
+
+Whenever a pair gets carved, the brushes from the first one on are
+reversed into a new working list with the pieces, same as rebuilding
+the list with CullList, and the scan starts over on it.
 =================
 */
 bspbrush_t *ChopBrushes (bspbrush_t *head)
 {
-	bspbrush_t	*b1, *b2, *next;
-	bspbrush_t	*tail;
+	bspbrush_t	*b1, *b2, *list;
 	bspbrush_t	*keep;
-	bspbrush_t	*sub, *sub2;
+	bspbrush_t	*sub, *sub2, *add;
 	int			c1, c2;
+	int			i, j, pos1, cullslot;
+	float		size;
+	int			c_pairtests, c_bruteforce;
 
 	qprintf ("---- ChopBrushes ----\n");
 	qprintf ("original brushes: %i\n", CountBrushList (head));
@@ -676,18 +821,40 @@ bspbrush_t *ChopBrushes (bspbrush_t *head)
 #endif
 	keep = NULL;
 
-newlist:
-	// find tail
 	if (!head)
 		return NULL;
-	for (tail=head ; tail->next ; tail=tail->next)
-	;
 
-	for (b1=head ; b1 ; b1=next)
+	// size the cells to the average brush
+	chopgrid_t *grid = new chopgrid_t;
+	size = 0;
+	for (b1=head ; b1 ; b1=b1->next)
+		size += MAX (b1->maxs[0] - b1->mins[0], MAX (b1->maxs[1] - b1->mins[1], b1->maxs[2] - b1->mins[2]));
+	grid->cellsize = clamp (size / CountBrushList (head), 64.0f, 4096.0f);
+	grid->curstamp = 0;
+
+	CUtlVector<int> worklist;		// slots, in list order
+	CUtlVector<int> candidates;
+	for (b1=head ; b1 ; b1=b1->next)
 	{
-		next = b1->next;
-		for (b2=b1->next ; b2 ; b2 = b2->next)
+		int slot = AddChopBrush (*grid, b1);
+		grid->pos[slot] = worklist.AddToTail (slot);
+	}
+
+	c_pairtests = 0;
+	c_bruteforce = 0;
+	for (pos1=0 ; pos1<worklist.Count() ; )
+	{
+		b1 = grid->brushes[worklist[pos1]];
+		GetChopCandidates (*grid, worklist, pos1, candidates);
+
+		cullslot = -1;
+		add = NULL;
+		for (j=0 ; j<candidates.Count() ; j++)
 		{
+			int slot2 = worklist[candidates[j]];
+			b2 = grid->brushes[slot2];
+
+			c_pairtests++;
 			if (BrushesDisjoint (b1, b2))
 				continue;
 
@@ -704,8 +871,8 @@ newlist:
 					continue;		// didn't really intersect
 				if (!sub)
 				{	// b1 is swallowed by b2
-					head = CullList (b1, b1);
-					goto newlist;
+					cullslot = worklist[pos1];
+					break;
 				}
 				c1 = CountBrushList (sub);
 			}
@@ -719,8 +886,8 @@ newlist:
 				if (!sub2)
 				{	// b2 is swallowed by b1
 					FreeBrushList (sub);
-					head = CullList (b1, b2);
-					goto newlist;
+					cullslot = slot2;
+					break;
 				}
 				c2 = CountBrushList (sub2);
 			}
@@ -749,28 +916,55 @@ newlist:
 			{
 				if (sub2)
 					FreeBrushList (sub2);
-				tail = AddBrushListToTail (sub, tail);
-				head = CullList (b1, b1);
-				goto newlist;
+				add = sub;
+				cullslot = worklist[pos1];
 			}
 			else
 			{
 				if (sub)
 					FreeBrushList (sub);
-				tail = AddBrushListToTail (sub2, tail);
-				head = CullList (b1, b2);
-				goto newlist;
+				add = sub2;
+				cullslot = slot2;
 			}
+			break;
 		}
 
-		if (!b2)
+		if (cullslot < 0)
 		{	// b1 is no longer intersecting anything, so keep it
+			c_bruteforce += worklist.Count() - 1 - pos1;
+
+			// it stays in the grid, but a rebuilt working list won't have it
+			grid->pos[worklist[pos1]] = -1;
 			b1->next = keep;
 			keep = b1;
+			pos1++;
+			continue;
 		}
+		c_bruteforce += candidates[j] - pos1;
+
+		// the pieces go on the end, then everything from b1 on is reversed without the culled brush
+		CUtlVector<int> newlist;
+		for (list=add ; list ; list=list->next)
+			worklist.AddToTail (AddChopBrush (*grid, list));
+
+		FreeBrush (grid->brushes[cullslot]);
+		grid->brushes[cullslot] = NULL;
+
+		newlist.EnsureCapacity (worklist.Count() - pos1);
+		for (i=worklist.Count()-1 ; i>=pos1 ; i--)
+		{
+			if (worklist[i] == cullslot)
+				continue;
+			grid->pos[worklist[i]] = newlist.AddToTail (worklist[i]);
+		}
+		worklist.Swap (newlist);
+		pos1 = 0;
 	}
 
+	delete grid;
+
 	qprintf ("output brushes: %i\n", CountBrushList (keep));
+	qprintf ("pair tests: %i (%i without the grid)\n", c_pairtests, c_bruteforce);
 #if DEBUG_BRUSHMODEL
 	if ( entity_num == DEBUG_BRUSHMODEL )
 	{
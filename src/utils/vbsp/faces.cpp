@@ -14,6 +14,7 @@
 #include "mstristrip.h"
 #include "tier1/strtools.h"
 #include "materialpatch.h"
+#include "faces.h"
 /*
 
   some faces will be removed before saving, but still form nodes:
@@ -64,41 +65,93 @@ float	g_maxLightmapDimension = 32;
 
 face_t *NewFaceFromFace (face_t *f);
 
-// Used to speed up GetEdge2(). Holds a list of edges connected to each vert.
-CUtlVector<int> g_VertEdgeList[MAX_MAP_VERTS];
-
 
 //===========================================================================
 
-typedef struct hashvert_s
+// Welded vertexes are hashed by 32 unit cell into an open addressed table. A cell
+// holds a chain of vertex numbers, newest first, and is only valid while its
+// generation matches, so a new model doesn't have to clear the table.
+typedef struct
 {
-	struct hashvert_s	*next;
-	int		num;
-} hashvert_t;
-
-#define HASH_BITS	7
-#define	HASH_SIZE	(COORD_EXTENT>>HASH_BITS)
+	int		key;			// packed cell coordinates
+	int		gen;
+	int		firstvert;		// a vertex number, or 0 for no verts
+	int		query;			// last FindEdgeVerts that gathered this cell
+} vertcell_t;
+
+#define VERT_CELL_BITS		5
+#define VERT_CELL_SIZE		(1<<VERT_CELL_BITS)
+#define VERT_CELL_AXIS		(COORD_EXTENT>>VERT_CELL_BITS)
+#define VERT_HASH_BITS		17		// never more than half full, there are fewer cells than verts
+#define VERT_HASH_SIZE		(1<<VERT_HASH_BITS)
+
+int			vertexchain[MAX_MAP_VERTS];		// the next vertex in a cell chain
+vertcell_t	vertcells[VERT_HASH_SIZE];
+int			vertcellgen = 1;
+int			vertcellquery;
+
+// Edges are found by their sorted vertex pair, each pair holding a chain of the
+// edges between those verts, newest first, that don't have a back face yet.
+typedef struct
+{
+	int		v[2];			// v[0] < v[1]
+	int		gen;
+	int		firstedge;		// an edge number, or 0 for no edges
+} edgepair_t;
 
+#define EDGE_HASH_BITS		19
+#define EDGE_HASH_SIZE		(1<<EDGE_HASH_BITS)
 
-int	vertexchain[MAX_MAP_VERTS];		// the next vertex in a hash chain
-int	hashverts[HASH_SIZE*HASH_SIZE];	// a vertex number, or 0 for no verts
+int			edgechain[MAX_MAP_EDGES];		// the next edge in a pair chain
+edgepair_t	edgepairs[EDGE_HASH_SIZE];
+int			edgepairgen = 1;
 
 //face_t		*edgefaces[MAX_MAP_EDGES][2];
 
 //============================================================================
 
 
-unsigned HashVec (Vector& vec)
+inline unsigned HashInts (int a, int b)
 {
-	int			x, y;
+	return (unsigned)a * 2654435761u + (unsigned)b * 40503u;
+}
 
-	x = (MAX_COORD_INTEGER + (int)(vec[0]+0.5)) >> HASH_BITS;
-	y = (MAX_COORD_INTEGER + (int)(vec[1]+0.5)) >> HASH_BITS;
 
-	if ( x < 0 || x >= HASH_SIZE || y < 0 || y >= HASH_SIZE )
-		Error ("HashVec: point outside valid range");
-	
-	return y*HASH_SIZE + x;
+inline int VertCellCoord (vec_t v)
+{
+	return ((int)floor(v) + MAX_COORD_INTEGER) >> VERT_CELL_BITS;
+}
+
+
+/*
+=============
+FindVertCell
+
+Returns the cell's slot in vertcells, or -1 if it holds no verts and create is false
+=============
+*/
+int FindVertCell (int x, int y, int z, bool create)
+{
+	int			key;
+	unsigned	h;
+	vertcell_t	*cell;
+
+	key = (z*VERT_CELL_AXIS + y)*VERT_CELL_AXIS + x;
+	for (h = HashInts (key, 0) >> (32-VERT_HASH_BITS) ; ; h = (h+1) & (VERT_HASH_SIZE-1))
+	{
+		cell = &vertcells[h];
+		if (cell->gen != vertcellgen)
+		{
+			if (!create)
+				return -1;
+			cell->key = key;
+			cell->gen = vertcellgen;
+			cell->firstvert = 0;
+			return h;
+		}
+		if (cell->key == key)
+			return h;
+	}
 }
 
 #ifdef USE_HASHING
@@ -111,10 +164,12 @@ Uses hashing
 */
 int	GetVertexnum (Vector& in)
 {
-	int			h;
 	int			i;
 	Vector		vert;
-	int			vnum;
+	int			vnum, best;
+	int			lo[3], hi[3];
+	int			x, y, z;
+	int			h;
 
 	c_totalverts++;
 
@@ -124,18 +179,44 @@ int	GetVertexnum (Vector& in)
 			vert[i] = (int)(in[i]+0.5);
 		else
 			vert[i] = in[i];
+
+		h = VertCellCoord (vert[i]);
+		if (h < 0 || h >= VERT_CELL_AXIS)
+			Error ("GetVertexnum: outside world, vertex %.1f %.1f %.1f", vert.x, vert.y, vert.z);
+
+		// a match can be in the next cell over when the point is near a cell wall
+		lo[i] = MAX (VertCellCoord (vert[i] - POINT_EPSILON), 0);
+		hi[i] = MIN (VertCellCoord (vert[i] + POINT_EPSILON), VERT_CELL_AXIS-1);
 	}
-	
-	h = HashVec (vert);
-	
-	for (vnum=hashverts[h] ; vnum ; vnum=vertexchain[vnum])
+
+	// the newest vertex wins if more than one is close enough
+	best = 0;
+	for (z=lo[2] ; z<=hi[2] ; z++)
 	{
-		Vector& p = dvertexes[vnum].point;
-		if ( fabs(p[0]-vert[0])<POINT_EPSILON
-		&& fabs(p[1]-vert[1])<POINT_EPSILON
-		&& fabs(p[2]-vert[2])<POINT_EPSILON )
-			return vnum;
+		for (y=lo[1] ; y<=hi[1] ; y++)
+		{
+			for (x=lo[0] ; x<=hi[0] ; x++)
+			{
+				h = FindVertCell (x, y, z, false);
+				if (h < 0)
+					continue;
+
+				for (vnum=vertcells[h].firstvert ; vnum > best ; vnum=vertexchain[vnum])
+				{
+					Vector& p = dvertexes[vnum].point;
+					if ( fabs(p[0]-vert[0])<POINT_EPSILON
+					&& fabs(p[1]-vert[1])<POINT_EPSILON
+					&& fabs(p[2]-vert[2])<POINT_EPSILON )
+					{
+						best = vnum;
+						break;
+					}
+				}
+			}
+		}
 	}
+	if (best)
+		return best;
 	
 // emit a vertex
 	if (numvertexes == MAX_MAP_VERTS)
@@ -145,8 +226,9 @@ int	GetVertexnum (Vector& in)
 	dvertexes[numvertexes].point[1] = vert[1];
 	dvertexes[numvertexes].point[2] = vert[2];
 
-	vertexchain[numvertexes] = hashverts[h];
-	hashverts[h] = numvertexes;
+	h = FindVertCell (VertCellCoord (vert[0]), VertCellCoord (vert[1]), VertCellCoord (vert[2]), true);
+	vertexchain[numvertexes] = vertcells[h].firstvert;
+	vertcells[h].firstvert = numvertexes;
 
 	c_uniqueverts++;
 
@@ -336,63 +418,51 @@ void EmitLeafFaceVertexes( face_t **ppLeafFaceList )
 ==========
 FindEdgeVerts
 
-Uses the hash tables to cut down to a small number
+Uses the hash table to cut down to a small number. Steps along the edge
+gathering every cell a vertex within OFF_EPSILON of it could be in.
 ==========
 */
 void FindEdgeVerts (Vector& v1, Vector& v2)
 {
-	int		x1, x2, y1, y2, t;
-	int		x, y;
-	int		vnum;
+	int		i, s, steps;
+	int		lo[3], hi[3];
+	int		x, y, z;
+	int		h, vnum;
+	Vector	delta, p;
+	vec_t	len, pad;
 
-#if 0
-{
-	int		i;
-	num_edge_verts = numvertexes-1;
-	for (i=0 ; i<numvertexes-1 ; i++)
-		edge_verts[i] = i+1;
-}
-#endif
+	VectorSubtract (v2, v1, delta);
+	len = delta.Length();
+	steps = (int)(len / VERT_CELL_SIZE) + 1;
 
-	x1 = (MAX_COORD_INTEGER + (int)(v1[0]+0.5)) >> HASH_BITS;
-	y1 = (MAX_COORD_INTEGER + (int)(v1[1]+0.5)) >> HASH_BITS;
-	x2 = (MAX_COORD_INTEGER + (int)(v2[0]+0.5)) >> HASH_BITS;
-	y2 = (MAX_COORD_INTEGER + (int)(v2[1]+0.5)) >> HASH_BITS;
+	// everything near the edge is near one of the steps
+	pad = OFF_EPSILON + 0.5 * len / steps;
 
-	if (x1 > x2)
-	{
-		t = x1;
-		x1 = x2;
-		x2 = t;
-	}
-	if (y1 > y2)
-	{
-		t = y1;
-		y1 = y2;
-		y2 = t;
-	}
-#if 0
-	x1--;
-	x2++;
-	y1--;
-	y2++;
-	if (x1 < 0)
-		x1 = 0;
-	if (x2 >= HASH_SIZE)
-		x2 = HASH_SIZE;
-	if (y1 < 0)
-		y1 = 0;
-	if (y2 >= HASH_SIZE)
-		y2 = HASH_SIZE;
-#endif
+	vertcellquery++;
 	num_edge_verts = 0;
-	for (x=x1 ; x <= x2 ; x++)
+	for (s=0 ; s<=steps ; s++)
 	{
-		for (y=y1 ; y <= y2 ; y++)
+		VectorMA (v1, (vec_t)s / steps, delta, p);
+		for (i=0 ; i<3 ; i++)
+		{
+			lo[i] = MAX (VertCellCoord (p[i] - pad), 0);
+			hi[i] = MIN (VertCellCoord (p[i] + pad), VERT_CELL_AXIS-1);
+		}
+
+		for (z=lo[2] ; z<=hi[2] ; z++)
 		{
-			for (vnum=hashverts[y*HASH_SIZE+x] ; vnum ; vnum=vertexchain[vnum])
+			for (y=lo[1] ; y<=hi[1] ; y++)
 			{
-				edge_verts[num_edge_verts++] = vnum;
+				for (x=lo[0] ; x<=hi[0] ; x++)
+				{
+					h = FindVertCell (x, y, z, false);
+					if (h < 0 || vertcells[h].query == vertcellquery)
+						continue;
+					vertcells[h].query = vertcellquery;
+
+					for (vnum=vertcells[h].firstvert ; vnum ; vnum=vertexchain[vnum])
+						edge_verts[num_edge_verts++] = vnum;
+				}
 			}
 		}
 	}
@@ -741,8 +811,7 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 {
 	// snap and merge all vertexes
 	qprintf ("---- snap verts ----\n");
-	memset (hashverts, 0, sizeof(hashverts));
-	memset (vertexchain, 0, sizeof(vertexchain));
+	vertcellgen++;
 	c_totalverts = 0;
 	c_uniqueverts = 0;
 	c_faceoverflows = 0;
@@ -785,6 +854,117 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 }
 
 
+/*
+===========
+BenchmarkVertexWeld
+
+Welds, fixes the t-junctions of and shares the edges of a synthetic grid of
+brushes, so the hashing can be timed without a map. Layers of 64 unit cubes
+alternate with layers of 32 unit cubes, which breaks the edges of every big
+face, and every point is jittered by less than POINT_EPSILON so the weld has
+to match near misses.
+===========
+*/
+void BenchmarkVertexWeld (int layers)
+{
+	// corners of a cube, wound the same way as every other face
+	static const int s_CubeFaces[6][4] =
+	{
+		{ 0, 4, 6, 2 }, { 1, 3, 7, 5 },
+		{ 0, 1, 5, 4 }, { 2, 6, 7, 3 },
+		{ 0, 2, 3, 1 }, { 4, 5, 7, 6 },
+	};
+
+	face_t		*list, *f;
+	winding_t	*w;
+	int			i, j, k, x, y;
+	int			layer, size, count, z;
+	int			numfaces, shared;
+	unsigned	seed;
+	double		start, weld, tjunc, edges;
+
+	// any more and the grid can run out of edges
+	layers = clamp (layers, 1, 12);
+
+	list = NULL;
+	numfaces = 0;
+	seed = 1;
+	z = 0;
+	for (layer=0 ; layer<layers ; layer++, z+=size)
+	{
+		size = (layer & 1) ? 32 : 64;
+		count = layers * 64 / size;
+		for (y=0 ; y<count ; y++)
+		{
+			for (x=0 ; x<count ; x++)
+			{
+				for (i=0 ; i<6 ; i++)
+				{
+					w = AllocWinding (4);
+					w->numpoints = 4;
+					for (j=0 ; j<4 ; j++)
+					{
+						k = s_CubeFaces[i][j];
+						w->p[j].Init ((x + (k & 1)) * size, (y + ((k >> 1) & 1)) * size, z + ((k >> 2) & 1) * size);
+						for (k=0 ; k<3 ; k++)
+						{
+							seed = seed * 1103515245 + 12345;
+							w->p[j][k] += ((seed >> 16) & 0xff) * (0.08 / 255) - 0.04;
+						}
+					}
+
+					f = AllocFace ();
+					f->w = w;
+					f->contents = CONTENTS_SOLID;
+					f->next = list;
+					list = f;
+					numfaces++;
+				}
+			}
+		}
+	}
+
+	// start from an empty bsp, without the world's retriangulation which
+	// would overflow the primitive lumps on a grid this dense
+	int oldentity = entity_num;
+	entity_num = 1;
+	numvertexes = 1;
+	numedges = 1;
+	vertcellgen++;
+	c_totalverts = 0;
+	c_uniqueverts = 0;
+	c_tjunctions = 0;
+
+	start = Plat_FloatTime();
+	EmitLeafFaceVertexes (&list);
+	weld = Plat_FloatTime();
+	FixLeafFaceEdges (&list);
+	tjunc = Plat_FloatTime();
+
+	GetEdge2_InitOptimizedList ();
+	shared = 0;
+	for (f=list ; f ; f=f->next)
+	{
+		if (f->merged || f->split[0] || f->split[1] || f->numpoints < 3)
+			continue;
+		for (i=0 ; i<f->numpoints ; i++)
+		{
+			if (GetEdge2 (f->vertexnums[i], f->vertexnums[(i+1)%f->numpoints], f) < 0)
+				shared++;
+		}
+	}
+	edges = Plat_FloatTime();
+
+	Msg ("Weld benchmark: %i faces in %i layers\n", numfaces, layers);
+	Msg ("  weld  %9.3f ms, %i unique verts from %i\n", (weld - start) * 1000, c_uniqueverts, c_totalverts);
+	Msg ("  tjunc %9.3f ms, %i edges added by tjunctions\n", (tjunc - weld) * 1000, c_tjunctions);
+	Msg ("  edges %9.3f ms, %i edges, %i shared\n", (edges - tjunc) * 1000, numedges - 1, shared);
+
+	FreeFaceList (list);
+	entity_num = oldentity;
+}
+
+
 //========================================================
 
 int		c_faces;
@@ -841,25 +1021,40 @@ void FreeFaceList( face_t *pFaces )
 
 void GetEdge2_InitOptimizedList()
 {
-	for( int i=0; i < MAX_MAP_VERTS; i++ )
-		g_VertEdgeList[i].RemoveAll();
+	edgepairgen++;
 }
 
 
-void IntSort( CUtlVector<int> &theList )
+/*
+==================
+FindEdgePair
+
+Returns the slot in edgepairs for the verts, or NULL if there's none and create is false
+==================
+*/
+edgepair_t *FindEdgePair (int v1, int v2, bool create)
 {
-	for( int i=0; i < theList.Size()-1; i++ )
+	unsigned	h;
+	edgepair_t	*pair;
+
+	if (v1 > v2)
+		V_swap (v1, v2);
+
+	for (h = HashInts (v1, v2) >> (32-EDGE_HASH_BITS) ; ; h = (h+1) & (EDGE_HASH_SIZE-1))
 	{
-		if( theList[i] > theList[i+1] )
+		pair = &edgepairs[h];
+		if (pair->gen != edgepairgen)
 		{
-			int temp = theList[i];
-			theList[i] = theList[i+1];
-			theList[i+1] = temp;
-			if( i > 0 )
-				i -= 2;
-			else
-				i = -1;
+			if (!create)
+				return NULL;
+			pair->v[0] = v1;
+			pair->v[1] = v2;
+			pair->gen = edgepairgen;
+			pair->firstedge = 0;
+			return pair;
 		}
+		if (pair->v[0] == v1 && pair->v[1] == v2)
+			return pair;
 	}
 }
 
@@ -869,10 +1064,9 @@ int AddEdge( int v1, int v2, face_t *f )
 	if (numedges >= MAX_MAP_EDGES)
 		Error ("Too many edges in map, max == %d", MAX_MAP_EDGES);
 
-	g_VertEdgeList[v1].AddToTail( numedges );
-	g_VertEdgeList[v2].AddToTail( numedges );
-	IntSort( g_VertEdgeList[v1] );
-	IntSort( g_VertEdgeList[v2] );
+	edgepair_t *pair = FindEdgePair( v1, v2, true );
+	edgechain[numedges] = pair->firstedge;
+	pair->firstedge = numedges;
 			  
 	dedge_t *edge = &dedges[numedges];
 	numedges++;
@@ -884,6 +1078,42 @@ int AddEdge( int v1, int v2, face_t *f )
 }
 
 
+/*
+==================
+FindBackEdge
+
+Finds the oldest edge running from v2 to v1 with the same contents and
+no back face yet, and makes f its back face. Returns 0 if there's none.
+==================
+*/
+int FindBackEdge( int v1, int v2, face_t *f )
+{
+	edgepair_t *pair = FindEdgePair( v1, v2, false );
+	if ( !pair )
+		return 0;
+
+	int *pLink = &pair->firstedge;
+	int *pBestLink = NULL;
+	for ( int iEdge = *pLink; iEdge; pLink = &edgechain[iEdge], iEdge = *pLink )
+	{
+		dedge_t *edge = &dedges[iEdge];
+		if ( v1 == edge->v[1] && v2 == edge->v[0] && edgefaces[iEdge][0]->contents == f->contents && !edgefaces[iEdge][1] )
+		{
+			pBestLink = pLink;
+		}
+	}
+
+	if ( !pBestLink )
+		return 0;
+
+	// the edge is full now, so it can leave the chain
+	int iEdge = *pBestLink;
+	*pBestLink = edgechain[iEdge];
+	edgefaces[iEdge][1] = f;
+	return iEdge;
+}
+
+
 /*
 ==================
 GetEdge
@@ -894,27 +1124,13 @@ Don't allow four way edges
 */
 int GetEdge2 (int v1, int v2,  face_t *f)
 {
-	dedge_t	*edge;
-
 	c_tryedges++;
 
 	if (!noshare)
 	{
-		// Check all edges connected to v1.
-		CUtlVector<int> &theList = g_VertEdgeList[v1];
-		for( int i=0; i < theList.Size(); i++ )
-		{
-			int iEdge = theList[i];
-			edge = &dedges[iEdge];
-			if (v1 == edge->v[1] && v2 == edge->v[0] && edgefaces[iEdge][0]->contents == f->contents)
-			{
-				if (edgefaces[iEdge][1])
-					continue;
-
-				edgefaces[iEdge][1] = f;
-				return -iEdge;
-			}
-		}
+		int iEdge = FindBackEdge( v1, v2, f );
+		if ( iEdge )
+			return -iEdge;
 	}
 
 	return AddEdge( v1, v2, f );
@@ -14,6 +14,7 @@
 
 void GetEdge2_InitOptimizedList();	// Call this before calling GetEdge2() on a bunch of edges.
 int AddEdge( int v1, int v2, face_t *f );
+int FindBackEdge( int v1, int v2, face_t *f );	// Returns 0 if there's no edge from v2 to v1 to share.
 int GetEdge2(int v1, int v2,  face_t *f);
 
 
@@ -25,7 +25,7 @@ AllocPortal
 */
 portal_t *AllocPortal (void)
 {
-	static int s_PortalCount = 0;
+	static CInterlockedInt s_PortalCount;
 
 	portal_t	*p;
 	
@@ -36,8 +36,7 @@ portal_t *AllocPortal (void)
 	
 	p = (portal_t*)malloc (sizeof(portal_t));
 	memset (p, 0, sizeof(portal_t));
-	p->id = s_PortalCount;
-	++s_PortalCount;
+	p->id = s_PortalCount++;
 
 	return p;
 }
@@ -56,6 +56,10 @@ bool		g_NodrawTriggers = false;
 bool		g_DisableWaterLighting = false;
 bool		g_bAllowDetailCracks = false;
 bool		g_bNoVirtualMesh = false;
+bool		g_bBenchLumps = false;
+bool		g_bBenchWeld = false;
+bool		g_bSerialModels = false;
+int			g_nModelThreads = 1;		// -threads, the submodel trees get built on these
 
 float		g_defaultLuxelSize = DEFAULT_LUXEL_SIZE;
 float		g_luxelScale = 1.0f;
@@ -373,11 +377,14 @@ void ProcessWorldModel (void)
 
 /*
 ============
-ProcessSubModel
+BuildSubModelTree
 
+Everything up to the faces, which only touches the entity's own brushes and
+sides. The planes it needs are the bounding box ones, so once those exist
+it's safe to run on several submodels at once.
 ============
 */
-void ProcessSubModel( )
+static tree_t *BuildSubModelTree( int iEntity )
 {
 	entity_t	*e;
 	int			start, end;
@@ -385,7 +392,7 @@ void ProcessSubModel( )
 	bspbrush_t	*list;
 	Vector		mins, maxs;
 
-	e = &entities[entity_num];
+	e = &entities[iEntity];
 
 	start = e->firstbrush;
 	end = start + e->numbrushes;
@@ -403,17 +410,93 @@ void ProcessSubModel( )
 	{
 		const char *pClassName = ValueForKey( e, "classname" );
 		const char *pTargetName = ValueForKey( e, "targetname" );
-		Error( "bmodel %d has no head node (class '%s', targetname '%s')", entity_num, pClassName, pTargetName );
+		Error( "bmodel %d has no head node (class '%s', targetname '%s')", iEntity, pClassName, pTargetName );
 	}
 
 	MakeTreePortals (tree);
 	
 #if DEBUG_BRUSHMODEL
-	if ( entity_num == DEBUG_BRUSHMODEL )
+	if ( iEntity == DEBUG_BRUSHMODEL )
 		WriteGLView( tree, "tree_all" );
 #endif
 
 	MarkVisibleSides (tree, start, end, FULL_DETAIL);
+
+	return tree;
+}
+
+
+//-----------------------------------------------------------------------------
+// Submodel trees built ahead of time, by entity
+//-----------------------------------------------------------------------------
+static CUtlVector<int>		s_SubModelEntities;
+static CUtlVector<tree_t *>	s_SubModelTrees;
+
+static void BuildSubModelTree_Thread( int iThread, int iSubModel )
+{
+	int iEntity = s_SubModelEntities[iSubModel];
+	s_SubModelTrees[iEntity] = BuildSubModelTree( iEntity );
+}
+
+//-----------------------------------------------------------------------------
+// Builds the trees of every submodel from the current entity on, across
+// threads. Faces, tjunctions and the lumps are still done one model at a
+// time, in entity order, so the output is the same as building them serially.
+//-----------------------------------------------------------------------------
+static void BuildSubModelTrees( void )
+{
+	Vector mins, maxs;
+
+	s_SubModelTrees.SetCount( num_entities );
+	for ( int i = 0; i < num_entities; i++ )
+	{
+		s_SubModelTrees[i] = NULL;
+	}
+
+	s_SubModelEntities.RemoveAll();
+	for ( int i = entity_num; i < num_entities; i++ )
+	{
+		if ( entities[i].numbrushes )
+		{
+			s_SubModelEntities.AddToTail( i );
+		}
+	}
+
+	// Create the bounding planes in the order the first submodel would have,
+	// so the threads only ever look planes up.
+	mins[0] = mins[1] = mins[2] = MIN_COORD_INTEGER;
+	maxs[0] = maxs[1] = maxs[2] = MAX_COORD_INTEGER;
+	MakeBspBrushList (0, 0, mins, maxs, FULL_DETAIL);
+	FreeBrush( BrushFromBounds( mins, maxs ) );
+
+	qprintf ("############### %i submodels on %i threads ###############\n", s_SubModelEntities.Count(), g_nModelThreads);
+
+	numthreads = g_nModelThreads;
+	RunThreadsOnIndividual( s_SubModelEntities.Count(), !verbose, BuildSubModelTree_Thread );
+	numthreads = 1;
+}
+
+
+/*
+============
+ProcessSubModel
+
+============
+*/
+void ProcessSubModel( )
+{
+	tree_t		*tree;
+
+	if ( s_SubModelTrees.IsValidIndex( entity_num ) && s_SubModelTrees[entity_num] )
+	{
+		tree = s_SubModelTrees[entity_num];
+		s_SubModelTrees[entity_num] = NULL;
+	}
+	else
+	{
+		tree = BuildSubModelTree( entity_num );
+	}
+
 	MakeFaces (tree->headnode);
 
 	FixTjuncs( tree->headnode, NULL );
@@ -847,6 +930,12 @@ void ProcessModels (void)
 		}
 		else
 		{
+			// the first submodel builds all of their trees
+			if ( !g_bSerialModels && !verboseentities && g_nModelThreads > 1 && !s_SubModelTrees.Count() )
+			{
+				BuildSubModelTrees();
+			}
+
 			ProcessSubModel( );
 		}
 
@@ -858,6 +947,9 @@ void ProcessModels (void)
 		}
 	}
 
+	s_SubModelTrees.Purge();
+	s_SubModelEntities.Purge();
+
 	// Turn the skybox into a cubemap in case we don't build env_cubemap textures.
 	Cubemap_CreateDefaultCubemaps();
 	EndBSPFile ();
@@ -1005,6 +1097,11 @@ int RunVBSP( int argc, char **argv )
 			Msg ("leaktest = true\n");
 			leaktest = true;
 		}
+		else if (!Q_stricmp(argv[i], "-serialmodels"))
+		{
+			Msg ("serialmodels = true\n");
+			g_bSerialModels = true;
+		}
 		else if (!Q_stricmp(argv[i], "-verboseentities"))
 		{
 			Msg ("verboseentities = true\n");
@@ -1133,6 +1230,14 @@ int RunVBSP( int argc, char **argv )
 		{
 			g_NodrawTriggers = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-benchlumps" ) )
+		{
+			g_bBenchLumps = true;
+		}
+		else if ( !Q_stricmp( argv[i], "-benchweld" ) )
+		{
+			g_bBenchWeld = true;
+		}
 		else if ( !Q_stricmp( argv[i], "-FullMinidumps" ) )
 		{
 			EnableFullMinidumps( true );
@@ -1199,6 +1304,8 @@ int RunVBSP( int argc, char **argv )
 				"  -threads     : Control the number of threads vbsp uses (defaults to the # of\n"
 				"                 processors on your machine).\n"
 				"  -verboseentities: If -v is on, this disables verbose output for submodels.\n"
+				"  -serialmodels: Build the brush entity models one at a time instead of on\n"
+				"                 all threads.\n"
 				"  -noweld      : Don't join face vertices together.\n"
 				"  -nocsg       : Don't chop out intersecting brush areas.\n"
 				"  -noshare     : Emit unique face edges instead of sharing them.\n"
@@ -1235,6 +1342,10 @@ int RunVBSP( int argc, char **argv )
 				"  -x360		   : Generate Xbox360 version of vsp\n"
 				"  -nox360		   : Disable generation Xbox360 version of vsp (default)\n"
 				"  -replacematerials : Substitute materials according to materialsub.txt in content\\maps\n"
+				"  -benchlumps     : Benchmark lump decompression (LZMA, chunked LZMA and\n"
+				"                    chunked Snappy) on the existing .bsp and exit.\n"
+				"  -benchweld      : Benchmark vertex welding, t-junction fixing and edge\n"
+				"                    sharing on a synthetic brush grid and exit.\n"
 				"  -FullMinidumps  : Write large minidumps on crash.\n"
 				);
 			}
@@ -1277,7 +1388,27 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
-	numthreads = 1;		// multiple threads aren't helping...
+
+	// The decode benchmark only reads the existing .bsp, and wants all the threads
+	if ( g_bBenchLumps )
+	{
+		BenchmarkLumpDecompression( mapFile, numthreads, 8 );
+		DeleteCmdLine( argc, argv );
+		CmdLib_Cleanup();
+		CmdLib_Exit( 0 );
+	}
+
+	// Doesn't touch the map at all
+	if ( g_bBenchWeld )
+	{
+		BenchmarkVertexWeld( 12 );
+		DeleteCmdLine( argc, argv );
+		CmdLib_Cleanup();
+		CmdLib_Exit( 0 );
+	}
+
+	g_nModelThreads = numthreads;
+	numthreads = 1;		// multiple threads aren't helping, except for building the submodels
 
 	// Setup the logfile.
 	char logFile[512];
@@ -482,6 +482,7 @@ void FreeBrushList (bspbrush_t *brushes);
 node_t	*PointInLeaf (node_t *node, Vector& point);
 
 tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs);
+bspbrush_t *BrushFromBounds (Vector& mins, Vector& maxs);
 
 #define	PSIDE_FRONT			1
 #define	PSIDE_BACK			2
@@ -558,6 +559,7 @@ extern	int	firstmodelface;
 void MakeFaces (node_t *headnode);
 void MakeDetailFaces (node_t *headnode);
 face_t *FixTjuncs( node_t *headnode, face_t *pLeafFaceList );
+void BenchmarkVertexWeld( int layers );
 
 face_t	*AllocFace (void);
 void FreeFace (face_t *f);
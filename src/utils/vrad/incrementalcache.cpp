@@ -0,0 +1,366 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-face direct lighting cache, see incrementalcache.h
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "incrementalcache.h"
+#include "tier1/checksum_crc.h"
+#include "tier1/utlbuffer.h"
+#include "gamebspfile.h"
+#include "vmpi.h"
+
+
+#define INCREMENTALCACHE_VERSION	2
+
+struct incrementalCacheHeader_t
+{
+	int				m_nVersion;
+	unsigned int	m_nSettingsHash;		// command line and light_environment settings
+	unsigned int	m_nWorldHash;			// everything that can cast a shadow or move a sample
+	int				m_nFaces;
+};
+
+// Followed by m_nNormals * m_nSamples LightingValue_t for each used style
+struct incrementalCacheFace_t
+{
+	unsigned int	m_nLightHash;
+	int				m_nSamples;
+	byte			m_nNormals;
+	byte			m_Styles[MAXLIGHTMAPS];
+	byte			m_Pad[3];
+};
+
+static char					s_szCacheFile[MAX_PATH] = "";
+static unsigned int			s_nSettingsHash = 0;
+static unsigned int			s_nWorldHash = 0;
+
+static CUtlBuffer			s_CacheData;		// the last run's cache file
+static CUtlVector<int>		s_FaceOffsets;		// into s_CacheData by face, -1 if not cached
+static CUtlVector<unsigned int>	s_FaceLightHashes;	// this run's, by face
+static CUtlVector<byte>		s_FaceNormals;
+
+static int	s_nFacesRestored[MAX_TOOL_THREADS+1];
+static int	s_nFacesRelit[MAX_TOOL_THREADS+1];
+
+
+static bool IsSettingIgnored( char const *pArg )
+{
+	// things that don't change the lighting
+	return !Q_stricmp( pArg, "-v" ) || !Q_stricmp( pArg, "-verbose" ) ||
+		!Q_stricmp( pArg, "-low" ) || !Q_stricmp( pArg, "-FullMinidumps" );
+}
+
+
+void InitIncrementalCache( char const *pFilename, int argc, char **argv )
+{
+	Q_strncpy( s_szCacheFile, pFilename, sizeof( s_szCacheFile ) );
+
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !Q_stricmp( argv[i], "-incremental-cache" ) || !Q_stricmp( argv[i], "-threads" ) )
+		{
+			++i;
+			continue;
+		}
+
+		if ( IsSettingIgnored( argv[i] ) )
+			continue;
+
+		CRC32_ProcessBuffer( &crc, argv[i], Q_strlen( argv[i] ) + 1 );
+	}
+	CRC32_Final( &crc );
+	s_nSettingsHash = crc;
+}
+
+
+bool IsIncrementalCacheActive()
+{
+	return s_szCacheFile[0] != 0;
+}
+
+
+static unsigned int HashWorld()
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+
+	CRC32_ProcessBuffer( &crc, dplanes, numplanes * sizeof( dplanes[0] ) );
+	CRC32_ProcessBuffer( &crc, dvertexes, numvertexes * sizeof( dvertexes[0] ) );
+	CRC32_ProcessBuffer( &crc, dedges, numedges * sizeof( dedges[0] ) );
+	CRC32_ProcessBuffer( &crc, dsurfedges, numsurfedges * sizeof( dsurfedges[0] ) );
+	CRC32_ProcessBuffer( &crc, dleafs, numleafs * sizeof( dleafs[0] ) );
+	CRC32_ProcessBuffer( &crc, dvisdata, visdatasize );
+	if ( texinfo.Count() )
+	{
+		CRC32_ProcessBuffer( &crc, texinfo.Base(), texinfo.Count() * sizeof( texinfo_t ) );
+	}
+	if ( g_dispinfo.Count() )
+	{
+		CRC32_ProcessBuffer( &crc, g_dispinfo.Base(), g_dispinfo.Count() * sizeof( ddispinfo_t ) );
+	}
+	if ( g_DispVerts.Count() )
+	{
+		CRC32_ProcessBuffer( &crc, g_DispVerts.Base(), g_DispVerts.Count() * sizeof( CDispVert ) );
+	}
+
+	// the lighting output lives in the faces too, so only take what shapes them
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		dface_t const &f = g_pFaces[i];
+		CRC32_ProcessBuffer( &crc, &f.planenum, sizeof( f.planenum ) );
+		CRC32_ProcessBuffer( &crc, &f.side, sizeof( f.side ) );
+		CRC32_ProcessBuffer( &crc, &f.firstedge, sizeof( f.firstedge ) );
+		CRC32_ProcessBuffer( &crc, &f.numedges, sizeof( f.numedges ) );
+		CRC32_ProcessBuffer( &crc, &f.texinfo, sizeof( f.texinfo ) );
+		CRC32_ProcessBuffer( &crc, &f.dispinfo, sizeof( f.dispinfo ) );
+		CRC32_ProcessBuffer( &crc, f.m_LightmapTextureMinsInLuxels, sizeof( f.m_LightmapTextureMinsInLuxels ) );
+		CRC32_ProcessBuffer( &crc, f.m_LightmapTextureSizeInLuxels, sizeof( f.m_LightmapTextureSizeInLuxels ) );
+		CRC32_ProcessBuffer( &crc, &f.smoothingGroups, sizeof( f.smoothingGroups ) );
+	}
+
+	// the brushes AddBrushesForRayTrace puts in the shadow raytracer, and the tree it finds them through
+	CRC32_ProcessBuffer( &crc, dmodels, nummodels * sizeof( dmodels[0] ) );
+	CRC32_ProcessBuffer( &crc, dnodes, numnodes * sizeof( dnodes[0] ) );
+	CRC32_ProcessBuffer( &crc, dleafbrushes, numleafbrushes * sizeof( dleafbrushes[0] ) );
+	CRC32_ProcessBuffer( &crc, dbrushes, numbrushes * sizeof( dbrushes[0] ) );
+	CRC32_ProcessBuffer( &crc, dbrushsides, numbrushsides * sizeof( dbrushsides[0] ) );
+
+	// brush entities shadow when asked to, see ExtractBrushEntityShadowCasters
+	static const char *s_pShadowCasterKeys[] = { "vrad_brush_cast_shadows", "model", "origin", "angles" };
+	for ( int i = 0; i < num_entities; i++ )
+	{
+		if ( IntForKey( &entities[i], "vrad_brush_cast_shadows" ) == 0 )
+			continue;
+
+		CRC32_ProcessBuffer( &crc, &i, sizeof( i ) );
+		for ( int k = 0; k < ARRAYSIZE( s_pShadowCasterKeys ); k++ )
+		{
+			const char *pValue = ValueForKey( &entities[i], s_pShadowCasterKeys[k] );
+			CRC32_ProcessBuffer( &crc, pValue, Q_strlen( pValue ) + 1 );
+		}
+	}
+
+	// static props shadow when asked to
+	GameLumpHandle_t hProps = g_GameLumps.GetGameLumpHandle( GAMELUMP_STATIC_PROPS );
+	if ( hProps != g_GameLumps.InvalidGameLump() )
+	{
+		CRC32_ProcessBuffer( &crc, g_GameLumps.GetGameLump( hProps ), g_GameLumps.GameLumpSize( hProps ) );
+	}
+
+	CRC32_Final( &crc );
+	return crc;
+}
+
+
+static void HashLight( directlight_t *dl )
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, &dl->light, sizeof( dl->light ) );
+	CRC32_ProcessBuffer( &crc, &dl->facenum, sizeof( dl->facenum ) );
+	CRC32_ProcessBuffer( &crc, &dl->m_flStartFadeDistance, sizeof( dl->m_flStartFadeDistance ) );
+	CRC32_ProcessBuffer( &crc, &dl->m_flEndFadeDistance, sizeof( dl->m_flEndFadeDistance ) );
+	CRC32_ProcessBuffer( &crc, &dl->m_flCapDist, sizeof( dl->m_flCapDist ) );
+	CRC32_Final( &crc );
+	dl->m_nCacheHash = crc;
+}
+
+
+void LoadIncrementalCache()
+{
+	if ( !IsIncrementalCacheActive() )
+		return;
+
+	if ( g_bUseMPI || g_pIncremental )
+	{
+		Warning( "-incremental-cache only works for local, non-incremental compiles; ignoring it.\n" );
+		s_szCacheFile[0] = 0;
+		return;
+	}
+
+	// the sun's spread comes from the light_environment, not the light itself
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, &s_nSettingsHash, sizeof( s_nSettingsHash ) );
+	CRC32_ProcessBuffer( &crc, &g_SunAngularExtent, sizeof( g_SunAngularExtent ) );
+	CRC32_Final( &crc );
+	s_nSettingsHash = crc;
+
+	s_nWorldHash = HashWorld();
+
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		HashLight( dl );
+	}
+
+	s_FaceLightHashes.SetCount( numfaces );
+	s_FaceNormals.SetCount( numfaces );
+	s_FaceOffsets.SetCount( numfaces );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		s_FaceOffsets[i] = -1;
+		s_FaceNormals[i] = 0;
+	}
+	memset( s_nFacesRestored, 0, sizeof( s_nFacesRestored ) );
+	memset( s_nFacesRelit, 0, sizeof( s_nFacesRelit ) );
+
+	s_CacheData.Purge();
+	if ( !g_pFileSystem->ReadFile( s_szCacheFile, NULL, s_CacheData ) )
+	{
+		Msg( "Incremental cache %s not found, lighting every face\n", s_szCacheFile );
+		return;
+	}
+
+	incrementalCacheHeader_t hdr;
+	if ( s_CacheData.TellPut() < (int)sizeof( hdr ) )
+	{
+		s_CacheData.Purge();
+		return;
+	}
+	s_CacheData.Get( &hdr, sizeof( hdr ) );
+
+	if ( hdr.m_nVersion != INCREMENTALCACHE_VERSION || hdr.m_nSettingsHash != s_nSettingsHash ||
+		hdr.m_nWorldHash != s_nWorldHash || hdr.m_nFaces != numfaces )
+	{
+		Msg( "Incremental cache %s is out of date, lighting every face\n", s_szCacheFile );
+		s_CacheData.Purge();
+		return;
+	}
+
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		int nOffset = s_CacheData.TellGet();
+		incrementalCacheFace_t face;
+		if ( nOffset + (int)sizeof( face ) > s_CacheData.TellPut() )
+			break;
+
+		s_CacheData.Get( &face, sizeof( face ) );
+
+		int nStyles = 0;
+		while ( nStyles < MAXLIGHTMAPS && face.m_Styles[nStyles] != 255 )
+			++nStyles;
+
+		int nSize = nStyles * face.m_nNormals * face.m_nSamples * sizeof( LightingValue_t );
+		if ( face.m_nSamples < 0 || nSize < 0 || s_CacheData.TellGet() + nSize > s_CacheData.TellPut() )
+			break;
+
+		s_FaceOffsets[i] = nOffset;
+		s_CacheData.SeekGet( CUtlBuffer::SEEK_CURRENT, nSize );
+	}
+}
+
+
+unsigned int HashFaceLights( CUtlVector<directlight_t *> const &lights )
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	FOR_EACH_VEC( lights, i )
+	{
+		CRC32_ProcessBuffer( &crc, &lights[i]->m_nCacheHash, sizeof( lights[i]->m_nCacheHash ) );
+	}
+	CRC32_Final( &crc );
+	return crc;
+}
+
+
+bool RestoreCachedFaceLight( int iThread, int facenum, unsigned int nLightHash, int nNormalCount, dface_t *f, facelight_t *fl )
+{
+	s_FaceLightHashes[facenum] = nLightHash;
+	s_FaceNormals[facenum] = nNormalCount;
+
+	if ( s_FaceOffsets[facenum] < 0 )
+	{
+		++s_nFacesRelit[iThread];
+		return false;
+	}
+
+	incrementalCacheFace_t const *pFace = (incrementalCacheFace_t const *)( (byte const *)s_CacheData.Base() + s_FaceOffsets[facenum] );
+	if ( pFace->m_nLightHash != nLightHash || pFace->m_nSamples != fl->numsamples || pFace->m_nNormals != nNormalCount )
+	{
+		++s_nFacesRelit[iThread];
+		return false;
+	}
+
+	LightingValue_t const *pSrc = (LightingValue_t const *)( pFace + 1 );
+	for ( int k = 0; k < MAXLIGHTMAPS; k++ )
+	{
+		f->styles[k] = pFace->m_Styles[k];
+		if ( f->styles[k] == 255 )
+			break;
+
+		for ( int n = 0; n < nNormalCount; n++ )
+		{
+			fl->light[k][n] = ( LightingValue_t* )calloc( fl->numsamples, sizeof( LightingValue_t ) );
+			memcpy( fl->light[k][n], pSrc, fl->numsamples * sizeof( LightingValue_t ) );
+			pSrc += fl->numsamples;
+		}
+	}
+
+	++s_nFacesRestored[iThread];
+	return true;
+}
+
+
+void SaveIncrementalCache()
+{
+	if ( !IsIncrementalCacheActive() )
+		return;
+
+	int nRestored = 0, nRelit = 0;
+	for ( int i = 0; i < MAX_TOOL_THREADS+1; i++ )
+	{
+		nRestored += s_nFacesRestored[i];
+		nRelit += s_nFacesRelit[i];
+	}
+	Msg( "Incremental cache reused %d faces, relit %d\n", nRestored, nRelit );
+
+	// the old data isn't needed once every face has been restored or relit
+	s_CacheData.Purge();
+	s_FaceOffsets.Purge();
+
+	CUtlBuffer buf;
+
+	incrementalCacheHeader_t hdr;
+	hdr.m_nVersion = INCREMENTALCACHE_VERSION;
+	hdr.m_nSettingsHash = s_nSettingsHash;
+	hdr.m_nWorldHash = s_nWorldHash;
+	hdr.m_nFaces = numfaces;
+	buf.Put( &hdr, sizeof( hdr ) );
+
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		facelight_t *fl = &facelight[i];
+
+		incrementalCacheFace_t face;
+		memset( &face, 0, sizeof( face ) );
+		memset( face.m_Styles, 255, sizeof( face.m_Styles ) );
+
+		// faces BuildFacelights skipped are written empty
+		if ( s_FaceNormals[i] && g_pFaces[i].styles[0] != 255 )
+		{
+			face.m_nLightHash = s_FaceLightHashes[i];
+			face.m_nSamples = fl->numsamples;
+			face.m_nNormals = s_FaceNormals[i];
+			memcpy( face.m_Styles, g_pFaces[i].styles, sizeof( face.m_Styles ) );
+		}
+		buf.Put( &face, sizeof( face ) );
+
+		for ( int k = 0; k < MAXLIGHTMAPS && face.m_Styles[k] != 255; k++ )
+		{
+			for ( int n = 0; n < face.m_nNormals; n++ )
+			{
+				buf.Put( fl->light[k][n], fl->numsamples * sizeof( LightingValue_t ) );
+			}
+		}
+	}
+
+	if ( !g_pFileSystem->WriteFile( s_szCacheFile, NULL, buf ) )
+	{
+		Warning( "Couldn't write incremental cache %s\n", s_szCacheFile );
+	}
+}
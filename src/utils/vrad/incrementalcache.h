@@ -0,0 +1,45 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-face direct lighting cache for -incremental-cache.
+//
+// Each face's direct lighting is saved along with a hash of every light whose
+// bounds reach the face. On the next compile a face whose lights hash the same
+// gets its samples back from the cache instead of being gathered again, so
+// moving one light only relights the faces its old and new bounds touch.
+// Bouncing and everything after it runs as usual. Any change to the world or
+// the command line throws the whole cache away.
+//
+//=============================================================================//
+
+#ifndef INCREMENTALCACHE_H
+#define INCREMENTALCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlvector.h"
+
+struct directlight_t;
+struct facelight_t;
+struct dface_t;
+
+
+// Called while parsing the command line, the other options are hashed here
+void InitIncrementalCache( char const *pFilename, int argc, char **argv );
+bool IsIncrementalCacheActive();
+
+// Once the active lights are final, before BuildFacelights. Loads the last run's cache if it matches.
+void LoadIncrementalCache();
+
+// After BuildFacelights, while the facelights still hold direct lighting only
+void SaveIncrementalCache();
+
+// Hashes the lights reaching a face, in the order they're gathered
+unsigned int HashFaceLights( CUtlVector<directlight_t *> const &lights );
+
+// Restores the face's lightstyles and samples if the cache has them for the same lights.
+// Either way the hash is remembered for the next save.
+bool RestoreCachedFaceLight( int iThread, int facenum, unsigned int nLightHash, int nNormalCount, dface_t *f, facelight_t *fl );
+
+
+#endif // INCREMENTALCACHE_H
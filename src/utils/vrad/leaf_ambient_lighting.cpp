@@ -16,6 +16,7 @@
 #include "messbuf.h"
 #include "vmpi.h"
 #include "vmpi_distribute_work.h"
+#include "localworkers.h"
 
 static TableVector g_BoxDirections[6] = 
 {
@@ -648,6 +649,10 @@ void ComputePerLeafAmbientLighting()
 		VMPI_SetCurrentStage( "ComputeLeafAmbientLighting" );
 		DistributeWork( numleafs, VMPI_DISTRIBUTEWORK_PACKETID, VMPI_ProcessLeafAmbient, VMPI_ReceiveLeafAmbientResults );
 	}
+	else if ( LocalWorkers_IsActive() )
+	{
+		DistributeWorkLocal( numleafs, VMPI_ProcessLeafAmbient, VMPI_ReceiveLeafAmbientResults );
+	}
 	else
 	{
 		RunThreadsOn(numleafs, true, ThreadComputeLeafAmbient);
@@ -0,0 +1,386 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Spatial culling of the direct lights for face lighting, see lightcull.h
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightcull.h"
+#include "threads.h"
+
+
+// The lighting code normalizes with estimated square roots, so the bounds get some slack
+#define LIGHTCULL_RADIUS_SCALE		1.01f
+#define LIGHTCULL_RADIUS_PAD		1.0f
+#define LIGHTCULL_ANGLE_PAD			0.01f		// radians
+#define LIGHTCULL_PLANE_PAD			0.01f
+
+#define LIGHTCULL_GRID_MAX_CELLS	32			// per axis
+#define LIGHTCULL_GRID_MIN_CELL		64.0f		// world units
+#define LIGHTCULL_GRID_MAX_SPAN		4096		// lights covering more cells than this are tested for every face
+
+struct lightCullInfo_t
+{
+	directlight_t	*m_pLight;
+	float			m_flRadius;		// FLT_MAX if the light can reach anywhere
+};
+
+static CUtlVector<lightCullInfo_t>	s_Lights;		// in activelights order
+static CUtlVector<int>				s_Unbinned;		// lights tested for every face
+static CUtlVector<int>				s_CellStart;	// lights of a cell are s_CellLights[ s_CellStart[cell] ... s_CellStart[cell+1] )
+static CUtlVector<int>				s_CellLights;
+static Vector						s_GridMins;
+static float						s_flCellSize;
+static int							s_nCells[3];
+static bool							s_bGridBuilt = false;
+
+static int64	s_nGroupLights[MAX_TOOL_THREADS+1];			// light / sample group pairs before culling
+static int64	s_nGroupLightsCulled[MAX_TOOL_THREADS+1];
+
+
+//-----------------------------------------------------------------------------
+// Distance past which the light contributes nothing, or less than -lightcullthreshold
+//-----------------------------------------------------------------------------
+static float ComputeInfluenceRadius( directlight_t const *dl )
+{
+	// sky lights come from everywhere, and attached lights don't trace from their origin
+	if ( dl->light.type == emit_skylight || dl->light.type == emit_skyambient || dl->facenum != -1 )
+		return FLT_MAX;
+
+	float flRadius = FLT_MAX;
+
+	// hard falloff lights fade to an actual zero
+	if ( dl->m_flEndFadeDistance > dl->m_flStartFadeDistance )
+	{
+		flRadius = dl->m_flEndFadeDistance;
+	}
+
+	if ( g_flLightCullThreshold > 0.0f )
+	{
+		// the falloff has to drop below this for the brightest channel to fall under the threshold
+		float flIntensity = MAX( dl->light.intensity.x, MAX( dl->light.intensity.y, dl->light.intensity.z ) );
+		float flRatio = flIntensity / g_flLightCullThreshold;
+		float flThresholdRadius = FLT_MAX;
+
+		if ( dl->light.type == emit_surface )
+		{
+			// surface falloff is at most 1 / dist^2
+			flThresholdRadius = sqrt( MAX( flRatio, 0.0f ) );
+		}
+		else
+		{
+			// point and spot falloff is at most 1 / ( c + l * dist + q * dist^2 ), evaluated no closer than 1 unit
+			float c = dl->light.constant_attn;
+			float l = dl->light.linear_attn;
+			float q = dl->light.quadratic_attn;
+			if ( c >= 0.0f && l >= 0.0f && q >= 0.0f )
+			{
+				if ( q > 0.0f )
+				{
+					flThresholdRadius = ( -l + sqrt( MAX( l * l + 4.0f * q * ( flRatio - c ), 0.0f ) ) ) / ( 2.0f * q );
+				}
+				else if ( l > 0.0f )
+				{
+					flThresholdRadius = ( flRatio - c ) / l;
+				}
+				flThresholdRadius = MAX( flThresholdRadius, 1.0f );
+			}
+		}
+
+		// past the cap distance the falloff stops dropping
+		if ( flThresholdRadius < dl->m_flCapDist )
+		{
+			flRadius = MIN( flRadius, flThresholdRadius );
+		}
+	}
+
+	if ( flRadius == FLT_MAX )
+		return FLT_MAX;
+
+	return flRadius * LIGHTCULL_RADIUS_SCALE + LIGHTCULL_RADIUS_PAD;
+}
+
+
+//-----------------------------------------------------------------------------
+// Conservative test of whether the light can light any point in the box
+//-----------------------------------------------------------------------------
+static bool CanLightReachBox( lightCullInfo_t const &info, Vector const &mins, Vector const &maxs )
+{
+	directlight_t const *dl = info.m_pLight;
+
+	if ( dl->light.type == emit_skylight || dl->light.type == emit_skyambient || dl->facenum != -1 )
+		return true;
+
+	Vector const &origin = dl->light.origin;
+
+	if ( info.m_flRadius != FLT_MAX )
+	{
+		if ( CalcSqrDistanceToAABB( mins, maxs, origin ) > info.m_flRadius * info.m_flRadius )
+			return false;
+	}
+
+	if ( dl->light.type == emit_surface )
+	{
+		// surface lights only shine in front of their plane, find the corner furthest in front
+		Vector const &normal = dl->light.normal;
+		float flFront = -DotProduct( origin, normal );
+		for ( int i = 0; i < 3; ++i )
+		{
+			flFront += normal[i] * ( ( normal[i] > 0.0f ) ? maxs[i] : mins[i] );
+		}
+
+		if ( flFront < -LIGHTCULL_PLANE_PAD )
+			return false;
+	}
+	else if ( dl->light.type == emit_spotlight )
+	{
+		// test the box's bounding sphere against the outer cone
+		Vector center = ( mins + maxs ) * 0.5f;
+		float flBoxRadius = ( maxs - mins ).Length() * 0.5f;
+
+		Vector delta = center - origin;
+		float flDist = delta.Length();
+		if ( flDist > flBoxRadius )
+		{
+			Vector axis = dl->light.normal;
+			VectorNormalize( axis );
+
+			float flAngle = acos( clamp( DotProduct( delta, axis ) / flDist, -1.0f, 1.0f ) );
+			float flConeAngle = acos( clamp( dl->light.stopdot2, -1.0f, 1.0f ) );
+			float flBoxAngle = asin( flBoxRadius / flDist );
+
+			if ( flAngle > flConeAngle + flBoxAngle + LIGHTCULL_ANGLE_PAD )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Range of grid cells overlapping the box, false if it misses the grid
+//-----------------------------------------------------------------------------
+static bool GetCellRange( Vector const &mins, Vector const &maxs, int lo[3], int hi[3] )
+{
+	for ( int i = 0; i < 3; ++i )
+	{
+		float flLo = ( mins[i] - s_GridMins[i] ) / s_flCellSize;
+		float flHi = ( maxs[i] - s_GridMins[i] ) / s_flCellSize;
+		if ( flHi < 0.0f || flLo >= s_nCells[i] )
+			return false;
+
+		lo[i] = clamp( (int)floor( flLo ), 0, s_nCells[i] - 1 );
+		hi[i] = clamp( (int)floor( flHi ), 0, s_nCells[i] - 1 );
+	}
+
+	return true;
+}
+
+
+static int CompareLightIndices( int const *a, int const *b )
+{
+	return *a - *b;
+}
+
+
+//-----------------------------------------------------------------------------
+// Bins every light with finite influence bounds into a uniform grid
+//-----------------------------------------------------------------------------
+void BuildLightCullGrid()
+{
+	FreeLightCullGrid();
+
+	Vector boundsMins, boundsMaxs;
+	ClearBounds( boundsMins, boundsMaxs );
+
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		lightCullInfo_t &info = s_Lights[ s_Lights.AddToTail() ];
+		info.m_pLight = dl;
+		info.m_flRadius = ComputeInfluenceRadius( dl );
+
+		if ( info.m_flRadius != FLT_MAX )
+		{
+			Vector extent( info.m_flRadius, info.m_flRadius, info.m_flRadius );
+			AddPointToBounds( dl->light.origin - extent, boundsMins, boundsMaxs );
+			AddPointToBounds( dl->light.origin + extent, boundsMins, boundsMaxs );
+		}
+	}
+
+	s_GridMins = boundsMins;
+	s_flCellSize = LIGHTCULL_GRID_MIN_CELL;
+	s_nCells[0] = s_nCells[1] = s_nCells[2] = 0;
+
+	if ( boundsMins.x <= boundsMaxs.x )
+	{
+		Vector extent = boundsMaxs - boundsMins;
+		float flLargest = MAX( extent.x, MAX( extent.y, extent.z ) );
+		s_flCellSize = MAX( flLargest / LIGHTCULL_GRID_MAX_CELLS, LIGHTCULL_GRID_MIN_CELL );
+		for ( int i = 0; i < 3; ++i )
+		{
+			s_nCells[i] = clamp( (int)ceil( extent[i] / s_flCellSize ), 1, LIGHTCULL_GRID_MAX_CELLS );
+		}
+	}
+
+	int nCells = s_nCells[0] * s_nCells[1] * s_nCells[2];
+	s_CellStart.SetCount( nCells + 1 );
+	memset( s_CellStart.Base(), 0, s_CellStart.Count() * sizeof( int ) );
+
+	// count the lights per cell, then lay them out back to back
+	for ( int nPass = 0; nPass < 2; ++nPass )
+	{
+		CUtlVector<int> cursor;
+		if ( nPass == 1 )
+		{
+			for ( int i = 0; i < nCells; ++i )
+			{
+				s_CellStart[i + 1] += s_CellStart[i];
+			}
+			s_CellLights.SetCount( s_CellStart[nCells] );
+			cursor.CopyArray( s_CellStart.Base(), nCells );
+		}
+
+		FOR_EACH_VEC( s_Lights, nLight )
+		{
+			lightCullInfo_t const &info = s_Lights[nLight];
+
+			int lo[3], hi[3];
+			bool bBinned = ( info.m_flRadius != FLT_MAX );
+			if ( bBinned )
+			{
+				Vector extent( info.m_flRadius, info.m_flRadius, info.m_flRadius );
+				GetCellRange( info.m_pLight->light.origin - extent, info.m_pLight->light.origin + extent, lo, hi );
+				bBinned = ( hi[0] - lo[0] + 1 ) * ( hi[1] - lo[1] + 1 ) * ( hi[2] - lo[2] + 1 ) <= LIGHTCULL_GRID_MAX_SPAN;
+			}
+
+			if ( !bBinned )
+			{
+				if ( nPass == 1 )
+				{
+					s_Unbinned.AddToTail( nLight );
+				}
+				continue;
+			}
+
+			for ( int z = lo[2]; z <= hi[2]; ++z )
+			{
+				for ( int y = lo[1]; y <= hi[1]; ++y )
+				{
+					for ( int x = lo[0]; x <= hi[0]; ++x )
+					{
+						int nCell = x + s_nCells[0] * ( y + s_nCells[1] * z );
+						if ( nPass == 0 )
+						{
+							++s_CellStart[nCell + 1];
+						}
+						else
+						{
+							s_CellLights[ cursor[nCell]++ ] = nLight;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	s_bGridBuilt = true;
+
+	qprintf( "Light culling: %d of %d lights binned into a %dx%dx%d grid of %.0f unit cells\n",
+		s_Lights.Count() - s_Unbinned.Count(), s_Lights.Count(), s_nCells[0], s_nCells[1], s_nCells[2], s_flCellSize );
+}
+
+
+void FreeLightCullGrid()
+{
+	s_Lights.Purge();
+	s_Unbinned.Purge();
+	s_CellStart.Purge();
+	s_CellLights.Purge();
+	s_bGridBuilt = false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Candidates come from the cells the box touches plus the unbinned lights, then
+// get the exact bounds tests. Sorting by index keeps the activelights order, so
+// lights accumulate in the same order as without culling.
+//-----------------------------------------------------------------------------
+void GetLightsAffectingBox( Vector const &mins, Vector const &maxs, CUtlVector<directlight_t *> &lights )
+{
+	lights.RemoveAll();
+
+	if ( !s_bGridBuilt || !g_bLightCull )
+	{
+		for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+		{
+			lights.AddToTail( dl );
+		}
+		return;
+	}
+
+	CUtlVectorFixedGrowable<int, 256> candidates;
+	candidates.AddMultipleToTail( s_Unbinned.Count(), s_Unbinned.Base() );
+
+	int lo[3], hi[3];
+	if ( s_CellLights.Count() && GetCellRange( mins, maxs, lo, hi ) )
+	{
+		for ( int z = lo[2]; z <= hi[2]; ++z )
+		{
+			for ( int y = lo[1]; y <= hi[1]; ++y )
+			{
+				for ( int x = lo[0]; x <= hi[0]; ++x )
+				{
+					int nCell = x + s_nCells[0] * ( y + s_nCells[1] * z );
+					int nCount = s_CellStart[nCell + 1] - s_CellStart[nCell];
+					if ( nCount )
+					{
+						candidates.AddMultipleToTail( nCount, &s_CellLights[ s_CellStart[nCell] ] );
+					}
+				}
+			}
+		}
+	}
+
+	candidates.Sort( CompareLightIndices );
+
+	int nPrev = -1;
+	FOR_EACH_VEC( candidates, i )
+	{
+		int nLight = candidates[i];
+		if ( nLight == nPrev )
+			continue;
+		nPrev = nLight;
+
+		if ( CanLightReachBox( s_Lights[nLight], mins, maxs ) )
+		{
+			lights.AddToTail( s_Lights[nLight].m_pLight );
+		}
+	}
+}
+
+
+void AddLightCullStats( int iThread, int nSampleGroups, int nLights )
+{
+	s_nGroupLights[iThread] += (int64)nSampleGroups * s_Lights.Count();
+	s_nGroupLightsCulled[iThread] += (int64)nSampleGroups * ( s_Lights.Count() - nLights );
+}
+
+
+void PrintLightCullStats()
+{
+	int64 nGroupLights = 0;
+	int64 nGroupLightsCulled = 0;
+	for ( int i = 0; i < MAX_TOOL_THREADS+1; ++i )
+	{
+		nGroupLights += s_nGroupLights[i];
+		nGroupLightsCulled += s_nGroupLightsCulled[i];
+		s_nGroupLights[i] = s_nGroupLightsCulled[i] = 0;
+	}
+
+	if ( !nGroupLights )
+		return;
+
+	Msg( "Light culling skipped %lld of %lld light evaluations (%.1f%%)\n",
+		nGroupLightsCulled, nGroupLights, 100.0 * (double)nGroupLightsCulled / (double)nGroupLights );
+}
@@ -0,0 +1,37 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Spatial culling of the direct lights for face lighting.
+//
+// The PVS only rejects lights a cluster at a time, so every sample still
+// walks every light in view, most of which contribute nothing at that
+// distance or angle. Each light gets conservative influence bounds from its
+// falloff and cone, the bounded lights are binned into a uniform grid, and
+// a face only walks the lights whose bounds touch it.
+//
+//=============================================================================//
+
+#ifndef LIGHTCULL_H
+#define LIGHTCULL_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlvector.h"
+
+struct directlight_t;
+
+
+// Must be called once the active light list is final, before BuildFacelights
+void BuildLightCullGrid();
+void FreeLightCullGrid();
+
+// Gathers the lights that can contribute to points inside the box, in activelights order.
+// Without a grid, or with culling disabled, that's every active light.
+void GetLightsAffectingBox( Vector const &mins, Vector const &maxs, CUtlVector<directlight_t *> &lights );
+
+// Tallies light / sample group pairs for the report at the end of direct lighting
+void AddLightCullStats( int iThread, int nSampleGroups, int nLights );
+void PrintLightCullStats();
+
+
+#endif // LIGHTCULL_H
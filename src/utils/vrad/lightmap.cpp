@@ -22,6 +22,8 @@
 #include "mathlib/quantize.h"
 #include "bitmap/imageformat.h"
 #include "coordsize.h"
+#include "lightcull.h"
+#include "incrementalcache.h"
 
 enum
 {
@@ -999,6 +1001,8 @@ void FreeDLights()
 	gSkyLight = NULL;
 	gAmbient = NULL;
 
+	FreeLightCullGrid();
+
 	directlight_t *pNext;
 	for( directlight_t *pCur=activelights; pCur; pCur=pNext )
 	{
@@ -2492,9 +2496,11 @@ static void GatherSampleLightAt4Points( SSE_SampleInfo_t& info, int sampleIdx, i
 {
 	SSE_sampleLightOutput_t out;
 
-	// Iterate over all direct lights and add them to the particular sample
-	for (directlight_t *dl = activelights; dl != NULL; dl = dl->next)
-	{	    
+	// Iterate over the direct lights that can reach the face and add them to the particular sample
+	FOR_EACH_VEC( info.m_Lights, nLight )
+	{
+		directlight_t *dl = info.m_Lights[nLight];
+
 		// is this lights cluster visible?
 		fltx4 dotMask = Four_Zeros;
 		bool skipLight = true;
@@ -2582,9 +2588,11 @@ static void ResampleLightAt4Points( SSE_SampleInfo_t& info, int lightStyleIndex,
 		}
 	}
 
-	// Iterate over all direct lights and add them to the particular sample
-	for (directlight_t *dl = activelights; dl != NULL; dl = dl->next)
+	// Iterate over the direct lights that can reach the face and add them to the particular sample
+	FOR_EACH_VEC( info.m_Lights, nLight )
 	{
+		directlight_t *dl = info.m_Lights[nLight];
+
 		if ((flags & AMBIENT_ONLY) && (dl->light.type != emit_skyambient))
 			continue;
 
@@ -3016,6 +3024,33 @@ void InitLightinfo( lightinfo_t *pl, int facenum )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Bounds every point lights get gathered at for the face: the samples, and the
+// supersamples within half a luxel of where the samples land in luxel space,
+// all pushed off the face along its normal.
+//-----------------------------------------------------------------------------
+static void GetFaceLightingBounds( lightinfo_t const& l, facelight_t const *fl, Vector &mins, Vector &maxs )
+{
+	ClearBounds( mins, maxs );
+
+	for ( int i = 0; i < fl->numsamples; ++i )
+	{
+		Vector const &pos = fl->sample[i].pos;
+		AddPointToBounds( pos, mins, maxs );
+
+		Vector2D coord;
+		Vector projected;
+		WorldToLuxelSpace( &l, pos, coord );
+		LuxelSpaceToWorld( &l, coord[0], coord[1], projected );
+		AddPointToBounds( projected, mins, maxs );
+	}
+
+	float flPad = 0.5f * ( l.luxelToWorldSpace[0].Length() + l.luxelToWorldSpace[1].Length() ) + 2.0f;
+	Vector pad( flPad, flPad, flPad );
+	mins -= pad;
+	maxs += pad;
+}
+
 static void InitSampleInfo( lightinfo_t const& l, int iThread, SSE_SampleInfo_t& info )
 {
 	info.m_LightmapWidth  = l.face->m_LightmapTextureSizeInLuxels[0]+1;
@@ -3109,9 +3144,26 @@ void BuildFacelights (int iThread, int facenum)
 	// Allocate sample positions/normals to SSE
 	int numGroups = ( fl->numsamples & 0x3) ? ( fl->numsamples / 4 ) + 1 : ( fl->numsamples / 4 );
 
-	// always allocate style 0 lightmap
-	f->styles[0] = 0;
-	AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
+	// only walk the lights that can reach this face
+	Vector faceMins, faceMaxs;
+	GetFaceLightingBounds( l, fl, faceMins, faceMaxs );
+	GetLightsAffectingBox( faceMins, faceMaxs, sampleInfo.m_Lights );
+	AddLightCullStats( iThread, numGroups, sampleInfo.m_Lights.Count() );
+
+	// reuse last run's samples if the same lights reach this face
+	bool bRestored = false;
+	if ( IsIncrementalCacheActive() )
+	{
+		unsigned int nLightHash = HashFaceLights( sampleInfo.m_Lights );
+		bRestored = RestoreCachedFaceLight( iThread, facenum, nLightHash, sampleInfo.m_NormalCount, f, fl );
+	}
+
+	if ( !bRestored )
+	{
+		// always allocate style 0 lightmap
+		f->styles[0] = 0;
+		AllocateLightstyleSamples( fl, 0, sampleInfo.m_NormalCount );
+	}
 
 	// sample the lights at each sample location
 	for ( int grp = 0; grp < numGroups; ++grp )
@@ -3142,7 +3194,10 @@ void BuildFacelights (int iThread, int facenum)
 		}
 
 		// Iterate over all the lights and add their contribution to this group of spots
-		GatherSampleLightAt4Points( sampleInfo, nSample, numSamples );
+		if ( !bRestored )
+		{
+			GatherSampleLightAt4Points( sampleInfo, nSample, numSamples );
+		}
 	}
 	
 	// Tell the incremental light manager that we're done with this face.
@@ -3161,7 +3216,7 @@ void BuildFacelights (int iThread, int facenum)
 	}
 
 	// get rid of the -extra functionality on displacement surfaces
-	if (do_extra && !sampleInfo.m_IsDispFace)
+	if (do_extra && !sampleInfo.m_IsDispFace && !bRestored)
 	{
 		// For each lightstyle, perform a supersampling pass
 		for ( i = 0; i < MAXLIGHTMAPS; ++i )
@@ -17,6 +17,7 @@
 
 #include "mathlib/bumpvects.h"
 #include "bsplib.h"
+#include "tier1/utlvector.h"
 
 typedef struct
 {
@@ -129,6 +130,8 @@ struct SSE_SampleInfo_t
 	int	        m_Clusters[4];
 	FourVectors	m_Points;
 	FourVectors	m_PointNormals[ NUM_BUMP_VECTS + 1 ];
+
+	CUtlVector<directlight_t *>	m_Lights;	// lights that can reach the face, see GetLightsAffectingBox
 };
 
 extern void InitLightinfo( lightinfo_t *l, int facenum );
@@ -22,6 +22,7 @@
 #include "bsplib.h"
 #include "consolewnd.h"
 #include "vismat.h"
+#include "transfermatrix.h"
 #include "vmpi_filesystem.h"
 #include "vmpi_dispatch.h"
 #include "utllinkedlist.h"
@@ -292,7 +293,19 @@ void MPI_ReceiveVisLeafsResults( uint64 iWorkUnit, MessageBuffer *pBuf, int iWor
 		int numtransfers;
 		pBuf->read( &numtransfers, sizeof(numtransfers) );
 		patch->numtransfers = numtransfers;
-		if (numtransfers) 
+		if (numtransfers && g_bTransferCompress)
+		{
+			CUtlVector<transfer_t> transfers;
+			transfers.SetCount( numtransfers );
+			pBuf->read(transfers.Base(), numtransfers * sizeof(transfer_t));
+			if ( g_bVerifyTransferCompress )
+			{
+				patch->transfers = new transfer_t[numtransfers];
+				memcpy( patch->transfers, transfers.Base(), numtransfers * sizeof(transfer_t) );
+			}
+			AddCompressedTransfers( patchnum, transfers.Base(), numtransfers, 0 );
+		}
+		else if (numtransfers) 
 		{
 			patch->transfers = new transfer_t[numtransfers];
 			pBuf->read(patch->transfers, numtransfers * sizeof(transfer_t));
@@ -12,6 +12,9 @@
 #endif
 
 
+class MessageBuffer;
+
+
 #define VMPI_VRAD_PACKET_ID						1
 	// Sub packet IDs.
 	#define VMPI_SUBPACKETID_VIS_LEAFS			0
@@ -29,6 +32,10 @@ void		RunMPIBuildFacelights(void);
 void		RunMPIBuildVisLeafs(void);
 void		VMPI_DistributeLightData();
 
+// The BuildFacelights work units, also run by the -procs local workers
+void		MPI_ProcessFaces( int iThread, uint64 iWorkUnit, MessageBuffer *pBuf );
+void		MPI_ReceiveFaceResults( uint64 iWorkUnit, MessageBuffer *pBuf, int iWorker );
+
 // This handles disconnections. They're usually not fatal for the master.
 void		HandleMPIDisconnect( int procID );
 
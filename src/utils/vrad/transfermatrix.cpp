@@ -0,0 +1,260 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compressed patch to patch transfer matrix, see transfermatrix.h
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "transfermatrix.h"
+#include "threads.h"
+#include "mathlib/ssemath.h"
+
+
+#define TRANSFER_WEIGHT_MAX		65535
+
+// Rows are at most 7 bytes a transfer, so even a row to every patch fits in a chunk
+#define TRANSFER_CHUNK_SHIFT	22
+#define TRANSFER_CHUNK_SIZE		( 1 << TRANSFER_CHUNK_SHIFT )
+COMPILE_TIME_ASSERT( MAX_PATCHES * ( sizeof( unsigned short ) + 5 ) + 1 <= TRANSFER_CHUNK_SIZE );
+
+struct compressedTransferRow_t
+{
+	int64	m_nOffset;		// chunk << TRANSFER_CHUNK_SHIFT | offset in the chunk, the row's weights start here
+	int		m_nTransfers;
+	float	m_flScale;		// transfer = weight * scale
+};
+
+static CUtlVector<compressedTransferRow_t>	s_Rows;		// by patch
+static CUtlVector<byte *>					s_Chunks;	// TRANSFER_CHUNK_SIZE bytes each
+static int									s_nChunkUsed = TRANSFER_CHUNK_SIZE;	// in the last chunk
+static int64								s_nDataSize = 0;
+
+// rows are encoded here before being copied into a chunk
+static CUtlVector<byte>						s_Scratch[MAX_TOOL_THREADS+1];
+
+// emitlight * reflectivity for every patch, w is zero
+static CUtlVector<VectorAligned, CUtlMemoryAligned<VectorAligned, 16> >	s_Radiance;
+
+static int64	s_nCompressedTransfers = 0;
+static float	s_flMaxRowError = 0;		// largest relative change in a row's total transfer
+
+
+static inline const byte *GetRowData( const compressedTransferRow_t &row )
+{
+	return s_Chunks[ (int)( row.m_nOffset >> TRANSFER_CHUNK_SHIFT ) ] + ( row.m_nOffset & ( TRANSFER_CHUNK_SIZE - 1 ) );
+}
+
+
+static int TransferSortFn( const void *p1, const void *p2 )
+{
+	return ( (const transfer_t *)p1 )->patch - ( (const transfer_t *)p2 )->patch;
+}
+
+
+static inline void WriteVarInt( byte *&pOut, unsigned int nValue )
+{
+	while ( nValue >= 0x80 )
+	{
+		*pOut++ = (byte)( nValue | 0x80 );
+		nValue >>= 7;
+	}
+	*pOut++ = (byte)nValue;
+}
+
+
+static inline unsigned int ReadVarInt( const byte *&pIn )
+{
+	unsigned int nValue = *pIn & 0x7f;
+	int nShift = 7;
+	while ( *pIn++ & 0x80 )
+	{
+		nValue |= ( *pIn & 0x7f ) << nShift;
+		nShift += 7;
+	}
+	return nValue;
+}
+
+
+void AddCompressedTransfers( int ndxPatch, transfer_t *pTransfers, int nTransfers, int iThread )
+{
+	if ( nTransfers <= 0 )
+		return;
+
+	qsort( pTransfers, nTransfers, sizeof( transfer_t ), TransferSortFn );
+
+	float flMax = 0;
+	double flTotal = 0;
+	for ( int i = 0; i < nTransfers; i++ )
+	{
+		flMax = max( flMax, pTransfers[i].transfer );
+		flTotal += pTransfers[i].transfer;
+	}
+
+	float flScale = flMax / TRANSFER_WEIGHT_MAX;
+	float flInvScale = ( flScale > 0 ) ? 1.0f / flScale : 0;
+
+	// weights, then at most 5 bytes an index, keeping the next row's weights aligned
+	int nMaxSize = ( nTransfers * ( sizeof( unsigned short ) + 5 ) + 1 ) & ~1;
+	if ( nMaxSize > TRANSFER_CHUNK_SIZE )
+		Error( "Compressed transfer row too large, run without -transfercompress\n" );
+
+	CUtlVector<byte> &scratch = s_Scratch[iThread];
+	if ( scratch.Count() < nMaxSize )
+	{
+		scratch.SetCount( nMaxSize );
+	}
+
+	unsigned short *pWeights = (unsigned short *)scratch.Base();
+	byte *pIndices = (byte *)( pWeights + nTransfers );
+	byte *pOut = pIndices;
+
+	// carry each weight's rounding error into the next so the row total stays put
+	double flQuantizedTotal = 0;
+	float flCarry = 0;
+	int nPrevPatch = 0;
+	for ( int i = 0; i < nTransfers; i++ )
+	{
+		float flWeight = ( pTransfers[i].transfer + flCarry ) * flInvScale;
+		int nWeight = clamp( (int)( flWeight + 0.5f ), 0, TRANSFER_WEIGHT_MAX );
+		flCarry = ( flWeight - nWeight ) * flScale;
+
+		pWeights[i] = (unsigned short)nWeight;
+		flQuantizedTotal += nWeight * flScale;
+
+		WriteVarInt( pOut, pTransfers[i].patch - nPrevPatch );
+		nPrevPatch = pTransfers[i].patch;
+	}
+
+	int nSize = ( ( pOut - (byte *)pWeights ) + 1 ) & ~1;
+
+	ThreadLock();
+
+	if ( s_Rows.Count() < g_Patches.Count() )
+	{
+		int nFirst = s_Rows.AddMultipleToTail( g_Patches.Count() - s_Rows.Count() );
+		memset( &s_Rows[nFirst], 0, ( s_Rows.Count() - nFirst ) * sizeof( compressedTransferRow_t ) );
+	}
+
+	if ( s_nChunkUsed + nSize > TRANSFER_CHUNK_SIZE )
+	{
+		s_Chunks.AddToTail( (byte *)malloc( TRANSFER_CHUNK_SIZE ) );
+		if ( !s_Chunks.Tail() )
+			Error( "Memory allocation failure" );
+		s_nChunkUsed = 0;
+	}
+
+	memcpy( s_Chunks.Tail() + s_nChunkUsed, pWeights, nSize );
+
+	compressedTransferRow_t &row = s_Rows[ndxPatch];
+	row.m_nOffset = ( (int64)( s_Chunks.Count() - 1 ) << TRANSFER_CHUNK_SHIFT ) | s_nChunkUsed;
+	s_nChunkUsed += nSize;
+	s_nDataSize += nSize;
+	row.m_nTransfers = nTransfers;
+	row.m_flScale = flScale;
+
+	s_nCompressedTransfers += nTransfers;
+	if ( flTotal > 0 )
+	{
+		s_flMaxRowError = max( s_flMaxRowError, (float)( fabs( flQuantizedTotal - flTotal ) / flTotal ) );
+	}
+
+	ThreadUnlock();
+}
+
+
+void FreeCompressedTransfers()
+{
+	s_Rows.Purge();
+	FOR_EACH_VEC( s_Chunks, i )
+	{
+		free( s_Chunks[i] );
+	}
+	s_Chunks.Purge();
+	s_nChunkUsed = TRANSFER_CHUNK_SIZE;
+	s_nDataSize = 0;
+	for ( int i = 0; i < MAX_TOOL_THREADS+1; i++ )
+	{
+		s_Scratch[i].Purge();
+	}
+	s_Radiance.Purge();
+}
+
+
+void PrintCompressedTransferStats()
+{
+	qprintf( "compressed transfer matrix: %5.1f megs in %d chunks, %.2f bytes per transfer, max row error %.4f%%\n",
+		(float)s_nDataSize / ( 1024 * 1024 ),
+		s_Chunks.Count(),
+		s_nCompressedTransfers ? (float)s_nDataSize / s_nCompressedTransfers : 0.0f,
+		s_flMaxRowError * 100.0f );
+}
+
+
+void PrepareCompressedGather()
+{
+	int nPatches = g_Patches.Count();
+	s_Radiance.SetCount( nPatches );
+	for ( int i = 0; i < nPatches; i++ )
+	{
+		VectorMultiply( emitlight[i], g_Patches[i].reflectivity, s_Radiance[i] );
+		s_Radiance[i].w = 0;
+	}
+}
+
+
+void GatherCompressedTransfers( int ndxPatch, Vector &sum )
+{
+	sum.Init();
+	if ( !s_Rows.IsValidIndex( ndxPatch ) || !s_Rows[ndxPatch].m_nTransfers )
+		return;
+
+	const compressedTransferRow_t &row = s_Rows[ndxPatch];
+	const unsigned short *pWeights = (const unsigned short *)GetRowData( row );
+	const byte *pIndices = (const byte *)( pWeights + row.m_nTransfers );
+	const VectorAligned *pRadiance = s_Radiance.Base();
+
+	// two accumulators so consecutive adds don't wait on each other
+	fltx4 sum0 = Four_Zeros;
+	fltx4 sum1 = Four_Zeros;
+	int ndxOther = 0;
+	int i = 0;
+	for ( ; i + 1 < row.m_nTransfers; i += 2 )
+	{
+		ndxOther += ReadVarInt( pIndices );
+		sum0 = MaddSIMD( LoadAlignedSIMD( pRadiance[ndxOther].Base() ), ReplicateX4( (float)pWeights[i] ), sum0 );
+		ndxOther += ReadVarInt( pIndices );
+		sum1 = MaddSIMD( LoadAlignedSIMD( pRadiance[ndxOther].Base() ), ReplicateX4( (float)pWeights[i+1] ), sum1 );
+	}
+	if ( i < row.m_nTransfers )
+	{
+		ndxOther += ReadVarInt( pIndices );
+		sum0 = MaddSIMD( LoadAlignedSIMD( pRadiance[ndxOther].Base() ), ReplicateX4( (float)pWeights[i] ), sum0 );
+	}
+
+	VectorAligned result;
+	StoreAlignedSIMD( result.Base(), MulSIMD( AddSIMD( sum0, sum1 ), ReplicateX4( row.m_flScale ) ) );
+	sum = result;
+}
+
+
+int DecompressTransfers( int ndxPatch, CUtlVector<transfer_t> &transfers )
+{
+	transfers.RemoveAll();
+	if ( !s_Rows.IsValidIndex( ndxPatch ) || !s_Rows[ndxPatch].m_nTransfers )
+		return 0;
+
+	const compressedTransferRow_t &row = s_Rows[ndxPatch];
+	const unsigned short *pWeights = (const unsigned short *)GetRowData( row );
+	const byte *pIndices = (const byte *)( pWeights + row.m_nTransfers );
+
+	transfers.SetCount( row.m_nTransfers );
+	int ndxOther = 0;
+	for ( int i = 0; i < row.m_nTransfers; i++ )
+	{
+		ndxOther += ReadVarInt( pIndices );
+		transfers[i].patch = ndxOther;
+		transfers[i].transfer = pWeights[i] * row.m_flScale;
+	}
+
+	return row.m_nTransfers;
+}
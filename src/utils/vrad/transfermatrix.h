@@ -0,0 +1,43 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compressed patch to patch transfer matrix for -transfercompress.
+//
+// Every patch normally owns a separate transfer_t array, 8 bytes a transfer, and
+// each bounce walks all of them. Compressed, the rows are packed back to back in
+// one buffer: 16 bit weights quantized against the row's largest transfer, then
+// the row's patch indices, sorted and delta coded as varints. Quantization error
+// is carried from weight to weight, so a row's total transfer is kept to within
+// half a quantum. The buffer is a list of fixed size chunks addressed by 64 bit
+// offsets, a row never straddles two chunks.
+//
+//=============================================================================//
+
+#ifndef TRANSFERMATRIX_H
+#define TRANSFERMATRIX_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlvector.h"
+
+struct transfer_t;
+
+
+// Encodes a patch's normalized transfers and appends them to the matrix.
+// The transfers get sorted in place. Safe to call from the vis matrix threads,
+// each thread encodes into its own scratch and only the append is locked.
+void AddCompressedTransfers( int ndxPatch, transfer_t *pTransfers, int nTransfers, int iThread );
+void FreeCompressedTransfers();
+void PrintCompressedTransferStats();
+
+// Premultiplies every patch's emitted light by its reflectivity. Call before each gather pass.
+void PrepareCompressedGather();
+
+// Sums the light a patch receives through its compressed row
+void GatherCompressedTransfers( int ndxPatch, Vector &sum );
+
+// Expands a patch's compressed row, for the bumped gather which needs every transfer
+int DecompressTransfers( int ndxPatch, CUtlVector<transfer_t> &transfers );
+
+
+#endif // TRANSFERMATRIX_H
@@ -36,15 +36,45 @@ Use the PVS to accelerate if available
 
 #define STREAM_SIZE 512
 
+#define CLUSTERPAIR_UNKNOWN		0xff
+#define CLUSTERPAIR_MAX_SHARED	( 64 * 1024 * 1024 )	// largest table of pairs shared between rows, in bytes
+
+// Bounds of the ray end points of every patch in or seen through a cluster
+static CUtlVector<Vector> g_ClusterMins;
+static CUtlVector<Vector> g_ClusterMaxs;
+
+// BOXVIS_ result for each unordered cluster pair, if the map is small enough to keep one
+static CUtlVector<byte> g_ClusterPairVis;
+
+static int64 g_nClusterPairs[MAX_TOOL_THREADS+1][3];	// by BOXVIS_ result
+static int64 g_nRaysTraced[MAX_TOOL_THREADS+1];
+static int64 g_nRaysSkipped[MAX_TOOL_THREADS+1];
+static double g_flRowTime[MAX_TOOL_THREADS+1];
+static double g_flClassifyTime[MAX_TOOL_THREADS+1];
+
 class CTransferMaker
 {
 public:
 
-	CTransferMaker( transfer_t *all_transfers );
+	CTransferMaker( transfer_t *all_transfers, int iThread );
 	~CTransferMaker();
 
+	// Called before testing the patches seen through a cluster
+	void SetReceiverCluster( int iShooterCluster, int iCluster );
+
 	FORCEINLINE void TestMakeTransfer( Vector start, Vector stop, int ndxShooter, int ndxReciever )
 	{
+		if ( m_nPairVis != BOXVIS_PARTIAL )
+		{
+			++g_nRaysSkipped[m_iThread];
+			if ( m_nPairVis == BOXVIS_OPEN )
+			{
+				MakeTransfer( ndxShooter, ndxReciever, m_AllTransfers );
+			}
+			return;
+		}
+
+		++g_nRaysTraced[m_iThread];
 		g_RtEnv.AddToRayStream( m_RayStream, start, stop, &m_pResults[m_nTests] );
 		m_pShooterPatches[m_nTests] = ndxShooter;
 		m_pRecieverPatches[m_nTests] = ndxReciever;
@@ -61,14 +91,23 @@ private:
 	int *m_pRecieverPatches;
 	RayStream m_RayStream;
 	transfer_t *m_AllTransfers;
+	int m_iThread;
+	int m_nPairVis;
+	CUtlVector<byte> m_PairVis;		// by receiver cluster, for the current shooter cluster
 };
 
-CTransferMaker::CTransferMaker( transfer_t *all_transfers ) :
-	m_AllTransfers( all_transfers ), m_nTests( 0 )
+CTransferMaker::CTransferMaker( transfer_t *all_transfers, int iThread ) :
+	m_AllTransfers( all_transfers ), m_nTests( 0 ), m_iThread( iThread ), m_nPairVis( BOXVIS_PARTIAL )
 {
 	m_pResults = (RayTracingSingleResult *)calloc( 1, MAX_PATCHES * sizeof ( RayTracingSingleResult ) );
 	m_pShooterPatches = (int *)calloc( 1, MAX_PATCHES * sizeof( int ) );
 	m_pRecieverPatches = (int *)calloc( 1, MAX_PATCHES * sizeof( int ) );
+
+	if ( g_bClusterPairVis && g_ClusterMins.Count() )
+	{
+		m_PairVis.SetCount( g_ClusterMins.Count() );
+		memset( m_PairVis.Base(), CLUSTERPAIR_UNKNOWN, m_PairVis.Count() );
+	}
 }
 
 CTransferMaker::~CTransferMaker()
@@ -91,6 +130,51 @@ void CTransferMaker::Finish()
 	m_nTests = 0;
 }
 
+void CTransferMaker::SetReceiverCluster( int iShooterCluster, int iCluster )
+{
+	m_nPairVis = BOXVIS_PARTIAL;
+	if ( !m_PairVis.IsValidIndex( iCluster ) || !g_ClusterMins.IsValidIndex( iShooterCluster ) )
+		return;
+
+	if ( m_PairVis[iCluster] != CLUSTERPAIR_UNKNOWN )
+	{
+		m_nPairVis = m_PairVis[iCluster];
+		return;
+	}
+
+	// the other cluster may have already classified the pair from its side
+	byte *pShared = NULL;
+	if ( g_ClusterPairVis.Count() )
+	{
+		int i = max( iShooterCluster, iCluster );
+		int j = min( iShooterCluster, iCluster );
+		pShared = &g_ClusterPairVis[ i * ( i + 1 ) / 2 + j ];
+	}
+
+	int nPairVis = pShared ? *pShared : CLUSTERPAIR_UNKNOWN;
+	if ( nPairVis == CLUSTERPAIR_UNKNOWN )
+	{
+		nPairVis = BOXVIS_PARTIAL;
+		if ( g_ClusterMins[iCluster].x <= g_ClusterMaxs[iCluster].x && g_ClusterMins[iShooterCluster].x <= g_ClusterMaxs[iShooterCluster].x )
+		{
+			double flStart = Plat_FloatTime();
+			nPairVis = g_RtEnv.ClassifyBoxToBoxVisibility( g_ClusterMins[iShooterCluster], g_ClusterMaxs[iShooterCluster],
+				g_ClusterMins[iCluster], g_ClusterMaxs[iCluster] );
+			g_flClassifyTime[m_iThread] += Plat_FloatTime() - flStart;
+			++g_nClusterPairs[m_iThread][nPairVis];
+		}
+
+		// two threads may both classify a pair, they'll store the same answer
+		if ( pShared )
+		{
+			*pShared = nPairVis;
+		}
+	}
+
+	m_PairVis[iCluster] = nPairVis;
+	m_nPairVis = nPairVis;
+}
+
 
 dleaf_t* PointInLeaf (int iNode, Vector const& point)
 {
@@ -323,6 +407,8 @@ void BuildVisRow (int patchnum, byte *pvs, int head, transfer_t *transfers, CTra
 			continue;		// not in pvs
 		}
 
+		transferMaker.SetReceiverCluster( patch->clusterNumber, j );
+
 		for ( leafIndex = 0; leafIndex < g_ClusterLeaves[j].leafCount; leafIndex++ )
 		{
 			leaf = dleafs + g_ClusterLeaves[j].leafs[leafIndex];
@@ -398,7 +484,7 @@ void BuildVisLeafs_Cluster(
 	DecompressVis( &dvisdata[ dvis->bitofs[ iCluster ][DVIS_PVS] ], pvs);
 	head = 0;
 
-	CTransferMaker transferMaker( transfers );
+	CTransferMaker transferMaker( transfers, threadnum );
 
 	// light every patch in the cluster
 	if( clusterChildren.Element( iCluster ) != clusterChildren.InvalidIndex() )
@@ -418,11 +504,13 @@ void BuildVisLeafs_Cluster(
 			patchnum = patch - g_Patches.Base();
 
 			// build to all other world clusters
+			double flStart = Plat_FloatTime();
 			BuildVisRow (patchnum, pvs, head, transfers, transferMaker, threadnum );
 			transferMaker.Finish();
+			g_flRowTime[threadnum] += Plat_FloatTime() - flStart;
 			
 			// do the transfers
-			MakeScales( patchnum, transfers );
+			MakeScales( patchnum, transfers, threadnum );
 
 			// Let MPI aggregate the data if it's being used.
 			if ( PatchCB )
@@ -465,8 +553,107 @@ void BuildVisLeafs( int threadnum, void *pUserData )
 BuildVisMatrix
 ==============
 */
+//-----------------------------------------------------------------------------
+// Bounds the ray end points of every patch that shoots from a cluster or is
+// tested through it, so the visibility between two clusters' patches can be
+// decided from their boxes.
+//-----------------------------------------------------------------------------
+static void AddFacePatchesToBounds( int ndxFace, Vector &mins, Vector &maxs )
+{
+	for( int ndxPatch = g_FacePatches.Element( ndxFace ); ndxPatch != g_FacePatches.InvalidIndex(); ndxPatch = g_Patches[ndxPatch].ndxNext )
+	{
+		CPatch *pPatch = &g_Patches[ndxPatch];
+		AddPointToBounds( pPatch->origin + pPatch->normal, mins, maxs );
+	}
+}
+
+static void BuildClusterBounds( void )
+{
+	g_ClusterMins.SetCount( dvis->numclusters );
+	g_ClusterMaxs.SetCount( dvis->numclusters );
+
+	for ( int iCluster = 0; iCluster < dvis->numclusters; iCluster++ )
+	{
+		Vector &mins = g_ClusterMins[iCluster];
+		Vector &maxs = g_ClusterMaxs[iCluster];
+		ClearBounds( mins, maxs );
+
+		for( int ndxPatch = clusterChildren.Element( iCluster ); ndxPatch != g_Patches.InvalidIndex(); ndxPatch = g_Patches[ndxPatch].ndxNextClusterChild )
+		{
+			CPatch *pPatch = &g_Patches[ndxPatch];
+			AddPointToBounds( pPatch->origin + pPatch->normal, mins, maxs );
+		}
+
+		for ( int leafIndex = 0; leafIndex < g_ClusterLeaves[iCluster].leafCount; leafIndex++ )
+		{
+			dleaf_t *leaf = dleafs + g_ClusterLeaves[iCluster].leafs[leafIndex];
+			for ( int k = 0; k < leaf->numleaffaces; k++ )
+			{
+				AddFacePatchesToBounds( dleaffaces[leaf->firstleafface + k], mins, maxs );
+			}
+		}
+
+		for( int ndxDisp = 0; ndxDisp < g_ClusterDispFaces[iCluster].dispFaces.Count(); ndxDisp++ )
+		{
+			AddFacePatchesToBounds( g_ClusterDispFaces[iCluster].dispFaces[ndxDisp], mins, maxs );
+		}
+	}
+
+	int64 nPairs = (int64)dvis->numclusters * ( dvis->numclusters + 1 ) / 2;
+	if ( nPairs <= CLUSTERPAIR_MAX_SHARED )
+	{
+		g_ClusterPairVis.SetCount( (int)nPairs );
+		memset( g_ClusterPairVis.Base(), CLUSTERPAIR_UNKNOWN, g_ClusterPairVis.Count() );
+	}
+
+	memset( g_nClusterPairs, 0, sizeof( g_nClusterPairs ) );
+	memset( g_nRaysTraced, 0, sizeof( g_nRaysTraced ) );
+	memset( g_nRaysSkipped, 0, sizeof( g_nRaysSkipped ) );
+	memset( g_flRowTime, 0, sizeof( g_flRowTime ) );
+	memset( g_flClassifyTime, 0, sizeof( g_flClassifyTime ) );
+}
+
+
+static void PrintClusterPairStats( void )
+{
+	int64 nPairs[3] = { 0, 0, 0 };
+	int64 nRaysTraced = 0, nRaysSkipped = 0;
+	double flRowTime = 0, flClassifyTime = 0;
+	for ( int i = 0; i < MAX_TOOL_THREADS+1; i++ )
+	{
+		for ( int j = 0; j < 3; j++ )
+		{
+			nPairs[j] += g_nClusterPairs[i][j];
+		}
+		nRaysTraced += g_nRaysTraced[i];
+		nRaysSkipped += g_nRaysSkipped[i];
+		flRowTime += g_flRowTime[i];
+		flClassifyTime += g_flClassifyTime[i];
+	}
+
+	int64 nTotalPairs = nPairs[BOXVIS_OPEN] + nPairs[BOXVIS_BLOCKED] + nPairs[BOXVIS_PARTIAL];
+	if ( !nTotalPairs || !( nRaysTraced + nRaysSkipped ) )
+		return;
+
+	// what the skipped rays would have cost at the rate the traced ones went
+	double flSaved = nRaysTraced ? nRaysSkipped * ( flRowTime - flClassifyTime ) / nRaysTraced : 0;
+
+	Msg( "Cluster pairs: %lld open, %lld blocked, %lld partial (%.1f%% decided)\n",
+		nPairs[BOXVIS_OPEN], nPairs[BOXVIS_BLOCKED], nPairs[BOXVIS_PARTIAL],
+		100.0 * ( nPairs[BOXVIS_OPEN] + nPairs[BOXVIS_BLOCKED] ) / nTotalPairs );
+	Msg( "Cluster pairs skipped %lld of %lld patch rays (%.1f%%), saving ~%.1fs for %.1fs classifying (thread time)\n",
+		nRaysSkipped, nRaysTraced + nRaysSkipped, 100.0 * nRaysSkipped / ( nRaysTraced + nRaysSkipped ),
+		flSaved, flClassifyTime );
+}
+
+
 void BuildVisMatrix (void)
 {
+	if ( g_bClusterPairVis )
+	{
+		BuildClusterBounds();
+	}
+
 	if ( g_bUseMPI )
 	{
 		RunMPIBuildVisLeafs();
@@ -474,10 +661,14 @@ void BuildVisMatrix (void)
 	else 
 	{
 		RunThreadsOn (dvis->numclusters, true, BuildVisLeafs);
+
+		PrintClusterPairStats();
 	}
 }
 
 void FreeVisMatrix (void)
 {
-
+	g_ClusterMins.Purge();
+	g_ClusterMaxs.Purge();
+	g_ClusterPairVis.Purge();
 }
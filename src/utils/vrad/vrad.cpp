@@ -19,6 +19,10 @@
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
+#include "lightcull.h"
+#include "transfermatrix.h"
+#include "incrementalcache.h"
+#include "localworkers.h"
 
 #define ALLOWDEBUGOPTIONS (0 || _DEBUG)
 
@@ -119,6 +123,14 @@ bool		g_bStaticPropLighting = false;
 bool        g_bStaticPropPolys = false;
 bool        g_bTextureShadows = false;
 bool        g_bDisablePropSelfShadowing = false;
+bool        g_bStaticPropLightingPerProp = false;
+bool        g_bStaticPropLightingCompare = false;
+bool        g_bLightCull = true;
+float       g_flLightCullThreshold = 0.0f;
+bool        g_bTransferCompress = false;
+bool        g_bVerifyTransferCompress = false;
+bool        g_bClusterPairVis = true;
+int         g_nLocalProcs = 0;
 
 
 CUtlVector<byte> g_FacesVisibleToLights;
@@ -1199,7 +1211,7 @@ void MakeTransfer( int ndxPatch1, int ndxPatch2, transfer_t *all_transfers )
 }
 
 
-void MakeScales ( int ndxPatch, transfer_t *all_transfers )
+void MakeScales ( int ndxPatch, transfer_t *all_transfers, int iThread )
 {
 	int		j;
 	float	total;
@@ -1219,10 +1231,6 @@ void MakeScales ( int ndxPatch, transfer_t *all_transfers )
 		}
 
 
-		patch->transfers = ( transfer_t* )calloc (1, patch->numtransfers * sizeof(transfer_t));
-		if (!patch->transfers)
-			Error ("Memory allocation failure");
-
 		// get total transfer energy
 		t2 = all_transfers;
 
@@ -1238,12 +1246,33 @@ void MakeScales ( int ndxPatch, transfer_t *all_transfers )
 		else	
 			total = 1.0f/M_PI;
 
-		t = patch->transfers;
-		t2 = all_transfers;
-		for (j=0 ; j<patch->numtransfers ; j++, t++, t2++)
+		// MPI workers always send plain transfers, the master compresses them as they arrive.
+		// -verifytransfercompress keeps the plain transfers too, to bounce the light both ways.
+		bool bCompress = g_bTransferCompress && !g_bUseMPI;
+		if ( !bCompress || g_bVerifyTransferCompress )
 		{
-			t->transfer = t2->transfer*total;
-			t->patch = t2->patch;
+			patch->transfers = ( transfer_t* )calloc (1, patch->numtransfers * sizeof(transfer_t));
+			if (!patch->transfers)
+				Error ("Memory allocation failure");
+
+			t = patch->transfers;
+			t2 = all_transfers;
+			for (j=0 ; j<patch->numtransfers ; j++, t++, t2++)
+			{
+				t->transfer = t2->transfer*total;
+				t->patch = t2->patch;
+			}
+		}
+
+		if ( bCompress )
+		{
+			t2 = all_transfers;
+			for (j=0 ; j<patch->numtransfers ; j++, t2++)
+			{
+				t2->transfer *= total;
+			}
+
+			AddCompressedTransfers( ndxPatch, all_transfers, patch->numtransfers, iThread );
 		}
 		if (patch->numtransfers > max_transfer)
 		{
@@ -1539,6 +1568,7 @@ void GatherLight (int threadnum, void *pUserData)
 	int			num;
 	CPatch		*patch;
 	Vector		sum, v;
+	CUtlVector<transfer_t> decompressed;
 
 	while (1)
 	{
@@ -1550,6 +1580,12 @@ void GatherLight (int threadnum, void *pUserData)
 
 		trans = patch->transfers;
 		num = patch->numtransfers;
+		if ( g_bTransferCompress && patch->needsBumpmap )
+		{
+			num = DecompressTransfers( j, decompressed );
+			trans = decompressed.Base();
+		}
+
 		if ( patch->needsBumpmap )
 		{
 			Vector delta;
@@ -1623,6 +1659,11 @@ void GatherLight (int threadnum, void *pUserData)
 				VectorCopy( bumpSum[i], addlight[j].light[i] );
 			}
 		}
+		else if ( g_bTransferCompress )
+		{
+			GatherCompressedTransfers( j, sum );
+			VectorCopy( sum, addlight[j].light[0] );
+		}
 		else
 		{
 			VectorFill( sum, 0 );
@@ -1706,6 +1747,8 @@ void BounceLight (void)
 		// transfer light from to the leaf patches from other patches via transfers
 		// this moves shooter->emitlight to receiver->addlight
 		unsigned int uiPatchCount = g_Patches.Size();
+		if ( g_bTransferCompress )
+			PrepareCompressedGather();
 		RunThreadsOn (uiPatchCount, true, GatherLight);
 		// move newly received light (addlight) to light to be sent out (emitlight)
 		// start at children and pull light up to parents
@@ -1728,6 +1771,74 @@ void BounceLight (void)
 
 
 
+//-----------------------------------------------------------------------------
+// -verifytransfercompress: bounces the light with the plain transfers and then
+// with the compressed matrix, and fails if any patch's bounced light, which is
+// what FinalLightFace blends into the lightmaps, differs by more than
+// TRANSFER_VERIFY_TOLERANCE. The compressed bounce is the one that's kept.
+//-----------------------------------------------------------------------------
+#define TRANSFER_VERIFY_TOLERANCE	0.01f		// of the brighter of the two, below 1 the difference is absolute
+
+static void VerifyCompressedBounceLight( void )
+{
+	int nPatches = g_Patches.Count();
+
+	// BounceLight swaps the direct light in totallight for the bounced light, keep it for the second pass
+	CUtlVector<bumplights_t> directLight;
+	directLight.SetCount( nPatches );
+	for ( int i = 0; i < nPatches; i++ )
+	{
+		directLight[i] = g_Patches[i].totallight;
+	}
+
+	qprintf( "Bouncing with the plain transfers to verify -transfercompress\n" );
+	g_bTransferCompress = false;
+	BounceLight();
+	g_bTransferCompress = true;
+
+	CUtlVector<bumplights_t> plainBounce;
+	plainBounce.SetCount( nPatches );
+	for ( int i = 0; i < nPatches; i++ )
+	{
+		plainBounce[i] = g_Patches[i].totallight;
+		g_Patches[i].totallight = directLight[i];
+	}
+
+	qprintf( "Bouncing with the compressed transfers\n" );
+	BounceLight();
+
+	float flMaxError = 0;
+	int ndxWorst = -1;
+	for ( int i = 0; i < nPatches; i++ )
+	{
+		int normalCount = g_Patches[i].needsBumpmap ? NUM_BUMP_VECTS+1 : 1;
+		for ( int j = 0; j < normalCount; j++ )
+		{
+			for ( int k = 0; k < 3; k++ )
+			{
+				float flPlain = plainBounce[i].light[j][k];
+				float flCompressed = g_Patches[i].totallight.light[j][k];
+				float flError = fabs( flPlain - flCompressed ) / MAX( 1.0f, MAX( fabs( flPlain ), fabs( flCompressed ) ) );
+				if ( flError > flMaxError )
+				{
+					flMaxError = flError;
+					ndxWorst = i;
+				}
+			}
+		}
+	}
+
+	Msg( "transfer compression verify: bounced light differs by at most %.4f%% (patch %d), tolerance %.2f%%\n",
+		flMaxError * 100.0f, ndxWorst, TRANSFER_VERIFY_TOLERANCE * 100.0f );
+
+	if ( flMaxError > TRANSFER_VERIFY_TOLERANCE )
+	{
+		Error( "-verifytransfercompress: patch %d's bounced light differs by %.4f%%, more than the %.2f%% tolerance\n",
+			ndxWorst, flMaxError * 100.0f, TRANSFER_VERIFY_TOLERANCE * 100.0f );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Counts the number of clusters in a map with no visibility
 // Output : int
@@ -1932,8 +2043,15 @@ void MakeAllScales (void)
 
 	Msg("transfers %d, max %d\n", total_transfer, max_transfer );
 
-	qprintf ("transfer lists: %5.1f megs\n"
-		, (float)total_transfer * sizeof(transfer_t) / (1024*1024));
+	if ( g_bTransferCompress )
+	{
+		PrintCompressedTransferStats();
+	}
+	else
+	{
+		qprintf ("transfer lists: %5.1f megs\n"
+			, (float)total_transfer * sizeof(transfer_t) / (1024*1024));
+	}
 }
 
 
@@ -2019,17 +2137,39 @@ bool RadWorld_Go()
 		BuildFacesVisibleToLights( true );
 	}
 
+	// only lights whose bounds reach a face get gathered for it
+	BuildLightCullGrid();
+
+	// faces reached by the same lights as last time can reuse their samples
+	LoadIncrementalCache();
+
 	// build initial facelights
 	if (g_bUseMPI) 
 	{
 		// RunThreadsOnIndividual (numfaces, true, BuildFacelights);
 		RunMPIBuildFacelights();
 	}
+	else if ( LocalWorkers_IsActive() && !IsIncrementalCacheActive() && !g_pIncremental )
+	{
+		// the workers' patch lights go away with them, so the master builds them like the MPI master
+		DistributeWorkLocal( numfaces, MPI_ProcessFaces, MPI_ReceiveFaceResults );
+		for ( int i = 0; i < numfaces; ++i )
+		{
+			BuildPatchLights( i );
+		}
+	}
 	else 
 	{
 		RunThreadsOnIndividual (numfaces, true, BuildFacelights);
 	}
 
+	PrintLightCullStats();
+
+	if ( !g_pIncremental )
+	{
+		SaveIncrementalCache();
+	}
+
 	// Was the process interrupted?
 	if( g_pIncremental && (g_iCurFace != numfaces) )
 		return false;
@@ -2068,7 +2208,12 @@ bool RadWorld_Go()
 			MakeAllScales ();
 
 			// spread light around
-			BounceLight ();
+			if ( g_bVerifyTransferCompress )
+				VerifyCompressedBounceLight();
+			else
+				BounceLight ();
+
+			FreeCompressedTransfers();
 		}
 
 		//
@@ -2126,6 +2271,14 @@ void VRAD_LoadBSP( char const *pFilename )
 {
 	ThreadSetDefault ();
 
+	if ( g_nLocalProcs > 0 )
+	{
+		if ( g_bUseMPI )
+			Warning( "-procs doesn't work with -mpi, ignoring it.\n" );
+		else
+			LocalWorkers_Init( g_nLocalProcs );
+	}
+
 	g_flStartTime = Plat_FloatTime();
 
 	if( g_bLowPriority )
@@ -2392,6 +2545,14 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bDisablePropSelfShadowing = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-StaticPropLightingPerProp" ) )
+		{
+			g_bStaticPropLightingPerProp = true;
+		}
+		else if ( !Q_stricmp( argv[i], "-StaticPropLightingCompare" ) )
+		{
+			g_bStaticPropLightingCompare = true;
+		}
 		else if ( !Q_stricmp( argv[i], "-textureshadows" ) )
 		{
 			g_bTextureShadows = true;
@@ -2557,6 +2718,59 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			*onlydetail = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-nolightcull" ) )
+		{
+			g_bLightCull = false;
+		}
+		else if ( !Q_stricmp( argv[i], "-lightcullthreshold" ) )
+		{
+			if ( ++i < argc )
+			{
+				g_flLightCullThreshold = MAX( atof( argv[i] ), 0.0f );
+			}
+			else
+			{
+				Warning("Error: expected a value after '-lightcullthreshold'\n" );
+				return -1;
+			}
+		}
+		else if (!Q_stricmp(argv[i],"-procs"))
+		{
+			if ( ++i < argc )
+			{
+				g_nLocalProcs = atoi (argv[i]);
+				if ( g_nLocalProcs <= 0 )
+				{
+					Warning("Error: expected positive value after '-procs'\n" );
+					return -1;
+				}
+			}
+		}
+		else if ( !Q_stricmp( argv[i], "-transfercompress" ) )
+		{
+			g_bTransferCompress = true;
+		}
+		else if ( !Q_stricmp( argv[i], "-verifytransfercompress" ) )
+		{
+			g_bTransferCompress = true;
+			g_bVerifyTransferCompress = true;
+		}
+		else if ( !Q_stricmp( argv[i], "-noclusterpairvis" ) )
+		{
+			g_bClusterPairVis = false;
+		}
+		else if ( !Q_stricmp( argv[i], "-incremental-cache" ) )
+		{
+			if ( ++i < argc )
+			{
+				InitIncrementalCache( argv[i], argc, argv );
+			}
+			else
+			{
+				Warning("Error: expected a filename after '-incremental-cache'\n" );
+				return -1;
+			}
+		}
 		else if (!Q_stricmp(argv[i],"-softsun"))
 		{
 			if ( ++i < argc )
@@ -2818,6 +3032,9 @@ void PrintUsage( int argc, char **argv )
 		"  -dumptrace      : Write ray-tracing environment to debug files.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
+		"  -procs <n>      : Fork n worker processes and hand them faces, leaf ambient and\n"
+		"                    static props the way -mpi would, instead of using threads.\n"
+		"                    Needs fork().\n"
 		"  -lights <file>  : Load a lights file in addition to lights.rad and the\n"
 		"                    level lights file.\n"
 		"  -noextra        : Disable supersampling.\n"
@@ -2837,6 +3054,20 @@ void PrintUsage( int argc, char **argv )
 		"  -loghash        : Log the sample hash table to samplehash.txt.\n"
 		"  -onlydetail     : Only light detail props and per-leaf lighting.\n"
 		"  -maxdispsamplesize #: Set max displacement sample size (default: 512).\n"
+		"  -nolightcull    : Gather every light in the PVS for every face, instead of only the\n"
+		"                    lights whose falloff and cone bounds reach the face.\n"
+		"  -lightcullthreshold <n> : Also skip lights contributing less than <n> to a luxel\n"
+		"                    (default 0, only skip lights that contribute nothing).\n"
+		"  -transfercompress : Store the bounce transfers as one packed matrix with 16 bit\n"
+		"                    weights. Uses about half the memory, bounced light differs\n"
+		"                    by a fraction of a percent.\n"
+		"  -verifytransfercompress : Bounce the light with and without -transfercompress and\n"
+		"                    fail if any patch's bounced light differs by more than 1%%.\n"
+		"  -noclusterpairvis : Trace every patch to patch ray, instead of deciding once for\n"
+		"                    cluster pairs that nothing or a single triangle lies between.\n"
+		"  -incremental-cache <file> : Save each face's direct lighting to <file>, and on the\n"
+		"                    next compile only relight faces whose lights changed. Any other\n"
+		"                    change to the map or the command line relights everything.\n"
 		"  -softsun <n>    : Treat the sun as an area light source of size <n> degrees."
 		"                    Produces soft shadows.\n"
 		"                    Recommended values are between 0 and 5. Default is 0.\n"
@@ -2854,6 +3085,10 @@ void PrintUsage( int argc, char **argv )
 		"  -textureshadows : Allows texture alpha channels to block light - rays intersecting alpha surfaces will sample the texture\n"
 		"  -noskyboxrecurse : Turn off recursion into 3d skybox (skybox shadows on world)\n"
 		"  -nossprops      : Globally disable self-shadowing on static props\n"
+		"  -StaticPropLightingPerProp : Light static props a whole prop per thread work item\n"
+		"                    instead of in sample chunks (for comparing compile times)\n"
+		"  -StaticPropLightingCompare : Light static props both ways, report both times and\n"
+		"                    how far apart the results are. The chunked results are kept.\n"
 		"\n"
 #if 1 // Disabled for the initial SDK release with VMPI so we can get feedback from selected users.
 		);
@@ -83,6 +83,7 @@ struct directlight_t
 
 	int		dorecalc; // position, vector, spot angle, etc.
 	IncrementalLightID	m_IncrementalID;
+	unsigned int		m_nCacheHash;	// for -incremental-cache
 
 	// hard-falloff lights (lights that fade to an actual zero). between m_flStartFadeDistance and
 	// m_flEndFadeDistance, a smoothstep to zero will be done, so that the light goes to zero at
@@ -244,6 +245,7 @@ struct CPatch
 
 
 extern CUtlVector<CPatch>	g_Patches;
+extern CUtlVector<Vector>	emitlight;
 extern CUtlVector<int>		g_FacePatches;		// constains all patches, children first
 extern CUtlVector<int>		faceParents;		// contains only root patches, use next parent to iterate
 extern CUtlVector<int>		clusterChildren;
@@ -290,6 +292,13 @@ extern bool g_bStaticPropPolys;
 extern bool g_bTextureShadows;
 extern bool g_bShowStaticPropNormals;
 extern bool g_bDisablePropSelfShadowing;
+extern bool g_bStaticPropLightingPerProp;
+extern bool g_bStaticPropLightingCompare;
+extern bool g_bLightCull;
+extern float g_flLightCullThreshold;
+extern bool g_bTransferCompress;
+extern bool g_bVerifyTransferCompress;
+extern bool g_bClusterPairVis;
 
 extern CUtlVector<char const *> g_NonShadowCastingMaterialStrings;
 extern void ForceTextureShadowsOnModel( const char *pModelName );
@@ -361,6 +370,7 @@ qboolean IsIncremental(char *filename);
 int SaveIncremental(char *filename);
 int PartialHead (void);
 void BuildFacelights (int facenum, int threadnum);
+void BuildPatchLights( int facenum );
 void PrecompLightmapOffsets();
 void FinalLightFace (int threadnum, int facenum);
 void PvsForOrigin (Vector& org, byte *pvs);
@@ -399,7 +409,7 @@ void CreateDirectLights (void);
 void GetPhongNormal( int facenum, Vector const& spot, Vector& phongnormal );
 int LightForString( char *pLight, Vector& intensity );
 void MakeTransfer( int ndxPatch1, int ndxPatch2, transfer_t *all_transfers );
-void MakeScales( int ndxPatch, transfer_t *all_transfers );
+void MakeScales( int ndxPatch, transfer_t *all_transfers, int iThread );
 
 // Run startup code like initialize mathlib.
 void VRAD_Init();
@@ -38,6 +38,7 @@
 #include "messbuf.h"
 #include "vmpi.h"
 #include "vmpi_distribute_work.h"
+#include "localworkers.h"
 
 
 #define ALIGN_TO_POW2(x,y) (((x)+(y-1))&~(y-1))
@@ -84,6 +85,43 @@ public:
 	CUtlVector< CUtlVector<colorTexel_t>* > m_ColorTexelsArrays;
 };
 
+// a vertex or texel waiting to be lit, gathered up front so points can be lit four at a time
+struct propLightSample_t
+{
+	Vector	m_Position;
+	Vector	m_Normal;
+	Vector	*m_pColor;		// receives direct + indirect, points into the results
+};
+
+// one model's vertexes, kept until the bad ones can be colored from their lit neighbors
+struct propModelVerts_t
+{
+	CUtlVector<colorVertex_t>	*m_pColorVerts;
+	int							m_nVertexes;
+	CUtlVector<badVertex_t>		m_BadVerts;
+};
+
+//-----------------------------------------------------------------------------
+// A static prop between gathering its sample points and taking its results
+//-----------------------------------------------------------------------------
+class CStaticPropLightingJob
+{
+public:
+	CComputeStaticPropLightingResults	m_Results;
+	CUtlVector<propLightSample_t>		m_Samples;
+	CUtlVector<propModelVerts_t>		m_Models;
+	int									m_nSkipProp;
+	int									m_nFlags;		// GATHERLFLAGS_
+};
+
+// a run of one prop's samples, the unit of work when lighting props with local threads
+struct propLightChunk_t
+{
+	CStaticPropLightingJob	*m_pJob;
+	int						m_nFirstSample;
+	int						m_nSamples;
+};
+
 //-----------------------------------------------------------------------------
 struct Rasterizer
 {
@@ -231,9 +269,9 @@ IPhysicsCollision *s_pPhysCollision = NULL;
 static void ConvertTexelDataToTexture(unsigned int _resX, unsigned int _resY, ImageFormat _destFmt, const CUtlVector<colorTexel_t>& _srcTexels, CUtlMemory<byte>* _outTexture);
 
 // Such a monstrosity. :(
-static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const matrix3x4_t& _matNormal, int _iThread, int _skipProp, int _nFlags, int _lightmapResX, int _lightmapResY, 
+static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const matrix3x4_t& _matNormal, int _lightmapResX, int _lightmapResY, 
 											studiohdr_t* _pStudioHdr, mstudiomodel_t* _pStudioModel, OptimizedModel::ModelHeader_t* _pVtxModel, int _meshID, 
-											CComputeStaticPropLightingResults *_pResults );
+											CComputeStaticPropLightingResults *_pResults, CUtlVector<propLightSample_t> *_pSamples );
 
 // Debug function, converts lightmaps to linear space then dumps them out. 
 // TODO: Write out the file in a .dds instead of a .tga, in whatever format we're supposed to use.
@@ -269,6 +307,13 @@ private:
 	static void ThreadComputeStaticPropLighting( int iThread, void *pUserData );
 	void ComputeLightingForProp( int iThread, int iStaticProp );
 
+	// local thread version that splits the work into sample chunks across props
+	static void ThreadGatherStaticPropSamples( int iThread, void *pUserData );
+	static void ThreadLightStaticPropChunk( int iThread, void *pUserData );
+	static void ThreadFinishStaticPropLighting( int iThread, void *pUserData );
+	void ComputeLightingInChunks();
+	void CompareLightingPaths();
+
 	// Methods associated with unserializing static props
 	void UnserializeModelDict( CUtlBuffer& buf );
 	void UnserializeModels( CUtlBuffer& buf );
@@ -335,7 +380,16 @@ private:
 
 	bool m_bIgnoreStaticPropTrace;
 
-	void ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults );
+	// props being lit by ComputeLightingInChunks, starting at m_nFirstJobProp
+	CUtlVector <CStaticPropLightingJob *>	m_LightingJobs;
+	CUtlVector <propLightChunk_t>			m_LightingChunks;
+	int										m_nFirstJobProp;
+
+	void ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CStaticPropLightingJob *pJob );
+	bool GatherLightingSamples( CStaticProp &prop, int prop_index, CStaticPropLightingJob *pJob );
+	void LightSamples( CStaticPropLightingJob *pJob, int nFirstSample, int nSamples, int iThread );
+	void FixupBadVertexes( CStaticProp &prop, int iThread, CStaticPropLightingJob *pJob );
+	int EstimateLightingSamples( const CStaticProp &prop );
 	void ApplyLightingToStaticProp( int iStaticProp, CStaticProp &prop, const CComputeStaticPropLightingResults *pResults );
 
 	void SerializeLighting();
@@ -363,6 +417,7 @@ CVradStaticPropMgr::CVradStaticPropMgr()
 {
 	// set to ignore static prop traces
 	m_bIgnoreStaticPropTrace = false;
+	m_nFirstJobProp = 0;
 }
 
 CVradStaticPropMgr::~CVradStaticPropMgr()
@@ -1145,17 +1200,37 @@ bool PositionInSolid( Vector &position )
 }
 
 //-----------------------------------------------------------------------------
-// Trace from a vertex to each direct light source, accumulating its contribution.
+// Trace from up to four points to each direct light source, one point per SIMD
+// lane, accumulating each light's contribution to its point.
 //-----------------------------------------------------------------------------
-void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &outColor, int iThread,
-								   int static_prop_id_to_skip=-1, int nLFlags = 0)
+static void ComputeDirectLightingAtPoints( const Vector *pPositions, const Vector *pNormals, int nPoints, Vector *pOutColors, int iThread,
+										   int static_prop_id_to_skip, int nLFlags )
 {
+	Assert( nPoints >= 1 && nPoints <= 4 );
+
 	SSE_sampleLightOutput_t	sampleOutput;
 
-	outColor.Init();
+	// short batches repeat their last point in the unused lanes
+	Vector positions[4];
+	Vector normals[4];
+	int clusters[4];
+	for ( int i = 0; i < 4; ++i )
+	{
+		int nPoint = MIN( i, nPoints - 1 );
+		positions[i] = pPositions[nPoint];
+		normals[i] = pNormals[nPoint];
+	}
+
+	for ( int i = 0; i < nPoints; ++i )
+	{
+		clusters[i] = ClusterFromPoint( positions[i] );
+		pOutColors[i].Init();
+	}
+
+	FourVectors normal4;
+	normal4.LoadAndSwizzle( normals[0], normals[1], normals[2], normals[3] );
 
 	// Iterate over all direct lights and accumulate their contribution
-	int cluster = ClusterFromPoint( position );
 	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
 	{
 		if ( dl->light.style )
@@ -1164,47 +1239,72 @@ void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &out
 			continue;
 		}
 
-		// is this lights cluster visible?
-		if ( !PVSCheck( dl->pvs, cluster ) )
+		// is this lights cluster visible to any of the points?
+		bool bVisible[4];
+		bool bAnyVisible = false;
+		for ( int i = 0; i < nPoints; ++i )
+		{
+			bVisible[i] = PVSCheck( dl->pvs, clusters[i] ) != 0;
+			bAnyVisible = bAnyVisible || bVisible[i];
+		}
+
+		if ( !bAnyVisible )
 			continue;
 
-		// push the vertex towards the light to avoid surface acne
-		Vector adjusted_pos = position;
+		// push the vertexes towards the light to avoid surface acne
+		Vector adjusted_pos[4];
 		float flEpsilon = 0.0;
 
-		if  (dl->light.type != emit_skyambient)
+		for ( int i = 0; i < 4; ++i )
 		{
-			// push towards the light
-			Vector fudge;
-			if ( dl->light.type == emit_skylight )
-				fudge = -( dl->light.normal);
-			else
+			adjusted_pos[i] = positions[i];
+
+			if  (dl->light.type != emit_skyambient)
 			{
-				fudge = dl->light.origin-position;
-				VectorNormalize( fudge );
+				// push towards the light
+				Vector fudge;
+				if ( dl->light.type == emit_skylight )
+					fudge = -( dl->light.normal);
+				else
+				{
+					fudge = dl->light.origin-positions[i];
+					VectorNormalize( fudge );
+				}
+				fudge *= 4.0;
+				adjusted_pos[i] += fudge;
+			}
+			else 
+			{
+				// push out along normal
+				adjusted_pos[i] += 4.0 * normals[i];
 			}
-			fudge *= 4.0;
-			adjusted_pos += fudge;
-		}
-		else 
-		{
-			// push out along normal
-			adjusted_pos += 4.0 * normal;
-//			flEpsilon = 1.0;
 		}
 
 		FourVectors adjusted_pos4;
-		FourVectors normal4;
-		adjusted_pos4.DuplicateVector( adjusted_pos );
-		normal4.DuplicateVector( normal );
+		adjusted_pos4.LoadAndSwizzle( adjusted_pos[0], adjusted_pos[1], adjusted_pos[2], adjusted_pos[3] );
 
 		GatherSampleLightSSE( sampleOutput, dl, -1, adjusted_pos4, &normal4, 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
 		                      static_prop_id_to_skip, flEpsilon );
-		
-		VectorMA( outColor, sampleOutput.m_flFalloff.m128_f32[0] * sampleOutput.m_flDot[0].m128_f32[0], dl->light.intensity, outColor );
+
+		for ( int i = 0; i < nPoints; ++i )
+		{
+			if ( bVisible[i] )
+			{
+				VectorMA( pOutColors[i], SubFloat( sampleOutput.m_flFalloff, i ) * SubFloat( sampleOutput.m_flDot[0], i ), dl->light.intensity, pOutColors[i] );
+			}
+		}
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Trace from a vertex to each direct light source, accumulating its contribution.
+//-----------------------------------------------------------------------------
+void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &outColor, int iThread,
+								   int static_prop_id_to_skip=-1, int nLFlags = 0)
+{
+	ComputeDirectLightingAtPoints( &position, &normal, 1, &outColor, iThread, static_prop_id_to_skip, nLFlags );
+}
+
 //-----------------------------------------------------------------------------
 // Takes the results from a ComputeLighting call and applies it to the static prop in question.
 //-----------------------------------------------------------------------------
@@ -1306,10 +1406,22 @@ void CVradStaticPropMgr::ApplyLightingToStaticProp( int iStaticProp, CStaticProp
 // sources at each ray termination. Use the winding data to distribute the unique vertexes
 // into the rendering layout.
 //-----------------------------------------------------------------------------
-void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults )
+void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CStaticPropLightingJob *pJob )
 {
-	CUtlVector<badVertex_t>		badVerts;
+	if ( !GatherLightingSamples( prop, prop_index, pJob ) )
+		return;
+
+	LightSamples( pJob, 0, pJob->m_Samples.Count(), iThread );
+	FixupBadVertexes( prop, iThread, pJob );
+}
 
+//-----------------------------------------------------------------------------
+// Lays out the results for a prop and gathers every vertex and texel that needs
+// lighting. Vertexes embedded in solid are set aside for FixupBadVertexes.
+// Returns false if the prop doesn't get lit.
+//-----------------------------------------------------------------------------
+bool CVradStaticPropMgr::GatherLightingSamples( CStaticProp &prop, int prop_index, CStaticPropLightingJob *pJob )
+{
 	StaticPropDict_t &dict = m_StaticPropDict[prop.m_ModelIdx];
 	studiohdr_t	*pStudioHdr = dict.m_pStudioHdr;
 	OptimizedModel::FileHeader_t *pVtxHdr = (OptimizedModel::FileHeader_t *)dict.m_VtxBuf.Base();
@@ -1317,23 +1429,27 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 	{
 		// must have model and its verts for lighting computation
 		// game will fallback to fullbright
-		return;
+		return false;
 	}
 
 	const bool withVertexLighting = (prop.m_Flags & STATIC_PROP_NO_PER_VERTEX_LIGHTING) == 0;
 	const bool withTexelLighting = (prop.m_Flags & STATIC_PROP_NO_PER_TEXEL_LIGHTING) == 0;
 
 	if (!withVertexLighting && !withTexelLighting)
-		return;
+		return false;
+
+	pJob->m_nSkipProp = (g_bDisablePropSelfShadowing || (prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING)) ? prop_index : -1;
+	pJob->m_nFlags = ( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) ? GATHERLFLAGS_IGNORE_NORMALS : 0;
 
-	const int skip_prop = (g_bDisablePropSelfShadowing || (prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING)) ? prop_index : -1;
-	const int nFlags = ( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) ? GATHERLFLAGS_IGNORE_NORMALS : 0;
+	CComputeStaticPropLightingResults *pResults = &pJob->m_Results;
 
 	VMPI_SetCurrentStage( "ComputeLighting" );
 
 	matrix3x4_t	matPos, matNormal;
 	AngleMatrix(prop.m_Angles, prop.m_Origin, matPos);
 	AngleMatrix(prop.m_Angles, matNormal);
+
+	CUtlVector<propLightSample_t> texelSamples;
 	
 	for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
 	{
@@ -1359,6 +1475,9 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 			colorVerts.EnsureCount( pStudioModel->numvertices );
 			memset( colorVerts.Base(), 0, colorVerts.Count() * sizeof(colorVertex_t) );
 
+			propModelVerts_t &modelVerts = pJob->m_Models[ pJob->m_Models.AddToTail() ];
+			modelVerts.m_pColorVerts = pColorVertsArray;
+
 			int numVertexes = 0;
 			for ( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
 			{
@@ -1370,7 +1489,7 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 				// TODO: Move this into its own function. In fact, refactor this whole function.
 				if (withTexelLighting)
 				{
-					GenerateLightmapSamplesForMesh( matPos, matNormal, iThread, skip_prop, nFlags, prop.m_LightmapImageWidth, prop.m_LightmapImageHeight, pStudioHdr, pStudioModel, pVtxModel, meshID, pResults );
+					GenerateLightmapSamplesForMesh( matPos, matNormal, prop.m_LightmapImageWidth, prop.m_LightmapImageHeight, pStudioHdr, pStudioModel, pVtxModel, meshID, pResults, &texelSamples );
 				}
 
 				// If we do lightmapping, we also do vertex lighting as a potential fallback. This may change.
@@ -1389,114 +1508,165 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 						badVertex.m_ColorVertex = numVertexes;
 						badVertex.m_Position = samplePosition;
 						badVertex.m_Normal = sampleNormal;
-						badVerts.AddToTail( badVertex );			
+						modelVerts.m_BadVerts.AddToTail( badVertex );			
 					}
 					else
 					{
-						Vector direct_pos=samplePosition;
-							
-						
-
-						Vector directColor(0,0,0);
-						ComputeDirectLightingAtPoint( direct_pos,
-														sampleNormal, directColor, iThread,
-														skip_prop, nFlags );
-						Vector indirectColor(0,0,0);
+						colorVerts[numVertexes].m_bValid = true;
+						colorVerts[numVertexes].m_Position = samplePosition;
 
 						if (g_bShowStaticPropNormals)
 						{
-							directColor= sampleNormal;
+							Vector directColor = sampleNormal;
 							directColor += Vector(1.0,1.0,1.0);
 							directColor *= 50.0;
+							colorVerts[numVertexes].m_Color = directColor;
 						}
 						else
 						{
-							if (numbounce >= 1)
-								ComputeIndirectLightingAtPoint( 
-									samplePosition, sampleNormal, 
-									indirectColor, iThread, true,
-									( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS) != 0 );
+							propLightSample_t &sample = pJob->m_Samples[ pJob->m_Samples.AddToTail() ];
+							sample.m_Position = samplePosition;
+							sample.m_Normal = sampleNormal;
+							sample.m_pColor = &colorVerts[numVertexes].m_Color;
 						}
-						
-						colorVerts[numVertexes].m_bValid = true;
-						colorVerts[numVertexes].m_Position = samplePosition;
-						VectorAdd( directColor, indirectColor, colorVerts[numVertexes].m_Color );
 					}
 					
 					numVertexes++;
 				}
 			}
-			
-			// color in the bad vertexes
-			// when entire model has no lighting origin and no valid neighbors
-			// must punt, leave black coloring
-			if ( badVerts.Count() && ( prop.m_bLightingOriginValid || badVerts.Count() != numVertexes ) )
+
+			modelVerts.m_nVertexes = numVertexes;
+
+			// the texels only hold the last mesh's samples, see GenerateLightmapSamplesForMesh
+			pJob->m_Samples.AddVectorToTail( texelSamples );
+			texelSamples.RemoveAll();
+		}
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Lights a run of a prop's gathered samples, four points per direct lighting pass.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::LightSamples( CStaticPropLightingJob *pJob, int nFirstSample, int nSamples, int iThread )
+{
+	const bool bIgnoreNormals = ( pJob->m_nFlags & GATHERLFLAGS_IGNORE_NORMALS ) != 0;
+
+	int nEndSample = nFirstSample + nSamples;
+	for ( int i = nFirstSample; i < nEndSample; i += 4 )
+	{
+		int nPoints = MIN( 4, nEndSample - i );
+
+		Vector positions[4];
+		Vector normals[4];
+		Vector directColors[4];
+		for ( int j = 0; j < nPoints; ++j )
+		{
+			positions[j] = pJob->m_Samples[i + j].m_Position;
+			normals[j] = pJob->m_Samples[i + j].m_Normal;
+		}
+
+		ComputeDirectLightingAtPoints( positions, normals, nPoints, directColors, iThread, pJob->m_nSkipProp, pJob->m_nFlags );
+
+		for ( int j = 0; j < nPoints; ++j )
+		{
+			propLightSample_t &sample = pJob->m_Samples[i + j];
+
+			Vector indirectColor(0,0,0);
+			if (numbounce >= 1)
 			{
-				for ( int nBadVertex = 0; nBadVertex < badVerts.Count(); nBadVertex++ )
-				{		
-					Vector bestPosition;
-					if ( prop.m_bLightingOriginValid )
-					{
-						// use the specified lighting origin
-						VectorCopy( prop.m_LightingOrigin, bestPosition );
-					}
-					else
+				ComputeIndirectLightingAtPoint( 
+					sample.m_Position, sample.m_Normal, 
+					indirectColor, iThread, true, bIgnoreNormals );
+			}
+
+			VectorAdd( directColors[j], indirectColor, *sample.m_pColor );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Colors in the vertexes embedded in solid from a nearby position outside of it.
+// Has to wait until the rest of the prop's vertexes are lit.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::FixupBadVertexes( CStaticProp &prop, int iThread, CStaticPropLightingJob *pJob )
+{
+	FOR_EACH_VEC( pJob->m_Models, nModel )
+	{
+		CUtlVector<colorVertex_t> &colorVerts = *pJob->m_Models[nModel].m_pColorVerts;
+		CUtlVector<badVertex_t> &badVerts = pJob->m_Models[nModel].m_BadVerts;
+		int numVertexes = pJob->m_Models[nModel].m_nVertexes;
+
+		// color in the bad vertexes
+		// when entire model has no lighting origin and no valid neighbors
+		// must punt, leave black coloring
+		if ( badVerts.Count() && ( prop.m_bLightingOriginValid || badVerts.Count() != numVertexes ) )
+		{
+			for ( int nBadVertex = 0; nBadVertex < badVerts.Count(); nBadVertex++ )
+			{		
+				Vector bestPosition;
+				if ( prop.m_bLightingOriginValid )
+				{
+					// use the specified lighting origin
+					VectorCopy( prop.m_LightingOrigin, bestPosition );
+				}
+				else
+				{
+					// find the closest valid neighbor
+					int best = 0;
+					float closest = FLT_MAX;
+					for ( int nColorVertex = 0; nColorVertex < numVertexes; nColorVertex++ )
 					{
-						// find the closest valid neighbor
-						int best = 0;
-						float closest = FLT_MAX;
-						for ( int nColorVertex = 0; nColorVertex < numVertexes; nColorVertex++ )
+						if ( !colorVerts[nColorVertex].m_bValid )
 						{
-							if ( !colorVerts[nColorVertex].m_bValid )
-							{
-								// skip invalid neighbors
-								continue;
-							}
-							Vector delta;
-							VectorSubtract( colorVerts[nColorVertex].m_Position, badVerts[nBadVertex].m_Position, delta );
-							float distance = VectorLength( delta );
-							if ( distance < closest )
-							{
-								closest = distance;
-								best    = nColorVertex;
-							}
+							// skip invalid neighbors
+							continue;
+						}
+						Vector delta;
+						VectorSubtract( colorVerts[nColorVertex].m_Position, badVerts[nBadVertex].m_Position, delta );
+						float distance = VectorLength( delta );
+						if ( distance < closest )
+						{
+							closest = distance;
+							best    = nColorVertex;
 						}
-
-						// use the best neighbor as the direction to crawl
-						VectorCopy( colorVerts[best].m_Position, bestPosition );
 					}
 
-					// crawl toward best position
-					// sudivide to determine a closer valid point to the bad vertex, and re-light
-					Vector midPosition;
-					int numIterations = 20;
-					while ( --numIterations > 0 )
-					{
-						VectorAdd( bestPosition, badVerts[nBadVertex].m_Position, midPosition );
-						VectorScale( midPosition, 0.5f, midPosition );
-						if ( PositionInSolid( midPosition ) )
-							break;
-						bestPosition = midPosition;
-					}
+					// use the best neighbor as the direction to crawl
+					VectorCopy( colorVerts[best].m_Position, bestPosition );
+				}
 
-					// re-light from better position
-					Vector directColor;
-					ComputeDirectLightingAtPoint( bestPosition, badVerts[nBadVertex].m_Normal, directColor, iThread );
+				// crawl toward best position
+				// sudivide to determine a closer valid point to the bad vertex, and re-light
+				Vector midPosition;
+				int numIterations = 20;
+				while ( --numIterations > 0 )
+				{
+					VectorAdd( bestPosition, badVerts[nBadVertex].m_Position, midPosition );
+					VectorScale( midPosition, 0.5f, midPosition );
+					if ( PositionInSolid( midPosition ) )
+						break;
+					bestPosition = midPosition;
+				}
 
-					Vector indirectColor;
-					ComputeIndirectLightingAtPoint( bestPosition, badVerts[nBadVertex].m_Normal,
-													indirectColor, iThread, true );
+				// re-light from better position
+				Vector directColor;
+				ComputeDirectLightingAtPoint( bestPosition, badVerts[nBadVertex].m_Normal, directColor, iThread );
 
-					// save results, not changing valid status
-					// to ensure this offset position is not considered as a viable candidate
-					colorVerts[badVerts[nBadVertex].m_ColorVertex].m_Position = bestPosition;
-					VectorAdd( directColor, indirectColor, colorVerts[badVerts[nBadVertex].m_ColorVertex].m_Color );
-				}
+				Vector indirectColor;
+				ComputeIndirectLightingAtPoint( bestPosition, badVerts[nBadVertex].m_Normal,
+												indirectColor, iThread, true );
+
+				// save results, not changing valid status
+				// to ensure this offset position is not considered as a viable candidate
+				colorVerts[badVerts[nBadVertex].m_ColorVertex].m_Position = bestPosition;
+				VectorAdd( directColor, indirectColor, colorVerts[badVerts[nBadVertex].m_ColorVertex].m_Color );
 			}
-			
-			// discard bad verts
-			badVerts.Purge();
 		}
+		
+		// discard bad verts
+		badVerts.Purge();
 	}
 }
 
@@ -1672,8 +1842,9 @@ void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults_Static( uint64 iStaticPro
 void CVradStaticPropMgr::VMPI_ProcessStaticProp( int iThread, int iStaticProp, MessageBuffer *pBuf )
 {
 	// Compute the lighting.
-	CComputeStaticPropLightingResults results;
-	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &results );
+	CStaticPropLightingJob job;
+	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &job );
+	const CComputeStaticPropLightingResults &results = job.m_Results;
 
 	VMPI_SetCurrentStage( "EncodeLightingResults" );
 	
@@ -1744,9 +1915,9 @@ void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults( int iStaticProp, Message
 void CVradStaticPropMgr::ComputeLightingForProp( int iThread, int iStaticProp )
 {
 	// Compute the lighting.
-	CComputeStaticPropLightingResults results;
-	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &results );
-	ApplyLightingToStaticProp( iStaticProp, m_StaticProps[iStaticProp], &results );
+	CStaticPropLightingJob job;
+	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &job );
+	ApplyLightingToStaticProp( iStaticProp, m_StaticProps[iStaticProp], &job.m_Results );
 }
 
 void CVradStaticPropMgr::ThreadComputeStaticPropLighting( int iThread, void *pUserData )
@@ -1761,6 +1932,214 @@ void CVradStaticPropMgr::ThreadComputeStaticPropLighting( int iThread, void *pUs
 	}
 }
 
+// samples lit per work item, a multiple of the four points lit per direct lighting pass
+#define STATIC_PROP_LIGHTING_CHUNK_SAMPLES	256
+
+// bounds the samples, and the results they point into, held at once
+#define STATIC_PROP_LIGHTING_WAVE_SAMPLES	( 2 * 1024 * 1024 )
+
+//-----------------------------------------------------------------------------
+// Roughly how many samples a prop will gather, for sizing waves of props
+//-----------------------------------------------------------------------------
+int CVradStaticPropMgr::EstimateLightingSamples( const CStaticProp &prop )
+{
+	studiohdr_t *pStudioHdr = m_StaticPropDict[prop.m_ModelIdx].m_pStudioHdr;
+	if ( !pStudioHdr )
+		return 0;
+
+	const bool withTexelLighting = (prop.m_Flags & STATIC_PROP_NO_PER_TEXEL_LIGHTING) == 0;
+
+	int nSamples = 0;
+	for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
+	{
+		mstudiobodyparts_t *pBodyPart = pStudioHdr->pBodypart( bodyID );
+		for ( int modelID = 0; modelID < pBodyPart->nummodels; ++modelID )
+		{
+			nSamples += pBodyPart->pModel( modelID )->numvertices;
+			if ( withTexelLighting )
+			{
+				nSamples += prop.m_LightmapImageWidth * prop.m_LightmapImageHeight;
+			}
+		}
+	}
+
+	return nSamples;
+}
+
+void CVradStaticPropMgr::ThreadGatherStaticPropSamples( int iThread, void *pUserData )
+{
+	while (1)
+	{
+		int j = GetThreadWork ();
+		if (j == -1)
+			break;
+		int iStaticProp = g_StaticPropMgr.m_nFirstJobProp + j;
+		g_StaticPropMgr.GatherLightingSamples( g_StaticPropMgr.m_StaticProps[iStaticProp], iStaticProp, g_StaticPropMgr.m_LightingJobs[j] );
+	}
+}
+
+void CVradStaticPropMgr::ThreadLightStaticPropChunk( int iThread, void *pUserData )
+{
+	while (1)
+	{
+		int j = GetThreadWork ();
+		if (j == -1)
+			break;
+		const propLightChunk_t &chunk = g_StaticPropMgr.m_LightingChunks[j];
+		g_StaticPropMgr.LightSamples( chunk.m_pJob, chunk.m_nFirstSample, chunk.m_nSamples, iThread );
+	}
+}
+
+void CVradStaticPropMgr::ThreadFinishStaticPropLighting( int iThread, void *pUserData )
+{
+	while (1)
+	{
+		int j = GetThreadWork ();
+		if (j == -1)
+			break;
+		int iStaticProp = g_StaticPropMgr.m_nFirstJobProp + j;
+		CStaticProp &prop = g_StaticPropMgr.m_StaticProps[iStaticProp];
+		CStaticPropLightingJob *pJob = g_StaticPropMgr.m_LightingJobs[j];
+
+		g_StaticPropMgr.FixupBadVertexes( prop, iThread, pJob );
+		g_StaticPropMgr.ApplyLightingToStaticProp( iStaticProp, prop, &pJob->m_Results );
+
+		delete pJob;
+		g_StaticPropMgr.m_LightingJobs[j] = NULL;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Lights the props with local threads. Handing out a prop per work item leaves
+// threads idle behind the few props with many vertexes or big lightmaps, so instead
+// a wave of props gathers its sample points, the points are lit in fixed size chunks
+// across every prop in the wave, then each prop fixes up its bad vertexes and takes
+// its results.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::ComputeLightingInChunks()
+{
+	int count = m_StaticProps.Count();
+	int nTotalSamples = 0;
+
+	for ( int nFirstProp = 0; nFirstProp < count; )
+	{
+		int nProps = 0;
+		int nWaveSamples = 0;
+		while ( nFirstProp + nProps < count && nWaveSamples < STATIC_PROP_LIGHTING_WAVE_SAMPLES )
+		{
+			nWaveSamples += EstimateLightingSamples( m_StaticProps[nFirstProp + nProps] );
+			++nProps;
+		}
+
+		m_nFirstJobProp = nFirstProp;
+		m_LightingJobs.SetCount( nProps );
+		for ( int i = 0; i < nProps; ++i )
+		{
+			m_LightingJobs[i] = new CStaticPropLightingJob;
+		}
+
+		SuppressPacifier( true );
+		RunThreadsOn( nProps, false, ThreadGatherStaticPropSamples );
+		SuppressPacifier( false );
+
+		m_LightingChunks.RemoveAll();
+		for ( int i = 0; i < nProps; ++i )
+		{
+			CStaticPropLightingJob *pJob = m_LightingJobs[i];
+			int nSamples = pJob->m_Samples.Count();
+			for ( int nFirstSample = 0; nFirstSample < nSamples; nFirstSample += STATIC_PROP_LIGHTING_CHUNK_SAMPLES )
+			{
+				propLightChunk_t &chunk = m_LightingChunks[ m_LightingChunks.AddToTail() ];
+				chunk.m_pJob = pJob;
+				chunk.m_nFirstSample = nFirstSample;
+				chunk.m_nSamples = MIN( STATIC_PROP_LIGHTING_CHUNK_SAMPLES, nSamples - nFirstSample );
+			}
+			nTotalSamples += nSamples;
+		}
+
+		RunThreadsOn( m_LightingChunks.Count(), true, ThreadLightStaticPropChunk );
+
+		SuppressPacifier( true );
+		RunThreadsOn( nProps, false, ThreadFinishStaticPropLighting );
+		SuppressPacifier( false );
+
+		nFirstProp += nProps;
+	}
+
+	m_LightingJobs.Purge();
+	m_LightingChunks.Purge();
+
+	qprintf( "%d static prop samples lit in chunks of %d\n", nTotalSamples, STATIC_PROP_LIGHTING_CHUNK_SAMPLES );
+}
+
+//-----------------------------------------------------------------------------
+// -StaticPropLightingCompare: lights every prop per prop and then in chunks on
+// the same map, and prints both times and how far apart the results are. The
+// chunked results are the ones that get saved.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::CompareLightingPaths()
+{
+	int count = m_StaticProps.Count();
+
+	double flStartTime = Plat_FloatTime();
+	RunThreadsOn( count, true, ThreadComputeStaticPropLighting );
+	double flPerPropTime = Plat_FloatTime() - flStartTime;
+
+	// ApplyLightingToStaticProp appends, so move the per prop results out of the way
+	CUtlVector< CUtlVector<MeshData_t> > perPropMeshData;
+	perPropMeshData.SetCount( count );
+	for ( int i = 0; i < count; ++i )
+	{
+		perPropMeshData[i].Swap( m_StaticProps[i].m_MeshData );
+	}
+
+	flStartTime = Plat_FloatTime();
+	ComputeLightingInChunks();
+	double flChunkedTime = Plat_FloatTime() - flStartTime;
+
+	float flMaxColorDelta = 0.0f;
+	int nTexelBytesDiffering = 0;
+	int nPropsMismatched = 0;
+	for ( int i = 0; i < count; ++i )
+	{
+		const CUtlVector<MeshData_t> &a = perPropMeshData[i];
+		const CUtlVector<MeshData_t> &b = m_StaticProps[i].m_MeshData;
+		if ( a.Count() != b.Count() )
+		{
+			++nPropsMismatched;
+			continue;
+		}
+
+		for ( int j = 0; j < a.Count(); ++j )
+		{
+			if ( a[j].m_VertexColors.Count() != b[j].m_VertexColors.Count() ||
+				 a[j].m_TexelsEncoded.Count() != b[j].m_TexelsEncoded.Count() )
+			{
+				++nPropsMismatched;
+				break;
+			}
+
+			for ( int k = 0; k < a[j].m_VertexColors.Count(); ++k )
+			{
+				Vector vDelta = a[j].m_VertexColors[k] - b[j].m_VertexColors[k];
+				flMaxColorDelta = MAX( flMaxColorDelta, MAX( fabs( vDelta.x ), MAX( fabs( vDelta.y ), fabs( vDelta.z ) ) ) );
+			}
+
+			for ( int k = 0; k < a[j].m_TexelsEncoded.Count(); ++k )
+			{
+				if ( a[j].m_TexelsEncoded[k] != b[j].m_TexelsEncoded[k] )
+					++nTexelBytesDiffering;
+			}
+		}
+	}
+
+	Msg( "\nStatic prop lighting A/B, %d props:\n", count );
+	Msg( "  per prop (-StaticPropLightingPerProp) : %.2f seconds\n", flPerPropTime );
+	Msg( "  sample chunks (default)              : %.2f seconds (%.2fx)\n", flChunkedTime, flChunkedTime > 0.0 ? flPerPropTime / flChunkedTime : 0.0 );
+	Msg( "  max vertex color difference %f, %d texel bytes differ, %d props laid out differently\n",
+		flMaxColorDelta, nTexelBytesDiffering, nPropsMismatched );
+}
+
 //-----------------------------------------------------------------------------
 // Computes lighting for the static props.
 // Must be after all other surface lighting has been computed for the indirect sampling.
@@ -1777,6 +2156,8 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 
 	StartPacifier( "Computing static prop lighting : " );
 
+	double flStartTime = Plat_FloatTime();
+
 	// ensure any traces against us are ignored because we have no inherit lighting contribution
 	m_bIgnoreStaticPropTrace = true;
 
@@ -1791,10 +2172,27 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 			&CVradStaticPropMgr::VMPI_ProcessStaticProp_Static, 
 			&CVradStaticPropMgr::VMPI_ReceiveStaticPropResults_Static );
 	}
-	else
+	else if ( LocalWorkers_IsActive() )
+	{
+		DistributeWorkLocal( 
+			count, 
+			&CVradStaticPropMgr::VMPI_ProcessStaticProp_Static, 
+			&CVradStaticPropMgr::VMPI_ReceiveStaticPropResults_Static );
+	}
+	else if ( g_bStaticPropLightingCompare )
+	{
+		CompareLightingPaths();
+	}
+	else if ( g_bStaticPropLightingPerProp )
 	{
 		RunThreadsOn(count, true, ThreadComputeStaticPropLighting);
 	}
+	else
+	{
+		ComputeLightingInChunks();
+	}
+
+	double flLightingTime = Plat_FloatTime() - flStartTime;
 
 	// restore default
 	m_bIgnoreStaticPropTrace = false;
@@ -1803,6 +2201,9 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 	SerializeLighting();
 
 	EndPacifier( true );
+
+	// for comparing against -StaticPropLightingPerProp, -StaticPropLightingCompare prints both
+	Msg( "Static prop lighting: %d props in %.2f seconds\n", count, flLightingTime );
 }
 
 //-----------------------------------------------------------------------------
@@ -2274,7 +2675,8 @@ inline float ComputeBarycentricDistanceToTri( Vector _barycentricCoord, Vector2D
 }
 
 // ------------------------------------------------------------------------------------------------
-static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const matrix3x4_t& _matNormal, int _iThread, int _skipProp, int _flags, int _lightmapResX, int _lightmapResY, studiohdr_t* _pStudioHdr, mstudiomodel_t* _pStudioModel, OptimizedModel::ModelHeader_t* _pVtxModel, int _meshID, CComputeStaticPropLightingResults *_outResults )
+// Each call starts the model's texels over, so only the samples of the last mesh are kept.
+static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const matrix3x4_t& _matNormal, int _lightmapResX, int _lightmapResY, studiohdr_t* _pStudioHdr, mstudiomodel_t* _pStudioModel, OptimizedModel::ModelHeader_t* _pVtxModel, int _meshID, CComputeStaticPropLightingResults *_outResults, CUtlVector<propLightSample_t> *_outSamples )
 {
 	// Could iterate and gen this if needed.
 	int nLod = 0;
@@ -2290,6 +2692,8 @@ static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const ma
 		colorTexels[i].m_fDistanceToTri = FLT_MAX;	
 	}
 
+	_outSamples->RemoveAll();
+
 	mstudiomesh_t* pMesh = _pStudioModel->pMesh(_meshID);
 	OptimizedModel::MeshHeader_t* pVtxMesh = pVtxLOD->pMesh(_meshID);
 	const mstudio_meshvertexdata_t *vertData = pMesh->GetVertexData((void *)_pStudioHdr);
@@ -2423,17 +2827,10 @@ static void GenerateLightmapSamplesForMesh( const matrix3x4_t& _matPos, const ma
 
 			if (shouldProcess)
 			{
-				Vector directColor(0, 0, 0),
-					   indirectColor(0, 0, 0);
-
-
-				ComputeDirectLightingAtPoint( colorTexels[linearPos].m_WorldPosition, colorTexels[linearPos].m_WorldNormal, directColor, _iThread, _skipProp, _flags);
-
-				if (numbounce >= 1) {
-					ComputeIndirectLightingAtPoint( colorTexels[linearPos].m_WorldPosition, colorTexels[linearPos].m_WorldNormal, indirectColor, _iThread, true, (_flags & GATHERLFLAGS_IGNORE_NORMALS) != 0 );
-				}
-
-				VectorAdd(directColor, indirectColor, colorTexels[linearPos].m_Color);
+				propLightSample_t &sample = (*_outSamples)[_outSamples->AddToTail()];
+				sample.m_Position = colorTexels[linearPos].m_WorldPosition;
+				sample.m_Normal = colorTexels[linearPos].m_WorldNormal;
+				sample.m_pColor = &colorTexels[linearPos].m_Color;
 			}
 
 			++linearPos;
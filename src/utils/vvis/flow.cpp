@@ -7,6 +7,8 @@
 //=============================================================================//
 #include "vis.h"
 #include "vmpi.h"
+#include "threads.h"
+#include <emmintrin.h>
 
 int g_TraceClusterStart = -1;
 int g_TraceClusterStop = -1;
@@ -74,6 +76,14 @@ winding_t *AllocStackWinding (pstack_t *stack)
 {
 	int		i;
 
+	if (stack->arena)
+	{
+		windingarena_t *arena = stack->arena;
+		if (arena->numwindings == arena->maxwindings)
+			Error ("Out of memory. AllocStackWinding: arena full");
+		return &arena->windings[arena->numwindings++];
+	}
+
 	for (i=0 ; i<3 ; i++)
 	{
 		if (stack->freewindings[i])
@@ -92,6 +102,15 @@ void FreeStackWinding (winding_t *w, pstack_t *stack)
 {
 	int		i;
 
+	if (stack->arena)
+	{
+		// only the newest winding can be given back, the rest go when the level moves on
+		i = w - stack->arena->windings;
+		if (i >= stack->arenamark && i == stack->arena->numwindings - 1)
+			stack->arena->numwindings--;
+		return;
+	}
+
 	i = w - stack->windings;
 
 	if (i<0 || i>2)
@@ -209,6 +228,19 @@ winding_t	*ChopWinding (winding_t *in, pstack_t *stack, plane_t *split)
 	}
 	
 // free the original winding
+	if (stack->arena)
+	{
+		// rechopping the newest winding is the common case, keep it where it is
+		i = in - stack->arena->windings;
+		if (i >= stack->arenamark && i == stack->arena->numwindings - 2)
+		{
+			in->numpoints = neww->numpoints;
+			memcpy (in->points, neww->points, neww->numpoints * sizeof(Vector));
+			stack->arena->numwindings--;
+			return in;
+		}
+	}
+
 	FreeStackWinding (in, stack);
 	
 	return neww;
@@ -467,6 +499,77 @@ void WritePortalTrace( const char *source )
 	Warning("Wrote %s!!!\n", filename);
 }
 
+/*
+==================
+FlowMightSee
+
+-fastflow version of the mightsee loop in RecursiveLeafFlow. ANDs the previous
+level's mightsee with test a block at a time, only over the blocks the previous
+level has bits in, and narrows the new level's blocks to the ones left non-zero.
+Returns non-zero if any bit left isn't in vis yet.
+==================
+*/
+static long FlowMightSee (pstack_t *prevstack, const byte *test, const byte *vis, pstack_t *stack)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i more = zero;
+
+	stack->firstblock = prevstack->lastblock + 1;
+	stack->lastblock = prevstack->firstblock - 1;
+
+	for (int b = prevstack->firstblock ; b <= prevstack->lastblock ; b++)
+	{
+		int ofs = b * FLOW_BLOCK_BYTES;
+		__m128i might0 = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *)(prevstack->mightsee + ofs)), _mm_loadu_si128 ((const __m128i *)(test + ofs)));
+		__m128i might1 = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *)(prevstack->mightsee + ofs + 16)), _mm_loadu_si128 ((const __m128i *)(test + ofs + 16)));
+		_mm_storeu_si128 ((__m128i *)(stack->mightsee + ofs), might0);
+		_mm_storeu_si128 ((__m128i *)(stack->mightsee + ofs + 16), might1);
+
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_or_si128 (might0, might1), zero)) == 0xffff)
+			continue;	// nothing left to see in this block
+
+		if (stack->firstblock > b)
+			stack->firstblock = b;
+		stack->lastblock = b;
+
+		more = _mm_or_si128 (more, _mm_andnot_si128 (_mm_loadu_si128 ((const __m128i *)(vis + ofs)), might0));
+		more = _mm_or_si128 (more, _mm_andnot_si128 (_mm_loadu_si128 ((const __m128i *)(vis + ofs + 16)), might1));
+	}
+
+	return _mm_movemask_epi8 (_mm_cmpeq_epi8 (more, zero)) != 0xffff;
+}
+
+
+/*
+==================
+VerifyFlowMightSee
+
+-verifyflow, runs the plain mightsee loop next to FlowMightSee and Errors if the
+bits or more differ. Bits outside a level's blocks count as zero, FlowMightSee
+leaves whatever was there before.
+==================
+*/
+static void VerifyFlowMightSee (pstack_t *prevstack, const byte *test, const byte *vis, pstack_t *stack, long more, int pnum)
+{
+	byte scalarmore = 0;
+	for (int j=0 ; j<portalbytes ; j++)
+	{
+		int b = j / FLOW_BLOCK_BYTES;
+		byte prev = (b >= prevstack->firstblock && b <= prevstack->lastblock) ? prevstack->mightsee[j] : 0;
+		byte might = (b >= stack->firstblock && b <= stack->lastblock) ? stack->mightsee[j] : 0;
+
+		byte expected = prev & test[j];
+		if (might != expected)
+			Error ("-verifyflow: mightsee through portal %d differs at byte %d (%02x, expected %02x)\n", pnum, j, might, expected);
+
+		scalarmore |= expected & ~vis[j];
+	}
+
+	if ((more != 0) != (scalarmore != 0))
+		Error ("-verifyflow: mightsee through portal %d says %s new to see, expected %s\n", pnum, more ? "something" : "nothing", scalarmore ? "something" : "nothing");
+}
+
+
 /*
 ==================
 RecursiveLeafFlow
@@ -505,6 +608,8 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 	stack.next = NULL;
 	stack.leaf = leaf;
 	stack.portal = NULL;
+	stack.arena = thread->arena;
+	stack.arenamark = thread->arena ? thread->arena->numwindings : 0;
 
 	might = (long *)stack.mightsee;
 	vis = (long *)thread->base->portalvis;
@@ -516,6 +621,11 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		p = leaf->portals[i];
 		pnum = p - portals;
 
+		if ( stack.arena && ( pnum / FLOW_BLOCK_BITS < prevstack->firstblock || pnum / FLOW_BLOCK_BITS > prevstack->lastblock ) )
+		{
+			continue;	// outside the blocks the previous level can see
+		}
+
 		if ( ! (prevstack->mightsee[pnum >> 3] & (1<<(pnum&7)) ) )
 		{
 			continue;	// can't possibly see it
@@ -531,11 +641,20 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 			test = (long *)p->portalflood;
 		}
 
-		more = 0;
-		for (j=0 ; j<portallongs ; j++)
+		if ( stack.arena )
 		{
-			might[j] = ((long *)prevstack->mightsee)[j] & test[j];
-			more |= (might[j] & ~vis[j]);
+			more = FlowMightSee (prevstack, (byte *)test, (byte *)vis, &stack);
+			if (g_bVerifyFlow)
+				VerifyFlowMightSee (prevstack, (byte *)test, (byte *)vis, &stack, more, pnum);
+		}
+		else
+		{
+			more = 0;
+			for (j=0 ; j<portallongs ; j++)
+			{
+				might[j] = ((long *)prevstack->mightsee)[j] & test[j];
+				more |= (might[j] & ~vis[j]);
+			}
 		}
 		
 		if ( !more && CheckBit( thread->base->portalvis, pnum ) )
@@ -553,6 +672,11 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		stack.freewindings[0] = 1;
 		stack.freewindings[1] = 1;
 		stack.freewindings[2] = 1;
+		if ( stack.arena )
+		{
+			// the last portal's windings are done with
+			stack.arena->numwindings = stack.arenamark;
+		}
 		
 		float d = DotProduct (p->origin, thread->pstack_head.portalplane.normal);
 		d -= thread->pstack_head.portalplane.dist;
@@ -617,6 +741,31 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 }
 
 
+static windingarena_t	s_FlowArenas[MAX_TOOL_THREADS+1];
+
+static windingarena_t *GetFlowArena (int iThread)
+{
+	windingarena_t *arena = &s_FlowArenas[iThread];
+	if (!arena->windings)
+	{
+		// a chain never enters a leaf twice, and each level keeps at most three windings
+		arena->maxwindings = 4 * (portalclusters + 2);
+		arena->windings = (winding_t *)malloc (arena->maxwindings * sizeof(winding_t));
+	}
+	arena->numwindings = 0;
+	return arena;
+}
+
+void FreeFlowArenas()
+{
+	for (int i=0 ; i<MAX_TOOL_THREADS+1 ; i++)
+	{
+		free (s_FlowArenas[i].windings);
+		memset (&s_FlowArenas[i], 0, sizeof(s_FlowArenas[i]));
+	}
+}
+
+
 /*
 ===============
 PortalFlow
@@ -642,6 +791,12 @@ void PortalFlow (int iThread, int portalnum)
 	data.pstack_head.portal = p;
 	data.pstack_head.source = p->winding;
 	data.pstack_head.portalplane = p->plane;
+	if (g_bFastFlow)
+	{
+		data.arena = GetFlowArena (iThread);
+		data.pstack_head.firstblock = 0;
+		data.pstack_head.lastblock = portalbytes / FLOW_BLOCK_BYTES - 1;
+	}
 	for (i=0 ; i<portallongs ; i++)
 		((long *)data.pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
 
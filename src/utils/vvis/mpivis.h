@@ -11,11 +11,20 @@
 #endif
 
 
+class MessageBuffer;
+
+
 void VVIS_SetupMPI( int &argc, char **&argv );
 
 
 void RunMPIBasePortalVis();
 void RunMPIPortalFlow();
 
+// The work units, also run by the -procs local workers
+void ProcessBasePortalVis( int iThread, uint64 iPortal, MessageBuffer *pBuf );
+void ReceiveBasePortalVis( uint64 iWorkUnit, MessageBuffer *pBuf, int iWorker );
+void ProcessPortalFlow( int iThread, uint64 iPortal, MessageBuffer *pBuf );
+void ReceivePortalFlow( uint64 iWorkUnit, MessageBuffer *pBuf, int iWorker );
+
 
 #endif // MPIVIS_H
@@ -18,6 +18,12 @@
 
 extern bool g_bUseRadius;			// prototyping TF2, "radius vis" solution
 extern double g_VisRadius;			// the radius for the TF2 "radius vis"
+extern bool g_bFastFlow;			// -fastflow, wide bit strings and arena windings in PortalFlow
+extern bool g_bVerifyFlow;			// -verifyflow, check -fastflow's mightsee against the plain loop
+
+// portal bit strings are padded to whole blocks so -fastflow can work on them a block at a time
+#define	FLOW_BLOCK_BITS	256
+#define	FLOW_BLOCK_BYTES	(FLOW_BLOCK_BITS/8)
 
 struct plane_t
 {
@@ -40,6 +46,15 @@ void		FreeWinding (winding_t *w);
 winding_t	*CopyWinding (winding_t *w);
 
 
+// -fastflow hands out the windings chopped during the flow from here, a recursion level at a time
+struct windingarena_t
+{
+	winding_t	*windings;
+	int			numwindings;
+	int			maxwindings;
+};
+
+
 typedef enum {stat_none, stat_working, stat_done} vstatus_t;
 struct portal_t
 {
@@ -77,6 +92,11 @@ struct pstack_t
 	int			freewindings[3];
 
 	plane_t		portalplane;
+
+	windingarena_t	*arena;		// -fastflow only, windings come from here instead
+	int			arenamark;		// -fastflow only, the first arena winding this level owns
+	int			firstblock;		// -fastflow only, mightsee is zero outside these blocks
+	int			lastblock;
 };
 
 struct threaddata_t
@@ -84,6 +104,7 @@ struct threaddata_t
 	portal_t	*base;
 	int			c_chains;
 	pstack_t	pstack_head;
+	windingarena_t	*arena;		// NULL unless -fastflow
 };
 
 extern	int			g_numportals;
@@ -114,6 +135,12 @@ void BasePortalVis (int iThread, int portalnum);
 void BetterPortalVis (int portalnum);
 void PortalFlow (int iThread, int portalnum);
 void WritePortalTrace( const char *source );
+void FreeFlowArenas();
+
+void SetVisCacheFile (const char *portalfile);
+bool IsVisCacheActive (void);
+int RestoreCachedPortalVis (void);
+void SaveVisCache (void);
 
 extern	portal_t	*sorted_portals[MAX_MAP_PORTALS*2];
 extern int g_TraceClusterStart, g_TraceClusterStop;
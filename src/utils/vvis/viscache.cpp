@@ -0,0 +1,289 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Portal vis cache for -viscache.
+//
+// Each portal is identified across compiles by a hash of its winding. A portal's
+// final portalvis only depends on the portals its flow can pass through, which
+// are the ones in its portalflood, and on the portals in the leafs those lead
+// into. So after BasePortalVis every portal gets a dependency hash over those,
+// and a portal whose dependency hash matches the last compile gets its portalvis
+// back, remapped to the new portal numbers, instead of being flowed again.
+//
+//=============================================================================//
+
+#include "vis.h"
+#include "tier1/checksum_md5.h"
+#include "tier1/utlbuffer.h"
+
+
+#define VISCACHE_VERSION	1
+
+struct viscacheheader_t
+{
+	int		version;
+	int		numportals;			// memory portals, two per file portal
+	int		portalbytes;
+};
+
+// The header is followed by every portal's winding hash, then for each portal
+// its dependency hash and portalvis bits in the old numbering.
+
+struct portalhash_t
+{
+	uint64	hash;
+	int		portalnum;
+};
+
+static char				s_VisCacheFile[MAX_PATH] = "";
+
+static uint64			*s_WindingHashes;		// by portal
+static uint64			*s_DependencyHashes;	// by portal
+
+static int				c_cachedportals;
+
+
+static uint64 HashBytes (const void *data, int size, uint64 seed = 0)
+{
+	MD5Context_t	ctx;
+	unsigned char	digest[MD5_DIGEST_LENGTH];
+	uint64			hash;
+
+	MD5Init (&ctx);
+	MD5Update (&ctx, (const unsigned char *)&seed, sizeof(seed));
+	MD5Update (&ctx, (const unsigned char *)data, size);
+	MD5Final (digest, &ctx);
+
+	memcpy (&hash, digest, sizeof(hash));
+	return hash;
+}
+
+
+static int PortalHashComp (const void *a, const void *b)
+{
+	uint64 ha = ((portalhash_t *)a)->hash;
+	uint64 hb = ((portalhash_t *)b)->hash;
+
+	if (ha == hb)
+		return 0;
+	return (ha < hb) ? -1 : 1;
+}
+
+
+void SetVisCacheFile (const char *portalfile)
+{
+	Q_StripExtension (portalfile, s_VisCacheFile, sizeof(s_VisCacheFile));
+	Q_strncat (s_VisCacheFile, ".vcache", sizeof(s_VisCacheFile), COPY_ALL_CHARACTERS);
+}
+
+
+bool IsVisCacheActive (void)
+{
+	return s_VisCacheFile[0] != 0;
+}
+
+
+/*
+==============
+BuildPortalHashes
+
+Needs portalflood, so call after BasePortalVis
+==============
+*/
+static void BuildPortalHashes (void)
+{
+	int			i, j, k;
+	portal_t	*p;
+	uint64		*leafhashes, *linkhashes;
+
+	s_WindingHashes = (uint64 *)malloc (g_numportals*2*sizeof(uint64));
+	s_DependencyHashes = (uint64 *)malloc (g_numportals*2*sizeof(uint64));
+	linkhashes = (uint64 *)malloc (g_numportals*2*sizeof(uint64));
+	leafhashes = (uint64 *)malloc (portalclusters*sizeof(uint64));
+
+	// the winding's point order tells the two sides of a file portal apart
+	for (i=0, p=portals ; i<g_numportals*2 ; i++, p++)
+		s_WindingHashes[i] = HashBytes (p->winding->points, p->winding->numpoints * sizeof(Vector));
+
+	// the portals a flow could continue through past each portal, numbering free
+	for (i=0 ; i<portalclusters ; i++)
+	{
+		leafhashes[i] = 0;
+		for (j=0 ; j<leafs[i].portals.Count() ; j++)
+			leafhashes[i] += s_WindingHashes[leafs[i].portals[j] - portals];
+	}
+
+	for (i=0, p=portals ; i<g_numportals*2 ; i++, p++)
+		linkhashes[i] = HashBytes (&leafhashes[p->leaf], sizeof(uint64), s_WindingHashes[i]);
+
+	for (i=0, p=portals ; i<g_numportals*2 ; i++, p++)
+	{
+		uint64 hash = linkhashes[i];
+		for (j=0 ; j<portalbytes ; j++)
+		{
+			if (!p->portalflood[j])
+				continue;
+			for (k=0 ; k<8 ; k++)
+			{
+				if (p->portalflood[j] & (1<<k))
+					hash += linkhashes[j*8+k];
+			}
+		}
+		s_DependencyHashes[i] = hash;
+	}
+
+	free (linkhashes);
+	free (leafhashes);
+}
+
+
+/*
+==============
+RestoreCachedPortalVis
+
+Fills in portalvis for every portal the cache still holds and moves the rest
+to the front of sorted_portals, keeping their order. Returns how many are left
+to flow.
+==============
+*/
+int RestoreCachedPortalVis (void)
+{
+	int			i, j, k;
+	portal_t	*p;
+	CUtlBuffer	buf;
+
+	BuildPortalHashes ();
+
+	c_cachedportals = 0;
+	if (!g_pFileSystem->ReadFile (s_VisCacheFile, NULL, buf))
+	{
+		Msg ("Vis cache %s not found, flowing every portal\n", s_VisCacheFile);
+		return g_numportals*2;
+	}
+
+	viscacheheader_t header;
+	buf.Get (&header, sizeof(header));
+	if (!buf.IsValid() || header.version != VISCACHE_VERSION || header.numportals <= 0 || header.numportals >= MAX_PORTALS ||
+		header.portalbytes != ((header.numportals+FLOW_BLOCK_BITS-1)&~(FLOW_BLOCK_BITS-1))>>3 ||
+		buf.TellPut() != (int)sizeof(header) + header.numportals * ( 2*(int)sizeof(uint64) + header.portalbytes ))
+	{
+		Msg ("Vis cache %s is out of date, flowing every portal\n", s_VisCacheFile);
+		return g_numportals*2;
+	}
+
+	// map the old portal numbers to the new ones, windings that aren't unique can't be mapped
+	CUtlVector<portalhash_t> newhashes;
+	newhashes.SetCount (g_numportals*2);
+	for (i=0 ; i<g_numportals*2 ; i++)
+	{
+		newhashes[i].hash = s_WindingHashes[i];
+		newhashes[i].portalnum = i;
+	}
+	qsort (newhashes.Base(), newhashes.Count(), sizeof(portalhash_t), PortalHashComp);
+
+	for (i=0 ; i<newhashes.Count() ; )
+	{
+		for (j=i+1 ; j<newhashes.Count() && newhashes[j].hash == newhashes[i].hash ; j++)
+			newhashes[j].portalnum = -1;
+		if (j > i+1)
+			newhashes[i].portalnum = -1;
+		i = j;
+	}
+
+	CUtlVector<int> remap;
+	remap.SetCount (header.numportals);
+	for (i=0 ; i<header.numportals ; i++)
+	{
+		portalhash_t key;
+		buf.Get (&key.hash, sizeof(key.hash));
+
+		portalhash_t *found = (portalhash_t *)bsearch (&key, newhashes.Base(), newhashes.Count(), sizeof(portalhash_t), PortalHashComp);
+		remap[i] = found ? found->portalnum : -1;
+	}
+
+	// pull in every old portal whose flow would come out the same
+	for (i=0 ; i<header.numportals ; i++)
+	{
+		uint64 dependencyhash;
+		buf.Get (&dependencyhash, sizeof(dependencyhash));
+		const byte *oldvis = (const byte *)buf.PeekGet();
+		buf.SeekGet (CUtlBuffer::SEEK_CURRENT, header.portalbytes);
+
+		int portalnum = remap[i];
+		if (portalnum < 0 || s_DependencyHashes[portalnum] != dependencyhash)
+			continue;
+
+		p = &portals[portalnum];
+		for (j=0 ; j<header.portalbytes ; j++)
+		{
+			if (!oldvis[j])
+				continue;
+			for (k=0 ; k<8 ; k++)
+			{
+				if (!(oldvis[j] & (1<<k)))
+					continue;
+				if (j*8+k >= header.numportals || remap[j*8+k] < 0)
+					break;
+				SetBit (p->portalvis, remap[j*8+k]);
+			}
+			if (k != 8)
+				break;
+		}
+
+		if (j != header.portalbytes)
+		{
+			// saw a portal that's gone, flow it after all
+			memset (p->portalvis, 0, portalbytes);
+			continue;
+		}
+
+		p->status = stat_done;
+		c_cachedportals++;
+	}
+
+	CUtlVector<portal_t *> cached;
+	int numflow = 0;
+	for (i=0 ; i<g_numportals*2 ; i++)
+	{
+		if (sorted_portals[i]->status == stat_done)
+			cached.AddToTail (sorted_portals[i]);
+		else
+			sorted_portals[numflow++] = sorted_portals[i];
+	}
+	memcpy (&sorted_portals[numflow], cached.Base(), cached.Count() * sizeof(portal_t *));
+
+	Msg ("Vis cache: reused %d portals, flowing %d\n", c_cachedportals, numflow);
+	return numflow;
+}
+
+
+/*
+==============
+SaveVisCache
+==============
+*/
+void SaveVisCache (void)
+{
+	int			i;
+	CUtlBuffer	buf;
+
+	viscacheheader_t header;
+	header.version = VISCACHE_VERSION;
+	header.numportals = g_numportals*2;
+	header.portalbytes = portalbytes;
+	buf.Put (&header, sizeof(header));
+
+	buf.Put (s_WindingHashes, g_numportals*2*sizeof(uint64));
+	for (i=0 ; i<g_numportals*2 ; i++)
+	{
+		buf.Put (&s_DependencyHashes[i], sizeof(uint64));
+		buf.Put (portals[i].portalvis, portalbytes);
+	}
+
+	if (!g_pFileSystem->WriteFile (s_VisCacheFile, NULL, buf))
+		Warning ("Couldn't write vis cache %s\n", s_VisCacheFile);
+
+	free (s_WindingHashes);
+	free (s_DependencyHashes);
+	s_WindingHashes = NULL;
+	s_DependencyHashes = NULL;
+}
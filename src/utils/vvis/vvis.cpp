@@ -22,6 +22,7 @@
 #include "tools_minidump.h"
 #include "loadcmdline.h"
 #include "byteswap.h"
+#include "localworkers.h"
 
 
 int			g_numportals;
@@ -54,6 +55,11 @@ portal_t	*sorted_portals[MAX_MAP_PORTALS*2];
 bool		g_bUseRadius = false;
 double		g_VisRadius = 4096.0f * 4096.0f;
 
+bool		g_bFastFlow = false;
+bool		g_bVerifyFlow = false;
+bool		g_bVisCache = false;
+int			g_nLocalProcs = 0;
+
 bool		g_bLowPriority = false;
 
 //=============================================================================
@@ -308,7 +314,28 @@ void CalcPortalVis (void)
 	}
 	else 
 	{
-		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
+		// portals the last compile already flowed the same way are left out
+		int numflow = g_numportals*2;
+		if ( IsVisCacheActive() )
+		{
+			numflow = RestoreCachedPortalVis();
+		}
+
+		if ( LocalWorkers_IsActive() )
+		{
+			DistributeWorkLocal (numflow, ProcessPortalFlow, ReceivePortalFlow);
+		}
+		else
+		{
+			RunThreadsOnIndividual (numflow, true, PortalFlow);
+		}
+	}
+
+	FreeFlowArenas();
+
+	if ( IsVisCacheActive() )
+	{
+		SaveVisCache();
 	}
 }
 
@@ -320,6 +347,7 @@ void CalcVisTrace (void)
 	// NOTE: We only schedule the one-way portals out of the start cluster here
 	// so don't run g_numportals*2 in this case
 	RunThreadsOnIndividual (g_numportals, true, PortalFlow);
+	FreeFlowArenas();
 }
 
 /*
@@ -335,6 +363,10 @@ void CalcVis (void)
 	{
 		RunMPIBasePortalVis();
 	}
+	else if ( LocalWorkers_IsActive() )
+	{
+		DistributeWorkLocal (g_numportals*2, ProcessBasePortalVis, ReceiveBasePortalVis);
+	}
 	else 
 	{
 	    RunThreadsOnIndividual (g_numportals*2, true, BasePortalVis);
@@ -472,7 +504,7 @@ void LoadPortals (char *name)
 	leafbytes = ((portalclusters+63)&~63)>>3;
 	leaflongs = leafbytes/sizeof(long);
 	
-	portalbytes = ((g_numportals*2+63)&~63)>>3;
+	portalbytes = ((g_numportals*2+FLOW_BLOCK_BITS-1)&~(FLOW_BLOCK_BITS-1))>>3;
 	portallongs = portalbytes/sizeof(long);
 
 // each file portal is split into two memory portals
@@ -916,6 +948,17 @@ int ParseCommandLine( int argc, char **argv )
 			numthreads = atoi (argv[i+1]);
 			i++;
 		}
+		else if (!Q_stricmp(argv[i],"-procs"))
+		{
+			if ( ++i >= argc || atoi (argv[i]) <= 0 )
+			{
+				Warning("Error: expected positive value after '-procs'\n" );
+				i = 100000;	// force it to print the usage
+				break;
+			}
+			g_nLocalProcs = atoi (argv[i]);
+			Msg ("procs = %d\n", g_nLocalProcs);
+		}
 		else if (!Q_stricmp(argv[i], "-fast"))
 		{
 			Msg ("fastvis = true\n");
@@ -942,6 +985,21 @@ int ParseCommandLine( int argc, char **argv )
 			i++;
 			Msg( "Tracing vis from cluster %d to %d\n", g_TraceClusterStart, g_TraceClusterStop );
 		}
+		else if (!Q_stricmp (argv[i],"-fastflow"))
+		{
+			Msg ("fastflow = true\n");
+			g_bFastFlow = true;
+		}
+		else if (!Q_stricmp (argv[i],"-verifyflow"))
+		{
+			Msg ("verifyflow = true\n");
+			g_bVerifyFlow = true;
+		}
+		else if (!Q_stricmp (argv[i],"-viscache"))
+		{
+			Msg ("viscache = true\n");
+			g_bVisCache = true;
+		}
 		else if (!Q_stricmp (argv[i],"-nosort"))
 		{
 			Msg ("nosort = true\n");
@@ -1029,7 +1087,15 @@ void PrintUsage( int argc, char **argv )
 		"  -mpi_pw <pw>    : Use a password to choose a specific set of VMPI workers.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
+		"  -procs <n>      : Fork n worker processes and hand them portals to vis the\n"
+		"                    way -mpi would, instead of using threads. Needs fork().\n"
 		"  -nosort         : Don't sort portals (sorting is an optimization).\n"
+		"  -viscache       : Keep each portal's vis in <mapname>.vcache next to the portal\n"
+		"                    file, and only flow portals whose surroundings changed since.\n"
+		"  -fastflow       : Flow portals 256 bits at a time, skipping empty blocks, with\n"
+		"                    windings from a per-thread arena. Same vis as without it.\n"
+		"  -verifyflow     : With -fastflow, also run the plain mightsee loop at every step\n"
+		"                    and stop with an error if the two ever differ. Slow.\n"
 		"  -tmpin          : Make portals come from \\tmp\\<mapname>.\n"
 		"  -tmpout         : Make portals come from \\tmp\\<mapname>.\n"
 		"  -trace <start cluster> <end cluster> : Writes a linefile that traces the vis from one cluster to another for debugging map vis.\n"
@@ -1126,6 +1192,14 @@ int RunVVis( int argc, char **argv )
 
 	ThreadSetDefault ();
 
+	if ( g_nLocalProcs > 0 )
+	{
+		if ( g_bUseMPI )
+			Warning ("-procs doesn't work with -mpi, ignoring it.\n");
+		else
+			LocalWorkers_Init (g_nLocalProcs);
+	}
+
 	Msg ("reading %s\n", mapFile);
 	LoadBSPFile (mapFile);
 	if (numnodes == 0 || numfaces == 0)
@@ -1162,6 +1236,14 @@ int RunVVis( int argc, char **argv )
 	Msg ("reading %s\n", portalfile);
 	LoadPortals (portalfile);
 
+	if ( g_bVisCache )
+	{
+		if ( g_bUseMPI || fastvis || g_TraceClusterStart >= 0 )
+			Warning ("-viscache doesn't work with -mpi, -fast or -trace, ignoring it.\n");
+		else
+			SetVisCacheFile (portalfile);
+	}
+
 	// don't write out results when simply doing a trace
 	if ( g_TraceClusterStart < 0 )
 	{